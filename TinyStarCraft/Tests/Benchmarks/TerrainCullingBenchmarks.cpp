@@ -0,0 +1,63 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainModifier.h"
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/*
+    Time per frame to gather the visible chunks with the quad tree and with the isometric
+    footprint, on sculpted maps up to 2048*2048 tiles with the viewports of 1600*1200 and
+    3840*2160. The terrains have no water, so drawWater only gathers the visible chunks and sorts
+    their slots, which costs the same in both modes. Terrains are in the streamed mesh mode, so
+    the large maps don't allocate a mesh of all tiles.
+ */
+TINYSC_BENCHMARK(TerrainCulling, QuadTreeVsIsometric)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(19);
+
+    printf("%-10s %-10s %14s %10s %14s %10s\n", "map", "view", "quad tree (us)", "chunks", "isometric (us)", "chunks");
+
+    const int mapSides[] = { 256, 1024, 2048 };
+    for (int mapSide : mapSides) {
+        const Size2d dimension(mapSide, mapSide);
+        Terrain terrain(renderSystem.get());
+        terrain.setRenderingMode(ETerrainRenderingMode::eStreamedMesh);
+        terrain.initialize(dimension);
+        TerrainModifier modifier(&terrain);
+        sculptRandomly(&modifier, dimension, mapSide * 8, &random);
+
+        const Size2f viewportSizes[] = { Size2f(1600.0f, 1200.0f), Size2f(3840.0f, 2160.0f) };
+        for (const Size2f& viewportSize : viewportSizes) {
+            std::vector<Camera> cameras;
+            for (int i = 0; i < 1024; ++i) {
+                cameras.push_back(makeCameraLookingAt(Point2d(random() % mapSide, random() % mapSide)));
+                cameras.back().setViewportSize(viewportSize);
+            }
+
+            double seconds[2];
+            size_t chunksCount[2];
+            const ETerrainCullingMode cullingModes[] = { ETerrainCullingMode::eQuadTree, ETerrainCullingMode::eIsometric };
+            for (int mode = 0; mode < 2; ++mode) {
+                terrain.setCullingMode(cullingModes[mode]);
+                seconds[mode] = measureBestSeconds(5, [&]() {
+                    chunksCount[mode] = 0;
+                    for (Camera& camera : cameras) {
+                        terrain.drawWater(&camera);
+                        chunksCount[mode] += terrain.getVisibleChunks().size();
+                    }
+                });
+            }
+
+            char map[32], view[32];
+            sprintf_s(map, sizeof(map), "%d*%d", mapSide, mapSide);
+            sprintf_s(view, sizeof(view), "%.0f*%.0f", viewportSize.x, viewportSize.y);
+            printf("%-10s %-10s %14.2f %10.1f %14.2f %10.1f\n", map, view,
+                seconds[0] / cameras.size() * 1e6, (double)chunksCount[0] / cameras.size(),
+                seconds[1] / cameras.size() * 1e6, (double)chunksCount[1] / cameras.size());
+        }
+    }
+}
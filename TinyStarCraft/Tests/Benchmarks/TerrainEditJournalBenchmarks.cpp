@@ -0,0 +1,50 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainModifier.h"
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/*
+    Memory of the journal after 5000 single ground edits on a 1024*1024 map, against a snapshot of
+    the tiles, then the tiles recorded and the time of one edit grouping 5000 ground edits in a
+    32*32 area, which write the same tiles many times.
+ */
+TINYSC_BENCHMARK(TerrainEditJournal, Memory)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(37);
+
+    const Size2d dimension(1024, 1024);
+    Terrain terrain(renderSystem.get());
+    terrain.setRenderingMode(ETerrainRenderingMode::eStreamedMesh);
+    terrain.initialize(dimension);
+    TerrainModifier modifier(&terrain);
+    TerrainEditJournal& journal = modifier.getJournal();
+
+    Stopwatch stopwatch;
+    for (int i = 0; i < 5000; ++i) {
+        const Point2d location(random() % dimension.x, random() % dimension.y);
+        (random() % 2) ? modifier.hightenGround(location) : modifier.lowerGround(location);
+    }
+    const double seconds = stopwatch.getSeconds();
+
+    printf("single edits:  %.0f KB in the journal, %.0f KB per snapshot, %.2f us per edit\n",
+        journal.getMemorySize() / 1024.0, dimension.x * dimension.y * sizeof(TileStore::PackedTile) / 1024.0,
+        seconds / 5000 * 1e6);
+
+    journal.clear();
+    modifier.beginEdit();
+    stopwatch = Stopwatch();
+    for (int i = 0; i < 5000; ++i) {
+        const Point2d location(500 + random() % 32, 500 + random() % 32);
+        (random() % 2) ? modifier.hightenGround(location) : modifier.lowerGround(location);
+    }
+    const size_t recordedTilesCount = journal.getRecordedTilesCount();
+    modifier.commitEdit();
+
+    printf("grouped edit:  %zu tiles recorded, %.0f KB in the journal, %.2f ms\n",
+        recordedTilesCount, journal.getMemorySize() / 1024.0, stopwatch.getSeconds() * 1e3);
+}
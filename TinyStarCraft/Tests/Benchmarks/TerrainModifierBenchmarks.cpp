@@ -0,0 +1,123 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "LegacyTerrainModifier.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainBrush.h"
+#include "Rendering/TerrainModifier.h"
+
+#include <thread>
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/*
+    Time of a lowerGround and hightenGround pair at random locations of sculpted maps, with the
+    iterative elevation logic and with the legacy one, whose lowerGround passes over every tile of
+    the map twice. Edits aren't applied to the terrain.
+ */
+TINYSC_BENCHMARK(TerrainModifier, GroundEdit)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(29);
+
+    printf("%-10s %14s %14s\n", "map", "current (us)", "legacy (us)");
+
+    const int mapSides[] = { 128, 512, 1024 };
+    for (int mapSide : mapSides) {
+        const Size2d dimension(mapSide, mapSide);
+        Terrain terrain(renderSystem.get());
+        terrain.setRenderingMode(ETerrainRenderingMode::eStreamedMesh);
+        terrain.initialize(dimension);
+        {
+            TerrainModifier modifier(&terrain);
+            sculptRandomly(&modifier, dimension, mapSide * 8, &random);
+        }
+
+        std::vector<Point2d> locations;
+        for (int i = 0; i < 64; ++i)
+            locations.push_back(Point2d(random() % mapSide, random() % mapSide));
+
+        TerrainModifier modifier(&terrain);
+        const double seconds = measureBestSeconds(3, [&]() {
+            for (const Point2d& location : locations) {
+                modifier.lowerGround(location);
+                modifier.hightenGround(location);
+            }
+        });
+
+        LegacyTerrainModifier legacyModifier(terrain.getTilesData());
+        const double legacySeconds = measureBestSeconds(3, [&]() {
+            for (const Point2d& location : locations) {
+                legacyModifier.lowerGround(location);
+                legacyModifier.hightenGround(location);
+            }
+        });
+
+        char map[32];
+        sprintf_s(map, sizeof(map), "%d*%d", mapSide, mapSide);
+        printf("%-10s %14.2f %14.2f\n", map, seconds / locations.size() * 1e6, legacySeconds / locations.size() * 1e6);
+    }
+}
+
+/*
+    Brushed tiles modified per millisecond by a hightenArea and lowerArea pair on a sculpted
+    2048*2048 map, against a hightenGround and lowerGround pair on each of the first 2000 brushed
+    tiles. Brushes of 4 circles far apart are modified in parallel parts. Edits are recorded in the
+    journal but aren't applied to the terrain.
+ */
+TINYSC_BENCHMARK(TerrainModifier, AreaEdit)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(31);
+
+    const Size2d dimension(2048, 2048);
+    Terrain terrain(renderSystem.get());
+    terrain.setRenderingMode(ETerrainRenderingMode::eStreamedMesh);
+    terrain.initialize(dimension);
+    TerrainModifier modifier(&terrain);
+    sculptRandomly(&modifier, dimension, 200000, &random);
+    modifier.getJournal().clear();
+
+    printf("%u hardware threads\n", std::thread::hardware_concurrency());
+    printf("%-16s %10s %16s %16s\n", "brush", "tiles", "area (tiles/ms)", "ground (tiles/ms)");
+
+    const Point2d center(dimension.x / 2, dimension.y / 2);
+    const int radiuses[] = { 16, 64, 256, 512 };
+    for (int parts = 1; parts <= 4; parts += 3) {
+        for (int radius : radiuses) {
+            if (parts > 1 && radius > 256)
+                continue;
+
+            TerrainBrush brush;
+            static const Point2d partOffsets[] = { {-1, -1}, {1, -1}, {-1, 1}, {1, 1} };
+            for (int i = 0; i < parts; ++i) {
+                const int distance = (parts > 1) ? radius + 64 : 0;
+                brush.add(TerrainBrush::makeCircle(center + Point2d(partOffsets[i].x * distance, partOffsets[i].y * distance), radius));
+            }
+
+            std::vector<Point2d> locations;
+            brush.getTiles(dimension, &locations);
+            const size_t brushedTilesCount = locations.size();
+
+            const double areaSeconds = measureBestSeconds(3, [&]() {
+                modifier.hightenArea(brush);
+                modifier.lowerArea(brush);
+            });
+
+            locations.resize(Math::min<size_t>(locations.size(), 2000));
+            const double groundSeconds = measureBestSeconds(3, [&]() {
+                for (const Point2d& location : locations) {
+                    modifier.hightenGround(location);
+                    modifier.lowerGround(location);
+                }
+            });
+            modifier.getJournal().clear();
+
+            char name[32];
+            sprintf_s(name, sizeof(name), "%d circle%s r=%d", parts, (parts > 1) ? "s" : "", radius);
+            printf("%-16s %10zu %16.0f %16.1f\n", name, brushedTilesCount, brushedTilesCount / (areaSeconds * 1e3),
+                locations.size() / (groundSeconds * 1e3));
+        }
+    }
+}
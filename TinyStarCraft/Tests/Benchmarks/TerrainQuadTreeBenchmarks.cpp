@@ -0,0 +1,334 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainQuadTree.h"
+#include "Utilities/AABB.h"
+#include "Utilities/Ray.h"
+
+#include <random>
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/*
+    The quad tree layout the terrain used before TerrainQuadTree: nodes linked by pointers, built
+    over a power of 2 square and traversed recursively. Null children are outside the terrain.
+    Its leaves are chunks too, so only the layout and the traversal differ from TerrainQuadTree.
+ */
+struct PointerQuadTreeNode
+{
+    PointerQuadTreeNode* children[4];
+    size_t childrenCount;
+    AABB aabb;
+    int leaf;
+};
+
+class PointerQuadTree
+{
+public:
+    void build(const Size2d& leafDimension, const std::vector<AABB>& leaves)
+    {
+        mLeafDimension = leafDimension;
+        int side = 1;
+        while (side < leafDimension.x || side < leafDimension.y)
+            side *= 2;
+
+        // Reserve space for nodes to avoid reallocation when adding nodes to the array.
+        mNodes.clear();
+        mNodes.reserve((side * side * 4 - 1) / 3);
+        _createNodeRecursively(Rectd::makeRect(Point2d::ZERO(), Size2d(side, side)), nullptr, leaves);
+    }
+
+    void gatherVisibleLeaves(const ViewFrustum& viewFrustum, std::vector<int>* leaves) const
+    {
+        _gatherVisibleLeavesRecursively(mNodes.front(), viewFrustum, false, leaves);
+    }
+
+    template <typename Callback>
+    void raycast(const Ray& ray, Callback callback) const
+    {
+        _raycastRecursively(mNodes.front(), ray, callback);
+    }
+
+    size_t getNodesCount() const { return mNodes.size(); }
+
+    /** Bytes allocated for the nodes, which are reserved for the whole power of 2 square. */
+    size_t getAllocatedBytes() const { return mNodes.capacity() * sizeof(PointerQuadTreeNode); }
+
+private:
+    void _createNodeRecursively(const Rectd& subSquare, PointerQuadTreeNode* parent, const std::vector<AABB>& leaves)
+    {
+        if (subSquare.getLeft() >= mLeafDimension.x || subSquare.getTop() >= mLeafDimension.y) {
+            // The node is not in the actual terrain.
+            parent->children[parent->childrenCount++] = nullptr;
+            return;
+        }
+
+        mNodes.emplace_back();
+        PointerQuadTreeNode& currentNode = mNodes.back();
+        currentNode.childrenCount = 0;
+        currentNode.leaf = -1;
+
+        if (subSquare.getWidth() == 1) {
+            currentNode.leaf = subSquare.getTop() * mLeafDimension.x + subSquare.getLeft();
+            currentNode.aabb = leaves[currentNode.leaf];
+        }
+        else {
+            const Size2d halfSize = subSquare.getSize() / 2;
+            const Point2d& position = subSquare.getPosition();
+            _createNodeRecursively(Rectd::makeRect(position, halfSize), &currentNode, leaves);
+            _createNodeRecursively(Rectd::makeRect(position + Point2d(halfSize.x, 0), halfSize), &currentNode, leaves);
+            _createNodeRecursively(Rectd::makeRect(position + Point2d(0, halfSize.y), halfSize), &currentNode, leaves);
+            _createNodeRecursively(Rectd::makeRect(position + Point2d(halfSize.x, halfSize.y), halfSize), &currentNode, leaves);
+
+            // The left-top child can't be outside the terrain.
+            currentNode.aabb = currentNode.children[0]->aabb;
+            for (int i = 1; i < 4; ++i) {
+                if (currentNode.children[i])
+                    currentNode.aabb = AABB::compound(currentNode.aabb, currentNode.children[i]->aabb);
+            }
+        }
+
+        if (parent)
+            parent->children[parent->childrenCount++] = &currentNode;
+    }
+
+    void _gatherVisibleLeavesRecursively(const PointerQuadTreeNode& node, const ViewFrustum& viewFrustum,
+        bool isParentInsideFrustum, std::vector<int>* leaves) const
+    {
+        int aabbCullingResult = ViewFrustum::AABB_INSIDE;
+        if (!isParentInsideFrustum) {
+            aabbCullingResult = viewFrustum.hasIntersection(node.aabb);
+            if (aabbCullingResult == ViewFrustum::AABB_OUTSIDE)
+                return;
+        }
+
+        if (node.leaf != -1) {
+            leaves->push_back(node.leaf);
+            return;
+        }
+
+        isParentInsideFrustum = (aabbCullingResult == ViewFrustum::AABB_INSIDE);
+        for (int i = 0; i < 4; ++i) {
+            if (node.children[i])
+                _gatherVisibleLeavesRecursively(*node.children[i], viewFrustum, isParentInsideFrustum, leaves);
+        }
+    }
+
+    template <typename Callback>
+    void _raycastRecursively(const PointerQuadTreeNode& node, const Ray& ray, Callback& callback) const
+    {
+        if (ray.intersectAABB(node.aabb) == false)
+            return;
+
+        if (node.leaf != -1) {
+            callback(node.leaf);
+            return;
+        }
+
+        for (int i = 0; i < 4; ++i) {
+            if (node.children[i])
+                _raycastRecursively(*node.children[i], ray, callback);
+        }
+    }
+
+private:
+    Size2d mLeafDimension;
+    std::vector<PointerQuadTreeNode> mNodes;
+};
+
+/*
+    Rebuilding the whole quad tree against refitting the leaves of the changed tiles, for 1, 64 and
+    4096 changed tiles of a 1024*1024 map. A leaf is an 8*8 chunk, so the changed tiles cover 1, 1
+    and 64 leaves. Leaf AABBs are precomputed, both sides only pay for the tree.
+ */
+TINYSC_BENCHMARK(TerrainQuadTree, RebuildVsRefit)
+{
+    const int chunkDimension = 8;
+    const Size2d leafDimension(1024 / chunkDimension, 1024 / chunkDimension);
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> distribution(0.0f, 100.0f);
+    std::vector<AABB> leaves(leafDimension.x * leafDimension.y);
+    for (AABB& leaf : leaves) {
+        const float height = distribution(random);
+        leaf = AABB(D3DXVECTOR3(0.0f, 0.0f, 0.0f), D3DXVECTOR3(1.0f, height, 1.0f));
+    }
+
+    const auto rebuild = [&](TerrainQuadTree* tree) {
+        tree->create(leafDimension);
+        for (int i = 0; i < (int)leaves.size(); ++i)
+            tree->setLeafAABB(Point2d(i % leafDimension.x, i / leafDimension.x), leaves[i]);
+        tree->refit(Rectd(Point2d::ZERO(), Point2d(leafDimension.x, leafDimension.y)));
+    };
+
+    printf("%-16s %14s %14s %10s\n", "changed tiles", "rebuild (us)", "refit (us)", "speedup");
+
+    const int changedTilesCounts[] = { 1, 64, 4096 };
+    for (int changedTilesCount : changedTilesCounts) {
+        const int tileSide = (int)std::sqrt((double)changedTilesCount);
+        const int leafSide = (tileSide + chunkDimension - 1) / chunkDimension;
+        const int iterationsCount = 2000;
+
+        TerrainQuadTree tree;
+        rebuild(&tree);
+
+        const double rebuildSeconds = measureBestSeconds(5, [&]() {
+            for (int i = 0; i < iterationsCount / 100; ++i)
+                rebuild(&tree);
+        }) / (iterationsCount / 100);
+
+        const double refitSeconds = measureBestSeconds(5, [&]() {
+            for (int i = 0; i < iterationsCount; ++i) {
+                const Point2d origin(random() % (leafDimension.x - leafSide), random() % (leafDimension.y - leafSide));
+                for (int y = 0; y < leafSide; ++y) {
+                    for (int x = 0; x < leafSide; ++x) {
+                        const Point2d location(origin.x + x, origin.y + y);
+                        tree.setLeafAABB(location, leaves[location.y * leafDimension.x + location.x]);
+                    }
+                }
+                tree.refit(Rectd(origin, Point2d(origin.x + leafSide, origin.y + leafSide)));
+            }
+        }) / iterationsCount;
+
+        printf("%-16d %14.2f %14.2f %9.0fx\n", changedTilesCount, rebuildSeconds * 1e6, refitSeconds * 1e6,
+            rebuildSeconds / refitSeconds);
+    }
+}
+
+/*
+    Culling and raycast on the pointer linked quad tree against TerrainQuadTree, for maps from 64*64
+    to 1024*1024 tiles with random chunk heights. Culling gathers the visible chunks of cameras
+    looking at random tiles, raycast traverses the chunks hit by the cameras' picking rays, alone and
+    in packets of 4 rays.
+ */
+TINYSC_BENCHMARK(TerrainQuadTree, PointerTreeVsTerrainQuadTree)
+{
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> screenX(0.0f, 800.0f), screenY(0.0f, 600.0f);
+
+    printf("%-10s %16s %16s %16s %16s %16s\n", "map", "cull before (us)", "cull after (us)", "ray before (ns)",
+        "ray after (ns)", "packet (ns/ray)");
+
+    const int mapSides[] = { 64, 128, 256, 512, 1024 };
+    for (int mapSide : mapSides) {
+        const Size2d leafDimension(mapSide / Terrain::CHUNK_DIMENSION, mapSide / Terrain::CHUNK_DIMENSION);
+        std::vector<AABB> leaves(leafDimension.x * leafDimension.y);
+        for (int i = 0; i < (int)leaves.size(); ++i) {
+            const int minLevel = random() % 3;
+            leaves[i] = makeChunkAABB(Point2d(i % leafDimension.x, i / leafDimension.x), minLevel, minLevel + random() % 3);
+        }
+
+        PointerQuadTree pointerTree;
+        pointerTree.build(leafDimension, leaves);
+
+        TerrainQuadTree tree;
+        tree.create(leafDimension);
+        for (int i = 0; i < (int)leaves.size(); ++i)
+            tree.setLeafAABB(Point2d(i % leafDimension.x, i / leafDimension.x), leaves[i]);
+        tree.refit(Rectd(Point2d::ZERO(), Point2d(leafDimension.x, leafDimension.y)));
+
+        std::vector<ViewFrustum> viewFrustums;
+        std::vector<Ray> rays;
+        for (int i = 0; i < 256; ++i) {
+            Camera camera = makeCameraLookingAt(Point2d(random() % mapSide, random() % mapSide));
+            viewFrustums.push_back(camera.getViewFrustum());
+            for (int j = 0; j < 16; ++j)
+                rays.push_back(camera.screenPointToRay(Point2f(screenX(random), screenY(random))));
+        }
+
+        // Both sides must find the same chunks.
+        size_t visibleLeavesCount[2] = {}, hitLeavesCount[3] = {};
+        std::vector<int> visibleLeaves;
+        const double cullBeforeSeconds = measureBestSeconds(20, [&]() {
+            visibleLeavesCount[0] = 0;
+            for (const ViewFrustum& viewFrustum : viewFrustums) {
+                visibleLeaves.clear();
+                pointerTree.gatherVisibleLeaves(viewFrustum, &visibleLeaves);
+                visibleLeavesCount[0] += visibleLeaves.size();
+            }
+        }) / viewFrustums.size();
+        const double cullAfterSeconds = measureBestSeconds(20, [&]() {
+            visibleLeavesCount[1] = 0;
+            for (const ViewFrustum& viewFrustum : viewFrustums) {
+                visibleLeaves.clear();
+                tree.gatherVisibleNodes(viewFrustum, tree.getDepth(), &visibleLeaves);
+                visibleLeavesCount[1] += visibleLeaves.size();
+            }
+        }) / viewFrustums.size();
+
+        const double rayBeforeSeconds = measureBestSeconds(20, [&]() {
+            hitLeavesCount[0] = 0;
+            for (const Ray& ray : rays)
+                pointerTree.raycast(ray, [&](int leaf) { ++hitLeavesCount[0]; });
+        }) / rays.size();
+        const double rayAfterSeconds = measureBestSeconds(20, [&]() {
+            hitLeavesCount[1] = 0;
+            for (const Ray& ray : rays)
+                tree.raycast(ray, [&](int leaf) { ++hitLeavesCount[1]; });
+        }) / rays.size();
+
+        const double packetSeconds = measureBestSeconds(20, [&]() {
+            hitLeavesCount[2] = 0;
+            for (size_t i = 0; i < rays.size(); i += 4) {
+                TerrainQuadTree::RayPacket packet;
+                for (int j = 0; j < 4; ++j)
+                    packet.setRay(j, rays[i + j], FLT_MAX);
+                tree.raycastPacket(packet, 0xf, [&](int leaf, int hitMask) {
+                    hitLeavesCount[2] += (hitMask & 1) + (hitMask >> 1 & 1) + (hitMask >> 2 & 1) + (hitMask >> 3);
+                });
+            }
+        }) / rays.size();
+
+        char map[32];
+        sprintf_s(map, sizeof(map), "%d*%d", mapSide, mapSide);
+        printf("%-10s %16.2f %16.2f %16.1f %16.1f %16.1f%s\n", map, cullBeforeSeconds * 1e6, cullAfterSeconds * 1e6,
+            rayBeforeSeconds * 1e9, rayAfterSeconds * 1e9, packetSeconds * 1e9,
+            visibleLeavesCount[0] != visibleLeavesCount[1] || hitLeavesCount[0] != hitLeavesCount[1] ? " MISMATCH" : "");
+    }
+}
+
+/*
+    Size and build time of the pointer linked quad tree against TerrainQuadTree, for square maps and
+    maps whose sides aren't powers of 2. TerrainQuadTree stores only the nodes over the chunks grid,
+    as 6 floats each. Both sides are built from precomputed leaf AABBs.
+ */
+TINYSC_BENCHMARK(TerrainQuadTree, SizeAndBuildTime)
+{
+    std::mt19937 random(10);
+
+    printf("%-10s %12s %12s %12s %12s %16s %16s\n", "map", "nodes before", "nodes after", "KB before", "KB after",
+        "build before (us)", "build after (us)");
+
+    const Size2d mapDimensions[] = { Size2d(64, 64), Size2d(256, 256), Size2d(1024, 1024), Size2d(200, 136),
+        Size2d(520, 520), Size2d(1024, 136) };
+    for (const Size2d& mapDimension : mapDimensions) {
+        const Size2d leafDimension(mapDimension.x / Terrain::CHUNK_DIMENSION, mapDimension.y / Terrain::CHUNK_DIMENSION);
+        std::vector<AABB> leaves(leafDimension.x * leafDimension.y);
+        for (int i = 0; i < (int)leaves.size(); ++i) {
+            const int minLevel = random() % 3;
+            leaves[i] = makeChunkAABB(Point2d(i % leafDimension.x, i / leafDimension.x), minLevel, minLevel + random() % 3);
+        }
+
+        PointerQuadTree pointerTree;
+        const double buildBeforeSeconds = measureBestSeconds(20, [&]() {
+            pointerTree.build(leafDimension, leaves);
+        });
+
+        TerrainQuadTree tree;
+        const double buildAfterSeconds = measureBestSeconds(20, [&]() {
+            tree.create(leafDimension);
+            for (int i = 0; i < (int)leaves.size(); ++i)
+                tree.setLeafAABB(Point2d(i % leafDimension.x, i / leafDimension.x), leaves[i]);
+            tree.refit(Rectd(Point2d::ZERO(), Point2d(leafDimension.x, leafDimension.y)));
+        });
+
+        const size_t bytesAfter = tree.getNodesCount() * 6 * sizeof(float);
+
+        char map[32];
+        sprintf_s(map, sizeof(map), "%d*%d", mapDimension.x, mapDimension.y);
+        printf("%-10s %12zu %12zu %12.1f %12.1f %16.2f %16.2f\n", map, pointerTree.getNodesCount(), tree.getNodesCount(),
+            pointerTree.getAllocatedBytes() / 1024.0, bytesAfter / 1024.0, buildBeforeSeconds * 1e6, buildAfterSeconds * 1e6);
+    }
+}
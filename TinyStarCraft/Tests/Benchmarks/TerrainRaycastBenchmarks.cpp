@@ -0,0 +1,71 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainModifier.h"
+
+#include <memory>
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/*
+    Rays per second of raycastAll, which tests the tiles of the quad tree leaves hit by the ray, of
+    raycast, which walks the tile grid, and of raycastBatch, on sculpted maps of 128*128 and 512*512
+    tiles. The rays are the four kinds of makeRandomRay, a quarter of them are camera picking rays.
+ */
+TINYSC_BENCHMARK(TerrainRaycast, ScalarVsBatch)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(13);
+
+    printf("%-10s %16s %16s %16s %10s\n", "map", "raycastAll (M/s)", "raycast (M/s)", "batch (M/s)", "hits");
+
+    const int mapSides[] = { 128, 512 };
+    for (int mapSide : mapSides) {
+        const Size2d dimension(mapSide, mapSide);
+        Terrain terrain(renderSystem.get());
+        terrain.initialize(dimension);
+        TerrainModifier modifier(&terrain);
+        sculptRandomly(&modifier, dimension, mapSide * mapSide / 16, &random);
+
+        const size_t raysCount = 16384;
+        std::vector<D3DXVECTOR3> origins(raysCount), directions(raysCount);
+        for (size_t i = 0; i < raysCount; ++i) {
+            const Ray ray = makeRandomRay(dimension, (int)(i % 4), &random);
+            origins[i] = ray.getOrigin();
+            directions[i] = ray.getDirection();
+        }
+
+        // Count the hits of each path, they must be the same.
+        size_t hitsCount[3] = {};
+        std::vector<TerrainRaycastHit> allHits;
+        const double allSeconds = measureBestSeconds(3, [&]() {
+            hitsCount[0] = 0;
+            for (size_t i = 0; i < raysCount; ++i) {
+                allHits.clear();
+                hitsCount[0] += terrain.raycastAll(Ray(origins[i], directions[i]), &allHits) ? 1 : 0;
+            }
+        });
+
+        const double scalarSeconds = measureBestSeconds(3, [&]() {
+            hitsCount[1] = 0;
+            TerrainRaycastHit hit;
+            for (size_t i = 0; i < raysCount; ++i)
+                hitsCount[1] += terrain.raycast(Ray(origins[i], directions[i]), &hit) ? 1 : 0;
+        });
+
+        std::vector<TerrainRaycastHit> hits(raysCount);
+        std::unique_ptr<bool[]> isHit(new bool[raysCount]);
+        const double batchSeconds = measureBestSeconds(3, [&]() {
+            terrain.raycastBatch(origins.data(), directions.data(), raysCount, hits.data(), isHit.get());
+        });
+        hitsCount[2] = std::count(isHit.get(), isHit.get() + raysCount, true);
+
+        char map[32];
+        sprintf_s(map, sizeof(map), "%d*%d", mapSide, mapSide);
+        printf("%-10s %16.2f %16.2f %16.2f %10zu%s\n", map, raysCount / allSeconds * 1e-6, raysCount / scalarSeconds * 1e-6,
+            raysCount / batchSeconds * 1e-6, hitsCount[1],
+            hitsCount[0] != hitsCount[1] || hitsCount[1] != hitsCount[2] ? " MISMATCH" : "");
+    }
+}
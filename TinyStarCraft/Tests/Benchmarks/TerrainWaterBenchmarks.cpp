@@ -0,0 +1,86 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/*
+    Time and bytes of the water instance buffer locked by setTilesData for edits of 4*4 tiles on a
+    512*512 map whose left half is water: ground edits on dry land, water altitude edits, water
+    added on dry land, which moves the instances after it, and water altitude edits of the whole
+    map, which rewrite every instance as all edits used to. Terrain geometry is updated by each
+    edit too, the same for every kind.
+ */
+TINYSC_BENCHMARK(TerrainWater, IncrementalUpdate)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(17);
+
+    const Size2d dimension(512, 512);
+    std::vector<Tile> tiles(dimension.x * dimension.y);
+    for (int y = 0; y < dimension.y; ++y) {
+        for (int x = 0; x < dimension.x / 2; ++x)
+            tiles[y * dimension.x + x] = Tile(ETileType::Flat, 0, true, 10.0f);
+    }
+
+    Terrain terrain(renderSystem.get());
+    terrain.initialize(dimension, tiles);
+
+    // Grow the instance buffer for water on the whole map, so it isn't recreated by the edits, and
+    // get it by drawing.
+    TileStore tilesData = terrain.getTilesData();
+    for (int i = 0; i < dimension.x * dimension.y; ++i)
+        tilesData.setWater(i, true, 10.0f);
+    terrain.setTilesData(tilesData, Rectd::makeRect(Point2d::ZERO(), dimension));
+    terrain.setTilesData(tiles);
+
+    IDirect3DDevice9* device = renderSystem.getDevice();
+    Camera camera = makeCameraLookingAt(Point2d(dimension.x / 4, dimension.y / 2));
+    device->clearDrawCalls();
+    terrain.drawWater(&camera);
+    if (device->getDrawCalls().empty()) {
+        printf("No water is drawn.\n");
+        return;
+    }
+    const IDirect3DVertexBuffer9* buffer = device->getDrawCalls().front().streams[1];
+
+    printf("%-22s %14s %14s\n", "edit", "time (us)", "locked (KB)");
+
+    const char* names[] = { "ground on dry land", "water altitude", "water on dry land", "whole map water" };
+    for (int kind = 0; kind < 4; ++kind) {
+        const int editsCount = kind == 3 ? 4 : 256;
+        std::vector<Rectd> rects;
+        for (int i = 0; i < editsCount; ++i) {
+            const int x = kind == 1 ? random() % (dimension.x / 2 - 4) : dimension.x / 2 + random() % (dimension.x / 2 - 4);
+            rects.push_back(kind == 3 ? Rectd::makeRect(Point2d::ZERO(), dimension) : Rectd::makeRect(x, random() % (dimension.y - 4), 4, 4));
+        }
+
+        // Edits alternate between two states, so every edit modifies the tiles.
+        double seconds = 0.0;
+        const size_t lockedBytes = buffer->getLockedBytes();
+        for (int i = 0; i < editsCount; ++i) {
+            tilesData = terrain.getTilesData();
+            const Rectd& rect = rects[i];
+            for (int y = rect.getTop(); y < rect.getBottom(); ++y) {
+                for (int x = rect.getLeft(); x < rect.getRight(); ++x) {
+                    const int index = y * dimension.x + x;
+                    if (kind == 0)
+                        tilesData.setLevel(index, 1 - tilesData.getLevel(index));
+                    else if (kind == 2)
+                        tilesData.setWater(index, !tilesData.hasWater(index), 10.0f);
+                    else if (tilesData.hasWater(index))
+                        tilesData.setWater(index, true, 22.0f - tilesData.getWaterAltitude(index));
+                }
+            }
+
+            Stopwatch stopwatch;
+            terrain.setTilesData(tilesData, rect);
+            seconds += stopwatch.getSeconds();
+        }
+
+        printf("%-22s %14.1f %14.1f\n", names[kind], seconds / editsCount * 1e6,
+            (buffer->getLockedBytes() - lockedBytes) / (double)editsCount / 1024.0);
+    }
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "Rendering/TerrainBrush.h"
+#include "Rendering/Tile.h"
+#include "Utilities/Point2.h"
+#include "Utilities/Rect2.h"
+
+#include <vector>
+
+namespace TinyStarCraft
+{
+namespace Testing
+{
+
+/**
+  	The elevation logic of TerrainModifier as it was before it became iterative, to check the
+    current one against.
+@remarks
+    Tiles are modified by a recursive walk. Lowering raises every non-flat tile of the map by one
+    level before the walk and lowers them back after it, so the walk sees the upper edges of slopes.
+    Levels are kept LEVEL_MARGIN levels away from the storable range, so the results only match
+    the current modifier for tiles away from that range. It modifies a copy of the tiles instead of
+    a terrain.
+ */
+class LegacyTerrainModifier
+{
+public:
+    /** Constructor */
+    explicit LegacyTerrainModifier(const TileStore& tiles);
+
+    /**
+      	Increase a tile's altitude level by 1, and the neighbor tiles by the elevation logic.
+    @return
+        Returns the rectangle of tiles written by this operation, which is empty if nothing is
+        written.
+     */
+    Rectd hightenGround(const Point2d& location);
+
+    /**
+      	Decrease a tile's altitude level by 1, and the neighbor tiles by the elevation logic.
+    @see
+        LegacyTerrainModifier::hightenGround
+     */
+    Rectd lowerGround(const Point2d& location);
+
+    /**
+      	Increase the altitude level of every tile of a brush by 1, seeded like
+        TerrainModifier::hightenArea, in a single walk.
+    @remarks
+        The brushed tiles are modified in row-major order from their levels before the operation,
+        each one by a recursive walk finished before the next one.
+    @return
+        Returns the rectangle of tiles written by this operation, which is empty if nothing is
+        written.
+     */
+    Rectd hightenArea(const TerrainBrush& brush);
+
+    /**
+      	Decrease the altitude level of every tile of a brush by 1, in a single walk.
+    @see
+        LegacyTerrainModifier::hightenArea
+     */
+    Rectd lowerArea(const TerrainBrush& brush);
+
+    /** Increase one tile's altitude level by 1. */
+    void hightenTile(const Point2d& location);
+
+    /** Decrease one tile's altitude level by 1. */
+    void lowerTile(const Point2d& location);
+
+    const TileStore& getTilesData() const { return mTilesData; }
+
+    /** Get an entry of the produce table of a method, which is built at runtime. */
+    int getProduceTile(int method, int desiredTile, int originalTile) const
+    {
+        return (method == 0) ? mHighteningTileProduceTable[desiredTile][originalTile] : mLoweringTileProduceTable[desiredTile][originalTile];
+    }
+
+private:
+    /**
+      	Altitude levels are kept this far from the storable range, since elevation logic may raise
+        or lower tiles around the modified one by another level.
+     */
+    static const int LEVEL_MARGIN = 3;
+
+    /** Transform a location to tile index in one dimensional array. */
+    int _toTileIndex(const Point2d& location) const;
+
+    /** Extend the area written by the operation to contain a modified tile. */
+    void _markTileDirty(const Point2d& location);
+
+    /** Change the altitude level of every non-flat tile of the map. */
+    void _shiftSlopeLevels(int levels);
+
+    /** Raise or lower the tiles of a brush in a single walk. */
+    Rectd _modifyArea(const TerrainBrush& brush, int method);
+
+    /** Initialize the produce tables. */
+    void _initTileProduceTables();
+
+    /**
+        Get a produce tile by giving two tile types and their altitude level.
+    @param method
+        Set to 0 means this is a hightening operation; Set to 1 means this is a lowering operation.
+     */
+    int _getProducetile(ETileType desiredtile, int desiredLevel, ETileType originalTile, int originalLevel, int method);
+
+    /**
+      	Perform elevation logic which need expansively modification on neighbor tiles.
+    @param directionMask 
+        Masks to tell the function the expanding directions. Masks are:
+        1 - Positive Y, 2 - Negative X, 4 - Negative Y, 8 - Positive X
+        Near directions combined togeter makes diagnal direction.
+    @param method
+        Set to 0 means this is a hightening operation; Set to 1 means this is a lowering operation.
+     */
+    void _modifyTilesRecursively(const Point2d& location, unsigned char directionMask, ETileType desiredTile, int altitudeLevel,
+        int method);
+
+private:
+    TileStore mTilesData;
+
+    // Area of tiles written by the current operation.
+    Rectd mDirtyRect;
+    bool mIsDirty;
+
+    typedef std::vector<std::vector<int>> ProduceTable;
+    // This two tables defines what type of tile to produce when certain two
+    // types of tile meet. For hightening and lowering method there are two different
+    // rules.
+    ProduceTable mHighteningTileProduceTable;
+    ProduceTable mLoweringTileProduceTable;
+};
+
+}
+}
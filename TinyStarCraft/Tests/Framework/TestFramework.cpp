@@ -0,0 +1,81 @@
+#include "TestFramework.h"
+
+#include <cstring>
+
+namespace TinyStarCraft
+{
+namespace Testing
+{
+
+static int gFailuresCount = 0;
+
+//-------------------------------------------------------------------------------------------------
+std::vector<TestCase>& getTestCases()
+{
+    static std::vector<TestCase> testCases;
+    return testCases;
+}
+//-------------------------------------------------------------------------------------------------
+void _reportFailure(const char* file, int line, const char* expression)
+{
+    // Only the first few failures of a test case are printed, the rest are likely the same.
+    if (gFailuresCount < 10)
+        printf("%s(%d): check failed: %s\n", file, line, expression);
+    ++gFailuresCount;
+}
+//-------------------------------------------------------------------------------------------------
+static bool _isSelected(const TestCase& testCase, int argc, char** argv)
+{
+    if (argc <= 1)
+        return true;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], testCase.suite) == 0)
+            return true;
+    }
+    return false;
+}
+//-------------------------------------------------------------------------------------------------
+int runTestCases(int argc, char** argv)
+{
+    int casesCount = 0;
+    int failedCasesCount = 0;
+
+    for (const TestCase& testCase : getTestCases()) {
+        if (!_isSelected(testCase, argc, argv))
+            continue;
+
+        printf("[ RUN  ] %s.%s\n", testCase.suite, testCase.name);
+        fflush(stdout);
+
+        gFailuresCount = 0;
+        Stopwatch stopwatch;
+        testCase.function();
+        const double seconds = stopwatch.getSeconds();
+
+        ++casesCount;
+        if (gFailuresCount > 0)
+            ++failedCasesCount;
+
+        printf("[ %s ] %s.%s (%d failures, %.3fs)\n", gFailuresCount > 0 ? "FAIL" : " OK ", testCase.suite,
+            testCase.name, gFailuresCount, seconds);
+        fflush(stdout);
+    }
+
+    if (casesCount == 0) {
+        printf("No test case is selected.\n");
+        return 1;
+    }
+
+    printf("%d of %d test cases passed.\n", casesCount - failedCasesCount, casesCount);
+    return failedCasesCount > 0 ? 1 : 0;
+}
+
+}
+}
+
+//-------------------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    return TinyStarCraft::Testing::runTestCases(argc, argv);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace TinyStarCraft
+{
+namespace Testing
+{
+
+typedef void (*TestFunction)();
+
+/** A registered test or benchmark. The suite is the name of the file it is defined in. */
+struct TestCase
+{
+    const char* suite;
+    const char* name;
+    TestFunction function;
+};
+
+/** All test cases linked into the executable, in registration order. */
+std::vector<TestCase>& getTestCases();
+
+/** Registers a test case at static initialization time, use TINYSC_TEST instead. */
+struct TestRegistrar
+{
+    TestRegistrar(const char* suite, const char* name, TestFunction function)
+    {
+        getTestCases().push_back(TestCase{ suite, name, function });
+    }
+};
+
+/** Reports a failed check of the running test case, use TINYSC_CHECK instead. */
+void _reportFailure(const char* file, int line, const char* expression);
+
+/**
+  	Runs the registered test cases.
+@param argc, argv
+    Names of the suites to run, all suites are run if there isn't any.
+@return
+    Returns 0 if every check passed, 1 otherwise.
+ */
+int runTestCases(int argc, char** argv);
+
+/** Measures wall time of the benchmarks. */
+class Stopwatch
+{
+public:
+    Stopwatch() : mStart(std::chrono::steady_clock::now()) {}
+
+    /** Seconds elapsed since construction. */
+    double getSeconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point mStart;
+};
+
+/** Runs a function a few times and returns the fastest run in seconds. */
+template <typename Function>
+double measureBestSeconds(int runsCount, Function&& function)
+{
+    double best = 0.0;
+    for (int i = 0; i < runsCount; ++i) {
+        Stopwatch stopwatch;
+        function();
+        const double seconds = stopwatch.getSeconds();
+        if (i == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+}
+}
+
+/** Defines a test case of a suite. */
+#define TINYSC_TEST(suite, name) \
+    static void suite##_##name(); \
+    static ::TinyStarCraft::Testing::TestRegistrar suite##_##name##_registrar(#suite, #name, suite##_##name); \
+    static void suite##_##name()
+
+/** Defines a benchmark of a suite. Benchmarks print their measurements and are run by the benchmarks executable. */
+#define TINYSC_BENCHMARK(suite, name) TINYSC_TEST(suite, name)
+
+/** Checks an expression in a test case, the test case keeps running if it fails. */
+#define TINYSC_CHECK(expr) \
+    ((expr) ? (void)0 : ::TinyStarCraft::Testing::_reportFailure(__FILE__, __LINE__, #expr))
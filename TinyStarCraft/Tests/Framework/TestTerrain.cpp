@@ -0,0 +1,135 @@
+#include "Precompiled.h"
+#include "TestTerrain.h"
+#include "TestFramework.h"
+#include "Asset/EffectManager.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainModifier.h"
+#include "Rendering/TerrainQuadTree.h"
+
+namespace TinyStarCraft
+{
+namespace Testing
+{
+
+//-------------------------------------------------------------------------------------------------
+TestRenderSystem::TestRenderSystem()
+    : mRenderSystem(nullptr)
+{
+    const bool isInitialized = mRenderSystem.initialize(nullptr, RenderSystemConfig(Size2d(800, 600), false, true));
+    TINYSC_CHECK(isInitialized);
+
+    // The headless device doesn't read the effect files, only the names have to match.
+    EffectManager* effectManager = mRenderSystem.getEffectManager();
+    TINYSC_CHECK(effectManager->createEffectFromFile(Terrain::EFFECT_RESOURCE_NAME_TERRAIN, "Terrain.cso"));
+    TINYSC_CHECK(effectManager->createEffectFromFile(Terrain::EFFECT_RESOURCE_NAME_WATER, "Water.cso"));
+}
+//-------------------------------------------------------------------------------------------------
+void sculptRandomly(TerrainModifier* modifier, const Size2d& dimension, int operationsCount, std::mt19937* random)
+{
+    for (int i = 0; i < operationsCount; ++i) {
+        const Point2d location((*random)() % dimension.x, (*random)() % dimension.y);
+        switch ((*random)() % 4) {
+        case 0: modifier->hightenGround(location); break;
+        case 1: modifier->lowerGround(location); break;
+        case 2: modifier->hightenTile(location); break;
+        default: modifier->lowerTile(location); break;
+        }
+    }
+
+    modifier->updateTerrain();
+}
+//-------------------------------------------------------------------------------------------------
+std::vector<Tile> unpackTiles(const TileStore& tiles)
+{
+    std::vector<Tile> unpackedTiles(tiles.size());
+    for (size_t i = 0; i < tiles.size(); ++i)
+        unpackedTiles[i] = tiles.getTile((int)i);
+    return unpackedTiles;
+}
+//-------------------------------------------------------------------------------------------------
+Camera makeCameraLookingAt(const Point2d& tileLocation)
+{
+    // The camera looks down the diagonal, at a point sqrt(1.5) times its height away on x and z.
+    const float height = 400.0f;
+    const float lookAtOffset = height * sqrtf(1.5f);
+    const D3DXVECTOR3 position(Tile::SIZE * tileLocation.y + lookAtOffset, height, Tile::SIZE * tileLocation.x + lookAtOffset);
+    return Camera(Size2f(800.0f, 600.0f), position);
+}
+//-------------------------------------------------------------------------------------------------
+Camera makeRandomCamera(const Size2d& dimension, std::mt19937* random)
+{
+    std::uniform_real_distribution<float> unit(-0.25f, 1.25f);
+    const Point2d target((int)(unit(*random) * dimension.x), (int)(unit(*random) * dimension.y));
+    Camera camera = makeCameraLookingAt(target);
+
+    const float scale = std::uniform_real_distribution<float>(0.5f, 5.5f)(*random);
+    camera.setViewportSize(Size2f(800.0f * scale, 600.0f * scale));
+    return camera;
+}
+//-------------------------------------------------------------------------------------------------
+AABB makeChunkAABB(const Point2d& chunkLocation, int minLevel, int maxLevel)
+{
+    // Grid x goes along world z axis and grid y goes along world x axis, tiles are centered at
+    // their location.
+    const float chunkSize = Tile::SIZE * Terrain::CHUNK_DIMENSION;
+    const D3DXVECTOR3 min(chunkSize * chunkLocation.y - Tile::SIZE * 0.5f, minLevel * Tile::HEIGHT_PER_LEVEL,
+        chunkSize * chunkLocation.x - Tile::SIZE * 0.5f);
+    const D3DXVECTOR3 max(min.x + chunkSize, (maxLevel + 1) * Tile::HEIGHT_PER_LEVEL, min.z + chunkSize);
+    return AABB(min, max);
+}
+//-------------------------------------------------------------------------------------------------
+Ray makeRandomRay(const Size2d& dimension, int kind, std::mt19937* random)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    const D3DXVECTOR3 center(Tile::SIZE * dimension.y * 0.5f, 0.0f, Tile::SIZE * dimension.x * 0.5f);
+    const float extent = Tile::SIZE * Math::max<int>(dimension.x, dimension.y) * 0.7f;
+
+    D3DXVECTOR3 origin, direction;
+    switch (kind) {
+    case 0:
+        origin = center + D3DXVECTOR3(unit(*random) * extent, 300.0f + unit(*random) * 200.0f, unit(*random) * extent);
+        direction = D3DXVECTOR3(unit(*random), -1.0f + unit(*random) * 0.5f, unit(*random));
+        break;
+    case 1:
+        origin = center + D3DXVECTOR3(unit(*random) * extent, 50.0f + unit(*random) * 50.0f, unit(*random) * extent);
+        direction = D3DXVECTOR3(unit(*random), unit(*random) * 0.1f, unit(*random));
+        break;
+    case 2:
+        origin = center + D3DXVECTOR3(unit(*random) * extent, 400.0f, unit(*random) * extent);
+        direction = D3DXVECTOR3(0.0f, -1.0f, 0.0f);
+        break;
+    default: {
+        Camera camera(Size2f(800.0f, 600.0f), center + D3DXVECTOR3(unit(*random) * extent, 600.0f, unit(*random) * extent));
+        return camera.screenPointToRay(Point2f((unit(*random) + 1.0f) * 400.0f, (unit(*random) + 1.0f) * 300.0f));
+    }
+    }
+
+    Ray ray(origin, direction);
+    ray.normalize();
+    return ray;
+}
+//-------------------------------------------------------------------------------------------------
+bool haveSameAABBs(const TerrainQuadTree& a, const TerrainQuadTree& b)
+{
+    if (a.getDepth() != b.getDepth())
+        return false;
+
+    for (int level = 0; level <= a.getDepth(); ++level) {
+        const Size2d& dimension = a.getLevelDimension(level);
+        if (dimension.x != b.getLevelDimension(level).x || dimension.y != b.getLevelDimension(level).y)
+            return false;
+
+        for (int y = 0; y < dimension.y; ++y) {
+            for (int x = 0; x < dimension.x; ++x) {
+                const AABB aabbA = a.getAABB(level, Point2d(x, y));
+                const AABB aabbB = b.getAABB(level, Point2d(x, y));
+                if (aabbA.getMin() != aabbB.getMin() || aabbA.getMax() != aabbB.getMax())
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+}
+}
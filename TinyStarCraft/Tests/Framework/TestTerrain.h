@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Rendering/Camera.h"
+#include "Rendering/RenderSystem.h"
+#include "Rendering/Tile.h"
+#include "Utilities/Ray.h"
+
+#include <random>
+
+namespace TinyStarCraft
+{
+
+class TerrainModifier;
+class TerrainQuadTree;
+
+namespace Testing
+{
+
+/**
+  	A render system on the headless device, with the effects the terrain retrieves when it is
+    initialized.
+ */
+class TestRenderSystem
+{
+public:
+    TestRenderSystem();
+
+    RenderSystem* get() { return &mRenderSystem; }
+
+    /** The headless device, which records the draw calls. */
+    IDirect3DDevice9* getDevice() const { return mRenderSystem.getD3DDevice(); }
+
+private:
+    RenderSystem mRenderSystem;
+};
+
+/**
+  	Applies random hightening and lowering operations on ground and tiles of a terrain of the
+    dimension, then updates the terrain.
+@remarks
+    The modifier only produces valid tile combinations, so this is the way to get a rugged terrain
+    which could have been edited by hand.
+ */
+void sculptRandomly(TerrainModifier* modifier, const Size2d& dimension, int operationsCount, std::mt19937* random);
+
+/** Unpack all tiles of a store, e.g. to initialize another terrain with them. */
+std::vector<Tile> unpackTiles(const TileStore& tiles);
+
+/** Create a camera with the viewport size of the test render system, looking at the center of a tile. */
+Camera makeCameraLookingAt(const Point2d& tileLocation);
+
+/**
+  	Make a camera looking at a random tile around a terrain of the dimension, with a random
+    viewport size from half to 5.5 times the size of the test render system's.
+ */
+Camera makeRandomCamera(const Size2d& dimension, std::mt19937* random);
+
+/**
+  	Make the AABB a chunk of the terrain at a location in the chunks grid would have, if its tiles
+    are between two levels.
+ */
+AABB makeChunkAABB(const Point2d& chunkLocation, int minLevel, int maxLevel);
+
+/**
+  	Make a random ray of one of four kinds around a terrain of the dimension: steep rays from above,
+    nearly horizontal rays just above the ground, vertical rays and picking rays of a camera.
+    Origins are spread beyond the terrain's edges too.
+ */
+Ray makeRandomRay(const Size2d& dimension, int kind, std::mt19937* random);
+
+/** Check if two quad trees have the same topology and all their nodes have the same AABBs. */
+bool haveSameAABBs(const TerrainQuadTree& a, const TerrainQuadTree& b);
+
+}
+}
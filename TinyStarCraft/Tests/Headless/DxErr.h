@@ -0,0 +1,9 @@
+#pragma once
+
+#include <windows.h>
+
+/** Get the name of a HRESULT code. */
+const char* DXGetErrorString(HRESULT hr);
+
+/** Get the description of a HRESULT code. */
+const char* DXGetErrorDescription(HRESULT hr);
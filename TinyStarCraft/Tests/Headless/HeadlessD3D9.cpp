@@ -0,0 +1,116 @@
+#include <d3d9.h>
+#include <DxErr.h>
+
+//-------------------------------------------------------------------------------------------------
+HRESULT HeadlessBuffer::Lock(UINT offset, UINT size, void** data, DWORD flags)
+{
+    if (size == 0)
+        size = (UINT)mData.size() - offset;
+
+    if ((size_t)offset + size > mData.size())
+        return D3DERR_INVALIDCALL;
+
+    ++mLocksCount;
+    mLockedBytes += size;
+    *data = mData.data() + offset;
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT HeadlessBuffer::Unlock()
+{
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT IDirect3DDevice9::GetRenderTarget(DWORD index, IDirect3DSurface9** surface)
+{
+    *surface = new IDirect3DSurface9();
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT IDirect3DDevice9::CreateVertexBuffer(UINT length, DWORD usage, DWORD FVF, D3DPOOL pool,
+    IDirect3DVertexBuffer9** buffer, HANDLE* sharedHandle)
+{
+    if (mFailingBufferCreations > 0) {
+        --mFailingBufferCreations;
+        *buffer = nullptr;
+        return D3DERR_OUTOFVIDEOMEMORY;
+    }
+
+    *buffer = new IDirect3DVertexBuffer9(length);
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT IDirect3DDevice9::CreateVertexDeclaration(const D3DVERTEXELEMENT9* elements,
+    IDirect3DVertexDeclaration9** declaration)
+{
+    *declaration = new IDirect3DVertexDeclaration9();
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT IDirect3DDevice9::SetStreamSource(UINT stream, IDirect3DVertexBuffer9* buffer, UINT offset, UINT stride)
+{
+    if (stream >= mStreams.size())
+        return D3DERR_INVALIDCALL;
+
+    mStreams[stream] = buffer;
+    mStreamOffsets[stream] = offset;
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT IDirect3DDevice9::SetStreamSourceFreq(UINT stream, UINT setting)
+{
+    if (stream >= mStreams.size())
+        return D3DERR_INVALIDCALL;
+
+    mStreamFrequencies[stream] = setting;
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT IDirect3DDevice9::DrawIndexedPrimitive(D3DPRIMITIVETYPE type, int baseVertexIndex, UINT minVertexIndex,
+    UINT verticesCount, UINT startIndex, UINT primitivesCount)
+{
+    HeadlessDrawCall drawCall;
+    drawCall.baseVertexIndex = (UINT)baseVertexIndex;
+    drawCall.minVertexIndex = minVertexIndex;
+    drawCall.verticesCount = verticesCount;
+    drawCall.startIndex = startIndex;
+    drawCall.primitivesCount = primitivesCount;
+    drawCall.streams = mStreams;
+    drawCall.streamOffsets = mStreamOffsets;
+    drawCall.streamFrequencies = mStreamFrequencies;
+    drawCall.indices = mIndices;
+    mDrawCalls.push_back(drawCall);
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT IDirect3D9::CreateDevice(UINT adapter, D3DDEVTYPE deviceType, HWND focusWindow, DWORD behaviorFlags,
+    D3DPRESENT_PARAMETERS* presentParams, IDirect3DDevice9** device)
+{
+    *device = new IDirect3DDevice9();
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+IDirect3D9* Direct3DCreate9(UINT SDKVersion)
+{
+    return SDKVersion == D3D_SDK_VERSION ? new IDirect3D9() : nullptr;
+}
+//-------------------------------------------------------------------------------------------------
+const char* DXGetErrorString(HRESULT hr)
+{
+    switch (hr) {
+    case S_OK: return "S_OK";
+    case E_FAIL: return "E_FAIL";
+    case E_OUTOFMEMORY: return "E_OUTOFMEMORY";
+    case E_INVALIDARG: return "E_INVALIDARG";
+    case D3DERR_DEVICELOST: return "D3DERR_DEVICELOST";
+    case D3DERR_DEVICENOTRESET: return "D3DERR_DEVICENOTRESET";
+    case D3DERR_INVALIDCALL: return "D3DERR_INVALIDCALL";
+    case D3DERR_OUTOFVIDEOMEMORY: return "D3DERR_OUTOFVIDEOMEMORY";
+    default: return "Unknown";
+    }
+}
+//-------------------------------------------------------------------------------------------------
+const char* DXGetErrorDescription(HRESULT hr)
+{
+    return DXGetErrorString(hr);
+}
@@ -0,0 +1,317 @@
+#include <d3dx9.h>
+
+#include <algorithm>
+#include <utility>
+
+//-------------------------------------------------------------------------------------------------
+D3DXMATRIX D3DXMATRIX::operator*(const D3DXMATRIX& other) const
+{
+    D3DXMATRIX result;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            result.m[i][j] = 0.0f;
+            for (int k = 0; k < 4; ++k)
+                result.m[i][j] += m[i][k] * other.m[k][j];
+        }
+    }
+    return result;
+}
+//-------------------------------------------------------------------------------------------------
+D3DXVECTOR3* D3DXVec3Cross(D3DXVECTOR3* out, const D3DXVECTOR3* a, const D3DXVECTOR3* b)
+{
+    *out = D3DXVECTOR3(a->y * b->z - a->z * b->y, a->z * b->x - a->x * b->z, a->x * b->y - a->y * b->x);
+    return out;
+}
+//-------------------------------------------------------------------------------------------------
+D3DXVECTOR3* D3DXVec3Normalize(D3DXVECTOR3* out, const D3DXVECTOR3* v)
+{
+    const float length = D3DXVec3Length(v);
+    *out = length > 0.0f ? *v / length : D3DXVECTOR3(0.0f, 0.0f, 0.0f);
+    return out;
+}
+//-------------------------------------------------------------------------------------------------
+D3DXVECTOR4* D3DXVec4Normalize(D3DXVECTOR4* out, const D3DXVECTOR4* v)
+{
+    const float length = std::sqrt(v->x * v->x + v->y * v->y + v->z * v->z + v->w * v->w);
+    *out = length > 0.0f ? *v * (1.0f / length) : D3DXVECTOR4(0.0f, 0.0f, 0.0f, 0.0f);
+    return out;
+}
+//-------------------------------------------------------------------------------------------------
+D3DXVECTOR4* D3DXVec4Transform(D3DXVECTOR4* out, const D3DXVECTOR4* v, const D3DXMATRIX* m)
+{
+    const float* in = *v;
+    D3DXVECTOR4 result;
+    float* r = result;
+    for (int j = 0; j < 4; ++j)
+        r[j] = in[0] * m->m[0][j] + in[1] * m->m[1][j] + in[2] * m->m[2][j] + in[3] * m->m[3][j];
+
+    *out = result;
+    return out;
+}
+//-------------------------------------------------------------------------------------------------
+D3DXVECTOR4* D3DXVec4TransformArray(D3DXVECTOR4* out, UINT outStride, const D3DXVECTOR4* v, UINT vStride,
+    const D3DXMATRIX* m, UINT count)
+{
+    for (UINT i = 0; i < count; ++i) {
+        D3DXVec4Transform((D3DXVECTOR4*)((BYTE*)out + i * outStride),
+            (const D3DXVECTOR4*)((const BYTE*)v + i * vStride), m);
+    }
+    return out;
+}
+//-------------------------------------------------------------------------------------------------
+D3DXPLANE* D3DXPlaneFromPointNormal(D3DXPLANE* out, const D3DXVECTOR3* point, const D3DXVECTOR3* normal)
+{
+    *out = D3DXPLANE(normal->x, normal->y, normal->z, -D3DXVec3Dot(point, normal));
+    return out;
+}
+//-------------------------------------------------------------------------------------------------
+D3DXMATRIX* D3DXMatrixIdentity(D3DXMATRIX* out)
+{
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j)
+            out->m[i][j] = i == j ? 1.0f : 0.0f;
+    }
+    return out;
+}
+//-------------------------------------------------------------------------------------------------
+D3DXMATRIX* D3DXMatrixTranslation(D3DXMATRIX* out, float x, float y, float z)
+{
+    D3DXMatrixIdentity(out);
+    out->_41 = x;
+    out->_42 = y;
+    out->_43 = z;
+    return out;
+}
+//-------------------------------------------------------------------------------------------------
+D3DXMATRIX* D3DXMatrixInverse(D3DXMATRIX* out, float* determinant, const D3DXMATRIX* m)
+{
+    // Gauss-Jordan elimination with partial pivoting on [m | I].
+    double a[4][8];
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 8; ++j)
+            a[i][j] = j < 4 ? m->m[i][j] : (j - 4 == i ? 1.0 : 0.0);
+    }
+
+    double det = 1.0;
+    for (int column = 0; column < 4; ++column) {
+        int pivot = column;
+        for (int row = column + 1; row < 4; ++row) {
+            if (std::fabs(a[row][column]) > std::fabs(a[pivot][column]))
+                pivot = row;
+        }
+
+        if (a[pivot][column] == 0.0)
+            return nullptr;
+
+        if (pivot != column) {
+            for (int j = 0; j < 8; ++j)
+                std::swap(a[column][j], a[pivot][j]);
+            det = -det;
+        }
+
+        const double diagonal = a[column][column];
+        det *= diagonal;
+        for (int j = 0; j < 8; ++j)
+            a[column][j] /= diagonal;
+
+        for (int row = 0; row < 4; ++row) {
+            if (row == column)
+                continue;
+            const double factor = a[row][column];
+            for (int j = 0; j < 8; ++j)
+                a[row][j] -= factor * a[column][j];
+        }
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j)
+            out->m[i][j] = (float)a[i][j + 4];
+    }
+
+    if (determinant)
+        *determinant = (float)det;
+    return out;
+}
+//-------------------------------------------------------------------------------------------------
+D3DXMATRIX* D3DXMatrixLookAtLH(D3DXMATRIX* out, const D3DXVECTOR3* eye, const D3DXVECTOR3* at, const D3DXVECTOR3* up)
+{
+    D3DXVECTOR3 zAxis = *at - *eye;
+    D3DXVec3Normalize(&zAxis, &zAxis);
+    D3DXVECTOR3 xAxis;
+    D3DXVec3Cross(&xAxis, up, &zAxis);
+    D3DXVec3Normalize(&xAxis, &xAxis);
+    D3DXVECTOR3 yAxis;
+    D3DXVec3Cross(&yAxis, &zAxis, &xAxis);
+
+    D3DXMatrixIdentity(out);
+    out->_11 = xAxis.x; out->_12 = yAxis.x; out->_13 = zAxis.x;
+    out->_21 = xAxis.y; out->_22 = yAxis.y; out->_23 = zAxis.y;
+    out->_31 = xAxis.z; out->_32 = yAxis.z; out->_33 = zAxis.z;
+    out->_41 = -D3DXVec3Dot(&xAxis, eye);
+    out->_42 = -D3DXVec3Dot(&yAxis, eye);
+    out->_43 = -D3DXVec3Dot(&zAxis, eye);
+    return out;
+}
+//-------------------------------------------------------------------------------------------------
+D3DXMATRIX* D3DXMatrixOrthoLH(D3DXMATRIX* out, float width, float height, float zNear, float zFar)
+{
+    D3DXMatrixIdentity(out);
+    out->_11 = 2.0f / width;
+    out->_22 = 2.0f / height;
+    out->_33 = 1.0f / (zFar - zNear);
+    out->_43 = zNear / (zNear - zFar);
+    return out;
+}
+//-------------------------------------------------------------------------------------------------
+BOOL D3DXIntersectTri(const D3DXVECTOR3* p0, const D3DXVECTOR3* p1, const D3DXVECTOR3* p2, const D3DXVECTOR3* rayPos,
+    const D3DXVECTOR3* rayDir, float* u, float* v, float* distance)
+{
+    // Moller-Trumbore, the same barycentrics and distance as D3DX reports.
+    const D3DXVECTOR3 edge1 = *p1 - *p0;
+    const D3DXVECTOR3 edge2 = *p2 - *p0;
+    D3DXVECTOR3 p;
+    D3DXVec3Cross(&p, rayDir, &edge2);
+
+    const float det = D3DXVec3Dot(&edge1, &p);
+    if (std::fabs(det) < 1e-8f)
+        return FALSE;
+
+    const float invDet = 1.0f / det;
+    const D3DXVECTOR3 t = *rayPos - *p0;
+    const float uu = D3DXVec3Dot(&t, &p) * invDet;
+    if (uu < 0.0f || uu > 1.0f)
+        return FALSE;
+
+    D3DXVECTOR3 q;
+    D3DXVec3Cross(&q, &t, &edge1);
+    const float vv = D3DXVec3Dot(rayDir, &q) * invDet;
+    if (vv < 0.0f || uu + vv > 1.0f)
+        return FALSE;
+
+    const float dist = D3DXVec3Dot(&edge2, &q) * invDet;
+    if (dist < 0.0f)
+        return FALSE;
+
+    *u = uu;
+    *v = vv;
+    *distance = dist;
+    return TRUE;
+}
+//-------------------------------------------------------------------------------------------------
+D3DXHANDLE ID3DXEffect::EndParameterBlock()
+{
+    mParameterBlocks.push_back(std::unique_ptr<char>(new char()));
+    return mParameterBlocks.back().get();
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT ID3DXEffect::DeleteParameterBlock(D3DXHANDLE parameterBlock)
+{
+    auto it = std::find_if(mParameterBlocks.begin(), mParameterBlocks.end(),
+        [parameterBlock](const std::unique_ptr<char>& block) { return block.get() == parameterBlock; });
+    if (it == mParameterBlocks.end())
+        return D3DERR_INVALIDCALL;
+
+    mParameterBlocks.erase(it);
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT D3DXCreateEffectPool(ID3DXEffectPool** pool)
+{
+    *pool = new ID3DXEffectPool();
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT D3DXCreateEffectFromFile(IDirect3DDevice9* device, const char* srcFile, const void* defines, void* include,
+    DWORD flags, ID3DXEffectPool* pool, ID3DXEffect** effect, ID3DXBuffer** compilationErrors)
+{
+    if (compilationErrors)
+        *compilationErrors = nullptr;
+
+    *effect = new ID3DXEffect();
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT D3DXCreateTexture(IDirect3DDevice9* device, UINT width, UINT height, UINT mipLevels, DWORD usage,
+    D3DFORMAT format, D3DPOOL pool, IDirect3DTexture9** texture)
+{
+    *texture = new IDirect3DTexture9();
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT D3DXCreateTextureFromFileEx(IDirect3DDevice9* device, const char* srcFile, UINT width, UINT height,
+    UINT mipLevels, DWORD usage, D3DFORMAT format, D3DPOOL pool, DWORD filter, DWORD mipFilter, D3DCOLOR colorKey,
+    void* srcInfo, void* palette, IDirect3DTexture9** texture)
+{
+    *texture = new IDirect3DTexture9();
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+static DWORD _getDeclarationTypeSize(BYTE type)
+{
+    switch (type) {
+    case D3DDECLTYPE_FLOAT1: return 4;
+    case D3DDECLTYPE_FLOAT2: return 8;
+    case D3DDECLTYPE_FLOAT3: return 12;
+    case D3DDECLTYPE_FLOAT4: return 16;
+    case D3DDECLTYPE_SHORT4: return 8;
+    default: return 4;
+    }
+}
+//-------------------------------------------------------------------------------------------------
+ID3DXMesh::ID3DXMesh(DWORD facesCount, DWORD verticesCount, DWORD options, const D3DVERTEXELEMENT9* declaration)
+    : mFacesCount(facesCount),
+      mVerticesCount(verticesCount),
+      mVertexSize(0),
+      mOptions(options),
+      mAttributes(facesCount)
+{
+    for (const D3DVERTEXELEMENT9* element = declaration; element->Stream != 0xFF; ++element) {
+        if (element->Stream == 0)
+            mVertexSize = std::max(mVertexSize, element->Offset + _getDeclarationTypeSize(element->Type));
+    }
+
+    const DWORD indexSize = (options & D3DXMESH_32BIT) ? 4 : 2;
+    mVertexBuffer = new IDirect3DVertexBuffer9(verticesCount * mVertexSize);
+    mIndexBuffer = new IDirect3DIndexBuffer9(facesCount * 3 * indexSize);
+}
+//-------------------------------------------------------------------------------------------------
+ID3DXMesh::~ID3DXMesh()
+{
+    mVertexBuffer->Release();
+    mIndexBuffer->Release();
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT ID3DXMesh::GetVertexBuffer(IDirect3DVertexBuffer9** buffer)
+{
+    mVertexBuffer->AddRef();
+    *buffer = mVertexBuffer;
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT ID3DXMesh::GetIndexBuffer(IDirect3DIndexBuffer9** buffer)
+{
+    mIndexBuffer->AddRef();
+    *buffer = mIndexBuffer;
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT ID3DXMesh::SetAttributeTable(const D3DXATTRIBUTERANGE* table, DWORD size)
+{
+    mAttributeTable.assign(table, table + size);
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT ID3DXMesh::GetAttributeTable(D3DXATTRIBUTERANGE* table, DWORD* size) const
+{
+    if (table)
+        std::copy(mAttributeTable.begin(), mAttributeTable.end(), table);
+    *size = (DWORD)mAttributeTable.size();
+    return S_OK;
+}
+//-------------------------------------------------------------------------------------------------
+HRESULT D3DXCreateMesh(DWORD facesCount, DWORD verticesCount, DWORD options, const D3DVERTEXELEMENT9* declaration,
+    IDirect3DDevice9* device, ID3DXMesh** mesh)
+{
+    *mesh = new ID3DXMesh(facesCount, verticesCount, options, declaration);
+    return S_OK;
+}
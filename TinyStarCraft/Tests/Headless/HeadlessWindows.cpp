@@ -0,0 +1,104 @@
+#include <windows.h>
+
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+
+/** Handles of files and file mappings, both refer to the content read from the file. */
+struct HeadlessHandle
+{
+    std::shared_ptr<const std::vector<BYTE>> content;
+};
+
+/** Views of file mappings, to keep their content alive until they are unmapped. */
+std::map<const void*, std::shared_ptr<const std::vector<BYTE>>> gViews;
+std::mutex gViewsMutex;
+
+}
+
+//-------------------------------------------------------------------------------------------------
+void GetSystemTime(SYSTEMTIME* systemTime)
+{
+    using namespace std::chrono;
+
+    const system_clock::time_point now = system_clock::now();
+    const std::time_t time = system_clock::to_time_t(now);
+    std::tm utc = {};
+#ifdef _MSC_VER
+    gmtime_s(&utc, &time);
+#else
+    gmtime_r(&time, &utc);
+#endif
+
+    systemTime->wYear = (WORD)(utc.tm_year + 1900);
+    systemTime->wMonth = (WORD)(utc.tm_mon + 1);
+    systemTime->wDayOfWeek = (WORD)utc.tm_wday;
+    systemTime->wDay = (WORD)utc.tm_mday;
+    systemTime->wHour = (WORD)utc.tm_hour;
+    systemTime->wMinute = (WORD)utc.tm_min;
+    systemTime->wSecond = (WORD)utc.tm_sec;
+    systemTime->wMilliseconds = (WORD)(duration_cast<milliseconds>(now.time_since_epoch()).count() % 1000);
+}
+//-------------------------------------------------------------------------------------------------
+void OutputDebugStringA(LPCSTR outputString)
+{
+    fputs(outputString, stderr);
+}
+//-------------------------------------------------------------------------------------------------
+HANDLE CreateFileA(LPCSTR fileName, DWORD desiredAccess, DWORD shareMode, void* securityAttributes,
+    DWORD creationDisposition, DWORD flagsAndAttributes, HANDLE templateFile)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file)
+        return INVALID_HANDLE_VALUE;
+
+    HeadlessHandle* handle = new HeadlessHandle();
+    handle->content = std::make_shared<const std::vector<BYTE>>(std::istreambuf_iterator<char>(file),
+        std::istreambuf_iterator<char>());
+    return handle;
+}
+//-------------------------------------------------------------------------------------------------
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* fileSize)
+{
+    fileSize->QuadPart = (LONGLONG)static_cast<HeadlessHandle*>(file)->content->size();
+    return TRUE;
+}
+//-------------------------------------------------------------------------------------------------
+HANDLE CreateFileMappingA(HANDLE file, void* attributes, DWORD protect, DWORD maximumSizeHigh, DWORD maximumSizeLow,
+    LPCSTR name)
+{
+    HeadlessHandle* handle = new HeadlessHandle();
+    handle->content = static_cast<HeadlessHandle*>(file)->content;
+    return handle;
+}
+//-------------------------------------------------------------------------------------------------
+void* MapViewOfFile(HANDLE fileMapping, DWORD desiredAccess, DWORD fileOffsetHigh, DWORD fileOffsetLow, size_t bytesToMap)
+{
+    const std::shared_ptr<const std::vector<BYTE>>& content = static_cast<HeadlessHandle*>(fileMapping)->content;
+    if (content->empty())
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(gViewsMutex);
+    gViews[content->data()] = content;
+    return (void*)content->data();
+}
+//-------------------------------------------------------------------------------------------------
+BOOL UnmapViewOfFile(const void* baseAddress)
+{
+    std::lock_guard<std::mutex> lock(gViewsMutex);
+    return gViews.erase(baseAddress) > 0;
+}
+//-------------------------------------------------------------------------------------------------
+BOOL CloseHandle(HANDLE object)
+{
+    delete static_cast<HeadlessHandle*>(object);
+    return TRUE;
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+/*
+    Headless subset of Direct3D 9. The device keeps buffers in system memory and records the draw
+    calls instead of rendering, so tests can inspect what the engine submitted.
+ */
+
+#include <windows.h>
+
+#include <array>
+#include <vector>
+
+#define D3D_SDK_VERSION 32
+
+#define MAKE_D3DHRESULT(code)   ((HRESULT)(0x88760000u | (code)))
+#define D3DERR_DEVICELOST       MAKE_D3DHRESULT(2152)
+#define D3DERR_DEVICENOTRESET   MAKE_D3DHRESULT(2153)
+#define D3DERR_INVALIDCALL      MAKE_D3DHRESULT(2156)
+#define D3DERR_OUTOFVIDEOMEMORY MAKE_D3DHRESULT(380)
+
+typedef DWORD D3DCOLOR;
+#define D3DCOLOR_ARGB(a, r, g, b) \
+    ((D3DCOLOR)((((a) & 0xff) << 24) | (((r) & 0xff) << 16) | (((g) & 0xff) << 8) | ((b) & 0xff)))
+#define D3DCOLOR_XRGB(r, g, b) D3DCOLOR_ARGB(0xff, r, g, b)
+
+enum D3DFORMAT
+{
+    D3DFMT_UNKNOWN = 0,
+    D3DFMT_A8R8G8B8 = 21,
+    D3DFMT_X8R8G8B8 = 22,
+    D3DFMT_D24S8 = 75,
+    D3DFMT_INDEX16 = 101,
+    D3DFMT_INDEX32 = 102
+};
+
+enum D3DPOOL { D3DPOOL_DEFAULT = 0, D3DPOOL_MANAGED = 1, D3DPOOL_SYSTEMMEM = 2 };
+enum D3DDEVTYPE { D3DDEVTYPE_HAL = 1, D3DDEVTYPE_REF = 2 };
+enum D3DSWAPEFFECT { D3DSWAPEFFECT_DISCARD = 1 };
+enum D3DMULTISAMPLE_TYPE { D3DMULTISAMPLE_NONE = 0 };
+enum D3DPRIMITIVETYPE { D3DPT_TRIANGLELIST = 4 };
+
+#define D3DUSAGE_RENDERTARGET               0x00000001u
+#define D3DUSAGE_WRITEONLY                  0x00000008u
+#define D3DUSAGE_DYNAMIC                    0x00000200u
+#define D3DLOCK_NOOVERWRITE                 0x00001000u
+#define D3DLOCK_DISCARD                     0x00002000u
+#define D3DCREATE_HARDWARE_VERTEXPROCESSING 0x00000040u
+#define D3DPRESENTFLAG_DISCARD_DEPTHSTENCIL 0x00000002u
+#define D3DPRESENT_RATE_DEFAULT             0x00000000u
+#define D3DPRESENT_INTERVAL_DEFAULT         0x00000000u
+#define D3DPRESENT_INTERVAL_IMMEDIATE       0x80000000u
+#define D3DSTREAMSOURCE_INDEXEDDATA         (1u << 30)
+#define D3DSTREAMSOURCE_INSTANCEDATA        (2u << 30)
+
+enum D3DDECLTYPE
+{
+    D3DDECLTYPE_FLOAT1 = 0, D3DDECLTYPE_FLOAT2 = 1, D3DDECLTYPE_FLOAT3 = 2, D3DDECLTYPE_FLOAT4 = 3,
+    D3DDECLTYPE_D3DCOLOR = 4, D3DDECLTYPE_UBYTE4 = 5, D3DDECLTYPE_SHORT2 = 6, D3DDECLTYPE_SHORT4 = 7,
+    D3DDECLTYPE_UNUSED = 17
+};
+enum D3DDECLMETHOD { D3DDECLMETHOD_DEFAULT = 0 };
+enum D3DDECLUSAGE
+{
+    D3DDECLUSAGE_POSITION = 0, D3DDECLUSAGE_BLENDWEIGHT = 1, D3DDECLUSAGE_BLENDINDICES = 2, D3DDECLUSAGE_NORMAL = 3,
+    D3DDECLUSAGE_PSIZE = 4, D3DDECLUSAGE_TEXCOORD = 5, D3DDECLUSAGE_COLOR = 10
+};
+
+struct D3DVERTEXELEMENT9
+{
+    WORD Stream;
+    WORD Offset;
+    BYTE Type;
+    BYTE Method;
+    BYTE Usage;
+    BYTE UsageIndex;
+};
+#define D3DDECL_END() { 0xFF, 0, D3DDECLTYPE_UNUSED, 0, 0, 0 }
+#define MAX_FVF_DECL_SIZE 65
+
+struct D3DPRESENT_PARAMETERS
+{
+    UINT BackBufferWidth;
+    UINT BackBufferHeight;
+    D3DFORMAT BackBufferFormat;
+    UINT BackBufferCount;
+    D3DMULTISAMPLE_TYPE MultiSampleType;
+    DWORD MultiSampleQuality;
+    D3DSWAPEFFECT SwapEffect;
+    HWND hDeviceWindow;
+    BOOL Windowed;
+    BOOL EnableAutoDepthStencil;
+    D3DFORMAT AutoDepthStencilFormat;
+    DWORD Flags;
+    UINT FullScreen_RefreshRateInHz;
+    UINT PresentationInterval;
+};
+
+/** Reference counting shared by all headless interfaces. */
+class HeadlessUnknown
+{
+public:
+    virtual ~HeadlessUnknown() {}
+
+    ULONG AddRef() { return ++mReferencesCount; }
+
+    ULONG Release()
+    {
+        ULONG count = --mReferencesCount;
+        if (count == 0)
+            delete this;
+        return count;
+    }
+
+private:
+    ULONG mReferencesCount = 1;
+};
+
+/** Vertex and index buffers live in system memory and count their locks. */
+class HeadlessBuffer : public HeadlessUnknown
+{
+public:
+    explicit HeadlessBuffer(UINT length) : mData(length) {}
+
+    HRESULT Lock(UINT offset, UINT size, void** data, DWORD flags);
+    HRESULT Unlock();
+
+    /** Content of the buffer. */
+    const std::vector<BYTE>& getData() const { return mData; }
+
+    /** Number of Lock calls. */
+    size_t getLocksCount() const { return mLocksCount; }
+
+    /** Total bytes covered by the Lock calls. */
+    size_t getLockedBytes() const { return mLockedBytes; }
+
+private:
+    std::vector<BYTE> mData;
+    size_t mLocksCount = 0;
+    size_t mLockedBytes = 0;
+};
+
+class IDirect3DVertexBuffer9 : public HeadlessBuffer
+{
+public:
+    using HeadlessBuffer::HeadlessBuffer;
+};
+
+class IDirect3DIndexBuffer9 : public HeadlessBuffer
+{
+public:
+    using HeadlessBuffer::HeadlessBuffer;
+};
+
+class IDirect3DVertexDeclaration9 : public HeadlessUnknown {};
+class IDirect3DSurface9 : public HeadlessUnknown {};
+class IDirect3DBaseTexture9 : public HeadlessUnknown {};
+class IDirect3DTexture9 : public IDirect3DBaseTexture9 {};
+
+/** A draw call recorded by the headless device, with the streams and indices bound at the time. */
+struct HeadlessDrawCall
+{
+    UINT baseVertexIndex;
+    UINT minVertexIndex;
+    UINT verticesCount;
+    UINT startIndex;
+    UINT primitivesCount;
+    std::array<const IDirect3DVertexBuffer9*, 2> streams;
+    std::array<UINT, 2> streamOffsets;
+    std::array<UINT, 2> streamFrequencies;
+    const IDirect3DIndexBuffer9* indices;
+};
+
+class IDirect3DDevice9 : public HeadlessUnknown
+{
+public:
+    HRESULT TestCooperativeLevel() { return S_OK; }
+    HRESULT Reset(D3DPRESENT_PARAMETERS* presentParams) { return S_OK; }
+    HRESULT Present(const void* sourceRect, const void* destRect, HWND destWindow, const void* dirtyRegion) { return S_OK; }
+
+    HRESULT GetRenderTarget(DWORD index, IDirect3DSurface9** surface);
+    HRESULT SetRenderTarget(DWORD index, IDirect3DSurface9* surface) { return S_OK; }
+
+    HRESULT CreateVertexBuffer(UINT length, DWORD usage, DWORD FVF, D3DPOOL pool, IDirect3DVertexBuffer9** buffer,
+        HANDLE* sharedHandle);
+    HRESULT CreateVertexDeclaration(const D3DVERTEXELEMENT9* elements, IDirect3DVertexDeclaration9** declaration);
+
+    HRESULT SetVertexDeclaration(IDirect3DVertexDeclaration9* declaration) { return S_OK; }
+    HRESULT SetStreamSource(UINT stream, IDirect3DVertexBuffer9* buffer, UINT offset, UINT stride);
+    HRESULT SetStreamSourceFreq(UINT stream, UINT setting);
+    HRESULT SetIndices(IDirect3DIndexBuffer9* indices) { mIndices = indices; return S_OK; }
+    HRESULT DrawIndexedPrimitive(D3DPRIMITIVETYPE type, int baseVertexIndex, UINT minVertexIndex, UINT verticesCount,
+        UINT startIndex, UINT primitivesCount);
+
+    /** Draw calls recorded since the last clearDrawCalls. */
+    const std::vector<HeadlessDrawCall>& getDrawCalls() const { return mDrawCalls; }
+
+    /** Forget the recorded draw calls. */
+    void clearDrawCalls() { mDrawCalls.clear(); }
+
+    /** Make the next few vertex buffer creations fail with D3DERR_OUTOFVIDEOMEMORY. */
+    void failNextBufferCreations(int count) { mFailingBufferCreations = count; }
+
+private:
+    std::vector<HeadlessDrawCall> mDrawCalls;
+    std::array<const IDirect3DVertexBuffer9*, 2> mStreams = {};
+    std::array<UINT, 2> mStreamOffsets = {};
+    std::array<UINT, 2> mStreamFrequencies = { { 1, 1 } };
+    const IDirect3DIndexBuffer9* mIndices = nullptr;
+    int mFailingBufferCreations = 0;
+};
+
+class IDirect3D9 : public HeadlessUnknown
+{
+public:
+    HRESULT CreateDevice(UINT adapter, D3DDEVTYPE deviceType, HWND focusWindow, DWORD behaviorFlags,
+        D3DPRESENT_PARAMETERS* presentParams, IDirect3DDevice9** device);
+};
+
+IDirect3D9* Direct3DCreate9(UINT SDKVersion);
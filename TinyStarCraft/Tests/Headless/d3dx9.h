@@ -0,0 +1,284 @@
+#pragma once
+
+/*
+    Headless subset of D3DX 9. The math functions are computed like D3DX does, meshes are backed
+    by headless buffers, effects accept every parameter and textures have no content.
+ */
+
+#include <d3d9.h>
+
+#include <cmath>
+#include <memory>
+#include <string>
+
+#define D3DX_DEFAULT            ((UINT)-1)
+#define D3DX_DEFAULT_NONPOW2    ((UINT)-2)
+
+#define D3DXMESH_32BIT          0x001u
+#define D3DXMESH_MANAGED        0x220u
+
+// Math
+//
+
+struct D3DXVECTOR4;
+
+struct D3DXVECTOR2
+{
+    float x, y;
+
+    D3DXVECTOR2() = default;
+    D3DXVECTOR2(float x, float y) : x(x), y(y) {}
+
+    D3DXVECTOR2 operator+(const D3DXVECTOR2& other) const { return D3DXVECTOR2(x + other.x, y + other.y); }
+    D3DXVECTOR2 operator-(const D3DXVECTOR2& other) const { return D3DXVECTOR2(x - other.x, y - other.y); }
+    D3DXVECTOR2 operator*(float s) const { return D3DXVECTOR2(x * s, y * s); }
+    D3DXVECTOR2& operator+=(const D3DXVECTOR2& other) { x += other.x; y += other.y; return *this; }
+    bool operator==(const D3DXVECTOR2& other) const { return x == other.x && y == other.y; }
+    bool operator!=(const D3DXVECTOR2& other) const { return !(*this == other); }
+};
+
+struct D3DXVECTOR3
+{
+    float x, y, z;
+
+    D3DXVECTOR3() = default;
+    D3DXVECTOR3(float x, float y, float z) : x(x), y(y), z(z) {}
+    explicit D3DXVECTOR3(const float* values) : x(values[0]), y(values[1]), z(values[2]) {}
+
+    D3DXVECTOR3 operator+(const D3DXVECTOR3& other) const { return D3DXVECTOR3(x + other.x, y + other.y, z + other.z); }
+    D3DXVECTOR3 operator-(const D3DXVECTOR3& other) const { return D3DXVECTOR3(x - other.x, y - other.y, z - other.z); }
+    D3DXVECTOR3 operator-() const { return D3DXVECTOR3(-x, -y, -z); }
+    D3DXVECTOR3 operator*(float s) const { return D3DXVECTOR3(x * s, y * s, z * s); }
+    D3DXVECTOR3 operator/(float s) const { return D3DXVECTOR3(x / s, y / s, z / s); }
+    D3DXVECTOR3& operator+=(const D3DXVECTOR3& other) { x += other.x; y += other.y; z += other.z; return *this; }
+    D3DXVECTOR3& operator-=(const D3DXVECTOR3& other) { x -= other.x; y -= other.y; z -= other.z; return *this; }
+    D3DXVECTOR3& operator*=(float s) { x *= s; y *= s; z *= s; return *this; }
+    D3DXVECTOR3& operator/=(float s) { x /= s; y /= s; z /= s; return *this; }
+    bool operator==(const D3DXVECTOR3& other) const { return x == other.x && y == other.y && z == other.z; }
+    bool operator!=(const D3DXVECTOR3& other) const { return !(*this == other); }
+    operator float*() { return &x; }
+    operator const float*() const { return &x; }
+};
+
+inline D3DXVECTOR3 operator*(float s, const D3DXVECTOR3& v) { return v * s; }
+
+typedef D3DXVECTOR3 D3DVECTOR;
+
+struct D3DXVECTOR4
+{
+    float x, y, z, w;
+
+    D3DXVECTOR4() = default;
+    D3DXVECTOR4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+    D3DXVECTOR4(const D3DXVECTOR3& v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+
+    D3DXVECTOR4 operator+(const D3DXVECTOR4& other) const
+    {
+        return D3DXVECTOR4(x + other.x, y + other.y, z + other.z, w + other.w);
+    }
+    D3DXVECTOR4 operator-(const D3DXVECTOR4& other) const
+    {
+        return D3DXVECTOR4(x - other.x, y - other.y, z - other.z, w - other.w);
+    }
+    D3DXVECTOR4 operator*(float s) const { return D3DXVECTOR4(x * s, y * s, z * s, w * s); }
+    operator float*() { return &x; }
+    operator const float*() const { return &x; }
+};
+
+struct D3DXPLANE
+{
+    float a, b, c, d;
+
+    D3DXPLANE() = default;
+    D3DXPLANE(float a, float b, float c, float d) : a(a), b(b), c(c), d(d) {}
+
+    bool operator==(const D3DXPLANE& other) const { return a == other.a && b == other.b && c == other.c && d == other.d; }
+    bool operator!=(const D3DXPLANE& other) const { return !(*this == other); }
+};
+
+struct D3DXMATRIX
+{
+    union
+    {
+        struct
+        {
+            float _11, _12, _13, _14;
+            float _21, _22, _23, _24;
+            float _31, _32, _33, _34;
+            float _41, _42, _43, _44;
+        };
+        float m[4][4];
+    };
+
+    D3DXMATRIX() = default;
+
+    D3DXMATRIX operator*(const D3DXMATRIX& other) const;
+    D3DXMATRIX& operator*=(const D3DXMATRIX& other) { return *this = *this * other; }
+    operator float*() { return &_11; }
+    operator const float*() const { return &_11; }
+};
+
+struct D3DXCOLOR
+{
+    float r, g, b, a;
+
+    D3DXCOLOR() = default;
+    D3DXCOLOR(float r, float g, float b, float a) : r(r), g(g), b(b), a(a) {}
+};
+
+inline float D3DXVec3Dot(const D3DXVECTOR3* a, const D3DXVECTOR3* b)
+{
+    return a->x * b->x + a->y * b->y + a->z * b->z;
+}
+
+inline float D3DXVec3Length(const D3DXVECTOR3* v)
+{
+    return std::sqrt(D3DXVec3Dot(v, v));
+}
+
+D3DXVECTOR3* D3DXVec3Cross(D3DXVECTOR3* out, const D3DXVECTOR3* a, const D3DXVECTOR3* b);
+D3DXVECTOR3* D3DXVec3Normalize(D3DXVECTOR3* out, const D3DXVECTOR3* v);
+D3DXVECTOR4* D3DXVec4Normalize(D3DXVECTOR4* out, const D3DXVECTOR4* v);
+D3DXVECTOR4* D3DXVec4Transform(D3DXVECTOR4* out, const D3DXVECTOR4* v, const D3DXMATRIX* m);
+D3DXVECTOR4* D3DXVec4TransformArray(D3DXVECTOR4* out, UINT outStride, const D3DXVECTOR4* v, UINT vStride,
+    const D3DXMATRIX* m, UINT count);
+
+inline float D3DXPlaneDot(const D3DXPLANE* p, const D3DXVECTOR4* v)
+{
+    return p->a * v->x + p->b * v->y + p->c * v->z + p->d * v->w;
+}
+
+inline float D3DXPlaneDotCoord(const D3DXPLANE* p, const D3DXVECTOR3* v)
+{
+    return p->a * v->x + p->b * v->y + p->c * v->z + p->d;
+}
+
+D3DXPLANE* D3DXPlaneFromPointNormal(D3DXPLANE* out, const D3DXVECTOR3* point, const D3DXVECTOR3* normal);
+
+D3DXMATRIX* D3DXMatrixIdentity(D3DXMATRIX* out);
+D3DXMATRIX* D3DXMatrixTranslation(D3DXMATRIX* out, float x, float y, float z);
+D3DXMATRIX* D3DXMatrixInverse(D3DXMATRIX* out, float* determinant, const D3DXMATRIX* m);
+D3DXMATRIX* D3DXMatrixLookAtLH(D3DXMATRIX* out, const D3DXVECTOR3* eye, const D3DXVECTOR3* at, const D3DXVECTOR3* up);
+D3DXMATRIX* D3DXMatrixOrthoLH(D3DXMATRIX* out, float width, float height, float zNear, float zFar);
+
+BOOL D3DXIntersectTri(const D3DXVECTOR3* p0, const D3DXVECTOR3* p1, const D3DXVECTOR3* p2, const D3DXVECTOR3* rayPos,
+    const D3DXVECTOR3* rayDir, float* u, float* v, float* distance);
+
+// Buffers
+//
+
+class ID3DXBuffer : public HeadlessUnknown
+{
+public:
+    explicit ID3DXBuffer(const std::string& content) : mContent(content) {}
+
+    void* GetBufferPointer() { return &mContent[0]; }
+    DWORD GetBufferSize() const { return (DWORD)mContent.size(); }
+
+private:
+    std::string mContent;
+};
+
+// Effects
+//
+
+typedef const char* D3DXHANDLE;
+
+class ID3DXEffectPool : public HeadlessUnknown {};
+
+/** Effects accept every parameter. Parameter blocks are handed out as unique handles. */
+class ID3DXEffect : public HeadlessUnknown
+{
+public:
+    HRESULT SetTechnique(D3DXHANDLE technique) { return S_OK; }
+    HRESULT Begin(UINT* passesCount, DWORD flags) { *passesCount = 1; return S_OK; }
+    HRESULT BeginPass(UINT pass) { return S_OK; }
+    HRESULT EndPass() { return S_OK; }
+    HRESULT End() { return S_OK; }
+
+    HRESULT SetBool(D3DXHANDLE parameter, BOOL value) { return S_OK; }
+    HRESULT SetInt(D3DXHANDLE parameter, int value) { return S_OK; }
+    HRESULT SetFloat(D3DXHANDLE parameter, float value) { return S_OK; }
+    HRESULT SetFloatArray(D3DXHANDLE parameter, const float* values, UINT count) { return S_OK; }
+    HRESULT SetVector(D3DXHANDLE parameter, const D3DXVECTOR4* value) { return S_OK; }
+    HRESULT SetVectorArray(D3DXHANDLE parameter, const D3DXVECTOR4* values, UINT count) { return S_OK; }
+    HRESULT SetMatrix(D3DXHANDLE parameter, const D3DXMATRIX* value) { return S_OK; }
+    HRESULT SetTexture(D3DXHANDLE parameter, IDirect3DBaseTexture9* texture) { return S_OK; }
+
+    HRESULT BeginParameterBlock() { return S_OK; }
+    D3DXHANDLE EndParameterBlock();
+    HRESULT ApplyParameterBlock(D3DXHANDLE parameterBlock) { return parameterBlock ? S_OK : D3DERR_INVALIDCALL; }
+    HRESULT DeleteParameterBlock(D3DXHANDLE parameterBlock);
+
+    HRESULT OnLostDevice() { return S_OK; }
+    HRESULT OnResetDevice() { return S_OK; }
+
+private:
+    std::vector<std::unique_ptr<char>> mParameterBlocks;
+};
+
+HRESULT D3DXCreateEffectPool(ID3DXEffectPool** pool);
+
+/** The source file isn't read, every effect file compiles. */
+HRESULT D3DXCreateEffectFromFile(IDirect3DDevice9* device, const char* srcFile, const void* defines, void* include,
+    DWORD flags, ID3DXEffectPool* pool, ID3DXEffect** effect, ID3DXBuffer** compilationErrors);
+
+// Textures
+//
+
+HRESULT D3DXCreateTexture(IDirect3DDevice9* device, UINT width, UINT height, UINT mipLevels, DWORD usage,
+    D3DFORMAT format, D3DPOOL pool, IDirect3DTexture9** texture);
+
+HRESULT D3DXCreateTextureFromFileEx(IDirect3DDevice9* device, const char* srcFile, UINT width, UINT height,
+    UINT mipLevels, DWORD usage, D3DFORMAT format, D3DPOOL pool, DWORD filter, DWORD mipFilter, D3DCOLOR colorKey,
+    void* srcInfo, void* palette, IDirect3DTexture9** texture);
+
+// Meshes
+//
+
+struct D3DXATTRIBUTERANGE
+{
+    DWORD AttribId;
+    DWORD FaceStart;
+    DWORD FaceCount;
+    DWORD VertexStart;
+    DWORD VertexCount;
+};
+
+class ID3DXMesh : public HeadlessUnknown
+{
+public:
+    ID3DXMesh(DWORD facesCount, DWORD verticesCount, DWORD options,
+        const D3DVERTEXELEMENT9* declaration);
+    ~ID3DXMesh();
+
+    DWORD GetNumFaces() const { return mFacesCount; }
+    DWORD GetNumVertices() const { return mVerticesCount; }
+    DWORD GetNumBytesPerVertex() const { return mVertexSize; }
+    DWORD GetOptions() const { return mOptions; }
+
+    HRESULT GetVertexBuffer(IDirect3DVertexBuffer9** buffer);
+    HRESULT GetIndexBuffer(IDirect3DIndexBuffer9** buffer);
+    HRESULT LockVertexBuffer(DWORD flags, void** data) { return mVertexBuffer->Lock(0, 0, data, flags); }
+    HRESULT UnlockVertexBuffer() { return mVertexBuffer->Unlock(); }
+    HRESULT LockIndexBuffer(DWORD flags, void** data) { return mIndexBuffer->Lock(0, 0, data, flags); }
+    HRESULT UnlockIndexBuffer() { return mIndexBuffer->Unlock(); }
+    HRESULT LockAttributeBuffer(DWORD flags, DWORD** data) { *data = mAttributes.data(); return S_OK; }
+    HRESULT UnlockAttributeBuffer() { return S_OK; }
+
+    HRESULT SetAttributeTable(const D3DXATTRIBUTERANGE* table, DWORD size);
+    HRESULT GetAttributeTable(D3DXATTRIBUTERANGE* table, DWORD* size) const;
+
+private:
+    DWORD mFacesCount;
+    DWORD mVerticesCount;
+    DWORD mVertexSize;
+    DWORD mOptions;
+    IDirect3DVertexBuffer9* mVertexBuffer;
+    IDirect3DIndexBuffer9* mIndexBuffer;
+    std::vector<DWORD> mAttributes;
+    std::vector<D3DXATTRIBUTERANGE> mAttributeTable;
+};
+
+HRESULT D3DXCreateMesh(DWORD facesCount, DWORD verticesCount, DWORD options, const D3DVERTEXELEMENT9* declaration,
+    IDirect3DDevice9* device, ID3DXMesh** mesh);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <windows.h>
+
+inline HRESULT StringCbVPrintf(char* dest, size_t destSize, const char* format, va_list args)
+{
+    int length = vsnprintf(dest, destSize, format, args);
+    return (length < 0 || (size_t)length >= destSize) ? E_FAIL : S_OK;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+/*
+    Headless subset of the Win32 API used by the engine sources built into the tests. Files are read
+    into memory instead of being mapped, console output goes to stdout.
+ */
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef unsigned int UINT;
+typedef int64_t LONGLONG;
+typedef float FLOAT;
+typedef int32_t HRESULT;
+typedef void* HANDLE;
+typedef struct HWND__* HWND;
+typedef const char* LPCSTR;
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+#define S_OK                ((HRESULT)0)
+#define E_FAIL              ((HRESULT)0x80004005)
+#define E_OUTOFMEMORY       ((HRESULT)0x8007000E)
+#define E_INVALIDARG        ((HRESULT)0x80070057)
+#define SUCCEEDED(hr)       (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)          (((HRESULT)(hr)) < 0)
+
+typedef union _LARGE_INTEGER
+{
+    struct
+    {
+        DWORD LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct _SYSTEMTIME
+{
+    WORD wYear;
+    WORD wMonth;
+    WORD wDayOfWeek;
+    WORD wDay;
+    WORD wHour;
+    WORD wMinute;
+    WORD wSecond;
+    WORD wMilliseconds;
+} SYSTEMTIME;
+
+void GetSystemTime(SYSTEMTIME* systemTime);
+
+void OutputDebugStringA(LPCSTR outputString);
+#define OutputDebugString OutputDebugStringA
+
+#ifndef _MSC_VER
+#define printf_s printf
+#define vprintf_s vprintf
+#define sprintf_s snprintf
+#endif
+
+// Files
+//
+
+#define GENERIC_READ            0x80000000u
+#define FILE_SHARE_READ         0x00000001u
+#define OPEN_EXISTING           3
+#define FILE_ATTRIBUTE_NORMAL   0x00000080u
+#define PAGE_READONLY           0x02u
+#define FILE_MAP_READ           0x0004u
+#define INVALID_HANDLE_VALUE    ((HANDLE)(intptr_t)-1)
+
+HANDLE CreateFileA(LPCSTR fileName, DWORD desiredAccess, DWORD shareMode, void* securityAttributes,
+    DWORD creationDisposition, DWORD flagsAndAttributes, HANDLE templateFile);
+
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* fileSize);
+
+HANDLE CreateFileMappingA(HANDLE file, void* attributes, DWORD protect, DWORD maximumSizeHigh, DWORD maximumSizeLow,
+    LPCSTR name);
+
+void* MapViewOfFile(HANDLE fileMapping, DWORD desiredAccess, DWORD fileOffsetHigh, DWORD fileOffsetLow, size_t bytesToMap);
+
+BOOL UnmapViewOfFile(const void* baseAddress);
+
+BOOL CloseHandle(HANDLE object);
@@ -0,0 +1,4 @@
+#pragma once
+
+// The engine sources built into the tests don't use any of the windowsx.h macros.
+#include <windows.h>
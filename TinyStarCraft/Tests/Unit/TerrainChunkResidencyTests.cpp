@@ -0,0 +1,187 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "Rendering/TerrainChunkResidency.h"
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/** A chunk uploaded into its slot. */
+struct UploadedChunk
+{
+    int chunk;
+    int slot;
+    int level;                  // Level of the first requested tile.
+    Point2d tilesOrigin;
+};
+
+/** Generate a chunk's geometry from the tiles of its request, so the upload tells which request it is. */
+static void _generateChunk(int chunk, const TileStore& tiles, const Point2d& tilesOrigin, TerrainChunkResidency::ChunkGeometry* geometry)
+{
+    geometry->vertices.assign(1, (char)chunk);
+    geometry->indices.assign(1, (unsigned)tilesOrigin.x);
+    geometry->verticesCount = tilesOrigin.y;
+    geometry->facesCount = tiles.getLevel(0);
+}
+
+/** Wait for the requests, and upload the generated chunks. */
+static std::vector<UploadedChunk> _uploadChunks(TerrainChunkResidency* residency)
+{
+    residency->waitForRequests();
+
+    std::vector<UploadedChunk> uploadedChunks;
+    residency->uploadGeneratedChunks([&uploadedChunks](int chunk, int slot, const TerrainChunkResidency::ChunkGeometry& geometry) {
+        TINYSC_CHECK(geometry.vertices.size() == 1 && geometry.vertices[0] == (char)chunk);
+        uploadedChunks.push_back({ chunk, slot, geometry.facesCount, Point2d((int)geometry.indices[0], geometry.verticesCount) });
+    });
+    return uploadedChunks;
+}
+
+/** Make a store of tiles all at a level. */
+static TileStore _makeTiles(int level)
+{
+    const Size2d dimension(64, 64);
+    return TileStore(dimension, std::vector<Tile>(dimension.x * dimension.y, Tile(ETileType::Flat, level, false, 0.0f)));
+}
+
+/** Get the rectangle of tiles requested for a chunk, in a row of 4 chunks of 16 tiles. */
+static Rectd _getChunkRect(int chunk)
+{
+    return Rectd::makeRect((chunk % 4) * 16, (chunk / 4) * 16, 16, 16);
+}
+
+TINYSC_TEST(TerrainChunkResidency, ChunksAreUploadedIntoSlots)
+{
+    TerrainChunkResidency residency;
+    residency.create(16, 4, _generateChunk);
+    TINYSC_CHECK(residency.getStats().slotsCount == 4 && residency.getStats().residentChunksCount == 0);
+
+    const TileStore tiles = _makeTiles(3);
+    residency.beginFrame();
+    for (int chunk = 0; chunk < 4; ++chunk)
+        residency.requestChunk(chunk, tiles, _getChunkRect(chunk));
+    TINYSC_CHECK(residency.isRequested(2) && residency.getSlot(2) == -1 && residency.useChunk(2) == -1);
+    TINYSC_CHECK(residency.getStats().requestedChunksCount == 4);
+
+    // Every chunk is generated from a copy of its own tiles, and gets a slot of its own.
+    const std::vector<UploadedChunk> uploadedChunks = _uploadChunks(&residency);
+    TINYSC_CHECK(uploadedChunks.size() == 4);
+    std::vector<bool> isSlotUsed(4, false);
+    for (const UploadedChunk& uploaded : uploadedChunks) {
+        TINYSC_CHECK(uploaded.level == 3);
+        TINYSC_CHECK(uploaded.tilesOrigin.x == _getChunkRect(uploaded.chunk).getLeft() &&
+            uploaded.tilesOrigin.y == _getChunkRect(uploaded.chunk).getTop());
+        TINYSC_CHECK(uploaded.slot >= 0 && uploaded.slot < 4 && !isSlotUsed[uploaded.slot]);
+        TINYSC_CHECK(residency.getSlot(uploaded.chunk) == uploaded.slot && !residency.isRequested(uploaded.chunk));
+        isSlotUsed[uploaded.slot] = true;
+    }
+
+    const TerrainResidencyStats& stats = residency.getStats();
+    TINYSC_CHECK(stats.residentChunksCount == 4 && stats.requestedChunksCount == 0 && stats.generatedChunksCount == 4);
+    TINYSC_CHECK(stats.evictedChunksCount == 0 && stats.droppedChunksCount == 0);
+
+    // A resident chunk requested again keeps its slot, and gets the new geometry.
+    residency.requestChunk(1, _makeTiles(5), _getChunkRect(1));
+    const std::vector<UploadedChunk> updatedChunks = _uploadChunks(&residency);
+    TINYSC_CHECK(updatedChunks.size() == 1 && updatedChunks[0].chunk == 1 && updatedChunks[0].level == 5);
+    TINYSC_CHECK(updatedChunks.size() == 1 && updatedChunks[0].slot == residency.getSlot(1));
+    TINYSC_CHECK(residency.getStats().residentChunksCount == 4 && residency.getStats().evictedChunksCount == 0);
+
+    // Destroying the residency removes every chunk.
+    residency.destroy();
+    TINYSC_CHECK(residency.getStats().residentChunksCount == 0 && residency.getStats().slotsCount == 0);
+}
+
+TINYSC_TEST(TerrainChunkResidency, LeastRecentlyUsedChunkIsEvicted)
+{
+    TerrainChunkResidency residency;
+    residency.create(16, 3, _generateChunk);
+    const TileStore tiles = _makeTiles(1);
+
+    residency.beginFrame();
+    for (int chunk = 0; chunk < 3; ++chunk) {
+        residency.requestChunk(chunk, tiles, _getChunkRect(chunk));
+        _uploadChunks(&residency);
+    }
+
+    // Chunk 1 is the least recently used once the others are used in a later frame.
+    residency.beginFrame();
+    residency.useChunk(2);
+    residency.useChunk(0);
+    const int slot = residency.getSlot(1);
+    residency.beginFrame();
+    residency.requestChunk(5, tiles, _getChunkRect(5));
+    const std::vector<UploadedChunk> uploadedChunks = _uploadChunks(&residency);
+    TINYSC_CHECK(uploadedChunks.size() == 1 && uploadedChunks[0].chunk == 5 && uploadedChunks[0].slot == slot);
+    TINYSC_CHECK(residency.getSlot(1) == -1 && residency.getSlot(5) == slot);
+    TINYSC_CHECK(residency.getSlot(0) >= 0 && residency.getSlot(2) >= 0);
+
+    // The chunk just uploaded is the most recently used, so chunk 2 goes next.
+    residency.requestChunk(6, tiles, _getChunkRect(6));
+    _uploadChunks(&residency);
+    TINYSC_CHECK(residency.getSlot(2) == -1 && residency.getSlot(0) >= 0 && residency.getSlot(5) >= 0 && residency.getSlot(6) >= 0);
+
+    const TerrainResidencyStats& stats = residency.getStats();
+    TINYSC_CHECK(stats.residentChunksCount == 3 && stats.evictedChunksCount == 2 && stats.droppedChunksCount == 0);
+}
+
+TINYSC_TEST(TerrainChunkResidency, ChunksUsedInFrameAreNotEvicted)
+{
+    TerrainChunkResidency residency;
+    residency.create(16, 2, _generateChunk);
+    const TileStore tiles = _makeTiles(1);
+
+    residency.beginFrame();
+    residency.requestChunk(0, tiles, _getChunkRect(0));
+    residency.requestChunk(1, tiles, _getChunkRect(1));
+    _uploadChunks(&residency);
+
+    // Both resident chunks are used in this frame, so the generated chunk is dropped.
+    residency.beginFrame();
+    residency.useChunk(0);
+    residency.useChunk(1);
+    residency.requestChunk(2, tiles, _getChunkRect(2));
+    TINYSC_CHECK(_uploadChunks(&residency).empty());
+    TINYSC_CHECK(residency.getSlot(2) == -1 && !residency.isRequested(2));
+    TINYSC_CHECK(residency.getSlot(0) >= 0 && residency.getSlot(1) >= 0);
+
+    TerrainResidencyStats stats = residency.getStats();
+    TINYSC_CHECK(stats.droppedChunksCount == 1 && stats.evictedChunksCount == 0);
+    TINYSC_CHECK(stats.residentChunksCount == 2 && stats.requestedChunksCount == 0 && stats.generatedChunksCount == 3);
+
+    // It can be requested again, and takes a slot in a frame using one chunk only.
+    residency.beginFrame();
+    residency.useChunk(1);
+    residency.requestChunk(2, tiles, _getChunkRect(2));
+    const std::vector<UploadedChunk> uploadedChunks = _uploadChunks(&residency);
+    TINYSC_CHECK(uploadedChunks.size() == 1 && uploadedChunks[0].chunk == 2);
+    TINYSC_CHECK(residency.getSlot(0) == -1 && residency.getSlot(1) >= 0 && residency.getSlot(2) >= 0);
+
+    stats = residency.getStats();
+    TINYSC_CHECK(stats.droppedChunksCount == 1 && stats.evictedChunksCount == 1 && stats.residentChunksCount == 2);
+}
+
+TINYSC_TEST(TerrainChunkResidency, StaleRequestsAreDiscarded)
+{
+    TerrainChunkResidency residency;
+    residency.create(16, 4, _generateChunk);
+
+    // Only the geometry of the latest request of a chunk is uploaded.
+    residency.beginFrame();
+    for (int level = 1; level <= 5; ++level)
+        residency.requestChunk(3, _makeTiles(level), _getChunkRect(3));
+    TINYSC_CHECK(residency.getStats().requestedChunksCount == 1);
+
+    const std::vector<UploadedChunk> uploadedChunks = _uploadChunks(&residency);
+    TINYSC_CHECK(uploadedChunks.size() == 1 && uploadedChunks[0].chunk == 3 && uploadedChunks[0].level == 5);
+
+    const TerrainResidencyStats& stats = residency.getStats();
+    TINYSC_CHECK(stats.generatedChunksCount == 5 && stats.requestedChunksCount == 0 && stats.residentChunksCount == 1);
+
+    // A request made after the generation of an earlier one isn't replaced by it.
+    residency.requestChunk(3, _makeTiles(7), _getChunkRect(3));
+    residency.waitForRequests();
+    residency.requestChunk(3, _makeTiles(8), _getChunkRect(3));
+    const std::vector<UploadedChunk> latestChunks = _uploadChunks(&residency);
+    TINYSC_CHECK(latestChunks.size() == 1 && latestChunks[0].level == 8);
+    TINYSC_CHECK(residency.getStats().requestedChunksCount == 0 && residency.getStats().residentChunksCount == 1);
+}
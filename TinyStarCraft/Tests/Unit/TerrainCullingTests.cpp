@@ -0,0 +1,153 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainModifier.h"
+#include "Rendering/TerrainQuadTree.h"
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/** Get the visible chunks of the terrain in a culling mode, sorted. */
+static std::vector<int> _gatherVisibleChunks(Terrain* terrain, Camera* camera, ETerrainCullingMode cullingMode)
+{
+    terrain->setCullingMode(cullingMode);
+    terrain->drawTerrain(camera);
+
+    std::vector<int> chunks = terrain->getVisibleChunks();
+    std::sort(chunks.begin(), chunks.end());
+    return chunks;
+}
+
+TINYSC_TEST(TerrainCulling, IsometricMatchesColumnsInFrustum)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(41);
+
+    // Neither side is a power of 2, nor a multiple of the other.
+    const Size2d dimension(200, 136);
+    Terrain terrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension));
+    TerrainModifier modifier(&terrain);
+    sculptRandomly(&modifier, dimension, 2000, &random);
+
+    const TerrainQuadTree& quadTree = terrain.getTerrainQuadTree();
+    const AABB terrainAABB = quadTree.getAABB(0, Point2d::ZERO());
+    const Size2d chunksDimension(dimension.x / Terrain::CHUNK_DIMENSION, dimension.y / Terrain::CHUNK_DIMENSION);
+
+    size_t visibleChunksCount = 0, extraChunksCount = 0;
+    for (int iCamera = 0; iCamera < 500; ++iCamera) {
+        Camera camera = makeRandomCamera(dimension, &random);
+        const ViewFrustum& viewFrustum = camera.getViewFrustum();
+
+        const std::vector<int> isometricChunks = _gatherVisibleChunks(&terrain, &camera, ETerrainCullingMode::eIsometric);
+        const std::vector<int> quadTreeChunks = _gatherVisibleChunks(&terrain, &camera, ETerrainCullingMode::eQuadTree);
+
+        // A fresh gather from the quad tree's leaves must be the same as the quad tree mode.
+        std::vector<int> leaves;
+        quadTree.gatherVisibleNodes(viewFrustum, quadTree.getDepth(), &leaves);
+        std::sort(leaves.begin(), leaves.end());
+        TINYSC_CHECK(leaves == quadTreeChunks);
+
+        // The isometric mode never drops a chunk of the quad tree mode.
+        TINYSC_CHECK(std::includes(isometricChunks.begin(), isometricChunks.end(), quadTreeChunks.begin(), quadTreeChunks.end()));
+
+        // Every chunk is treated as high as the whole terrain. Chunks whose columns are in the
+        // frustum are all gathered, and the others only within the rounding margin.
+        for (int y = 0; y < chunksDimension.y; ++y) {
+            for (int x = 0; x < chunksDimension.x; ++x) {
+                const AABB chunkAABB = makeChunkAABB(Point2d(x, y), 0, 0);
+                const D3DXVECTOR3 margin(1.0f, 0.0f, 1.0f);
+                const AABB column(D3DXVECTOR3(chunkAABB.getMin().x, terrainAABB.getMin().y, chunkAABB.getMin().z),
+                    D3DXVECTOR3(chunkAABB.getMax().x, terrainAABB.getMax().y, chunkAABB.getMax().z));
+                const AABB grownColumn(column.getMin() - margin, column.getMax() + margin);
+
+                const bool isGathered = std::binary_search(isometricChunks.begin(), isometricChunks.end(), y * chunksDimension.x + x);
+                if (viewFrustum.hasIntersection(column) != ViewFrustum::AABB_OUTSIDE)
+                    TINYSC_CHECK(isGathered);
+                else if (isGathered)
+                    TINYSC_CHECK(viewFrustum.hasIntersection(grownColumn) != ViewFrustum::AABB_OUTSIDE);
+            }
+        }
+
+        visibleChunksCount += quadTreeChunks.size();
+        extraChunksCount += isometricChunks.size() - quadTreeChunks.size();
+    }
+
+    // Lower chunks are only drawn near the top and bottom edges of the view.
+    TINYSC_CHECK(visibleChunksCount > 10000);
+    TINYSC_CHECK(extraChunksCount * 10 < visibleChunksCount);
+}
+
+TINYSC_TEST(TerrainCulling, CachedChunksMatchFreshCull)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(13);
+
+    // The reference terrain gets the same edits, and culls again for every draw.
+    const Size2d dimension(128, 96);
+    Terrain terrain(renderSystem.get()), referenceTerrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension) && referenceTerrain.initialize(dimension));
+    TerrainModifier modifier(&terrain), referenceModifier(&referenceTerrain);
+
+    ETerrainCullingMode cullingMode = terrain.getCullingMode();
+    Camera camera = makeRandomCamera(dimension, &random);
+    std::vector<int> lastChunks;
+    size_t changesCount = 0;
+    for (int step = 0; step < 1000; ++step) {
+        // Scroll the view mostly, by less than a tile too, or draw again from the same place.
+        const int action = random() % 10;
+        if (action < 4) {
+            const float distance = (random() % 2) ? Tile::SIZE * 0.25f : Tile::SIZE * 4.0f;
+            const D3DXVECTOR3 offset((float)((int)(random() % 3) - 1), 0.0f, (float)((int)(random() % 3) - 1));
+            camera.setPosition(camera.getPosition() + offset * distance);
+        }
+        else if (action == 4) {
+            camera = makeRandomCamera(dimension, &random);
+        }
+        else if (action == 5) {
+            camera.setViewportSize(camera.getViewportSize() * ((random() % 2) ? 1.25f : 0.8f));
+        }
+        else if (action == 6) {
+            cullingMode = (cullingMode == ETerrainCullingMode::eQuadTree) ? ETerrainCullingMode::eIsometric : ETerrainCullingMode::eQuadTree;
+            terrain.setCullingMode(cullingMode);
+        }
+        else if (action == 7) {
+            // Raise or lower a hill, which changes the AABBs of the chunks under it.
+            const Point2d location(random() % dimension.x, random() % dimension.y);
+            const bool isHightened = (random() % 2) != 0;
+            for (int i = 0; i < 4; ++i) {
+                isHightened ? modifier.hightenGround(location) : modifier.lowerGround(location);
+                isHightened ? referenceModifier.hightenGround(location) : referenceModifier.lowerGround(location);
+            }
+            modifier.updateTerrain();
+            referenceModifier.updateTerrain();
+        }
+
+        // The water is drawn with the same camera after the terrain in some frames.
+        terrain.drawTerrain(&camera);
+        if (action % 2)
+            terrain.drawWater(&camera);
+        std::vector<int> chunks = terrain.getVisibleChunks();
+        std::sort(chunks.begin(), chunks.end());
+
+        TINYSC_CHECK(chunks == _gatherVisibleChunks(&referenceTerrain, &camera, cullingMode));
+        changesCount += (chunks != lastChunks) ? 1 : 0;
+        lastChunks = chunks;
+    }
+
+    // Many steps change the visible chunks, the others are drawn from the cache.
+    TINYSC_CHECK(changesCount > 200 && changesCount < 800);
+
+    // Switching the culling mode culls again, even if the camera doesn't move. The isometric mode
+    // draws more chunks near the edges of some views.
+    bool hasExtraChunks = false;
+    for (int iCamera = 0; iCamera < 100 && !hasExtraChunks; ++iCamera) {
+        camera = makeRandomCamera(dimension, &random);
+        const std::vector<int> quadTreeChunks = _gatherVisibleChunks(&terrain, &camera, ETerrainCullingMode::eQuadTree);
+        const std::vector<int> isometricChunks = _gatherVisibleChunks(&terrain, &camera, ETerrainCullingMode::eIsometric);
+        TINYSC_CHECK(isometricChunks == _gatherVisibleChunks(&referenceTerrain, &camera, ETerrainCullingMode::eIsometric));
+        hasExtraChunks = isometricChunks != quadTreeChunks;
+    }
+    TINYSC_CHECK(hasExtraChunks);
+}
@@ -0,0 +1,122 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainModifier.h"
+#include "Rendering/TerrainTileInstances.h"
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/** A run of adjacent slots, which is drawn by one call. */
+struct SlotRun
+{
+    int firstSlot;
+    int slotsCount;
+};
+
+/**
+  	Get the runs of adjacent slots of the visible chunks. Slots are numbered in the Morton order of
+    the chunks, like the terrain does.
+ */
+static std::vector<SlotRun> _gatherSlotRuns(const Size2d& dimension, const std::vector<int>& visibleChunks)
+{
+    const int chunksDimensionX = dimension.x / Terrain::CHUNK_DIMENSION;
+    const int chunksCount = chunksDimensionX * (dimension.y / Terrain::CHUNK_DIMENSION);
+    std::vector<std::pair<uint32_t, int>> codes;
+    for (int chunk = 0; chunk < chunksCount; ++chunk)
+        codes.push_back(std::make_pair(Math::mortonCode(chunk % chunksDimensionX, chunk / chunksDimensionX), chunk));
+    std::sort(codes.begin(), codes.end());
+
+    std::vector<int> chunkSlots(chunksCount);
+    for (int slot = 0; slot < chunksCount; ++slot)
+        chunkSlots[codes[slot].second] = slot;
+
+    std::vector<int> slots;
+    for (int chunk : visibleChunks)
+        slots.push_back(chunkSlots[chunk]);
+    std::sort(slots.begin(), slots.end());
+
+    std::vector<SlotRun> runs;
+    for (int slot : slots) {
+        if (!runs.empty() && runs.back().firstSlot + runs.back().slotsCount == slot)
+            ++runs.back().slotsCount;
+        else
+            runs.push_back({ slot, 1 });
+    }
+    return runs;
+}
+
+/** Check the draw calls and the statistics of a terrain drawn with a camera match its visible chunks. */
+static void _checkDrawCalls(Terrain* terrain, Camera* camera, IDirect3DDevice9* device, size_t* mergedChunksCount)
+{
+    device->clearDrawCalls();
+    terrain->drawTerrain(camera);
+
+    const std::vector<int>& visibleChunks = terrain->getVisibleChunks();
+    const std::vector<SlotRun> runs = _gatherSlotRuns(terrain->getDimension(), visibleChunks);
+    const std::vector<HeadlessDrawCall>& drawCalls = device->getDrawCalls();
+    const TerrainDrawStats& stats = terrain->getDrawStats();
+    TINYSC_CHECK(stats.visibleChunksCount == (int)visibleChunks.size());
+    TINYSC_CHECK(stats.drawCallsCount == (int)drawCalls.size() && drawCalls.size() == runs.size());
+    TINYSC_CHECK(stats.trianglesCount == (int)visibleChunks.size() * Terrain::TILES_COUNT_PER_CHUNK * 2);
+    if (drawCalls.size() != runs.size())
+        return;
+
+    // Every tile is a quad, so the chunks fill their slots and a run is one range of the buffers.
+    const bool isInstanced = terrain->getRenderingMode() == ETerrainRenderingMode::eInstanced;
+    for (size_t i = 0; i < runs.size(); ++i) {
+        const HeadlessDrawCall& drawCall = drawCalls[i];
+        const UINT tilesCount = runs[i].slotsCount * Terrain::TILES_COUNT_PER_CHUNK;
+        const UINT firstTile = runs[i].firstSlot * Terrain::TILES_COUNT_PER_CHUNK;
+        if (isInstanced) {
+            TINYSC_CHECK(drawCall.primitivesCount == 2 && drawCall.startIndex == 0 && drawCall.verticesCount == 4);
+            TINYSC_CHECK(drawCall.streamFrequencies[0] == (D3DSTREAMSOURCE_INDEXEDDATA | tilesCount));
+            TINYSC_CHECK(drawCall.streamOffsets[1] == firstTile * sizeof(TerrainTileInstances::Instance));
+        }
+        else {
+            TINYSC_CHECK(drawCall.primitivesCount == tilesCount * 2 && drawCall.startIndex == firstTile * 6);
+            TINYSC_CHECK(drawCall.minVertexIndex == firstTile * 4 && drawCall.verticesCount == tilesCount * 4);
+        }
+
+        *mergedChunksCount += runs[i].slotsCount - 1;
+    }
+}
+
+TINYSC_TEST(TerrainDraw, DrawCallsMatchVisibleChunks)
+{
+    TestRenderSystem renderSystem;
+    IDirect3DDevice9* device = renderSystem.getDevice();
+    std::mt19937 random(17);
+
+    // Neither side is a power of 2, so the Morton order of the chunks has gaps.
+    const Size2d dimension(96, 72);
+    Terrain terrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension));
+    TerrainModifier modifier(&terrain);
+    sculptRandomly(&modifier, dimension, 1000, &random);
+
+    const ETerrainRenderingMode renderingModes[] = { ETerrainRenderingMode::eMesh, ETerrainRenderingMode::eInstanced };
+    for (ETerrainRenderingMode renderingMode : renderingModes) {
+        TINYSC_CHECK(terrain.setRenderingMode(renderingMode));
+
+        size_t visibleChunksCount = 0, mergedChunksCount = 0;
+        for (int iCamera = 0; iCamera < 200; ++iCamera) {
+            Camera camera = makeRandomCamera(dimension, &random);
+            _checkDrawCalls(&terrain, &camera, device, &mergedChunksCount);
+            visibleChunksCount += terrain.getVisibleChunks().size();
+        }
+
+        // Most visible chunks are drawn together with the chunks of adjacent slots.
+        TINYSC_CHECK(visibleChunksCount > 2000);
+        TINYSC_CHECK(mergedChunksCount * 2 > visibleChunksCount);
+
+        // The whole terrain is drawn by one call.
+        Camera camera = makeCameraLookingAt(Point2d(dimension.x / 2, dimension.y / 2));
+        const float viewportSize = 2.0f * Tile::SIZE * (dimension.x + dimension.y);
+        camera.setViewportSize(Size2f(viewportSize, viewportSize));
+        _checkDrawCalls(&terrain, &camera, device, &mergedChunksCount);
+        TINYSC_CHECK(terrain.getDrawStats().drawCallsCount == 1);
+        TINYSC_CHECK(terrain.getDrawStats().visibleChunksCount * Terrain::TILES_COUNT_PER_CHUNK == dimension.x * dimension.y);
+    }
+}
@@ -0,0 +1,158 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainEditJournal.h"
+#include "Rendering/TerrainModifier.h"
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/** Determine if two stores have the same tiles. */
+static bool _haveSameTiles(const TileStore& a, const TileStore& b)
+{
+    for (int i = 0; i < (int)a.size(); ++i) {
+        const TileStore::PackedTile tileA = a.getPackedTile(i);
+        const TileStore::PackedTile tileB = b.getPackedTile(i);
+        if (tileA.typeAndFlags != tileB.typeAndFlags || tileA.level != tileB.level || tileA.waterAltitude != tileB.waterAltitude)
+            return false;
+    }
+    return true;
+}
+
+/** Change the level of the tiles in a range of indices and record them in the journal. */
+static void _raiseTiles(TerrainEditJournal* journal, TileStore* tiles, int firstTile, int tilesCount)
+{
+    for (int i = firstTile; i < firstTile + tilesCount; ++i) {
+        journal->recordTile(i, tiles->getPackedTile(i));
+        tiles->setLevel(i, tiles->getLevel(i) + 1);
+    }
+}
+
+TINYSC_TEST(TerrainEditJournal, TilesAreRecordedOnce)
+{
+    const Size2d dimension(100, 100);
+    TileStore tiles(dimension, std::vector<Tile>(dimension.x * dimension.y));
+    const TileStore initialTiles = tiles;
+
+    // A tile written over and over is recorded once, with its value before the first write. Tiles
+    // on both sides of a word of the bitmap are recorded separately.
+    TerrainEditJournal journal;
+    const int tileIndices[] = { 5, 63, 64, 9999 };
+    for (int i = 0; i < 100000; ++i) {
+        for (int tileIndex : tileIndices) {
+            journal.recordTile(tileIndex, tiles.getPackedTile(tileIndex));
+            tiles.setLevel(tileIndex, i % 7 + 1);
+        }
+    }
+    TINYSC_CHECK(journal.getRecordedTilesCount() == 4);
+
+    TINYSC_CHECK(journal.commit(tiles));
+    TINYSC_CHECK(journal.getRecordedTilesCount() == 0);
+    const TileStore editedTiles = tiles;
+
+    Rectd rect;
+    TINYSC_CHECK(journal.undo(&tiles, &rect));
+    TINYSC_CHECK(_haveSameTiles(tiles, initialTiles));
+    TINYSC_CHECK(rect.getLeft() == 5 && rect.getTop() == 0 && rect.getRight() == 100 && rect.getBottom() == 100);
+    TINYSC_CHECK(journal.redo(&tiles, &rect));
+    TINYSC_CHECK(_haveSameTiles(tiles, editedTiles));
+
+    // The tiles are recorded again by the next edit.
+    _raiseTiles(&journal, &tiles, 5, 1);
+    _raiseTiles(&journal, &tiles, 5, 1);
+    TINYSC_CHECK(journal.getRecordedTilesCount() == 1);
+    TINYSC_CHECK(journal.commit(tiles));
+    TINYSC_CHECK(journal.undo(&tiles, &rect));
+    TINYSC_CHECK(_haveSameTiles(tiles, editedTiles));
+
+    // Tiles written back to their old value aren't an edit.
+    journal.recordTile(7, tiles.getPackedTile(7));
+    TINYSC_CHECK(!journal.commit(tiles));
+    TINYSC_CHECK(journal.canRedo());
+}
+
+TINYSC_TEST(TerrainEditJournal, LatestEditIsKeptOverBudget)
+{
+    const Size2d dimension(64, 64);
+    TileStore tiles(dimension, std::vector<Tile>(dimension.x * dimension.y));
+    const TileStore initialTiles = tiles;
+
+    // An edit larger than the budget on its own can still be undone.
+    TerrainEditJournal journal;
+    journal.setBudget(1);
+    _raiseTiles(&journal, &tiles, 0, 100);
+    TINYSC_CHECK(journal.commit(tiles));
+    TINYSC_CHECK(journal.canUndo() && journal.getMemorySize() > journal.getBudget());
+    const TileStore firstEditTiles = tiles;
+
+    // The next edit drops it.
+    _raiseTiles(&journal, &tiles, 50, 100);
+    TINYSC_CHECK(journal.commit(tiles));
+    journal.setBudget(0);
+
+    Rectd rect;
+    TINYSC_CHECK(journal.undo(&tiles, &rect));
+    TINYSC_CHECK(_haveSameTiles(tiles, firstEditTiles));
+    TINYSC_CHECK(!journal.undo(&tiles, &rect));
+
+    // Edits within the budget are all kept.
+    journal.clear();
+    journal.setBudget(TerrainEditJournal::DEFAULT_BUDGET);
+    tiles = initialTiles;
+    for (int i = 0; i < 10; ++i) {
+        _raiseTiles(&journal, &tiles, i * 100, 100);
+        TINYSC_CHECK(journal.commit(tiles));
+    }
+    for (int i = 0; i < 10; ++i)
+        TINYSC_CHECK(journal.undo(&tiles, &rect));
+    TINYSC_CHECK(_haveSameTiles(tiles, initialTiles));
+}
+
+TINYSC_TEST(TerrainEditJournal, UndoRedoMatchSnapshots)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(31);
+
+    const Size2d dimension(48, 40);
+    Terrain terrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension));
+    TerrainModifier modifier(&terrain);
+
+    // Tiles after each edit, and the index of the current one. Undone edits follow it.
+    std::vector<TileStore> snapshots(1, terrain.getTilesData());
+    size_t current = 0;
+
+    for (int step = 0; step < 1500; ++step) {
+        const int action = random() % 10;
+        if (action < 2) {
+            TINYSC_CHECK(modifier.undo() == (current > 0));
+            current = (current > 0) ? current - 1 : 0;
+        }
+        else if (action < 4) {
+            TINYSC_CHECK(modifier.redo() == (current + 1 < snapshots.size()));
+            current = Math::min(current + 1, snapshots.size() - 1);
+        }
+        else {
+            // Single operations and groups of them.
+            const int operationsCount = (action < 7) ? 1 : 1 + random() % 8;
+            if (operationsCount > 1)
+                modifier.beginEdit();
+            std::mt19937 operationsRandom(random());
+            sculptRandomly(&modifier, dimension, operationsCount, &operationsRandom);
+            if (operationsCount > 1)
+                modifier.commitEdit();
+
+            // An edit which changes nothing isn't recorded, and keeps the undone edits.
+            if (!_haveSameTiles(terrain.getTilesData(), snapshots[current])) {
+                snapshots.resize(current + 1);
+                snapshots.push_back(terrain.getTilesData());
+                ++current;
+            }
+        }
+
+        TINYSC_CHECK(_haveSameTiles(terrain.getTilesData(), snapshots[current]));
+    }
+
+    TINYSC_CHECK(snapshots.size() > 100);
+}
@@ -0,0 +1,228 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainModifier.h"
+#include "Utilities/Ray.h"
+
+#include <random>
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/** Make a sculpted terrain of the dimension. */
+static void _sculptTerrain(Terrain* terrain, const Size2d& dimension, std::mt19937* random)
+{
+    TINYSC_CHECK(terrain->initialize(dimension));
+    TerrainModifier modifier(terrain);
+    sculptRandomly(&modifier, dimension, dimension.x * dimension.y / 2, random);
+    modifier.updateTerrain();
+}
+
+/** Make a random position on the ground, around the terrain of the dimension by a margin of tiles. */
+static D3DXVECTOR2 _makeRandomPosition(const Size2d& dimension, float margin, std::mt19937* random)
+{
+    // Grid x goes along world z axis and grid y goes along world x axis, tile centers are on integers.
+    std::uniform_real_distribution<float> x((-0.5f - margin) * Tile::SIZE, (dimension.y - 0.5f + margin) * Tile::SIZE);
+    std::uniform_real_distribution<float> z((-0.5f - margin) * Tile::SIZE, (dimension.x - 0.5f + margin) * Tile::SIZE);
+    const float positionX = x(*random);
+    return D3DXVECTOR2(positionX, z(*random));
+}
+
+/** Get the location of the tile under a world space position on the ground. */
+static Point2d _getTileLocation(float x, float z)
+{
+    return Point2d((int)std::floor(z / Tile::SIZE + 0.5f), (int)std::floor(x / Tile::SIZE + 0.5f));
+}
+
+/**
+  	Calculate the height of a tile at a world space position in it, by interpolating the vertices
+    of the face which contains the position.
+ */
+static float _calcReferenceHeight(const Terrain& terrain, const Point2d& location, float x, float z)
+{
+    const TileStore& tiles = terrain.getTilesData();
+    const int tileIndex = location.y * tiles.getDimension().x + location.x;
+    const TileShape& shape = TileShape::SHAPES()[tiles.getType(tileIndex)];
+
+    // Position in the tile, from 0 to 1.
+    const float u = x / Tile::SIZE - location.y + 0.5f;
+    const float v = z / Tile::SIZE - location.x + 0.5f;
+
+    float bestHeight = 0.0f, bestOutside = FLT_MAX;
+    for (int face = 0; face < 2; ++face) {
+        float us[3], vs[3], heights[3];
+        for (int i = 0; i < 3; ++i) {
+            const int vertex = shape.indices[face * 3 + i];
+            us[i] = (vertex & 2) ? 1.0f : 0.0f;
+            vs[i] = (vertex & 1) ? 1.0f : 0.0f;
+            heights[i] = (tiles.getLevel(tileIndex) + shape.vertexLevels[vertex]) * Tile::HEIGHT_PER_LEVEL;
+        }
+
+        // Barycentric coordinates of the position, the face which it is the least outside of contains it.
+        const float area = (us[1] - us[0]) * (vs[2] - vs[0]) - (us[2] - us[0]) * (vs[1] - vs[0]);
+        const float b1 = ((u - us[0]) * (vs[2] - vs[0]) - (us[2] - us[0]) * (v - vs[0])) / area;
+        const float b2 = ((us[1] - us[0]) * (v - vs[0]) - (u - us[0]) * (vs[1] - vs[0])) / area;
+        const float b0 = 1.0f - b1 - b2;
+        const float outside = -Math::min(b0, Math::min(b1, b2));
+        if (outside < bestOutside) {
+            bestOutside = outside;
+            bestHeight = b0 * heights[0] + b1 * heights[1] + b2 * heights[2];
+        }
+    }
+
+    return bestHeight;
+}
+
+TINYSC_TEST(TerrainHeight, BatchMatchesHeightAt)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(7);
+
+    const Size2d dimension(40, 24);
+    Terrain terrain(renderSystem.get());
+    _sculptTerrain(&terrain, dimension, &random);
+
+    // Counts which aren't a multiple of 4 too, and positions out of the terrain.
+    const size_t counts[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 31, 1001 };
+    for (size_t count : counts) {
+        std::vector<float> x(count), z(count), heights(count + 1, -12345.0f);
+        for (size_t i = 0; i < count; ++i) {
+            const D3DXVECTOR2 position = _makeRandomPosition(dimension, (i % 3 == 0) ? 2.0f : 0.0f, &random);
+            x[i] = position.x;
+            z[i] = position.y;
+        }
+
+        terrain.getHeightsAt(x.data(), z.data(), count, heights.data());
+        for (size_t i = 0; i < count; ++i)
+            TINYSC_CHECK(fabsf(heights[i] - terrain.getHeightAt(x[i], z[i])) <= 1e-3f);
+
+        // Nothing is written past the positions.
+        TINYSC_CHECK(heights[count] == -12345.0f);
+    }
+}
+
+TINYSC_TEST(TerrainHeight, HeightsMatchRaycastHits)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(8);
+
+    const Size2d dimension(32, 32);
+    Terrain terrain(renderSystem.get());
+    _sculptTerrain(&terrain, dimension, &random);
+
+    const float top = 1000.0f * Tile::HEIGHT_PER_LEVEL;
+    for (int i = 0; i < 5000; ++i) {
+        const D3DXVECTOR2 position = _makeRandomPosition(dimension, 0.0f, &random);
+
+        // A vertical ray hits the surface of the tile under it.
+        TerrainRaycastHit hit;
+        TINYSC_CHECK(terrain.raycast(Ray(D3DXVECTOR3(position.x, top, position.y), D3DXVECTOR3(0.0f, -1.0f, 0.0f)), &hit));
+        const Point2d location = _getTileLocation(position.x, position.y);
+        TINYSC_CHECK(hit.tileLocation.x == location.x && hit.tileLocation.y == location.y);
+        TINYSC_CHECK(fabsf(hit.hitPosition.y - terrain.getHeightAt(position.x, position.y)) <= 1e-2f);
+
+        // The normal is perpendicular to the surface around the position, on the same face of the tile.
+        const D3DXVECTOR3 normal = terrain.getNormalAt(position.x, position.y);
+        TINYSC_CHECK(fabsf(::D3DXVec3Length(&normal) - 1.0f) <= 1e-4f && normal.y > 0.0f);
+        const float offsets[][2] = { { 0.5f, 0.0f }, { 0.0f, 0.5f }, { -0.5f, 0.0f }, { 0.0f, -0.5f } };
+        for (const float* offset : offsets) {
+            const float x = position.x + offset[0], z = position.y + offset[1];
+            const Point2d otherLocation = _getTileLocation(x, z);
+            if (terrain.getNormalAt(x, z) != normal || otherLocation.x != location.x || otherLocation.y != location.y)
+                continue;
+
+            const D3DXVECTOR3 tangent(offset[0], terrain.getHeightAt(x, z) - hit.hitPosition.y, offset[1]);
+            TINYSC_CHECK(fabsf(::D3DXVec3Dot(&normal, &tangent)) <= 1e-2f);
+        }
+    }
+}
+
+TINYSC_TEST(TerrainHeight, HeightsMatchTileFaces)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(9);
+
+    const Size2d dimension(48, 32);
+    Terrain terrain(renderSystem.get());
+    _sculptTerrain(&terrain, dimension, &random);
+    const TileStore& tiles = terrain.getTilesData();
+
+    // Positions on both diagonals of every tile, which are the split lines of the tile shapes, and
+    // random positions in the tiles.
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    int shapesCount[15] = {};
+    for (int y = 0; y < dimension.y; ++y) {
+        for (int x = 0; x < dimension.x; ++x) {
+            ++shapesCount[tiles.getType(y * dimension.x + x)];
+
+            std::vector<D3DXVECTOR2> positions;
+            for (int i = 1; i < 8; ++i) {
+                positions.push_back(D3DXVECTOR2(i / 8.0f, i / 8.0f));
+                positions.push_back(D3DXVECTOR2(i / 8.0f, 1.0f - i / 8.0f));
+            }
+            for (int i = 0; i < 8; ++i)
+                positions.push_back(D3DXVECTOR2(unit(random), unit(random)));
+
+            std::vector<float> positionsX, positionsZ;
+            for (const D3DXVECTOR2& position : positions) {
+                positionsX.push_back((y - 0.5f + position.x) * Tile::SIZE);
+                positionsZ.push_back((x - 0.5f + position.y) * Tile::SIZE);
+            }
+
+            std::vector<float> heights(positions.size());
+            terrain.getHeightsAt(positionsX.data(), positionsZ.data(), positions.size(), heights.data());
+            for (size_t i = 0; i < positions.size(); ++i) {
+                const float reference = _calcReferenceHeight(terrain, Point2d(x, y), positionsX[i], positionsZ[i]);
+                TINYSC_CHECK(fabsf(terrain.getHeightAt(positionsX[i], positionsZ[i]) - reference) <= 1e-2f);
+                TINYSC_CHECK(fabsf(heights[i] - reference) <= 1e-2f);
+            }
+        }
+    }
+
+    // Flat tiles and the other shapes are all tested.
+    for (int type = 0; type < 13; ++type)
+        TINYSC_CHECK(shapesCount[type] > 0);
+}
+
+TINYSC_TEST(TerrainHeight, PositionsOutOfTerrainAreClamped)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(10);
+
+    const Size2d dimension(24, 40);
+    Terrain terrain(renderSystem.get());
+    _sculptTerrain(&terrain, dimension, &random);
+
+    const float minX = -0.5f * Tile::SIZE, maxX = (dimension.y - 0.5f) * Tile::SIZE;
+    const float minZ = -0.5f * Tile::SIZE, maxZ = (dimension.x - 0.5f) * Tile::SIZE;
+    std::vector<float> x, z, clampedX, clampedZ;
+    for (int i = 0; i < 2000; ++i) {
+        const D3DXVECTOR2 position = _makeRandomPosition(dimension, 20.0f, &random);
+        x.push_back(position.x);
+        z.push_back(position.y);
+    }
+
+    // Far positions, and positions on the borders.
+    const float farPositions[][2] = { { -1e6f, -1e6f }, { 1e6f, 1e6f }, { -1e6f, 1e6f }, { 1e6f, 0.0f },
+        { minX, minZ }, { maxX, maxZ }, { maxX, minZ }, { minX, maxZ } };
+    for (const float* position : farPositions) {
+        x.push_back(position[0]);
+        z.push_back(position[1]);
+    }
+
+    // Clamp the positions to the borders of the terrain, the far borders belong to the last tiles.
+    for (size_t i = 0; i < x.size(); ++i) {
+        clampedX.push_back(Math::clamp(x[i], minX, maxX - 1e-3f));
+        clampedZ.push_back(Math::clamp(z[i], minZ, maxZ - 1e-3f));
+    }
+
+    std::vector<float> heights(x.size());
+    terrain.getHeightsAt(x.data(), z.data(), x.size(), heights.data());
+    for (size_t i = 0; i < x.size(); ++i) {
+        const float clampedHeight = terrain.getHeightAt(clampedX[i], clampedZ[i]);
+        TINYSC_CHECK(fabsf(terrain.getHeightAt(x[i], z[i]) - clampedHeight) <= 1e-2f);
+        TINYSC_CHECK(fabsf(heights[i] - clampedHeight) <= 1e-2f);
+        TINYSC_CHECK(terrain.getNormalAt(x[i], z[i]) == terrain.getNormalAt(clampedX[i], clampedZ[i]));
+    }
+}
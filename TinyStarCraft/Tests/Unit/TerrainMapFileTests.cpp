@@ -0,0 +1,132 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainMapFile.h"
+#include "Rendering/TerrainModifier.h"
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+static const char* MAP_FILE_NAME = "TerrainMapFileTests.map";
+
+/** Read a whole file. */
+static std::vector<char> _readFile(const char* fileName)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+/** Write a whole file. */
+static void _writeFile(const char* fileName, const std::vector<char>& data)
+{
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+}
+
+/** Write a sculpted terrain with its quad tree to the map file and get the file's content. */
+static std::vector<char> _writeSculptedMap(TestRenderSystem* renderSystem, const Size2d& dimension, Terrain* terrain)
+{
+    std::mt19937 random(21);
+    TINYSC_CHECK(terrain->initialize(dimension));
+    TerrainModifier modifier(terrain);
+    sculptRandomly(&modifier, dimension, 300, &random);
+
+    TINYSC_CHECK(TerrainMapFile::write(MAP_FILE_NAME, *terrain, true));
+    return _readFile(MAP_FILE_NAME);
+}
+
+TINYSC_TEST(TerrainMapFile, WriteAndLoad)
+{
+    TestRenderSystem renderSystem;
+    const Size2d dimension(40, 24);
+    Terrain terrain(renderSystem.get());
+    _writeSculptedMap(&renderSystem, dimension, &terrain);
+
+    TerrainMapFile mapFile;
+    TINYSC_CHECK(mapFile.open(MAP_FILE_NAME));
+    TINYSC_CHECK(mapFile.getDimension().x == dimension.x && mapFile.getDimension().y == dimension.y);
+    TINYSC_CHECK(mapFile.hasQuadTree());
+
+    TileStore tiles;
+    TINYSC_CHECK(mapFile.decodeTiles(&tiles));
+    TINYSC_CHECK(tiles.size() == terrain.getTilesData().size());
+    for (int i = 0; i < (int)tiles.size(); ++i) {
+        const TileStore::PackedTile a = tiles.getPackedTile(i);
+        const TileStore::PackedTile b = terrain.getTilesData().getPackedTile(i);
+        TINYSC_CHECK(a.typeAndFlags == b.typeAndFlags && a.level == b.level && a.waterAltitude == b.waterAltitude);
+    }
+
+    Terrain loadedTerrain(renderSystem.get());
+    TINYSC_CHECK(loadedTerrain.initialize(mapFile));
+    TINYSC_CHECK(haveSameAABBs(loadedTerrain.getTerrainQuadTree(), terrain.getTerrainQuadTree()));
+}
+
+TINYSC_TEST(TerrainMapFile, RejectsCorruptHeaders)
+{
+    TestRenderSystem renderSystem;
+    Terrain terrain(renderSystem.get());
+    const std::vector<char> data = _writeSculptedMap(&renderSystem, Size2d(32, 32), &terrain);
+
+    // Each corruption of the header must be rejected when the file is opened.
+    const std::function<void(TerrainMapFile::Header*)> corruptions[] = {
+        [](TerrainMapFile::Header* header) { header->magic[0] = 'X'; },
+        [](TerrainMapFile::Header* header) { header->version = TerrainMapFile::VERSION + 1; },
+        [](TerrainMapFile::Header* header) { header->width = 0; },
+        [](TerrainMapFile::Header* header) { header->height = 12; },
+        // The tiles would wrap a 32-bit size.
+        [](TerrainMapFile::Header* header) { header->width = 0x7ffffff8; header->height = 0x7ffffff8; },
+        // The offset plus the size of the tiles would wrap a 32-bit size.
+        [](TerrainMapFile::Header* header) { header->tilesOffset = 0xfffffff0u; },
+        [](TerrainMapFile::Header* header) { header->tilesOffset = 8; },
+        // The size of the quad tree section would wrap a 32-bit size.
+        [](TerrainMapFile::Header* header) { header->quadTreeNodesCount = 0x40000000u; },
+        [](TerrainMapFile::Header* header) { header->quadTreeOffset = 0xfffffff0u; },
+        [](TerrainMapFile::Header* header) { header->quadTreeOffset += 4; },
+    };
+
+    for (const auto& corrupt : corruptions) {
+        std::vector<char> corruptData = data;
+        corrupt((TerrainMapFile::Header*)corruptData.data());
+        _writeFile(MAP_FILE_NAME, corruptData);
+
+        TerrainMapFile mapFile;
+        TINYSC_CHECK(!mapFile.open(MAP_FILE_NAME));
+        TINYSC_CHECK(!mapFile.isOpen());
+    }
+
+    // Truncated files.
+    const size_t sizes[] = { 0, sizeof(TerrainMapFile::Header) - 1, sizeof(TerrainMapFile::Header), data.size() - 1 };
+    for (size_t size : sizes) {
+        _writeFile(MAP_FILE_NAME, std::vector<char>(data.begin(), data.begin() + size));
+        TerrainMapFile mapFile;
+        TINYSC_CHECK(!mapFile.open(MAP_FILE_NAME));
+    }
+}
+
+TINYSC_TEST(TerrainMapFile, RejectsInvalidTiles)
+{
+    TestRenderSystem renderSystem;
+    Terrain terrain(renderSystem.get());
+    const std::vector<char> data = _writeSculptedMap(&renderSystem, Size2d(32, 32), &terrain);
+    const TerrainMapFile::Header* header = (const TerrainMapFile::Header*)data.data();
+
+    // An unknown type, and an unknown flag.
+    const uint8_t invalidTypesAndFlags[] = { 0x0f, 0x1f, 0x20, 0x80 };
+    for (uint8_t typeAndFlags : invalidTypesAndFlags) {
+        std::vector<char> corruptData = data;
+        TerrainMapFile::TileRecord* tiles = (TerrainMapFile::TileRecord*)(corruptData.data() + header->tilesOffset);
+        tiles[32 * 32 - 3].typeAndFlags = typeAndFlags;
+        _writeFile(MAP_FILE_NAME, corruptData);
+
+        // The header is valid, the tiles are checked when they are decoded.
+        TerrainMapFile mapFile;
+        TINYSC_CHECK(mapFile.open(MAP_FILE_NAME));
+
+        TileStore decodedTiles;
+        TINYSC_CHECK(!mapFile.decodeTiles(&decodedTiles));
+
+        Terrain loadedTerrain(renderSystem.get());
+        TINYSC_CHECK(!loadedTerrain.initialize(mapFile));
+    }
+}
@@ -0,0 +1,236 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainModifier.h"
+
+#include <random>
+#include <set>
+#include <tuple>
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/** Vertex of the terrain mesh, see TerrainVertex in Terrain.cpp. */
+struct MeshVertex
+{
+    int16_t corner[4];
+    uint32_t normal;
+};
+
+typedef std::array<MeshVertex, 3> MeshTriangle;
+
+/** Get the triangles of the draw calls recorded by the device, without the degenerate ones padding the chunks. */
+static std::vector<MeshTriangle> _gatherTriangles(IDirect3DDevice9* device)
+{
+    std::vector<MeshTriangle> triangles;
+    for (const HeadlessDrawCall& drawCall : device->getDrawCalls()) {
+        const MeshVertex* vertices = (const MeshVertex*)drawCall.streams[0]->getData().data();
+        const unsigned* indices = (const unsigned*)drawCall.indices->getData().data() + drawCall.startIndex;
+
+        for (UINT face = 0; face < drawCall.primitivesCount; ++face) {
+            const unsigned* faceIndices = indices + face * 3;
+            if (faceIndices[0] == faceIndices[1] && faceIndices[1] == faceIndices[2])
+                continue;
+
+            MeshTriangle triangle;
+            for (int i = 0; i < 3; ++i) {
+                TINYSC_CHECK(faceIndices[i] >= drawCall.minVertexIndex && faceIndices[i] < drawCall.minVertexIndex + drawCall.verticesCount);
+                triangle[i] = vertices[faceIndices[i]];
+            }
+            triangles.push_back(triangle);
+        }
+    }
+    return triangles;
+}
+
+/** Draw a terrain with a camera, and get the triangles drawn. */
+static std::vector<MeshTriangle> _drawTriangles(Terrain* terrain, Camera* camera, IDirect3DDevice9* device)
+{
+    device->clearDrawCalls();
+    terrain->drawTerrain(camera);
+    return _gatherTriangles(device);
+}
+
+/** Draw a terrain seen as a whole, and get the triangles drawn. */
+static std::vector<MeshTriangle> _drawWholeTerrain(Terrain* terrain, IDirect3DDevice9* device)
+{
+    const Size2d& dimension = terrain->getDimension();
+    Camera camera = makeCameraLookingAt(Point2d(dimension.x / 2, dimension.y / 2));
+    const float viewportSize = 2.0f * Tile::SIZE * (dimension.x + dimension.y);
+    camera.setViewportSize(Size2f(viewportSize, viewportSize));
+    return _drawTriangles(terrain, &camera, device);
+}
+
+/** Get the signed area of a triangle on the tiles grid, in tiles. */
+static float _calcSignedArea(const MeshTriangle& triangle)
+{
+    return 0.5f * ((triangle[1].corner[0] - triangle[0].corner[0]) * (triangle[2].corner[2] - triangle[0].corner[2]) -
+        (triangle[2].corner[0] - triangle[0].corner[0]) * (triangle[1].corner[2] - triangle[0].corner[2]));
+}
+
+/** Get the level of a vertex and its normal's bytes, which are interpolated across the triangles. */
+static std::array<float, 4> _getAttributes(const MeshVertex& vertex)
+{
+    return { { (float)vertex.corner[1], (float)((vertex.normal >> 16) & 0xff), (float)((vertex.normal >> 8) & 0xff),
+        (float)(vertex.normal & 0xff) } };
+}
+
+/**
+  	Sample the level and the normal of the surface of triangles at a few points in each tile of a
+    terrain of the dimension. Points which no triangle covers are sampled as NaN.
+ */
+static std::vector<std::array<float, 4>> _sampleSurface(const std::vector<MeshTriangle>& triangles, const Size2d& dimension)
+{
+    // Triangles overlapping each tile.
+    std::vector<std::vector<int>> tileTriangles(dimension.x * dimension.y);
+    for (int i = 0; i < (int)triangles.size(); ++i) {
+        const MeshTriangle& triangle = triangles[i];
+        const int minRow = Math::min(triangle[0].corner[0], Math::min(triangle[1].corner[0], triangle[2].corner[0]));
+        const int maxRow = Math::max(triangle[0].corner[0], Math::max(triangle[1].corner[0], triangle[2].corner[0]));
+        const int minColumn = Math::min(triangle[0].corner[2], Math::min(triangle[1].corner[2], triangle[2].corner[2]));
+        const int maxColumn = Math::max(triangle[0].corner[2], Math::max(triangle[1].corner[2], triangle[2].corner[2]));
+        for (int y = minRow; y < maxRow; ++y) {
+            for (int x = minColumn; x < maxColumn; ++x)
+                tileTriangles[y * dimension.x + x].push_back(i);
+        }
+    }
+
+    // Points off the diagonals of the tiles, where the faces of the per-tile mesh meet.
+    const float points[][2] = { { 0.3f, 0.6f }, { 0.6f, 0.3f }, { 0.15f, 0.8f }, { 0.85f, 0.4f } };
+    std::vector<std::array<float, 4>> samples;
+    for (int y = 0; y < dimension.y; ++y) {
+        for (int x = 0; x < dimension.x; ++x) {
+            for (const float* point : points) {
+                const float row = y + point[0], column = x + point[1];
+                std::array<float, 4> sample;
+                sample.fill(std::numeric_limits<float>::quiet_NaN());
+                for (int i : tileTriangles[y * dimension.x + x]) {
+                    const MeshTriangle& triangle = triangles[i];
+                    const float area = _calcSignedArea(triangle);
+                    const float b1 = 0.5f * ((row - triangle[0].corner[0]) * (triangle[2].corner[2] - triangle[0].corner[2]) -
+                        (triangle[2].corner[0] - triangle[0].corner[0]) * (column - triangle[0].corner[2])) / area;
+                    const float b2 = 0.5f * ((triangle[1].corner[0] - triangle[0].corner[0]) * (column - triangle[0].corner[2]) -
+                        (row - triangle[0].corner[0]) * (triangle[1].corner[2] - triangle[0].corner[2])) / area;
+                    const float b0 = 1.0f - b1 - b2;
+                    if (b0 >= -1e-5f && b1 >= -1e-5f && b2 >= -1e-5f) {
+                        const std::array<float, 4> a0 = _getAttributes(triangle[0]), a1 = _getAttributes(triangle[1]),
+                            a2 = _getAttributes(triangle[2]);
+                        for (int iAttribute = 0; iAttribute < 4; ++iAttribute)
+                            sample[iAttribute] = b0 * a0[iAttribute] + b1 * a1[iAttribute] + b2 * a2[iAttribute];
+                        break;
+                    }
+                }
+                samples.push_back(sample);
+            }
+        }
+    }
+    return samples;
+}
+
+/** Check a greedy mesh covers the same surface with the same shading as a per-tile mesh, with fewer faces. */
+static void _checkSameSurface(const std::vector<MeshTriangle>& perTileTriangles, const std::vector<MeshTriangle>& greedyTriangles,
+    const Size2d& dimension)
+{
+    TINYSC_CHECK(perTileTriangles.size() == (size_t)dimension.x * dimension.y * 2);
+    TINYSC_CHECK(greedyTriangles.size() < perTileTriangles.size());
+
+    // Both meshes cover the terrain once, with triangles facing the same way.
+    float perTileArea = 0.0f, greedyArea = 0.0f;
+    const float sign = (_calcSignedArea(perTileTriangles.front()) > 0.0f) ? 1.0f : -1.0f;
+    for (const MeshTriangle& triangle : perTileTriangles) {
+        TINYSC_CHECK(sign * _calcSignedArea(triangle) > 0.0f);
+        perTileArea += sign * _calcSignedArea(triangle);
+    }
+    for (const MeshTriangle& triangle : greedyTriangles) {
+        TINYSC_CHECK(sign * _calcSignedArea(triangle) > 0.0f);
+        greedyArea += sign * _calcSignedArea(triangle);
+    }
+    TINYSC_CHECK(perTileArea == (float)(dimension.x * dimension.y) && greedyArea == perTileArea);
+
+    // The surfaces have the same levels and the same interpolated normals.
+    const std::vector<std::array<float, 4>> perTileSamples = _sampleSurface(perTileTriangles, dimension);
+    const std::vector<std::array<float, 4>> greedySamples = _sampleSurface(greedyTriangles, dimension);
+    for (size_t i = 0; i < perTileSamples.size(); ++i) {
+        for (int iAttribute = 0; iAttribute < 4; ++iAttribute)
+            TINYSC_CHECK(fabsf(perTileSamples[i][iAttribute] - greedySamples[i][iAttribute]) <= 1e-3f);
+    }
+
+    // Every vertex of the greedy mesh is a vertex of the per-tile mesh at the same corner with the same normal.
+    std::set<std::tuple<int, int, int, uint32_t>> perTileVertices;
+    for (const MeshTriangle& triangle : perTileTriangles) {
+        for (const MeshVertex& vertex : triangle)
+            perTileVertices.insert(std::make_tuple(vertex.corner[0], vertex.corner[1], vertex.corner[2], vertex.normal));
+    }
+    for (const MeshTriangle& triangle : greedyTriangles) {
+        for (const MeshVertex& vertex : triangle)
+            TINYSC_CHECK(perTileVertices.count(std::make_tuple(vertex.corner[0], vertex.corner[1], vertex.corner[2], vertex.normal)) == 1);
+    }
+}
+
+TINYSC_TEST(TerrainMeshing, GreedyMeshCoversSameSurface)
+{
+    TestRenderSystem renderSystem;
+    IDirect3DDevice9* device = renderSystem.getDevice();
+    std::mt19937 random(16);
+
+    const Size2d dimension(48, 32);
+    const int chunksCount = dimension.x * dimension.y / Terrain::TILES_COUNT_PER_CHUNK;
+    Terrain terrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension));
+
+    // A flat terrain is one quad per chunk.
+    const std::vector<MeshTriangle> flatPerTileTriangles = _drawWholeTerrain(&terrain, device);
+    terrain.setMeshingMode(ETerrainMeshingMode::eGreedy);
+    const std::vector<MeshTriangle> flatGreedyTriangles = _drawWholeTerrain(&terrain, device);
+    TINYSC_CHECK(flatGreedyTriangles.size() == (size_t)chunksCount * 2);
+    _checkSameSurface(flatPerTileTriangles, flatGreedyTriangles, dimension);
+
+    // Sculpted in the greedy mode, so its quads are updated by the edits.
+    TerrainModifier modifier(&terrain);
+    sculptRandomly(&modifier, dimension, 150, &random);
+    const std::vector<MeshTriangle> greedyTriangles = _drawWholeTerrain(&terrain, device);
+    terrain.setMeshingMode(ETerrainMeshingMode::ePerTile);
+    const std::vector<MeshTriangle> perTileTriangles = _drawWholeTerrain(&terrain, device);
+    TINYSC_CHECK(greedyTriangles.size() > (size_t)chunksCount * 2);
+    _checkSameSurface(perTileTriangles, greedyTriangles, dimension);
+}
+
+TINYSC_TEST(TerrainMeshing, GreedyChunksAreDrawnOneByOne)
+{
+    TestRenderSystem renderSystem;
+    IDirect3DDevice9* device = renderSystem.getDevice();
+    std::mt19937 random(17);
+
+    const Size2d dimension(96, 72);
+    const int chunksDimensionX = dimension.x / Terrain::CHUNK_DIMENSION;
+    Terrain terrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension));
+    terrain.setMeshingMode(ETerrainMeshingMode::eGreedy);
+    TerrainModifier modifier(&terrain);
+    sculptRandomly(&modifier, dimension, 300, &random);
+
+    // Chunks have different numbers of quads, and the draw calls of the visible chunks draw each
+    // of their tiles once and nothing of the other chunks.
+    for (int iCamera = 0; iCamera < 100; ++iCamera) {
+        Camera camera = makeRandomCamera(dimension, &random);
+        const std::vector<MeshTriangle> triangles = _drawTriangles(&terrain, &camera, device);
+
+        std::vector<int> visibleChunks = terrain.getVisibleChunks();
+        std::sort(visibleChunks.begin(), visibleChunks.end());
+        std::vector<float> chunkAreas(visibleChunks.size(), 0.0f);
+        for (const MeshTriangle& triangle : triangles) {
+            const int row = Math::min(triangle[0].corner[0], Math::min(triangle[1].corner[0], triangle[2].corner[0]));
+            const int column = Math::min(triangle[0].corner[2], Math::min(triangle[1].corner[2], triangle[2].corner[2]));
+            const int chunk = (row / Terrain::CHUNK_DIMENSION) * chunksDimensionX + column / Terrain::CHUNK_DIMENSION;
+
+            const auto visibleChunk = std::lower_bound(visibleChunks.begin(), visibleChunks.end(), chunk);
+            TINYSC_CHECK(visibleChunk != visibleChunks.end() && *visibleChunk == chunk);
+            if (visibleChunk != visibleChunks.end() && *visibleChunk == chunk)
+                chunkAreas[visibleChunk - visibleChunks.begin()] += fabsf(_calcSignedArea(triangle));
+        }
+
+        for (float area : chunkAreas)
+            TINYSC_CHECK(area == (float)Terrain::TILES_COUNT_PER_CHUNK);
+    }
+}
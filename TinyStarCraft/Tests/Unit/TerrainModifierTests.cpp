@@ -0,0 +1,384 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "LegacyTerrainModifier.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainBrush.h"
+#include "Rendering/TerrainModifier.h"
+#include "Rendering/TerrainQuadTree.h"
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/** Determine if two packed tiles are the same. */
+static bool _isSameTile(const TileStore::PackedTile& a, const TileStore::PackedTile& b)
+{
+    return a.typeAndFlags == b.typeAndFlags && a.level == b.level && a.waterAltitude == b.waterAltitude;
+}
+
+/** Determine if two stores have the same tiles, except the ones in a rectangle. */
+static bool _haveSameTilesOutside(const TileStore& a, const TileStore& b, const Rectd& rect)
+{
+    const int dimensionX = a.getDimension().x;
+    for (int i = 0; i < (int)a.size(); ++i) {
+        if (!rect.isPointInside(Point2d(i % dimensionX, i / dimensionX)) && !_isSameTile(a.getPackedTile(i), b.getPackedTile(i)))
+            return false;
+    }
+    return true;
+}
+
+/** Determine if two stores have the same tiles. */
+static bool _haveSameTiles(const TileStore& a, const TileStore& b)
+{
+    return _haveSameTilesOutside(a, b, Rectd::makeRect(0, 0, 0, 0));
+}
+
+/** Determine if two rectangles are the same, or both are empty. */
+static bool _isSameRect(const Rectd& a, const Rectd& b)
+{
+    if (a.getWidth() <= 0 || b.getWidth() <= 0)
+        return a.getWidth() <= 0 && b.getWidth() <= 0;
+    return a.getLeft() == b.getLeft() && a.getTop() == b.getTop() && a.getRight() == b.getRight() && a.getBottom() == b.getBottom();
+}
+
+/** Get the tiles of a modifier, by applying them to its terrain. */
+static const TileStore& _getTiles(TerrainModifier* modifier, Terrain* terrain)
+{
+    modifier->updateTerrain();
+    return terrain->getTilesData();
+}
+
+/**
+  	Make a brush of 1 to 4 random shapes around a terrain of the dimension. Shapes are far apart
+    or overlap, and may be partly out of the terrain.
+ */
+static TerrainBrush _makeRandomBrush(const Size2d& dimension, std::mt19937* random)
+{
+    TerrainBrush brush;
+    const int shapesCount = 1 + (*random)() % 4;
+    for (int i = 0; i < shapesCount; ++i) {
+        const Point2d center(-8 + (*random)() % (dimension.x + 16), -8 + (*random)() % (dimension.y + 16));
+        switch ((*random)() % 3) {
+        case 0:
+            brush.add(TerrainBrush::makeCircle(center, (*random)() % 12));
+            break;
+        case 1:
+            brush.add(TerrainBrush::makeRectangle(Rectd::makeRect(center, Size2d(1 + (*random)() % 20, 1 + (*random)() % 20))));
+            break;
+        default: {
+            std::vector<Point2d> points(1, center);
+            for (int point = (*random)() % 4; point > 0; --point)
+                points.push_back(points.back() + Point2d(-20 + (*random)() % 41, -20 + (*random)() % 41));
+            brush.add(TerrainBrush::makePolyline(points, (*random)() % 5));
+            break;
+        }
+        }
+    }
+    return brush;
+}
+
+TINYSC_TEST(TerrainModifier, ProduceTablesMatchLegacyTables)
+{
+    // Every entry of the tables generated at compile time, including the unused 16th type.
+    const LegacyTerrainModifier legacyModifier(TileStore(Size2d(1, 1), std::vector<Tile>(1)));
+    int undefinedCount = 0;
+    for (int method = 0; method < 2; ++method) {
+        for (int desiredTile = 0; desiredTile < 16; ++desiredTile) {
+            for (int originalTile = 0; originalTile < 16; ++originalTile) {
+                const int produceTile = TerrainModifier::getProduceTile(method, desiredTile, originalTile);
+                TINYSC_CHECK(produceTile == legacyModifier.getProduceTile(method, desiredTile, originalTile));
+                undefinedCount += (produceTile == -1) ? 1 : 0;
+            }
+        }
+    }
+    TINYSC_CHECK(undefinedCount > 0 && undefinedCount < 2 * 16 * 16);
+}
+
+TINYSC_TEST(TerrainModifier, GroundEditsMatchLegacyModifier)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(21);
+
+    const Size2d dimensions[] = { Size2d(16, 16), Size2d(40, 24), Size2d(80, 64) };
+    for (const Size2d& dimension : dimensions) {
+        Terrain terrain(renderSystem.get());
+        TINYSC_CHECK(terrain.initialize(dimension));
+        TerrainModifier modifier(&terrain);
+        LegacyTerrainModifier legacyModifier(terrain.getTilesData());
+
+        int minLevel = 0, maxLevel = 0;
+        for (int i = 0; i < 3000; ++i) {
+            const Point2d location(random() % dimension.x, random() % dimension.y);
+            const TileStore tiles = _getTiles(&modifier, &terrain);
+
+            // Single tiles are changed now and then, so ground edits meet any tile combination.
+            const int operation = random() % 10;
+            Rectd rect, legacyRect;
+            if (operation < 4) {
+                rect = modifier.hightenGround(location);
+                legacyRect = legacyModifier.hightenGround(location);
+            }
+            else if (operation < 8) {
+                rect = modifier.lowerGround(location);
+                legacyRect = legacyModifier.lowerGround(location);
+            }
+            else if (operation < 9) {
+                modifier.hightenTile(location);
+                legacyModifier.hightenTile(location);
+                rect = legacyRect = Rectd::makeRect(location, Size2d(1, 1));
+            }
+            else {
+                modifier.lowerTile(location);
+                legacyModifier.lowerTile(location);
+                rect = legacyRect = Rectd::makeRect(location, Size2d(1, 1));
+            }
+
+            const TileStore& modifiedTiles = _getTiles(&modifier, &terrain);
+            TINYSC_CHECK(_haveSameTiles(modifiedTiles, legacyModifier.getTilesData()));
+            TINYSC_CHECK(_isSameRect(rect, legacyRect));
+            TINYSC_CHECK(_haveSameTilesOutside(tiles, modifiedTiles, rect));
+
+            for (int tile = 0; tile < (int)modifiedTiles.size(); ++tile) {
+                minLevel = Math::min(minLevel, modifiedTiles.getLevel(tile));
+                maxLevel = Math::max(maxLevel, modifiedTiles.getLevel(tile));
+            }
+        }
+
+        // The legacy modifier rejects edits near the storable range, which are never reached.
+        TINYSC_CHECK(minLevel < -2 && maxLevel > 2);
+        TINYSC_CHECK(minLevel > TileStore::MIN_LEVEL + 8 && maxLevel < TileStore::MAX_LEVEL - 8);
+    }
+}
+
+TINYSC_TEST(TerrainModifier, LoweringTreatsSlopesAsUpperEdges)
+{
+    TestRenderSystem renderSystem;
+
+    const Size2d dimension(16, 16);
+    Terrain terrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension));
+    TerrainModifier modifier(&terrain);
+    modifier.hightenGround(Point2d(8, 8));
+    LegacyTerrainModifier legacyModifier(_getTiles(&modifier, &terrain));
+
+    // The tiles around the raised one are slopes stored at level 0, from level 0 up to level 1.
+    const TileStore& tiles = _getTiles(&modifier, &terrain);
+    const int slopeIndex = 8 * dimension.x + 9;
+    TINYSC_CHECK(tiles.getType(slopeIndex) != ETileType::Flat && tiles.getLevel(slopeIndex) == 0);
+
+    // Lowering a slope lowers its upper edge, which makes it flat at its stored level.
+    modifier.lowerGround(Point2d(9, 8));
+    legacyModifier.lowerGround(Point2d(9, 8));
+    TINYSC_CHECK(_haveSameTiles(_getTiles(&modifier, &terrain), legacyModifier.getTilesData()));
+    TINYSC_CHECK(tiles.getType(slopeIndex) == ETileType::Flat && tiles.getLevel(slopeIndex) == 0);
+
+    // Lowering a flat tile lowers it by one level.
+    const int flatIndex = 2 * dimension.x + 2;
+    modifier.lowerGround(Point2d(2, 2));
+    legacyModifier.lowerGround(Point2d(2, 2));
+    TINYSC_CHECK(_haveSameTiles(_getTiles(&modifier, &terrain), legacyModifier.getTilesData()));
+    TINYSC_CHECK(tiles.getType(flatIndex) == ETileType::Flat && tiles.getLevel(flatIndex) == -1);
+}
+
+TINYSC_TEST(TerrainModifier, EditsNearLevelBoundsAreStoredOrRejected)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(22);
+
+    const Size2d dimension(24, 24);
+    const Point2d center(12, 12);
+    const int centerIndex = center.y * dimension.x + center.x;
+
+    for (int method = 0; method < 2; ++method) {
+        // Tiles one level away from the bound the method moves towards.
+        const int bound = (method == 0) ? TileStore::MAX_LEVEL : TileStore::MIN_LEVEL;
+        const int step = (method == 0) ? 1 : -1;
+        auto modifyGround = [method](TerrainModifier* modifier, const Point2d& location) {
+            return (method == 0) ? modifier->hightenGround(location) : modifier->lowerGround(location);
+        };
+
+        Terrain terrain(renderSystem.get());
+        TINYSC_CHECK(terrain.initialize(dimension, Tile(ETileType::Flat, bound - step, false, 0.0f)));
+        TerrainModifier modifier(&terrain);
+        const TileStore initialTiles = terrain.getTilesData();
+
+        // The bound itself can be reached.
+        TINYSC_CHECK(modifyGround(&modifier, center).getWidth() > 0);
+        TINYSC_CHECK(_getTiles(&modifier, &terrain).getLevel(centerIndex) == bound);
+
+        // Going beyond it changes nothing, and isn't recorded as an edit.
+        const TileStore tiles = _getTiles(&modifier, &terrain);
+        TINYSC_CHECK(modifyGround(&modifier, center).getWidth() <= 0);
+        TINYSC_CHECK(_haveSameTiles(tiles, _getTiles(&modifier, &terrain)));
+        TINYSC_CHECK(modifier.undo());
+        TINYSC_CHECK(_haveSameTiles(initialTiles, _getTiles(&modifier, &terrain)));
+        TINYSC_CHECK(!modifier.undo());
+        modifier.redo();
+
+        // Edits which would leave the range change nothing, and the others only change the tiles
+        // in their rectangle. The checked build asserts that every stored level is in the range.
+        // Most edits move towards the bound.
+        int acceptedCount = 0, rejectedCount = 0;
+        for (int i = 0; i < 1000; ++i) {
+            const Point2d location(random() % dimension.x, random() % dimension.y);
+            const TileStore tiles = _getTiles(&modifier, &terrain);
+
+            const Rectd rect = (random() % 4 != 0) ? modifyGround(&modifier, location) :
+                (method == 0) ? modifier.lowerGround(location) : modifier.hightenGround(location);
+            const TileStore& modifiedTiles = _getTiles(&modifier, &terrain);
+            if (rect.getWidth() > 0) {
+                TINYSC_CHECK(_haveSameTilesOutside(tiles, modifiedTiles, rect));
+                ++acceptedCount;
+            }
+            else {
+                TINYSC_CHECK(_haveSameTiles(tiles, modifiedTiles));
+                ++rejectedCount;
+            }
+        }
+        TINYSC_CHECK(acceptedCount > 100 && rejectedCount > 10);
+    }
+}
+
+TINYSC_TEST(TerrainModifier, AreaEditsMatchSingleWalk)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(23);
+
+    // Maps large enough for the shapes of a brush to be modified in parallel parts.
+    const Size2d dimensions[] = { Size2d(128, 128), Size2d(256, 160) };
+    for (const Size2d& dimension : dimensions) {
+        Terrain terrain(renderSystem.get());
+        TINYSC_CHECK(terrain.initialize(dimension));
+        TerrainModifier modifier(&terrain);
+        sculptRandomly(&modifier, dimension, dimension.x * dimension.y / 8, &random);
+
+        // Slopes of peaks are long enough for the elevation logic of a part to leave its window,
+        // so the whole brush is modified at once instead.
+        for (int peak = 0; peak < 4; ++peak) {
+            const Point2d location(random() % dimension.x, random() % dimension.y);
+            for (int level = 0; level < 24; ++level)
+                (peak % 2 == 0) ? modifier.hightenGround(location) : modifier.lowerGround(location);
+        }
+        LegacyTerrainModifier legacyModifier(_getTiles(&modifier, &terrain));
+
+        int raisedFurtherCount = 0;
+        for (int i = 0; i < 400; ++i) {
+            const TerrainBrush brush = _makeRandomBrush(dimension, &random);
+            const int method = random() % 2;
+            const TileStore tiles = _getTiles(&modifier, &terrain);
+
+            const Rectd rect = (method == 0) ? modifier.hightenArea(brush) : modifier.lowerArea(brush);
+            const Rectd legacyRect = (method == 0) ? legacyModifier.hightenArea(brush) : legacyModifier.lowerArea(brush);
+
+            const TileStore& modifiedTiles = _getTiles(&modifier, &terrain);
+            TINYSC_CHECK(_haveSameTiles(modifiedTiles, legacyModifier.getTilesData()));
+            TINYSC_CHECK(_isSameRect(rect, legacyRect));
+            TINYSC_CHECK(_haveSameTilesOutside(tiles, modifiedTiles, rect));
+
+            // Brushed tiles are moved by one level at least, as seen by the elevation logic of the
+            // method, and further where the slopes of other seeds reach them.
+            std::vector<Point2d> locations;
+            brush.getTiles(dimension, &locations);
+            for (const Point2d& location : locations) {
+                const int tileIndex = location.y * dimension.x + location.x;
+                const int level = tiles.getLevel(tileIndex) + ((method == 1 && tiles.getType(tileIndex) != ETileType::Flat) ? 1 : 0);
+                const int modifiedLevel = modifiedTiles.getLevel(tileIndex) +
+                    ((method == 1 && modifiedTiles.getType(tileIndex) != ETileType::Flat) ? 1 : 0);
+                const int change = (method == 0) ? modifiedLevel - level : level - modifiedLevel;
+                TINYSC_CHECK(change >= 1);
+                raisedFurtherCount += (change > 1) ? 1 : 0;
+            }
+
+            // Undoing the edit restores the tiles before it. Brushes which change nothing aren't
+            // recorded as edits.
+            if (random() % 8 == 0 && !_haveSameTiles(tiles, modifiedTiles)) {
+                TINYSC_CHECK(modifier.undo());
+                TINYSC_CHECK(_haveSameTiles(_getTiles(&modifier, &terrain), tiles));
+                legacyModifier = LegacyTerrainModifier(tiles);
+            }
+        }
+
+        TINYSC_CHECK(raisedFurtherCount > 0);
+    }
+}
+
+TINYSC_TEST(TerrainModifier, AreaEditsNearLevelBoundsAreStoredOrSkipped)
+{
+    TestRenderSystem renderSystem;
+
+    const Size2d dimension(48, 48);
+    const TerrainBrush brush = TerrainBrush::makeRectangle(Rectd::makeRect(8, 8, 32, 32));
+
+    for (int method = 0; method < 2; ++method) {
+        const int bound = (method == 0) ? TileStore::MAX_LEVEL : TileStore::MIN_LEVEL;
+        const int step = (method == 0) ? 1 : -1;
+        auto modifyArea = [method](TerrainModifier* modifier, const TerrainBrush& brush) {
+            return (method == 0) ? modifier->hightenArea(brush) : modifier->lowerArea(brush);
+        };
+
+        // The left half of the brushed tiles is at the bound already, the right half is one level
+        // away from it.
+        Terrain terrain(renderSystem.get());
+        TINYSC_CHECK(terrain.initialize(dimension, Tile(ETileType::Flat, bound - step, false, 0.0f)));
+        TerrainModifier modifier(&terrain);
+        modifyArea(&modifier, TerrainBrush::makeRectangle(Rectd::makeRect(0, 0, 24, 48)));
+        const TileStore tiles = _getTiles(&modifier, &terrain);
+
+        // Tiles at the bound are left unchanged, the other brushed tiles reach it, and only the
+        // tiles next to the brush get slopes.
+        TINYSC_CHECK(modifyArea(&modifier, brush).getWidth() > 0);
+        const TileStore& modifiedTiles = _getTiles(&modifier, &terrain);
+        for (int i = 0; i < (int)modifiedTiles.size(); ++i) {
+            if (tiles.getType(i) == ETileType::Flat && tiles.getLevel(i) == bound)
+                TINYSC_CHECK(_isSameTile(tiles.getPackedTile(i), modifiedTiles.getPackedTile(i)));
+            else if (brush.isTileBrushed(Point2d(i % dimension.x, i / dimension.x)))
+                TINYSC_CHECK(modifiedTiles.getType(i) == ETileType::Flat && modifiedTiles.getLevel(i) == bound);
+        }
+        TINYSC_CHECK(_haveSameTilesOutside(tiles, modifiedTiles, Rectd::makeRect(7, 7, 34, 34)));
+
+        // A brush of tiles all at the bound changes nothing, and isn't recorded as an edit.
+        const TileStore boundTiles = _getTiles(&modifier, &terrain);
+        TINYSC_CHECK(modifyArea(&modifier, brush).getWidth() <= 0);
+        TINYSC_CHECK(_haveSameTiles(boundTiles, _getTiles(&modifier, &terrain)));
+        TINYSC_CHECK(modifier.undo());
+        TINYSC_CHECK(_haveSameTiles(tiles, _getTiles(&modifier, &terrain)));
+    }
+}
+
+TINYSC_TEST(TerrainModifier, ModifiersOfOneTerrainKeepEachOthersEdits)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(25);
+
+    // Both modifiers are created before any edit, so each one has tiles the other one modifies
+    // afterwards, in the same pages as its own edits.
+    const Size2d dimension(64, 64);
+    Terrain terrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension));
+    TerrainModifier modifierA(&terrain);
+    TerrainModifier modifierB(&terrain);
+
+    modifierA.hightenGround(Point2d(8, 4));
+    modifierA.updateTerrain();
+    modifierB.hightenGround(Point2d(40, 4));
+    modifierB.updateTerrain();
+
+    const TileStore& tiles = terrain.getTilesData();
+    TINYSC_CHECK(tiles.getLevel(4 * dimension.x + 8) == 1 && tiles.getLevel(4 * dimension.x + 40) == 1);
+
+    // Edits of tiles far apart keep the terrain's tiles and its quad tree in step.
+    for (int i = 0; i < 200; ++i) {
+        TerrainModifier& modifier = (i % 2) ? modifierA : modifierB;
+        const Point2d location((i % 2) * 32 + random() % 24, random() % dimension.y);
+        const TileStore expectedTiles = terrain.getTilesData();
+        const Rectd rect = (random() % 2) ? modifier.hightenGround(location) : modifier.lowerGround(location);
+        modifier.updateTerrain();
+
+        const TileStore& modifiedTiles = terrain.getTilesData();
+        TINYSC_CHECK(_haveSameTilesOutside(expectedTiles, modifiedTiles, rect));
+    }
+
+    Terrain expectedTerrain(renderSystem.get());
+    TINYSC_CHECK(expectedTerrain.initialize(dimension, unpackTiles(terrain.getTilesData())));
+    TINYSC_CHECK(haveSameAABBs(terrain.getTerrainQuadTree(), expectedTerrain.getTerrainQuadTree()));
+}
@@ -0,0 +1,138 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainModifier.h"
+#include "Rendering/TerrainNormals.h"
+
+#include <random>
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/** World position of a tile's vertex. Grid x goes along world z axis and grid y goes along world x axis. */
+static TerrainNormals::Normal _getVertexPosition(const TileStore& tiles, const Point2d& location, int vertex)
+{
+    const int tileIndex = location.y * tiles.getDimension().x + location.x;
+    const int level = tiles.getLevel(tileIndex) + TileShape::SHAPES()[tiles.getType(tileIndex)].vertexLevels[vertex];
+    return { Tile::SIZE * (location.y + (vertex >> 1)), level * Tile::HEIGHT_PER_LEVEL, Tile::SIZE * (location.x + (vertex & 1)) };
+}
+
+/**
+  	Calculate a vertex normal by averaging the normals of the faces around it, from the world
+    positions of their vertices.
+@remarks
+    The faces of the 4 tiles sharing the vertex's corner whose vertex at the corner has the same
+    position are averaged, like the terrain did with D3DX before normals were read from tables.
+ */
+static TerrainNormals::Normal _calcReferenceNormal(const TileStore& tiles, const Point2d& location, int vertex)
+{
+    const Size2d& dimension = tiles.getDimension();
+    const Point2d corner(location.x + (vertex & 1), location.y + (vertex >> 1));
+    const TerrainNormals::Normal position = _getVertexPosition(tiles, location, vertex);
+
+    double normal[3] = { 0.0, 0.0, 0.0 };
+    for (int y = corner.y - 1; y <= corner.y; ++y) {
+        for (int x = corner.x - 1; x <= corner.x; ++x) {
+            if (x < 0 || y < 0 || x >= dimension.x || y >= dimension.y)
+                continue;
+
+            const Point2d neighbor(x, y);
+            const int neighborVertex = (corner.x - x) | ((corner.y - y) << 1);
+            if (std::fabs(_getVertexPosition(tiles, neighbor, neighborVertex).y - position.y) > 0.01f)
+                continue;
+
+            const int* indices = TileShape::SHAPES()[tiles.getType(y * dimension.x + x)].indices;
+            for (int face = 0; face < 2; ++face) {
+                const int* faceIndices = indices + face * 3;
+                if (faceIndices[0] != neighborVertex && faceIndices[1] != neighborVertex && faceIndices[2] != neighborVertex)
+                    continue;
+
+                const TerrainNormals::Normal v0 = _getVertexPosition(tiles, neighbor, faceIndices[0]);
+                const TerrainNormals::Normal v1 = _getVertexPosition(tiles, neighbor, faceIndices[1]);
+                const TerrainNormals::Normal v2 = _getVertexPosition(tiles, neighbor, faceIndices[2]);
+                const double edge0[3] = { v1.x - v0.x, v1.y - v0.y, v1.z - v0.z };
+                const double edge1[3] = { v2.x - v0.x, v2.y - v0.y, v2.z - v0.z };
+                const double faceNormal[3] = {
+                    edge0[1] * edge1[2] - edge0[2] * edge1[1],
+                    edge0[2] * edge1[0] - edge0[0] * edge1[2],
+                    edge0[0] * edge1[1] - edge0[1] * edge1[0]
+                };
+                const double length = std::sqrt(faceNormal[0] * faceNormal[0] + faceNormal[1] * faceNormal[1] + faceNormal[2] * faceNormal[2]);
+                for (int i = 0; i < 3; ++i)
+                    normal[i] += faceNormal[i] / length;
+            }
+        }
+    }
+
+    const double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    return { (float)(normal[0] / length), (float)(normal[1] / length), (float)(normal[2] / length) };
+}
+
+/** Decode a packed component like the terrain shader does. */
+static float _unpackComponent(uint32_t packedNormal, int shift)
+{
+    return ((packedNormal >> shift) & 0xff) / 255.0f * 2.0f - 1.0f;
+}
+
+TINYSC_TEST(TerrainNormals, NormalsMatchFaceAveraging)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(15);
+
+    // Sculpted maps have every tile shape between them, cliffs between unconnected vertices and map edges.
+    const Size2d dimensions[] = { Size2d(32, 32), Size2d(48, 16) };
+    int shapesCount[15] = {};
+    for (const Size2d& dimension : dimensions) {
+        Terrain terrain(renderSystem.get());
+        TINYSC_CHECK(terrain.initialize(dimension));
+        TerrainModifier modifier(&terrain);
+        sculptRandomly(&modifier, dimension, dimension.x * dimension.y, &random);
+        const TileStore& tiles = terrain.getTilesData();
+
+        int tiltedCount = 0;
+        for (int y = 0; y < dimension.y; ++y) {
+            for (int x = 0; x < dimension.x; ++x) {
+                ++shapesCount[tiles.getType(y * dimension.x + x)];
+                for (int vertex = 0; vertex < 4; ++vertex) {
+                    const TerrainNormals::Normal normal = TerrainNormals::calcTileVertexNormal(tiles, Point2d(x, y), vertex);
+                    const TerrainNormals::Normal reference = _calcReferenceNormal(tiles, Point2d(x, y), vertex);
+                    TINYSC_CHECK(std::fabs(normal.x - reference.x) < 1e-5f && std::fabs(normal.y - reference.y) < 1e-5f &&
+                        std::fabs(normal.z - reference.z) < 1e-5f);
+                    tiltedCount += (normal.y < 0.999f) ? 1 : 0;
+                }
+            }
+        }
+        TINYSC_CHECK(tiltedCount > 0);
+    }
+
+    for (int type = 0; type < 15; ++type)
+        TINYSC_CHECK(shapesCount[type] > 0);
+}
+
+TINYSC_TEST(TerrainNormals, PackedNormalsRoundToNearestStep)
+{
+    // Components are packed as the bytes of normal * 0.5 + 0.5 in 0xffRRGGBB.
+    TINYSC_CHECK(TerrainNormals::packNormal({ 0.0f, 1.0f, 0.0f }) == 0xff80ff80);
+    TINYSC_CHECK(TerrainNormals::packNormal({ -1.0f, 0.0f, 0.0f }) == 0xff008080);
+    TINYSC_CHECK(TerrainNormals::packNormal({ 0.0f, 0.0f, -1.0f }) == 0xff808000);
+    TINYSC_CHECK(TerrainNormals::packNormal({ 1.0f, -1.0f, 1.0f }) == 0xffff00ff);
+
+    // 0 has no exact step, and is decoded as 1 / 255.
+    TINYSC_CHECK(std::fabs(_unpackComponent(TerrainNormals::packNormal({ 0.0f, 0.0f, 0.0f }), 0) - 1.0f / 255.0f) < 1e-6f);
+
+    // Values slightly beyond the range are clamped.
+    TINYSC_CHECK(TerrainNormals::packNormal({ 1.01f, -1.01f, 0.0f }) == 0xffff0080);
+
+    // Decoded components are within half a step of the packed ones.
+    std::mt19937 random(16);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    for (int i = 0; i < 10000; ++i) {
+        const TerrainNormals::Normal normal = { unit(random), unit(random), unit(random) };
+        const uint32_t packedNormal = TerrainNormals::packNormal(normal);
+        TINYSC_CHECK((packedNormal >> 24) == 0xff);
+        TINYSC_CHECK(std::fabs(_unpackComponent(packedNormal, 16) - normal.x) <= 1.0f / 255.0f + 1e-6f);
+        TINYSC_CHECK(std::fabs(_unpackComponent(packedNormal, 8) - normal.y) <= 1.0f / 255.0f + 1e-6f);
+        TINYSC_CHECK(std::fabs(_unpackComponent(packedNormal, 0) - normal.z) <= 1.0f / 255.0f + 1e-6f);
+    }
+}
@@ -0,0 +1,247 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainModifier.h"
+#include "Rendering/TerrainQuadTree.h"
+#include "Utilities/Ray.h"
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+static AABB _makeRandomAABB(std::mt19937* random)
+{
+    std::uniform_real_distribution<float> distribution(-100.0f, 100.0f);
+    D3DXVECTOR3 a(distribution(*random), distribution(*random), distribution(*random));
+    D3DXVECTOR3 b(distribution(*random), distribution(*random), distribution(*random));
+    return AABB(D3DXVECTOR3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)),
+        D3DXVECTOR3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)));
+}
+
+TINYSC_TEST(TerrainQuadTree, RefitMatchesRebuild)
+{
+    std::mt19937 random(2);
+
+    // Odd dimensions, so there are padding nodes in every level.
+    const Size2d leafDimension(13, 7);
+    std::vector<AABB> leaves(leafDimension.x * leafDimension.y);
+    std::vector<bool> isEmpty(leaves.size(), false);
+    for (AABB& leaf : leaves)
+        leaf = _makeRandomAABB(&random);
+
+    TerrainQuadTree refitted;
+    refitted.create(leafDimension);
+    for (int i = 0; i < (int)leaves.size(); ++i)
+        refitted.setLeafAABB(Point2d(i % leafDimension.x, i / leafDimension.x), leaves[i]);
+    refitted.refit(Rectd(Point2d::ZERO(), Point2d(leafDimension.x, leafDimension.y)));
+
+    for (int iEdit = 0; iEdit < 200; ++iEdit) {
+        const int left = random() % leafDimension.x;
+        const int top = random() % leafDimension.y;
+        const int right = left + 1 + random() % (leafDimension.x - left);
+        const int bottom = top + 1 + random() % (leafDimension.y - top);
+        const Rectd rect(Point2d(left, top), Point2d(right, bottom));
+
+        for (int y = top; y < bottom; ++y) {
+            for (int x = left; x < right; ++x) {
+                const int leaf = y * leafDimension.x + x;
+                // An empty leaf must not leak into its ancestors.
+                isEmpty[leaf] = random() % 4 == 0;
+                leaves[leaf] = _makeRandomAABB(&random);
+                if (isEmpty[leaf])
+                    refitted.clearLeafAABB(Point2d(x, y));
+                else
+                    refitted.setLeafAABB(Point2d(x, y), leaves[leaf]);
+            }
+        }
+        refitted.refit(rect);
+
+        TerrainQuadTree rebuilt;
+        rebuilt.create(leafDimension);
+        for (int i = 0; i < (int)leaves.size(); ++i) {
+            if (!isEmpty[i])
+                rebuilt.setLeafAABB(Point2d(i % leafDimension.x, i / leafDimension.x), leaves[i]);
+        }
+        rebuilt.refit(Rectd(Point2d::ZERO(), Point2d(leafDimension.x, leafDimension.y)));
+
+        TINYSC_CHECK(haveSameAABBs(refitted, rebuilt));
+    }
+}
+
+TINYSC_TEST(TerrainQuadTree, TerrainEditsMatchFreshTerrain)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(3);
+
+    const Size2d dimension(72, 40);
+    Terrain terrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension));
+
+    TerrainModifier modifier(&terrain);
+    for (int iRound = 0; iRound < 8; ++iRound) {
+        sculptRandomly(&modifier, dimension, 40, &random);
+
+        // A terrain built from the same tiles has its quad tree built from scratch.
+        Terrain freshTerrain(renderSystem.get());
+        TINYSC_CHECK(freshTerrain.initialize(dimension, unpackTiles(terrain.getTilesData())));
+        TINYSC_CHECK(haveSameAABBs(terrain.getTerrainQuadTree(), freshTerrain.getTerrainQuadTree()));
+    }
+}
+
+TINYSC_TEST(TerrainQuadTree, SaveAndLoadAABBs)
+{
+    std::mt19937 random(4);
+
+    const Size2d leafDimension(9, 16);
+    TerrainQuadTree saved;
+    saved.create(leafDimension);
+    for (int y = 0; y < leafDimension.y; ++y) {
+        for (int x = 0; x < leafDimension.x; ++x)
+            saved.setLeafAABB(Point2d(x, y), _makeRandomAABB(&random));
+    }
+    saved.refit(Rectd(Point2d::ZERO(), Point2d(leafDimension.x, leafDimension.y)));
+
+    std::vector<float> data(saved.getNodesCount() * 6);
+    saved.saveAABBs(data.data());
+
+    TerrainQuadTree loaded;
+    loaded.create(leafDimension);
+    TINYSC_CHECK(loaded.getNodesCount() == saved.getNodesCount());
+    loaded.loadAABBs(data.data());
+    TINYSC_CHECK(haveSameAABBs(saved, loaded));
+}
+
+/** A quad tree over a map of the dimension in chunks, with random heights and a few empty chunks. */
+static void _createRandomChunksTree(const Size2d& leafDimension, std::mt19937* random, TerrainQuadTree* tree,
+    std::vector<bool>* isEmpty)
+{
+    tree->create(leafDimension);
+    isEmpty->assign(leafDimension.x * leafDimension.y, false);
+    for (int y = 0; y < leafDimension.y; ++y) {
+        for (int x = 0; x < leafDimension.x; ++x) {
+            const int minLevel = (*random)() % 3;
+            if ((*random)() % 16 == 0)
+                (*isEmpty)[y * leafDimension.x + x] = true;
+            else
+                tree->setLeafAABB(Point2d(x, y), makeChunkAABB(Point2d(x, y), minLevel, minLevel + (*random)() % 3));
+        }
+    }
+    tree->refit(Rectd(Point2d::ZERO(), Point2d(leafDimension.x, leafDimension.y)));
+}
+
+TINYSC_TEST(TerrainQuadTree, GatherVisibleNodesMatchesBruteForce)
+{
+    std::mt19937 random(5);
+
+    const Size2d leafDimensions[] = { Size2d(1, 1), Size2d(16, 16), Size2d(40, 24), Size2d(64, 64) };
+    for (const Size2d& leafDimension : leafDimensions) {
+        TerrainQuadTree tree;
+        std::vector<bool> isEmpty;
+        _createRandomChunksTree(leafDimension, &random, &tree, &isEmpty);
+
+        for (int iCamera = 0; iCamera < 50; ++iCamera) {
+            const Point2d target(random() % (leafDimension.x * Terrain::CHUNK_DIMENSION),
+                random() % (leafDimension.y * Terrain::CHUNK_DIMENSION));
+            Camera camera = makeCameraLookingAt(target);
+            const ViewFrustum& viewFrustum = camera.getViewFrustum();
+
+            for (int level = 0; level <= tree.getDepth(); ++level) {
+                std::vector<int> nodes;
+                tree.gatherVisibleNodes(viewFrustum, level, &nodes);
+                std::sort(nodes.begin(), nodes.end());
+
+                // A parent is completely inside or outside if its children are, so testing every node
+                // of the level alone gives the same set.
+                std::vector<int> expectedNodes;
+                const Size2d& dimension = tree.getLevelDimension(level);
+                for (int y = 0; y < dimension.y; ++y) {
+                    for (int x = 0; x < dimension.x; ++x) {
+                        const Point2d location(x, y);
+                        if (level == tree.getDepth() && isEmpty[y * dimension.x + x])
+                            continue;
+                        if (viewFrustum.hasIntersection(tree.getAABB(level, location)) != ViewFrustum::AABB_OUTSIDE)
+                            expectedNodes.push_back(y * dimension.x + x);
+                    }
+                }
+                TINYSC_CHECK(nodes == expectedNodes);
+            }
+        }
+    }
+}
+
+TINYSC_TEST(TerrainQuadTree, RaycastMatchesBruteForce)
+{
+    std::mt19937 random(6);
+    std::uniform_real_distribution<float> screenX(0.0f, 800.0f), screenY(0.0f, 600.0f), direction(-1.0f, 1.0f);
+
+    const Size2d leafDimensions[] = { Size2d(1, 1), Size2d(16, 16), Size2d(40, 24), Size2d(64, 64) };
+    for (const Size2d& leafDimension : leafDimensions) {
+        TerrainQuadTree tree;
+        std::vector<bool> isEmpty;
+        _createRandomChunksTree(leafDimension, &random, &tree, &isEmpty);
+
+        const Size2d mapDimension(leafDimension.x * Terrain::CHUNK_DIMENSION, leafDimension.y * Terrain::CHUNK_DIMENSION);
+        std::vector<Ray> rays;
+        for (int iRay = 0; iRay < 400; ++iRay) {
+            Camera camera = makeCameraLookingAt(Point2d(random() % mapDimension.x, random() % mapDimension.y));
+            if (iRay % 2 == 0) {
+                // Picking rays of the camera.
+                rays.push_back(camera.screenPointToRay(Point2f(screenX(random), screenY(random))));
+            }
+            else {
+                // Rays in any direction, starting above the terrain.
+                Ray ray(camera.getPosition(), D3DXVECTOR3(direction(random), direction(random), direction(random)));
+                ray.normalize();
+                rays.push_back(ray);
+            }
+        }
+
+        // The leaves whose AABB is hit by the line of each ray, and by the ray itself.
+        std::vector<std::vector<int>> expectedLeaves(rays.size()), expectedLeavesAhead(rays.size());
+        for (size_t iRay = 0; iRay < rays.size(); ++iRay) {
+            for (int leaf = 0; leaf < (int)isEmpty.size(); ++leaf) {
+                float t[2];
+                const AABB aabb = tree.getAABB(tree.getDepth(), Point2d(leaf % leafDimension.x, leaf / leafDimension.x));
+                if (isEmpty[leaf] || rays[iRay].intersectAABB(aabb, t) == false)
+                    continue;
+                expectedLeaves[iRay].push_back(leaf);
+                if (t[1] >= 0.0f)
+                    expectedLeavesAhead[iRay].push_back(leaf);
+            }
+        }
+
+        // The scalar raycast tests AABBs like Ray::intersectAABB, which doesn't clip the line at the
+        // origin. The packet clips the rays to [0, tMax].
+        for (size_t iRay = 0; iRay < rays.size(); ++iRay) {
+            std::vector<int> leaves;
+            tree.raycast(rays[iRay], [&](int leaf) { leaves.push_back(leaf); });
+            std::sort(leaves.begin(), leaves.end());
+            TINYSC_CHECK(leaves == expectedLeaves[iRay]);
+        }
+
+        for (size_t iPacket = 0; iPacket < rays.size() / 4; ++iPacket) {
+            TerrainQuadTree::RayPacket packet;
+            for (int i = 0; i < 4; ++i)
+                packet.setRay(i, rays[iPacket * 4 + i], FLT_MAX);
+
+            // Leave one ray of the packet inactive.
+            const int rayMask = 0xf & ~(1 << (iPacket % 5));
+            std::vector<int> leaves[4];
+            tree.raycastPacket(packet, rayMask, [&](int leaf, int hitMask) {
+                TINYSC_CHECK((hitMask & ~rayMask) == 0);
+                for (int i = 0; i < 4; ++i) {
+                    if (hitMask & (1 << i))
+                        leaves[i].push_back(leaf);
+                }
+            });
+
+            for (int i = 0; i < 4; ++i) {
+                std::sort(leaves[i].begin(), leaves[i].end());
+                if (rayMask & (1 << i))
+                    TINYSC_CHECK(leaves[i] == expectedLeavesAhead[iPacket * 4 + i]);
+                else
+                    TINYSC_CHECK(leaves[i].empty());
+            }
+        }
+    }
+}
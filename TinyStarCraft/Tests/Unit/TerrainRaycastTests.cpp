@@ -0,0 +1,85 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainModifier.h"
+#include "Utilities/Ray.h"
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/** Check if two hits are at the same distance, relative to the distance. */
+static bool _haveSameDistance(const TerrainRaycastHit& a, const TerrainRaycastHit& b)
+{
+    return fabsf(a.distance - b.distance) <= 1e-3f * Math::max<float>(1.0f, a.distance);
+}
+
+TINYSC_TEST(TerrainRaycast, NearestHitMatchesRaycastAll)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(11);
+
+    const Size2d dimension(48, 40);
+    Terrain terrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension));
+    TerrainModifier modifier(&terrain);
+    sculptRandomly(&modifier, dimension, 400, &random);
+
+    int hitsCount = 0;
+    for (int iRay = 0; iRay < 20000; ++iRay) {
+        const Ray ray = makeRandomRay(dimension, iRay % 4, &random);
+
+        // raycastAll tests every tile under the quad tree leaves which the ray hits, the DDA raycast
+        // walks the tiles along the ray and stops at the first hit.
+        std::vector<TerrainRaycastHit> hits;
+        TerrainRaycastHit hit;
+        const bool isHit = terrain.raycastAll(ray, &hits);
+        TINYSC_CHECK(terrain.raycast(ray, &hit) == isHit);
+        if (!isHit)
+            continue;
+
+        ++hitsCount;
+        TINYSC_CHECK(_haveSameDistance(hits.front(), hit));
+        const D3DXVECTOR3 offset = hits.front().hitPosition - hit.hitPosition;
+        TINYSC_CHECK(::D3DXVec3Length(&offset) <= 1e-3f * Math::max<float>(1.0f, hit.distance) + 1e-3f);
+    }
+
+    // About a third of the rays hit the terrain, the others pass beside it or over it.
+    TINYSC_CHECK(hitsCount > 5000);
+}
+
+TINYSC_TEST(TerrainRaycast, BatchMatchesRaycast)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(12);
+
+    const Size2d dimension(56, 32);
+    Terrain terrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension));
+    TerrainModifier modifier(&terrain);
+    sculptRandomly(&modifier, dimension, 400, &random);
+
+    // Batches which aren't a multiple of the packet size too.
+    const size_t batchSizes[] = { 1, 3, 4, 7, 64, 1001 };
+    for (size_t batchSize : batchSizes) {
+        for (int iBatch = 0; iBatch < 10; ++iBatch) {
+            std::vector<D3DXVECTOR3> origins(batchSize), directions(batchSize);
+            for (size_t i = 0; i < batchSize; ++i) {
+                const Ray ray = makeRandomRay(dimension, random() % 4, &random);
+                origins[i] = ray.getOrigin();
+                directions[i] = ray.getDirection();
+            }
+
+            std::vector<TerrainRaycastHit> hits(batchSize);
+            std::unique_ptr<bool[]> isHit(new bool[batchSize]);
+            terrain.raycastBatch(origins.data(), directions.data(), batchSize, hits.data(), isHit.get());
+
+            for (size_t i = 0; i < batchSize; ++i) {
+                TerrainRaycastHit hit;
+                TINYSC_CHECK(terrain.raycast(Ray(origins[i], directions[i]), &hit) == isHit[i]);
+                if (isHit[i])
+                    TINYSC_CHECK(_haveSameDistance(hits[i], hit));
+            }
+        }
+    }
+}
@@ -0,0 +1,135 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainModifier.h"
+#include "Rendering/TerrainTileInstances.h"
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/** Vertex of the terrain mesh, see TerrainVertex in Terrain.cpp. */
+struct MeshVertex
+{
+    int16_t corner[4];
+    uint32_t normal;
+};
+
+/** Draw a terrain seen as a whole and get the buffer of a vertex stream. */
+static const std::vector<BYTE>* _drawTerrain(Terrain* terrain, IDirect3DDevice9* device, int stream)
+{
+    // The projection is orthographic, the viewport is as large as the terrain's diagonals.
+    const Size2d& dimension = terrain->getDimension();
+    Camera camera = makeCameraLookingAt(Point2d(dimension.x / 2, dimension.y / 2));
+    const float viewportSize = 2.0f * Tile::SIZE * (dimension.x + dimension.y);
+    camera.setViewportSize(Size2f(viewportSize, viewportSize));
+
+    device->clearDrawCalls();
+    terrain->drawTerrain(&camera);
+    TINYSC_CHECK(terrain->getVisibleChunks().size() * Terrain::TILES_COUNT_PER_CHUNK == (size_t)dimension.x * dimension.y);
+    return device->getDrawCalls().empty() ? nullptr : &device->getDrawCalls().front().streams[stream]->getData();
+}
+
+/**
+  	Check if the instance buffer of a terrain drawn by tile instances matches the vertices of a
+    terrain with the same tiles drawn by the per-tile mesh, slot by slot, and the records built
+    from the tiles.
+ */
+static void _checkInstancesMatchMesh(Terrain* meshTerrain, Terrain* instancedTerrain, IDirect3DDevice9* device)
+{
+    const std::vector<BYTE>* vertexData = _drawTerrain(meshTerrain, device, 0);
+    const std::vector<BYTE>* instanceData = _drawTerrain(instancedTerrain, device, 1);
+    TINYSC_CHECK(vertexData && instanceData);
+    if (!vertexData || !instanceData)
+        return;
+
+    const TileStore& tiles = instancedTerrain->getTilesData();
+    const Size2d& dimension = tiles.getDimension();
+    const int slotsCount = dimension.x * dimension.y / Terrain::TILES_COUNT_PER_CHUNK;
+    TINYSC_CHECK(instanceData->size() == slotsCount * Terrain::TILES_COUNT_PER_CHUNK * sizeof(TerrainTileInstances::Instance));
+    TINYSC_CHECK(vertexData->size() >= slotsCount * Terrain::TILES_COUNT_PER_CHUNK * 4 * sizeof(MeshVertex));
+
+    const TerrainTileInstances::Instance* instances = (const TerrainTileInstances::Instance*)instanceData->data();
+    const MeshVertex* vertices = (const MeshVertex*)vertexData->data();
+    for (int slot = 0; slot < slotsCount; ++slot) {
+        // The chunk in the slot is found from its first record, and its records are rebuilt.
+        const TerrainTileInstances::Instance* slotInstances = instances + slot * Terrain::TILES_COUNT_PER_CHUNK;
+        const Rectd chunkRect = Rectd::makeRect(slotInstances[0].tile[2], slotInstances[0].tile[0],
+            Terrain::CHUNK_DIMENSION, Terrain::CHUNK_DIMENSION);
+        TerrainTileInstances::Instance builtInstances[Terrain::TILES_COUNT_PER_CHUNK];
+        TerrainTileInstances::buildInstances(tiles, chunkRect, builtInstances);
+        TINYSC_CHECK(memcmp(builtInstances, slotInstances, sizeof(builtInstances)) == 0);
+
+        // Each tile of the chunk is a quad of the mesh, in the same order.
+        for (int i = 0; i < Terrain::TILES_COUNT_PER_CHUNK; ++i) {
+            const TerrainTileInstances::Instance& instance = slotInstances[i];
+            const TileShape& shape = TileShape::SHAPES()[instance.tile[3]];
+            const MeshVertex* quad = vertices + (slot * Terrain::TILES_COUNT_PER_CHUNK + i) * 4;
+            for (int iVert = 0; iVert < 4; ++iVert) {
+                TINYSC_CHECK(quad[iVert].corner[0] == instance.tile[0] + (iVert >> 1));
+                TINYSC_CHECK(quad[iVert].corner[1] == instance.tile[1] + shape.vertexLevels[iVert]);
+                TINYSC_CHECK(quad[iVert].corner[2] == instance.tile[2] + (iVert & 1));
+                TINYSC_CHECK(quad[iVert].normal == instance.normals[iVert]);
+            }
+        }
+    }
+}
+
+TINYSC_TEST(TerrainTileInstances, QuadCornersSplitLikeShapes)
+{
+    // The shared quad is drawn as faces (0, 1, 2) and (0, 2, 3) of its vertices, which must be the
+    // faces of the tile's shape with the same winding.
+    auto rotate = [](std::array<int, 3> face) {
+        std::rotate(face.begin(), std::min_element(face.begin(), face.end()), face.end());
+        return face;
+    };
+
+    for (int type = 0; type < 15; ++type) {
+        const int* corners = TerrainTileInstances::QUAD_CORNERS[TerrainTileInstances::getDiagonal((ETileType)type)];
+        std::array<std::array<int, 3>, 2> quadFaces = { {
+            rotate({ { corners[0], corners[1], corners[2] } }), rotate({ { corners[0], corners[2], corners[3] } })
+        } };
+
+        const int* indices = TileShape::SHAPES()[type].indices;
+        std::array<std::array<int, 3>, 2> shapeFaces = { {
+            rotate({ { indices[0], indices[1], indices[2] } }), rotate({ { indices[3], indices[4], indices[5] } })
+        } };
+
+        std::sort(quadFaces.begin(), quadFaces.end());
+        std::sort(shapeFaces.begin(), shapeFaces.end());
+        TINYSC_CHECK(quadFaces == shapeFaces);
+    }
+}
+
+TINYSC_TEST(TerrainTileInstances, InstancesMatchMeshVertices)
+{
+    TestRenderSystem renderSystem;
+    IDirect3DDevice9* device = renderSystem.getDevice();
+
+    // Both terrains are sculpted by the same operations.
+    const Size2d dimension(64, 48);
+    Terrain meshTerrain(renderSystem.get());
+    TINYSC_CHECK(meshTerrain.initialize(dimension));
+    Terrain instancedTerrain(renderSystem.get());
+    TINYSC_CHECK(instancedTerrain.setRenderingMode(ETerrainRenderingMode::eInstanced));
+    TINYSC_CHECK(instancedTerrain.initialize(dimension));
+
+    TerrainModifier meshModifier(&meshTerrain);
+    TerrainModifier instancedModifier(&instancedTerrain);
+    std::mt19937 meshRandom(51), instancedRandom(51);
+    sculptRandomly(&meshModifier, dimension, 600, &meshRandom);
+    sculptRandomly(&instancedModifier, dimension, 600, &instancedRandom);
+    _checkInstancesMatchMesh(&meshTerrain, &instancedTerrain, device);
+
+    // Modified chunks and the chunks around them are rewritten in both buffers.
+    for (int i = 0; i < 20; ++i) {
+        sculptRandomly(&meshModifier, dimension, 5, &meshRandom);
+        sculptRandomly(&instancedModifier, dimension, 5, &instancedRandom);
+        _checkInstancesMatchMesh(&meshTerrain, &instancedTerrain, device);
+    }
+
+    // The mode can be switched on an initialized terrain.
+    TINYSC_CHECK(meshTerrain.setRenderingMode(ETerrainRenderingMode::eInstanced));
+    TINYSC_CHECK(instancedTerrain.setRenderingMode(ETerrainRenderingMode::eMesh));
+    _checkInstancesMatchMesh(&instancedTerrain, &meshTerrain, device);
+}
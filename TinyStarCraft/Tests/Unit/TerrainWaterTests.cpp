@@ -0,0 +1,267 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "TestTerrain.h"
+#include "Rendering/Terrain.h"
+#include "Rendering/TerrainModifier.h"
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+// Bytes of a water tile instance in the instance buffer, a position and a texture coordinate.
+static const size_t WATER_TILE_INSTANCE_SIZE = 5 * sizeof(float);
+
+/** Create a camera looking at the center of a terrain, which sees all of it. */
+static Camera _makeCameraSeeingAll(const Size2d& dimension)
+{
+    // The projection is orthographic, the viewport is as large as the terrain's diagonals.
+    const float viewportSize = 2.0f * Tile::SIZE * (dimension.x + dimension.y);
+    const float height = 400.0f;
+    const float lookAtOffset = height * sqrtf(1.5f);
+    const D3DXVECTOR3 center(Tile::SIZE * dimension.y * 0.5f, 0.0f, Tile::SIZE * dimension.x * 0.5f);
+    return Camera(Size2f(viewportSize, viewportSize), center + D3DXVECTOR3(lookAtOffset, height, lookAtOffset));
+}
+
+/**
+  	Draw the water of a terrain and get the instances it drew in order. The instance buffer is
+    written to buffer, nullptr if nothing is drawn.
+ */
+static std::vector<BYTE> _drawWater(Terrain* terrain, Camera* camera, IDirect3DDevice9* device,
+    const IDirect3DVertexBuffer9** buffer)
+{
+    device->clearDrawCalls();
+    terrain->drawWater(camera);
+
+    std::vector<BYTE> instances;
+    *buffer = nullptr;
+    for (const HeadlessDrawCall& drawCall : device->getDrawCalls()) {
+        const UINT instancesCount = drawCall.streamFrequencies[0] & ~D3DSTREAMSOURCE_INDEXEDDATA;
+        const std::vector<BYTE>& data = drawCall.streams[1]->getData();
+        TINYSC_CHECK(drawCall.streamOffsets[1] + instancesCount * WATER_TILE_INSTANCE_SIZE <= data.size());
+        instances.insert(instances.end(), data.begin() + drawCall.streamOffsets[1],
+            data.begin() + drawCall.streamOffsets[1] + instancesCount * WATER_TILE_INSTANCE_SIZE);
+        *buffer = drawCall.streams[1];
+    }
+    return instances;
+}
+
+/** Add or remove water on a random rectangle of tiles, at altitudes around the ground's. */
+static void _setWaterRandomly(Terrain* terrain, std::mt19937* random)
+{
+    const Size2d& dimension = terrain->getDimension();
+    const Rectd rect = Rectd::intersection(Rectd::makeRect((*random)() % dimension.x, (*random)() % dimension.y,
+        1 + (*random)() % 12, 1 + (*random)() % 12), Rectd::makeRect(Point2d::ZERO(), dimension));
+
+    TileStore tiles = terrain->getTilesData();
+    const bool hasWater = (*random)() % 4 != 0;
+    const float waterAltitude = ((int)((*random)() % 6) - 1) * Tile::HEIGHT_PER_LEVEL + 4.0f;
+    for (int y = rect.getTop(); y < rect.getBottom(); ++y) {
+        for (int x = rect.getLeft(); x < rect.getRight(); ++x)
+            tiles.setWater(y * dimension.x + x, hasWater, waterAltitude);
+    }
+
+    terrain->setTilesData(tiles, rect);
+}
+
+/** Count the water tiles in the chunks whose water surfaces are in a view frustum, by testing every chunk. */
+static size_t _countVisibleWaterTiles(const Terrain& terrain, const ViewFrustum& viewFrustum)
+{
+    const Size2d& dimension = terrain.getDimension();
+    const TileStore& tiles = terrain.getTilesData();
+    const int rowChunksCount = dimension.x / Terrain::CHUNK_DIMENSION;
+    const TerrainWaterChunks& waterChunks = terrain.getWaterChunks();
+
+    size_t tilesCount = 0;
+    for (size_t i = 0; i < waterChunks.getChunksCount(); ++i) {
+        const TerrainWaterChunks::Chunk& chunk = waterChunks.getChunk(i);
+        const Point2d firstTile = Point2d(chunk.index % rowChunksCount, chunk.index / rowChunksCount) * Terrain::CHUNK_DIMENSION;
+
+        // The AABB compounds the water surfaces of the tiles in the mask.
+        D3DXVECTOR3 min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (int bit = 0; bit < Terrain::TILES_COUNT_PER_CHUNK; ++bit) {
+            if ((chunk.tileMask & ((uint64_t)1 << bit)) == 0)
+                continue;
+
+            const Point2d location(firstTile.x + bit % Terrain::CHUNK_DIMENSION, firstTile.y + bit / Terrain::CHUNK_DIMENSION);
+            const float altitude = tiles.getWaterAltitude(location.y * dimension.x + location.x);
+            min = D3DXVECTOR3(std::min(min.x, Tile::SIZE * (location.y - 0.5f)), std::min(min.y, altitude),
+                std::min(min.z, Tile::SIZE * (location.x - 0.5f)));
+            max = D3DXVECTOR3(std::max(max.x, Tile::SIZE * (location.y + 0.5f)), std::max(max.y, altitude),
+                std::max(max.z, Tile::SIZE * (location.x + 0.5f)));
+        }
+
+        if (viewFrustum.hasIntersection(AABB(min, max)) != ViewFrustum::AABB_OUTSIDE)
+            tilesCount += chunk.tilesCount;
+    }
+    return tilesCount;
+}
+
+/** Check if a terrain's water chunks and instance buffer are the same as a terrain built from its tiles. */
+static void _checkSameAsRebuilt(RenderSystem* renderSystem, IDirect3DDevice9* device, Terrain* terrain)
+{
+    const Size2d& dimension = terrain->getDimension();
+    Terrain rebuilt(renderSystem);
+    TINYSC_CHECK(rebuilt.initialize(dimension, unpackTiles(terrain->getTilesData())));
+
+    const TerrainWaterChunks& waterChunks = terrain->getWaterChunks();
+    const TerrainWaterChunks& rebuiltWaterChunks = rebuilt.getWaterChunks();
+    TINYSC_CHECK(waterChunks.getChunksCount() == rebuiltWaterChunks.getChunksCount());
+    TINYSC_CHECK(waterChunks.getTilesCount() == rebuiltWaterChunks.getTilesCount());
+    if (waterChunks.getChunksCount() != rebuiltWaterChunks.getChunksCount())
+        return;
+
+    for (size_t i = 0; i < waterChunks.getChunksCount(); ++i) {
+        const TerrainWaterChunks::Chunk& chunk = waterChunks.getChunk(i);
+        const TerrainWaterChunks::Chunk& rebuiltChunk = rebuiltWaterChunks.getChunk(i);
+        TINYSC_CHECK(chunk.index == rebuiltChunk.index);
+        TINYSC_CHECK(chunk.tileMask == rebuiltChunk.tileMask);
+        TINYSC_CHECK(chunk.firstTile == rebuiltChunk.firstTile);
+        TINYSC_CHECK(chunk.tilesCount == rebuiltChunk.tilesCount);
+    }
+
+    // Regions are culled before their chunks, a stale region AABB would drop its chunks.
+    Camera camera = _makeCameraSeeingAll(dimension);
+    const IDirect3DVertexBuffer9* buffer = nullptr;
+    const IDirect3DVertexBuffer9* rebuiltBuffer = nullptr;
+    const std::vector<BYTE> instances = _drawWater(terrain, &camera, device, &buffer);
+    const std::vector<BYTE> rebuiltInstances = _drawWater(&rebuilt, &camera, device, &rebuiltBuffer);
+    TINYSC_CHECK(instances == rebuiltInstances);
+    TINYSC_CHECK(instances.size() == waterChunks.getTilesCount() * WATER_TILE_INSTANCE_SIZE);
+
+    // Cameras which see parts of the regions.
+    for (int y = 0; y < dimension.y; y += 12) {
+        for (int x = 0; x < dimension.x; x += 12) {
+            Camera nearCamera = makeCameraLookingAt(Point2d(x, y));
+            const std::vector<BYTE> nearInstances = _drawWater(terrain, &nearCamera, device, &buffer);
+            TINYSC_CHECK(nearInstances == _drawWater(&rebuilt, &nearCamera, device, &rebuiltBuffer));
+            TINYSC_CHECK(nearInstances.size() == _countVisibleWaterTiles(*terrain, nearCamera.getViewFrustum()) * WATER_TILE_INSTANCE_SIZE);
+        }
+    }
+}
+
+TINYSC_TEST(TerrainWater, IncrementalUpdateMatchesRebuild)
+{
+    TestRenderSystem renderSystem;
+    std::mt19937 random(31);
+
+    // Not a multiple of the region dimension in chunks.
+    const Size2d dimension(72, 88);
+    Terrain terrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension));
+
+    for (int i = 0; i < 300; ++i) {
+        if (i % 10 == 9) {
+            // Sculpting moves the ground above and below the water. The modifier is created again,
+            // since it keeps its own tiles, which must have the water.
+            TerrainModifier modifier(&terrain);
+            sculptRandomly(&modifier, dimension, 20, &random);
+        }
+        else {
+            _setWaterRandomly(&terrain, &random);
+        }
+
+        if (i % 20 == 19)
+            _checkSameAsRebuilt(renderSystem.get(), renderSystem.getDevice(), &terrain);
+    }
+
+    TINYSC_CHECK(terrain.getWaterChunks().getTilesCount() > 1000);
+}
+
+TINYSC_TEST(TerrainWater, OnlyModifiedInstancesAreWritten)
+{
+    TestRenderSystem renderSystem;
+    IDirect3DDevice9* device = renderSystem.getDevice();
+
+    // Water on the left half, chunks are 8 * 8 tiles.
+    const Size2d dimension(64, 64);
+    std::vector<Tile> tiles(dimension.x * dimension.y);
+    for (int y = 0; y < dimension.y; ++y) {
+        for (int x = 0; x < dimension.x / 2; ++x)
+            tiles[y * dimension.x + x] = Tile(ETileType::Flat, 0, true, 10.0f);
+    }
+
+    Terrain terrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension, tiles));
+    Camera camera = _makeCameraSeeingAll(dimension);
+    const IDirect3DVertexBuffer9* buffer = nullptr;
+    _drawWater(&terrain, &camera, device, &buffer);
+    TINYSC_CHECK(buffer != nullptr);
+    if (!buffer)
+        return;
+
+    const size_t locksCount = buffer->getLocksCount();
+    const size_t lockedBytes = buffer->getLockedBytes();
+
+    // Tiles without water are modified, and water altitudes are set to their current value.
+    TileStore tilesData = terrain.getTilesData();
+    tilesData.setLevel(10 * dimension.x + 50, 1);
+    tilesData.setWater(20 * dimension.x + 5, true, 10.0f);
+    terrain.setTilesData(tilesData, Rectd::makeRect(0, 10, 64, 11));
+    TINYSC_CHECK(buffer->getLocksCount() == locksCount);
+
+    // The altitude of one tile is modified, the instances of its chunk are rewritten.
+    tilesData = terrain.getTilesData();
+    tilesData.setWater(20 * dimension.x + 5, true, 12.0f);
+    terrain.setTilesData(tilesData, Rectd::makeRect(5, 20, 1, 1));
+    TINYSC_CHECK(buffer->getLocksCount() == locksCount + 1);
+    TINYSC_CHECK(buffer->getLockedBytes() == lockedBytes + 64 * WATER_TILE_INSTANCE_SIZE);
+
+    // Water is removed from a tile, instances from its chunk to the end of the list are moved.
+    const int tilesCount = terrain.getWaterChunks().getTilesCount();
+    tilesData = terrain.getTilesData();
+    tilesData.setWater(20 * dimension.x + 6, false, 0.0f);
+    terrain.setTilesData(tilesData, Rectd::makeRect(6, 20, 1, 1));
+    TINYSC_CHECK(terrain.getWaterChunks().getTilesCount() == tilesCount - 1);
+
+    const int chunk = terrain.getWaterChunks().findChunk(Point2d(0, 2));
+    TINYSC_CHECK(chunk >= 0);
+    const int movedTilesCount = tilesCount - 1 - terrain.getWaterChunks().getChunk(chunk).firstTile;
+    TINYSC_CHECK(buffer->getLocksCount() == locksCount + 2);
+    TINYSC_CHECK(buffer->getLockedBytes() == lockedBytes + (64 + movedTilesCount) * WATER_TILE_INSTANCE_SIZE);
+
+    _checkSameAsRebuilt(renderSystem.get(), device, &terrain);
+}
+
+TINYSC_TEST(TerrainWater, FailedBufferGrowthKeepsPreviousBuffer)
+{
+    TestRenderSystem renderSystem;
+    IDirect3DDevice9* device = renderSystem.getDevice();
+
+    const Size2d dimension(32, 32);
+    Terrain terrain(renderSystem.get());
+    TINYSC_CHECK(terrain.initialize(dimension));
+
+    // A chunk of water.
+    TileStore tilesData = terrain.getTilesData();
+    for (int y = 0; y < 8; ++y) {
+        for (int x = 0; x < 8; ++x)
+            tilesData.setWater(y * dimension.x + x, true, 10.0f);
+    }
+    terrain.setTilesData(tilesData, Rectd::makeRect(0, 0, 8, 8));
+
+    Camera camera = _makeCameraSeeingAll(dimension);
+    const IDirect3DVertexBuffer9* buffer = nullptr;
+    TINYSC_CHECK(_drawWater(&terrain, &camera, device, &buffer).size() == 64 * WATER_TILE_INSTANCE_SIZE);
+
+    // The buffer fails to grow for all of the water, the tiles which fit are still drawn.
+    tilesData = terrain.getTilesData();
+    for (int i = 0; i < dimension.x * dimension.y; ++i)
+        tilesData.setWater(i, true, 10.0f);
+    device->failNextBufferCreations(1);
+    terrain.setTilesData(tilesData, Rectd::makeRect(Point2d::ZERO(), dimension));
+
+    const IDirect3DVertexBuffer9* failedBuffer = nullptr;
+    TINYSC_CHECK(_drawWater(&terrain, &camera, device, &failedBuffer).size() == 64 * WATER_TILE_INSTANCE_SIZE);
+    TINYSC_CHECK(failedBuffer == buffer);
+
+    // The next modification grows the buffer with all instances.
+    tilesData = terrain.getTilesData();
+    tilesData.setWater(0, true, 12.0f);
+    terrain.setTilesData(tilesData, Rectd::makeRect(0, 0, 1, 1));
+    _checkSameAsRebuilt(renderSystem.get(), device, &terrain);
+
+    // Without any buffer, nothing is drawn.
+    Terrain emptyTerrain(renderSystem.get());
+    device->failNextBufferCreations(1);
+    TINYSC_CHECK(emptyTerrain.initialize(dimension, unpackTiles(terrain.getTilesData())));
+    TINYSC_CHECK(_drawWater(&emptyTerrain, &camera, device, &failedBuffer).empty());
+}
@@ -0,0 +1,147 @@
+#include "Precompiled.h"
+#include "TestFramework.h"
+#include "Rendering/Tile.h"
+
+#include <random>
+
+using namespace TinyStarCraft;
+using namespace TinyStarCraft::Testing;
+
+/** Make a random valid packed tile. */
+static TileStore::PackedTile _makeRandomTile(std::mt19937* random)
+{
+    TileStore::PackedTile tile;
+    tile.typeAndFlags = (uint8_t)((*random)() % 15 | (((*random)() % 2) ? 0x10 : 0));
+    tile.level = (int8_t)((int)((*random)() % 256) - 128);
+    tile.waterAltitude = (int16_t)((int)((*random)() % 65536) - 32768);
+    return tile;
+}
+
+/** Determine if a store has the tiles of a model. */
+static bool _hasTiles(const TileStore& store, const std::vector<TileStore::PackedTile>& tiles)
+{
+    for (int i = 0; i < (int)tiles.size(); ++i) {
+        const TileStore::PackedTile tile = store.getPackedTile(i);
+        if (tile.typeAndFlags != tiles[i].typeAndFlags || tile.level != tiles[i].level || tile.waterAltitude != tiles[i].waterAltitude)
+            return false;
+    }
+    return true;
+}
+
+/** Make a random rectangle in a grid of the dimension, which may be empty. */
+static Rectd _makeRandomRect(const Size2d& dimension, std::mt19937* random)
+{
+    const int left = (*random)() % (dimension.x + 1), top = (*random)() % (dimension.y + 1);
+    return Rectd::makeRect(left, top, (*random)() % (dimension.x - left + 1), (*random)() % (dimension.y - top + 1));
+}
+
+TINYSC_TEST(TileStore, CopiesAreIsolated)
+{
+    const Size2d dimension(100, 30);
+    TileStore store;
+    store.resize(dimension);
+    const TileStore flatStore = store;
+
+    // A copy shares the pages of the store until one of them writes to a page.
+    TileStore copy = store;
+    TINYSC_CHECK(copy.isSharingTile(store, 0) && copy.isSharingTile(store, 2999));
+    copy.setLevel(1500, 7);
+    TINYSC_CHECK(copy.getLevel(1500) == 7 && store.getLevel(1500) == 0);
+    TINYSC_CHECK(!copy.isSharingTile(store, 1500) && copy.isSharingTile(store, 0));
+
+    // Every page of a resized store shares the same flat tiles, which stay flat.
+    store.setTile(5, Tile(ETileType::SouthA, -3, true, 10.0f));
+    TINYSC_CHECK(store.getTile(5).type == ETileType::SouthA && copy.getTile(5).type == ETileType::Flat);
+    TINYSC_CHECK(flatStore.getLevel(5) == 0 && flatStore.getLevel(1500) == 0 && flatStore.getLevel(2005) == 0);
+    store.setLevel(2005, 1);
+    TINYSC_CHECK(flatStore.getLevel(2005) == 0 && copy.getLevel(2005) == 0);
+}
+
+TINYSC_TEST(TileStore, OperationsMatchModel)
+{
+    std::mt19937 random(25);
+
+    // Dimensions narrower and wider than a page, and one which isn't a multiple of it.
+    const Size2d dimensions[] = { Size2d(16, 200), Size2d(100, 37), Size2d(1500, 3) };
+    for (const Size2d& dimension : dimensions) {
+        const size_t tilesCount = dimension.x * dimension.y;
+        std::vector<TileStore> stores(3);
+        std::vector<std::vector<TileStore::PackedTile>> models(3, std::vector<TileStore::PackedTile>(tilesCount));
+        for (size_t i = 0; i < stores.size(); ++i) {
+            stores[i].resize(dimension);
+            models[i].assign(tilesCount, stores[i].getPackedTile(0));
+        }
+
+        for (int step = 0; step < 4000; ++step) {
+            const int target = random() % 3, source = random() % 3;
+            switch (random() % 6) {
+            case 0:
+            case 1: {
+                const int index = random() % tilesCount;
+                models[target][index] = _makeRandomTile(&random);
+                stores[target].setPackedTile(index, models[target][index]);
+                break;
+            }
+            case 2: {
+                const int index = random() % tilesCount;
+                std::vector<TileStore::PackedTile> tiles(1 + random() % Math::min<size_t>(tilesCount - index, 3000));
+                for (TileStore::PackedTile& tile : tiles)
+                    tile = _makeRandomTile(&random);
+                std::copy(tiles.begin(), tiles.end(), models[target].begin() + index);
+                stores[target].setPackedTiles(index, tiles.data(), (int)tiles.size());
+                break;
+            }
+            case 3:
+                if (random() % 8 == 0) {
+                    stores[target] = stores[source];
+                    models[target] = models[source];
+                }
+                break;
+            default: {
+                // Whole rows, which share pages, and random rectangles.
+                Rectd rect = _makeRandomRect(dimension, &random);
+                if (random() % 2)
+                    rect = Rectd::makeRect(0, rect.getTop(), dimension.x, rect.getHeight());
+                for (int y = rect.getTop(); y < rect.getBottom(); ++y) {
+                    for (int x = rect.getLeft(); x < rect.getRight(); ++x)
+                        models[target][y * dimension.x + x] = models[source][y * dimension.x + x];
+                }
+                (random() % 2) ? stores[target].copyRect(stores[source], rect) : stores[target].shareRect(stores[source], rect);
+                break;
+            }
+            }
+
+            for (size_t i = 0; i < stores.size(); ++i)
+                TINYSC_CHECK(_hasTiles(stores[i], models[i]));
+        }
+    }
+}
+
+TINYSC_TEST(TileStore, ShareRectSharesCoveredPagesOnly)
+{
+    const Size2d dimension(64, 64);
+    TileStore store;
+    store.resize(dimension);
+    TileStore other = store;
+
+    // Every page of the other store holds 16 rows, and is modified.
+    for (int i = 0; i < (int)other.size(); ++i)
+        other.setLevel(i, 1 + i / (16 * dimension.x));
+
+    // A page partly in the rectangle is copied, and its tiles out of it are kept.
+    store.shareRect(other, Rectd::makeRect(8, 4, 4, 20));
+    TINYSC_CHECK(!store.isSharingTile(other, 0) && !store.isSharingTile(other, 16 * dimension.x));
+    TINYSC_CHECK(store.getLevel(4 * dimension.x + 8) == 1 && store.getLevel(23 * dimension.x + 11) == 2);
+    TINYSC_CHECK(store.getLevel(4 * dimension.x + 7) == 0 && store.getLevel(24 * dimension.x + 8) == 0);
+
+    // Pages wholly in the rectangle are shared.
+    store.shareRect(other, Rectd::makeRect(0, 10, dimension.x, 40));
+    TINYSC_CHECK(store.isSharingTile(other, 16 * dimension.x) && store.isSharingTile(other, 47 * dimension.x + 63));
+    TINYSC_CHECK(!store.isSharingTile(other, 0) && !store.isSharingTile(other, 48 * dimension.x));
+    TINYSC_CHECK(store.getLevel(9 * dimension.x) == 0 && store.getLevel(10 * dimension.x) == 1);
+    TINYSC_CHECK(store.getLevel(49 * dimension.x) == 4 && store.getLevel(50 * dimension.x) == 0);
+
+    // A shared page is copied by the first store writing to it.
+    other.setLevel(20 * dimension.x, 9);
+    TINYSC_CHECK(store.getLevel(20 * dimension.x) == 2 && !store.isSharingTile(other, 20 * dimension.x));
+}
@@ -13,7 +13,7 @@ ResourceManager::~ResourceManager()
 
 Resource* ResourceManager::getResource(const std::string& name) const
 {
-    auto& it = mResources.find(name);
+    auto it = mResources.find(name);
     if (it == mResources.end())
         return nullptr;
     else
@@ -29,7 +29,7 @@ void ResourceManager::addResource(Resource* resource)
 
 void ResourceManager::destroyResource(const std::string& name)
 {
-    auto& it = mResources.find(name);
+    auto it = mResources.find(name);
     if (it != mResources.end()) 
     {
         // Delete the resource through its pointer and remove the entry
@@ -2,10 +2,15 @@
 
 #include <strsafe.h>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <exception>
+#include <fstream>
 #include <functional>
 #include <sstream>
 #include <string>
@@ -21,5 +26,9 @@
 #include <d3dx9.h>
 #include <DxErr.h>
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 
 
@@ -141,6 +141,15 @@ ViewFrustum::ViewFrustum(const D3DXPLANE planes[4])
         mPlanes[i] = planes[i];
 }
 
+bool ViewFrustum::operator==(const ViewFrustum& other) const
+{
+    for (int i = 0; i < 4; ++i) {
+        if (mPlanes[i] != other.mPlanes[i])
+            return false;
+    }
+    return true;
+}
+
 int ViewFrustum::hasIntersection(const AABB& aabb) const
 {
     const D3DXVECTOR3& aabbMin = aabb.getMin();
@@ -198,4 +207,56 @@ int ViewFrustum::hasIntersection(const AABB& aabb) const
     return ret;
 }
 
+void ViewFrustum::hasIntersection4(const float minX[4], const float minY[4], const float minZ[4],
+    const float maxX[4], const float maxY[4], const float maxZ[4], int results[4]) const
+{
+#if defined(_M_IX86) || defined(_M_X64)
+    const __m128 boxMinX = _mm_loadu_ps(minX), boxMinY = _mm_loadu_ps(minY), boxMinZ = _mm_loadu_ps(minZ);
+    const __m128 boxMaxX = _mm_loadu_ps(maxX), boxMaxY = _mm_loadu_ps(maxY), boxMaxZ = _mm_loadu_ps(maxZ);
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 outside = zero, intersect = zero;
+    for (int i = 0; i < 4; ++i) {
+        const D3DXPLANE& plane = mPlanes[i];
+
+        // Choose the components of the min & max points along the plane normal. The plane is 
+        // the same for all 4 AABBs, so the choice is made only once.
+        const __m128 maxPointX = plane.a > 0.0f ? boxMaxX : boxMinX;
+        const __m128 minPointX = plane.a > 0.0f ? boxMinX : boxMaxX;
+        const __m128 maxPointY = plane.b > 0.0f ? boxMaxY : boxMinY;
+        const __m128 minPointY = plane.b > 0.0f ? boxMinY : boxMaxY;
+        const __m128 maxPointZ = plane.c > 0.0f ? boxMaxZ : boxMinZ;
+        const __m128 minPointZ = plane.c > 0.0f ? boxMinZ : boxMaxZ;
+
+        const __m128 a = _mm_set1_ps(plane.a), b = _mm_set1_ps(plane.b);
+        const __m128 c = _mm_set1_ps(plane.c), d = _mm_set1_ps(plane.d);
+
+        // Same evaluation order as D3DXPlaneDot, so results match the scalar test exactly.
+        const __m128 maxDot = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a, maxPointX), _mm_mul_ps(b, maxPointY)), 
+            _mm_mul_ps(c, maxPointZ)), d);
+        const __m128 minDot = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a, minPointX), _mm_mul_ps(b, minPointY)),
+            _mm_mul_ps(c, minPointZ)), d);
+
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(maxDot, zero));
+        intersect = _mm_or_ps(intersect, _mm_cmplt_ps(minDot, zero));
+    }
+
+    const int outsideMask = _mm_movemask_ps(outside);
+    const int intersectMask = _mm_movemask_ps(intersect);
+    for (int i = 0; i < 4; ++i) {
+        if (outsideMask & (1 << i))
+            results[i] = AABB_OUTSIDE;
+        else if (intersectMask & (1 << i))
+            results[i] = AABB_INTERSECT;
+        else
+            results[i] = AABB_INSIDE;
+    }
+#else
+    for (int i = 0; i < 4; ++i) {
+        const AABB aabb(D3DXVECTOR3(minX[i], minY[i], minZ[i]), D3DXVECTOR3(maxX[i], maxY[i], maxZ[i]));
+        results[i] = hasIntersection(aabb);
+    }
+#endif
+}
+
 }
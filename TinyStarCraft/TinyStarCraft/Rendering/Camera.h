@@ -25,6 +25,9 @@ public:
     /** Modify one of the planes in frustum */
     void setPlane(int i, const D3DXPLANE& plane) { mPlanes[i] = plane; }
 
+    /** Check if all planes of two frustums are exactly the same. */
+    bool operator==(const ViewFrustum& other) const;
+
     /** Test whether a point is inside the frustum. */
     bool isPointInside(const D3DXVECTOR4& point) const
     {
@@ -51,6 +54,17 @@ public:
      */
     int hasIntersection(const AABB& aabb) const;
 
+    /**
+      	Test whether 4 AABBs have intersection with this frustum at once.
+    @remarks
+        The AABBs are given as separated arrays of their min & max components. The arrays are not
+        required to be aligned. An empty AABB, whose min is greater than its max, is always outside.
+    @param results
+        Receives the same result as hasIntersection for each AABB.
+     */
+    void hasIntersection4(const float minX[4], const float minY[4], const float minZ[4],
+        const float maxX[4], const float maxY[4], const float maxZ[4], int results[4]) const;
+
 private:
     D3DXPLANE mPlanes[4];
 };
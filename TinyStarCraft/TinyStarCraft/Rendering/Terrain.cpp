@@ -2,6 +2,9 @@
 #include "Terrain.h"
 #include "Camera.h"
 #include "RenderSystem.h"
+#include "TerrainMapFile.h"
+#include "TerrainNormals.h"
+#include "TerrainTileInstances.h"
 #include "Asset/Effect.h"
 #include "Asset/EffectManager.h"
 #include "Asset/Material.h"
@@ -17,275 +20,353 @@
 namespace TinyStarCraft
 {
 
-static const int    WATER_TILES_BATCH_SIZE = 64;
 static const float  WATER_TILE_TEXCOORD_SIZE = 0.2f;
 
-/** Vertex structure for water mesh */
+/** Vertex structure for water tile mesh */
 struct WaterVertex
 {
     D3DXVECTOR3 pos;
     D3DXVECTOR2 texcoord;
-    float index;
 };
 
-/** Vertex structure for terrain mesh */
+/** Instance structure of a water tile, in the second vertex stream */
+struct WaterTileInstance
+{
+    D3DXVECTOR3 position;
+    D3DXVECTOR2 texcoord;
+};
+
+/**
+  	Vertex structure for terrain mesh.
+@remarks
+    Vertices always lie on the tiles grid's corners and at whole altitude levels, so positions are 
+    stored exactly as integers and scaled in the vertex shader. Texture coordinates are derived from
+    the positions in the vertex shader as well.
+ */
 struct TerrainVertex
 {
-    D3DXVECTOR3 pos;
-    D3DXVECTOR3 normal;
-    D3DXVECTOR2 blendTexcoord;
-    D3DXVECTOR2 controlTexcoord;
+    short corner[4];    // Row and column of the tiles grid's corner and altitude level, as (row, level, column, 1).
+    D3DCOLOR normal;    // Normal packed into RGB as normal * 0.5 + 0.5.
+};
+
+static_assert(sizeof(TerrainVertex) == 12, "TerrainVertex must match the terrain vertex declaration.");
+static_assert(offsetof(TerrainVertex, normal) == 8, "TerrainVertex must match the terrain vertex declaration.");
+static_assert(Terrain::CHUNK_SLOT_BYTES == Terrain::TILES_COUNT_PER_CHUNK * (4 * sizeof(TerrainVertex) + 6 * sizeof(unsigned) + 2 * sizeof(DWORD)),
+    "CHUNK_SLOT_BYTES must match the terrain mesh.");
+
+/**
+  	Vertex structure for the quad shared by the tile instances.
+@remarks
+    Masks select the vertex's corner of the tile, one component per corner, for each diagonal of 
+    the tile's faces. See TerrainTileInstances::QUAD_CORNERS.
+ */
+struct TileQuadVertex
+{
+    D3DXVECTOR4 cornerMasks[2];
+};
+
+static_assert(sizeof(TerrainTileInstances::Instance) == 24, "Instance must match the tile vertex declaration.");
+
+/**
+  	Walk through the tiles in a rectangle of the grid along a ray's projection on the ground. Tiles
+    are visited front-to-back, and hits in a tile are inside the tile's column, so they are nearer 
+    than any hit in the tiles after it.
+ */
+class TileGridWalker
+{
+public:
+    /**
+      	Start walking.
+    @param bounds
+        AABB containing the tiles in the rectangle. The ray is clipped by it.
+    @return
+        Returns false if the ray misses the bounds within maxDistance.
+     */
+    bool begin(const Ray& ray, const AABB& bounds, const Rectd& rect, float maxDistance)
+    {
+        float t[2];
+        if (!ray.intersectAABB(bounds, t) || t[1] < 0.0f)
+            return false;
+
+        const float tStart = Math::max<float>(t[0], 0.0f);
+        mTEnd = Math::min<float>(t[1], maxDistance);
+        if (tStart > mTEnd)
+            return false;
+
+        // Grid x goes along world z axis and grid y goes along world x axis, and tile centers are on
+        // integer grid coordinates.
+        const D3DXVECTOR3 start = ray.getPointOnRay(tStart);
+        const float gridStart[2] = { start.z / Tile::SIZE + 0.5f, start.x / Tile::SIZE + 0.5f };
+        const float gridDirection[2] = { ray.getDirection().z / Tile::SIZE, ray.getDirection().x / Tile::SIZE };
+        mCellMin[0] = rect.getLeft();
+        mCellMin[1] = rect.getTop();
+        mCellMax[0] = rect.getRight() - 1;
+        mCellMax[1] = rect.getBottom() - 1;
+
+        for (int axis = 0; axis < 2; ++axis) {
+            // The start point may be slightly outside of the rectangle because of floating point error.
+            mCell[axis] = Math::clamp<int>((int)floorf(gridStart[axis]), mCellMin[axis], mCellMax[axis]);
+
+            if (gridDirection[axis] > 0.0f) {
+                mStep[axis] = 1;
+                mTDelta[axis] = 1.0f / gridDirection[axis];
+                mTMax[axis] = tStart + (mCell[axis] + 1 - gridStart[axis]) * mTDelta[axis];
+            }
+            else if (gridDirection[axis] < 0.0f) {
+                mStep[axis] = -1;
+                mTDelta[axis] = -1.0f / gridDirection[axis];
+                mTMax[axis] = tStart + (gridStart[axis] - mCell[axis]) * mTDelta[axis];
+            }
+            else {
+                // The ray never crosses a cell boundary on this axis.
+                mStep[axis] = 0;
+                mTDelta[axis] = FLT_MAX;
+                mTMax[axis] = FLT_MAX;
+            }
+        }
+
+        mTCell = tStart;
+        return true;
+    }
+
+    /** Get the current tile and step to the next one. Returns false if the walk is finished. */
+    bool next(Point2d* location)
+    {
+        if (mTCell > mTEnd)
+            return false;
+
+        *location = Point2d(mCell[0], mCell[1]);
+
+        const int axis = mTMax[0] < mTMax[1] ? 0 : 1;
+        mCell[axis] += mStep[axis];
+        if (mCell[axis] < mCellMin[axis] || mCell[axis] > mCellMax[axis])
+            // Leaving the rectangle.
+            mTCell = FLT_MAX;
+        else
+            mTCell = mTMax[axis];
+        mTMax[axis] += mTDelta[axis];
+
+        return true;
+    }
+
+private:
+    int mCell[2], mStep[2];
+    int mCellMin[2], mCellMax[2];
+    float mTMax[2], mTDelta[2];
+    float mTCell, mTEnd;
 };
 
 //-------------------------------------------------------------------------------------------------
 const std::array<Terrain::TileGeometry, 15>& Terrain::TILE_GEOMETRIES()
 {
-    static const std::array<Terrain::TileGeometry, 15> geometries =
-    {
-        {
-            // RAMPTYPE_FLAT
-            {
-                {
-                    { -Tile::SIZE * 0.5f, 0.0f, -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f, 0.0f,  Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f, 0.0f, -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f, 0.0f,  Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 2, 2, 1, 3
-                }
-            },
-            // RAMPTYPE_SOUTH_A
-            {
-                {
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,                      0.0f,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 2, 2, 1, 3
-                }
-            },
-            // RAMPTYPE_WEST_A
-            {
-                {
-                    { -Tile::SIZE * 0.5f,                      0.0f,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 3, 0, 3, 2
-                }
-            },
-            // RAMPTYPE_NORTH_A
-            {
-                {
-                    { -Tile::SIZE * 0.5f,                      0.0f,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,                      0.0f,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 2, 2, 1, 3
-                }
-            },
-            // RAMPTYPE_EAST_A
-            {
-                {
-                    { -Tile::SIZE * 0.5f,                      0.0f,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,                      0.0f,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 3, 0, 3, 2
-                }
-            },
-            // RAMPTYPE_SOUTHWEST
-            {
-                {
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 2, 2, 1, 3
-                }
-            },
-            // RAMPTYPE_NORTHWEST
-            {
-                {
-                    { -Tile::SIZE * 0.5f,                      0.0f,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 2, 2, 1, 3
-                }
-            },
-            // RAMPTYPE_NORTHEAST
-            {
-                {
-                    { -Tile::SIZE * 0.5f,                     0.0f,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,                     0.0f,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,   Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,   Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 2, 2, 1, 3
-                }
-            },
-            // RAMPTYPE_SOUTHEAST
-            {
-                {
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,                      0.0f,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 2, 2, 1, 3
-                }
-            },
-            // RAMPTYPE_SOUTH_B
-            {
-                {
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 2, 2, 1, 3
-                }
-            },
-            // RAMPTYPE_WEST_B
-            {
-                {
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 3, 0, 3, 2
-                }
-            },
-            // RAMPTYPE_NORTH_B
-            {
-                {
-                    { -Tile::SIZE * 0.5f,                      0.0f,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 2, 2, 1, 3
-                }
-            },
-            // RAMPTYPE_EAST_B
-            {
-                {
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,                      0.0f,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 3, 0, 3, 2
-                }
-            },
-            // RAMPTYPE_DOUBLE_WESTTOEAST
-            {
-                {
-                    { -Tile::SIZE * 0.5f,                      0.0f,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 3, 0, 3, 2
-                }
-            },
-            // RAMPTYPE_DOUBLE_NORTHTOSOUTH
-            {
-                {
-                    { -Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,  -Tile::SIZE * 0.5f },
-                    { -Tile::SIZE * 0.5f,                      0.0f,   Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,                      0.0f,  -Tile::SIZE * 0.5f },
-                    {  Tile::SIZE * 0.5f,    Tile::HEIGHT_PER_LEVEL,   Tile::SIZE * 0.5f }
-                },
-                {
-                    0, 1, 2, 2, 1, 3
-                }
+    static const std::array<TileGeometry, 15> geometries = []() {
+        std::array<TileGeometry, 15> geometries;
+
+        for (size_t type = 0; type < geometries.size(); ++type) {
+            const TileShape& shape = TileShape::SHAPES()[type];
+            TileGeometry& geometry = geometries[type];
+
+            for (int i = 0; i < 4; ++i) {
+                geometry.vertices[i].x = (i & 2) ? Tile::SIZE * 0.5f : -Tile::SIZE * 0.5f;
+                geometry.vertices[i].y = shape.vertexLevels[i] * Tile::HEIGHT_PER_LEVEL;
+                geometry.vertices[i].z = (i & 1) ? Tile::SIZE * 0.5f : -Tile::SIZE * 0.5f;
             }
+
+            std::copy(shape.indices, shape.indices + 6, geometry.indices);
         }
-    };
+
+        return geometries;
+    }();
 
     return geometries;
 }
 //-------------------------------------------------------------------------------------------------
+const std::array<Terrain::TileSurface, 15>& Terrain::TILE_SURFACES()
+{
+    static const std::array<TileSurface, 15> surfaces = []() {
+        std::array<TileSurface, 15> surfaces;
+
+        for (size_t type = 0; type < surfaces.size(); ++type) {
+            const TileGeometry& geometry = TILE_GEOMETRIES()[type];
+            TileSurface& surface = surfaces[type];
+
+            for (int face = 0; face < 2; ++face) {
+                // Solve dot(normal, p - v0) = 0 for p.y.
+                const D3DXVECTOR3 normal = geometry.calcFaceNormal(face);
+                const D3DXVECTOR3& v0 = geometry.vertices[geometry.indices[face * 3]];
+                surface.normals[face] = normal;
+                surface.slopeX[face] = -normal.x / normal.y;
+                surface.slopeZ[face] = -normal.z / normal.y;
+                surface.offset[face] = v0.y - surface.slopeX[face] * v0.x - surface.slopeZ[face] * v0.z;
+            }
+
+            // Find the edge shared by the two faces, and the vertex of face 0 which is not on it.
+            int edge[2], edgeCount = 0, opposite = 0;
+            for (int i = 0; i < 3; ++i) {
+                const int vertex = geometry.indices[i];
+                const int* face1 = &geometry.indices[3];
+                if (std::find(face1, face1 + 3, vertex) != face1 + 3)
+                    edge[edgeCount++] = vertex;
+                else
+                    opposite = vertex;
+            }
+            TINYSC_ASSERT(edgeCount == 2, "Faces of a tile should share an edge.");
+
+            // Line through the shared edge on x-z plane, oriented to face 0.
+            const D3DXVECTOR3& p = geometry.vertices[edge[0]];
+            const D3DXVECTOR3& q = geometry.vertices[edge[1]];
+            const D3DXVECTOR3& r = geometry.vertices[opposite];
+            D3DXVECTOR3 line(p.z - q.z, q.x - p.x, 0.0f);
+            line.z = -(line.x * p.x + line.y * p.z);
+            if (line.x * r.x + line.y * r.z + line.z < 0.0f)
+                line = -line;
+            surface.splitLine = line;
+        }
+
+        return surfaces;
+    }();
+
+    return surfaces;
+}
+//-------------------------------------------------------------------------------------------------
 Terrain::Terrain(RenderSystem* renderSystem)
     : mRenderSystem(renderSystem),
       mTerrainMesh(nullptr),
-      mWaterTileInstancesMesh(nullptr),
-      mWaterTileInstancePositions(WATER_TILES_BATCH_SIZE),
-      mWaterTileInstanceTexcoords(WATER_TILES_BATCH_SIZE)
+      mWaterTileMesh(nullptr),
+      mTerrainVertexDeclaration(nullptr),
+      mTileMesh(nullptr),
+      mTileInstanceBuffer(nullptr),
+      mTileVertexDeclaration(nullptr),
+      mRenderingMode(ETerrainRenderingMode::eMesh),
+      mStreamingBudget(DEFAULT_STREAMING_BUDGET),
+      mMeshingMode(ETerrainMeshingMode::ePerTile),
+      mCullingMode(ETerrainCullingMode::eIsometric),
+      mIsVisibleChunksCacheValid(false),
+      mDrawStats(),
+      mWaterTileInstanceBuffer(nullptr),
+      mWaterTileInstanceBufferCapacity(0),
+      mWaterVertexDeclaration(nullptr)
 {
 }
 //-------------------------------------------------------------------------------------------------
 Terrain::~Terrain()
 {
-    delete mTerrainMesh;
-    delete mWaterTileInstancesMesh;
+    _releaseTerrainGeometry();
+    delete mWaterTileMesh;
+
+    if (mWaterTileInstanceBuffer)
+        mWaterTileInstanceBuffer->Release();
+
+    if (mWaterVertexDeclaration)
+        mWaterVertexDeclaration->Release();
 }
 //-------------------------------------------------------------------------------------------------
 
 bool Terrain::initialize(const Size2d& dimension, const std::vector<Tile>& tilesData)
 {
-    return _initializeImpl(dimension, tilesData);
+    return _initializeImpl(TileStore(dimension, tilesData));
 }
 
 bool Terrain::initialize(const Size2d& dimension, Tile initialTile)
 {
     std::vector<Tile> tilesData(dimension.x * dimension.y, initialTile);
-    return _initializeImpl(dimension, tilesData);
+    return _initializeImpl(TileStore(dimension, tilesData));
+}
+
+bool Terrain::initialize(const TerrainMapFile& mapFile)
+{
+    TINYSC_ASSERT(mapFile.isOpen(), "Map file is not opened.");
+
+    TileStore tilesData;
+    if (!mapFile.decodeTiles(&tilesData))
+        return false;
+
+    return _initializeImpl(tilesData, &mapFile);
 }
 //-------------------------------------------------------------------------------------------------
 void Terrain::setTilesData(const std::vector<Tile>& tilesData)
+{
+    setTilesData(TileStore(mDimension, tilesData), Rectd::makeRect(Point2d::ZERO(), mDimension));
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::setTilesData(const TileStore& tilesData, const Rectd& dirtyRect)
 {
     // Validate tiles data size
     TINYSC_ASSERT(tilesData.size() == mDimension.x * mDimension.y, "Tiles data's length is invalid.");
 
-    // Update tiles data.
-    mTilesData = tilesData;
+    const Rectd rect = Rectd::intersection(dirtyRect, Rectd::makeRect(Point2d::ZERO(), mDimension));
+    if (rect.getWidth() <= 0 || rect.getHeight() <= 0)
+        // Nothing is modified.
+        return;
 
-    // Update mesh geometry.
-    _updateTerrainMeshGeometry();
+    // Share the pages of tiles data covered by the dirty area, and copy the other tiles in it.
+    mTilesData.shareRect(tilesData, rect);
 
-    // Rebuild terrain quad tree.
-    if (!mTerrainQuadTreeNodes.empty())
-        mTerrainQuadTreeNodes.clear();
+    // Update the geometry to draw.
+    _updateTerrainGeometry(rect);
 
-    _buildTerrainQuadTree();
+    // Topology of the quad trees is fixed after initialization, only AABBs of nodes covering
+    // the dirty area need to be refitted.
+    _updateTerrainQuadTree(rect);
+    _updateWaterChunks(rect);
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::setMeshingMode(ETerrainMeshingMode mode)
+{
+    mMeshingMode = mode;
 
-    // Rebuild water quad tree.
-    if (!mWaterQuadTreeNodes.empty())
-        mWaterQuadTreeNodes.clear();
+    if (mRenderingMode == ETerrainRenderingMode::eStreamedMesh && mTerrainMesh) {
+        // The worker thread generates chunks with the meshing mode it's started with.
+        _releaseTerrainGeometry();
+        _createTerrainGeometry();
+    }
+    else if (mTerrainMesh) {
+        _updateTerrainMeshGeometry(Rectd::makeRect(Point2d::ZERO(), mDimension));
+    }
+}
+//-------------------------------------------------------------------------------------------------
+bool Terrain::setRenderingMode(ETerrainRenderingMode mode)
+{
+    if (mode == mRenderingMode)
+        return true;
+
+    const bool isInitialized = mTerrainMesh || mTileInstanceBuffer;
+    const ETerrainRenderingMode previousMode = mRenderingMode;
+    mRenderingMode = mode;
+    if (!isInitialized)
+        return true;
 
-    _buildWaterQuadTree();
+    _releaseTerrainGeometry();
+    if (_createTerrainGeometry())
+        return true;
+
+    TINYSC_LOGLINE_ERR("Failed to create terrain geometry for rendering mode %d.", (int)mode);
+    mRenderingMode = previousMode;
+    _createTerrainGeometry();
+    return false;
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::setStreamingBudget(size_t bytes)
+{
+    mStreamingBudget = bytes;
+
+    if (mRenderingMode == ETerrainRenderingMode::eStreamedMesh && mTerrainMesh) {
+        _releaseTerrainGeometry();
+        _createTerrainGeometry();
+    }
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::setCullingMode(ETerrainCullingMode mode)
+{
+    mCullingMode = mode;
+    mIsVisibleChunksCacheValid = false;
 }
 //-------------------------------------------------------------------------------------------------
 void Terrain::drawTerrain(Camera* camera)
 {
-    // Gather visible terrain chunks
-    std::vector<int> visibleChunks;
-    _gatherVisibleTerrainChunksRecursively(mTerrainQuadTreeNodes.front(), camera->getViewFrustum(), 
-        false, &visibleChunks);
+    _updateVisibleChunks(camera->getViewFrustum());
+
+    IDirect3DDevice9* D3DDevice = mRenderSystem->getD3DDevice();
 
     ID3DXEffect* effectPtr = mTerrainEffect->getPointer();
 
@@ -300,44 +381,74 @@ void Terrain::drawTerrain(Camera* camera)
     // Setup control texture
     effectPtr->SetTexture("_ControlTexture", mControlTexture->getPointer());
 
+    // Control texture coordinates are derived from the tiles grid's corners in the vertex shader.
+    const D3DXVECTOR4 invDimension(1.0f / mDimension.x, 1.0f / mDimension.y, 0.0f, 0.0f);
+    effectPtr->SetVector("_InvTerrainDimension", &invDimension);
+
+    const bool isInstanced = mRenderingMode == ETerrainRenderingMode::eInstanced;
+    if (isInstanced) {
+        // Shapes of the tile types are looked up by the vertex shader with the instances' types.
+        D3DXVECTOR4 vertexLevels[15];
+        float diagonals[15];
+        for (int type = 0; type < 15; ++type) {
+            const int* levels = TileShape::SHAPES()[type].vertexLevels;
+            vertexLevels[type] = D3DXVECTOR4((float)levels[0], (float)levels[1], (float)levels[2], (float)levels[3]);
+            diagonals[type] = (float)TerrainTileInstances::getDiagonal((ETileType)type);
+        }
+        effectPtr->SetVectorArray("_TileVertexLevels", vertexLevels, 15);
+        effectPtr->SetFloatArray("_TileDiagonals", diagonals, 15);
+    }
+    effectPtr->SetTechnique(isInstanced ? "Instanced" : "Default");
+
+    // Upload the generated chunks before drawing, and request the visible chunks which aren't 
+    // resident. They are drawn in a later frame.
+    if (mRenderingMode == ETerrainRenderingMode::eStreamedMesh)
+        _updateResidentChunks();
+
     UINT passesCount = 0;
     effectPtr->Begin(&passesCount, 0);
     effectPtr->BeginPass(0);
 
-    for (auto& it : visibleChunks)
-        mTerrainMesh->getPointer()->DrawSubset(it);
+    mDrawStats.visibleChunksCount = (int)mVisibleChunks.size();
+    mDrawStats.drawCallsCount = 0;
+    mDrawStats.trianglesCount = 0;
+
+    if (isInstanced) {
+        _drawTileInstances();
+    }
+    else if (mRenderingMode == ETerrainRenderingMode::eStreamedMesh) {
+        _drawTerrainMeshChunks(mResidentChunkSlots);
+    }
+    else {
+        _drawTerrainMeshChunks(mVisibleChunkSlots);
+    }
 
     effectPtr->EndPass();
     effectPtr->End();
+
+    D3DDevice->SetVertexDeclaration(nullptr);
 }
 //-------------------------------------------------------------------------------------------------
 void Terrain::drawWater(Camera* camera)
 {
-    // Gather visible water tiles
-    std::vector<int> visibleWaterTiles;
-    _gatherVisibleWaterTilesRecursively(mWaterQuadTreeNodes.front(), camera->getViewFrustum(), false, &visibleWaterTiles);
+    _updateVisibleChunks(camera->getViewFrustum());
+    const std::vector<int>& visibleWaterChunks = mVisibleWaterChunks;
+    if (visibleWaterChunks.empty())
+        return;
 
     IDirect3DVertexBuffer9* verticesBuffer = nullptr;
     IDirect3DIndexBuffer9* indicesBuffer = nullptr;
-    D3DVERTEXELEMENT9 vertElement[MAX_FVF_DECL_SIZE];
-    mWaterTileInstancesMesh->getPointer()->GetVertexBuffer(&verticesBuffer);
-    mWaterTileInstancesMesh->getPointer()->GetIndexBuffer(&indicesBuffer);
-    mWaterTileInstancesMesh->getPointer()->GetDeclaration(vertElement);
-
-    // Create vertex declaration.
-    //
+    mWaterTileMesh->getPointer()->GetVertexBuffer(&verticesBuffer);
+    mWaterTileMesh->getPointer()->GetIndexBuffer(&indicesBuffer);
 
     IDirect3DDevice9* D3DDevice = mRenderSystem->getD3DDevice();
-    IDirect3DVertexDeclaration9* vertDecl = nullptr;
-    HRESULT hr = D3DDevice->CreateVertexDeclaration(vertElement, &vertDecl);
-    TINYSC_ASSERT(SUCCEEDED(hr), "Failed to create vertex declaration.");
 
     // Bind vertex stream.
     D3DDevice->SetStreamSource(0, verticesBuffer, 0, sizeof(WaterVertex));
     // Bind index
     D3DDevice->SetIndices(indicesBuffer);
     // Set vertex declaration
-    D3DDevice->SetVertexDeclaration(vertDecl);
+    D3DDevice->SetVertexDeclaration(mWaterVertexDeclaration);
 
     ID3DXEffect* effectPtr = mWaterEffect->getPointer();
 
@@ -349,58 +460,54 @@ void Terrain::drawWater(Camera* camera)
     effectPtr->Begin(&passesCount, 0);
     effectPtr->BeginPass(0);
 
-    size_t tileRemainingCount = visibleWaterTiles.size();
-    size_t batchedTilesCount = 0;
-    size_t tileStartIndex = 0;
-    while (tileRemainingCount) {
-        batchedTilesCount = tileRemainingCount < WATER_TILES_BATCH_SIZE ? tileRemainingCount : WATER_TILES_BATCH_SIZE;
-        tileRemainingCount -= batchedTilesCount;
-        
-        // Prepare instance position buffer
-        for (size_t i = 0; i < batchedTilesCount; ++i) {
-            Point2d tileLocation(visibleWaterTiles[tileStartIndex + i] % mDimension.x, visibleWaterTiles[tileStartIndex + i] / mDimension.x);
-            mWaterTileInstancePositions[i] = D3DXVECTOR4(_calcTilePositionFromLocation(tileLocation), 1.0f);
-            mWaterTileInstancePositions[i].y = mTilesData[visibleWaterTiles[tileStartIndex + i]].waterAltitude;
-        }
-
-        // Prepare instance texcoord buffer
-        for (size_t i = 0; i < batchedTilesCount; ++i) {
-            Point2d tileLocation(visibleWaterTiles[tileStartIndex + i] % mDimension.x, visibleWaterTiles[tileStartIndex + i] / mDimension.x);
-            mWaterTileInstanceTexcoords[i].x = tileLocation.x * WATER_TILE_TEXCOORD_SIZE;
-            mWaterTileInstanceTexcoords[i].y = tileLocation.y * WATER_TILE_TEXCOORD_SIZE;
-        }
-
-        // Commit instance buffer.
-        effectPtr->SetVectorArray("_InstancePositions", &mWaterTileInstancePositions.front(), batchedTilesCount);
-        effectPtr->SetVectorArray("_InstanceTexcoords", &mWaterTileInstanceTexcoords.front(), batchedTilesCount);
-        effectPtr->CommitChanges();
-
-        // Draw one batch.
-        D3DDevice->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, 0, batchedTilesCount * 4, 0, batchedTilesCount * 2);
-
-        // Update tile start index of the next batch
-        tileStartIndex += batchedTilesCount;
+    // Instances of the tiles in adjacent chunks of the list are contiguous in the instance buffer,
+    // so each run of adjacent visible chunks is drawn by one call.
+    size_t i = 0;
+    while (i < visibleWaterChunks.size()) {
+        const int firstChunk = visibleWaterChunks[i];
+        int lastChunk = firstChunk;
+        while (++i < visibleWaterChunks.size() && visibleWaterChunks[i] == lastChunk + 1)
+            ++lastChunk;
+
+        // Tiles beyond the capacity of the buffer are dropped if it failed to grow.
+        const int firstTile = mWaterChunks.getChunk(firstChunk).firstTile;
+        const int tilesCount = Math::min<int>(mWaterChunks.getChunk(lastChunk).firstTile + mWaterChunks.getChunk(lastChunk).tilesCount,
+            mWaterTileInstanceBufferCapacity) - firstTile;
+        if (tilesCount <= 0)
+            continue;
+
+        D3DDevice->SetStreamSourceFreq(0, D3DSTREAMSOURCE_INDEXEDDATA | tilesCount);
+        D3DDevice->SetStreamSource(1, mWaterTileInstanceBuffer, firstTile * sizeof(WaterTileInstance), sizeof(WaterTileInstance));
+        D3DDevice->SetStreamSourceFreq(1, D3DSTREAMSOURCE_INSTANCEDATA | 1);
+
+        D3DDevice->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, 0, 4, 0, 2);
     }
 
     effectPtr->EndPass();
     effectPtr->End();
 
-    // Release vertex declaration.
+    // Restore the streams to non-instanced drawing.
+    D3DDevice->SetStreamSourceFreq(0, 1);
+    D3DDevice->SetStreamSourceFreq(1, 1);
+    D3DDevice->SetStreamSource(1, nullptr, 0, 0);
     D3DDevice->SetVertexDeclaration(nullptr);
-    vertDecl->Release();
+
+    verticesBuffer->Release();
+    indicesBuffer->Release();
 }
 //-------------------------------------------------------------------------------------------------
 bool Terrain::raycast(const Ray& ray, TerrainRaycastHit* hit) const
 {
-    // Get all hits.
-    std::vector<TerrainRaycastHit> hits;
-    _raycastOnQuadTreeRecursively(mTerrainQuadTreeNodes.front(), ray, &hits);
+    // Walk through the whole grid, the ray is clipped by the AABB of the whole terrain which is 
+    // bounded by the highest tile.
+    TileGridWalker walker;
+    if (!walker.begin(ray, mTerrainQuadTree.getAABB(0, Point2d::ZERO()), Rectd::makeRect(Point2d::ZERO(), mDimension), FLT_MAX))
+        return false;
 
-    if (!hits.empty()) {
-        // Sort the hit result by distance and return the nearst hit result.
-        std::sort(hits.begin(), hits.end());
-        *hit = hits.front();
-        return true;
+    Point2d location;
+    while (walker.next(&location)) {
+        if (_raycastOnTileNearest(location, ray, hit))
+            return true;
     }
 
     return false;
@@ -409,7 +516,10 @@ bool Terrain::raycast(const Ray& ray, TerrainRaycastHit* hit) const
 bool Terrain::raycastAll(const Ray& ray, std::vector<TerrainRaycastHit>* hits) const
 {
     // Get all hits.
-    _raycastOnQuadTreeRecursively(mTerrainQuadTreeNodes.front(), ray, hits);
+    const int rowChunksCount = mDimension.x / CHUNK_DIMENSION;
+    mTerrainQuadTree.raycast(ray, [&](int chunk) {
+        _raycastOnChunk(Point2d(chunk % rowChunksCount, chunk / rowChunksCount), ray, hits);
+    });
 
     if (!hits->empty()) {
         // Sort the hits by distance
@@ -420,6 +530,107 @@ bool Terrain::raycastAll(const Ray& ray, std::vector<TerrainRaycastHit>* hits) c
     return false;
 }
 //-------------------------------------------------------------------------------------------------
+void Terrain::raycastBatch(const D3DXVECTOR3* origins, const D3DXVECTOR3* directions, size_t count,
+    TerrainRaycastHit* hits, bool* isHit) const
+{
+    // Each ray walks the tile grid like raycast. Traversing the quad tree in packets of 4 rays was
+    // slower than the walk for incoherent and coherent rays alike, the chunk AABBs are too loose.
+    for (size_t i = 0; i < count; ++i)
+        isHit[i] = raycast(Ray(origins[i], directions[i]), &hits[i]);
+}
+//-------------------------------------------------------------------------------------------------
+float Terrain::getHeightAt(float x, float z) const
+{
+    float localX, localZ;
+    int face;
+    const int tileIndex = _findTileFace(x, z, &localX, &localZ, &face);
+    const TileSurface& surface = TILE_SURFACES()[mTilesData.getType(tileIndex)];
+
+    return mTilesData.getAltitude(tileIndex) + (localX * surface.slopeX[face] + localZ * surface.slopeZ[face] + surface.offset[face]);
+}
+//-------------------------------------------------------------------------------------------------
+D3DXVECTOR3 Terrain::getNormalAt(float x, float z) const
+{
+    float localX, localZ;
+    int face;
+    const int tileIndex = _findTileFace(x, z, &localX, &localZ, &face);
+
+    return TILE_SURFACES()[mTilesData.getType(tileIndex)].normals[face];
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::getHeightsAt(const float* x, const float* z, size_t count, float* heights) const
+{
+    size_t i = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+    const __m128 invTileSize = _mm_set1_ps(1.0f / Tile::SIZE);
+    const __m128 tileSize = _mm_set1_ps(Tile::SIZE);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    // Grid x goes along world z axis and grid y goes along world x axis.
+    const __m128 gridMaxX = _mm_set1_ps((float)mDimension.x);
+    const __m128 gridMaxY = _mm_set1_ps((float)mDimension.y);
+    const __m128i cellMaxX = _mm_set1_epi32(mDimension.x - 1);
+    const __m128i cellMaxY = _mm_set1_epi32(mDimension.y - 1);
+
+    for (; i + 4 <= count; i += 4) {
+        // Grid coordinates clamped to the terrain, tile centers are on half integers.
+        const __m128 gridX = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(z + i), invTileSize), half), zero), gridMaxX);
+        const __m128 gridY = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(x + i), invTileSize), half), zero), gridMaxY);
+
+        // Coordinates are not negative, so truncation is floor. The far border belongs to the last tile.
+        __m128i cellX = _mm_cvttps_epi32(gridX);
+        __m128i cellY = _mm_cvttps_epi32(gridY);
+        cellX = _mm_sub_epi32(cellX, _mm_and_si128(_mm_cmpgt_epi32(cellX, cellMaxX), _mm_set1_epi32(1)));
+        cellY = _mm_sub_epi32(cellY, _mm_and_si128(_mm_cmpgt_epi32(cellY, cellMaxY), _mm_set1_epi32(1)));
+
+        // Local position in the tiles.
+        const __m128 localX = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(gridY, _mm_cvtepi32_ps(cellY)), half), tileSize);
+        const __m128 localZ = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(gridX, _mm_cvtepi32_ps(cellX)), half), tileSize);
+
+        // Gather the tiles' surfaces.
+        int cellsX[4], cellsY[4];
+        _mm_storeu_si128((__m128i*)cellsX, cellX);
+        _mm_storeu_si128((__m128i*)cellsY, cellY);
+
+        float altitude[4], splitA[4], splitB[4], splitC[4];
+        float slopeX[2][4], slopeZ[2][4], offset[2][4];
+        for (int lane = 0; lane < 4; ++lane) {
+            const int tileIndex = cellsY[lane] * mDimension.x + cellsX[lane];
+            const TileSurface& surface = TILE_SURFACES()[mTilesData.getType(tileIndex)];
+
+            altitude[lane] = mTilesData.getAltitude(tileIndex);
+            splitA[lane] = surface.splitLine.x;
+            splitB[lane] = surface.splitLine.y;
+            splitC[lane] = surface.splitLine.z;
+            for (int face = 0; face < 2; ++face) {
+                slopeX[face][lane] = surface.slopeX[face];
+                slopeZ[face][lane] = surface.slopeZ[face];
+                offset[face][lane] = surface.offset[face];
+            }
+        }
+
+        // Choose the face by the side of the split line, then evaluate its plane.
+        const __m128 side = _mm_add_ps(_mm_add_ps(_mm_mul_ps(localX, _mm_loadu_ps(splitA)), 
+            _mm_mul_ps(localZ, _mm_loadu_ps(splitB))), _mm_loadu_ps(splitC));
+        const __m128 isFace0 = _mm_cmpge_ps(side, zero);
+
+        __m128 faceHeights[2];
+        for (int face = 0; face < 2; ++face) {
+            faceHeights[face] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(localX, _mm_loadu_ps(slopeX[face])), 
+                _mm_mul_ps(localZ, _mm_loadu_ps(slopeZ[face]))), _mm_loadu_ps(offset[face]));
+        }
+
+        const __m128 height = _mm_or_ps(_mm_and_ps(isFace0, faceHeights[0]), _mm_andnot_ps(isFace0, faceHeights[1]));
+        _mm_storeu_ps(heights + i, _mm_add_ps(height, _mm_loadu_ps(altitude)));
+    }
+#endif
+
+    // Remaining positions.
+    for (; i < count; ++i)
+        heights[i] = getHeightAt(x[i], z[i]);
+}
+//-------------------------------------------------------------------------------------------------
 void Terrain::setBlendTexture(size_t index, Texture* texture)
 {
     TINYSC_ASSERT(index <= 3, "Index out of range.");
@@ -440,19 +651,87 @@ void Terrain::setWaveTexture(size_t index, Texture* texture)
     mWaveTextures[index] = texture;
 }
 //-------------------------------------------------------------------------------------------------
-bool Terrain::_createTerrainMesh()
+bool Terrain::_createTerrainGeometry()
+{
+    const int chunksCount = (mDimension.x * mDimension.y) / TILES_COUNT_PER_CHUNK;
+
+    bool isCreated = false;
+    switch (mRenderingMode) {
+    case ETerrainRenderingMode::eMesh:
+        isCreated = _createTerrainMesh(chunksCount);
+        break;
+    case ETerrainRenderingMode::eInstanced:
+        isCreated = _createTileInstances();
+        break;
+    case ETerrainRenderingMode::eStreamedMesh:
+        // The mesh only has the slots of the resident chunks.
+        isCreated = _createTerrainMesh(Math::clamp<int>((int)(mStreamingBudget / CHUNK_SLOT_BYTES), 1, chunksCount));
+        if (isCreated)
+            _createChunkResidency();
+        break;
+    }
+
+    if (!isCreated) {
+        _releaseTerrainGeometry();
+        return false;
+    }
+
+    _updateTerrainGeometry(Rectd::makeRect(Point2d::ZERO(), mDimension));
+    return true;
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::_releaseTerrainGeometry()
+{
+    // Stop the worker thread first, requests in flight are discarded.
+    mChunkResidency.destroy();
+
+    delete mTerrainMesh;
+    mTerrainMesh = nullptr;
+
+    if (mTerrainVertexDeclaration)
+        mTerrainVertexDeclaration->Release();
+    mTerrainVertexDeclaration = nullptr;
+
+    mChunkRanges.clear();
+
+    delete mTileMesh;
+    mTileMesh = nullptr;
+
+    if (mTileInstanceBuffer)
+        mTileInstanceBuffer->Release();
+    mTileInstanceBuffer = nullptr;
+
+    if (mTileVertexDeclaration)
+        mTileVertexDeclaration->Release();
+    mTileVertexDeclaration = nullptr;
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::_updateTerrainGeometry(const Rectd& dirtyRect)
+{
+    switch (mRenderingMode) {
+    case ETerrainRenderingMode::eMesh:
+        _updateTerrainMeshGeometry(dirtyRect);
+        break;
+    case ETerrainRenderingMode::eInstanced:
+        _updateTileInstances(dirtyRect);
+        break;
+    case ETerrainRenderingMode::eStreamedMesh:
+        _invalidateResidentChunks(dirtyRect);
+        break;
+    }
+}
+//-------------------------------------------------------------------------------------------------
+bool Terrain::_createTerrainMesh(int slotsCount)
 {
     D3DVERTEXELEMENT9 vertElement[] = 
     {
-        { 0, 0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0 },
-        { 0, 12, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_NORMAL, 0 },
-        { 0, 24, D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0 },
-        { 0, 32, D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 1 },
+        { 0, 0, D3DDECLTYPE_SHORT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0 },
+        { 0, 8, D3DDECLTYPE_D3DCOLOR, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_NORMAL, 0 },
         D3DDECL_END()
     };
 
-    const DWORD numFaces = mDimension.x * mDimension.y * 2;
-    const DWORD numVertices = mDimension.x * mDimension.y * 4;
+    const DWORD numFaces = slotsCount * TILES_COUNT_PER_CHUNK * 2;
+    const DWORD numVertices = slotsCount * TILES_COUNT_PER_CHUNK * 4;
 
     mTerrainMesh = new Mesh(mRenderSystem->getD3DDevice());
     if (!mTerrainMesh->create(numFaces, numVertices, D3DXMESH_32BIT | D3DXMESH_MANAGED, vertElement)) {
@@ -460,72 +739,110 @@ bool Terrain::_createTerrainMesh()
         return false;
     }
 
-    // Divide the mesh into chunks, e.g. sub-meshes.
+    TINYSC_LOGLINE_INFO("Terrain mesh: %u vertices(%u KB), %u faces(%u KB).", numVertices, 
+        numVertices * (DWORD)sizeof(TerrainVertex) / 1024, numFaces, numFaces * 3 * (DWORD)sizeof(unsigned) / 1024);
+
+    // The mesh is drawn by ranges of its buffers instead of by subsets.
+    HRESULT hr = mRenderSystem->getD3DDevice()->CreateVertexDeclaration(vertElement, &mTerrainVertexDeclaration);
+    if (FAILED(hr)) {
+        TINYSC_LOGLINE_ERR("Failed to create terrain vertex declaration.");
+        return false;
+    }
+
+    // Divide the mesh into chunks, e.g. sub-meshes. Each chunk has a slot in the mesh and the 
+    // attribute of its faces is its slot.
     DWORD* attribBuffer = NULL;
     mTerrainMesh->getPointer()->LockAttributeBuffer(0, &attribBuffer);
-    const int chunksCount = (mDimension.x * mDimension.y) / TILES_COUNT_PER_CHUNK;
-    for (int iChunk = 0; iChunk < chunksCount; ++iChunk) {
+    for (int iSlot = 0; iSlot < slotsCount; ++iSlot) {
         for (int iFace = 0; iFace < TILES_COUNT_PER_CHUNK * 2; ++iFace) {
-            *attribBuffer = (DWORD)iChunk;
+            *attribBuffer = (DWORD)iSlot;
             attribBuffer++;
         }
     }
     mTerrainMesh->getPointer()->UnlockAttributeBuffer();
 
-    // Blending texture coordinate for one tile.
-    const float tileBlendTexcoordStride = 1.0f / BLEND_TEXTURE_DIMENSION;
-    D3DXVECTOR2 tileBlendTexcoord[4] =
-    {
-        { 0.0f, 0.0f },
-        { tileBlendTexcoordStride, 0.0f },
-        { 0.0f, tileBlendTexcoordStride },
-        { tileBlendTexcoordStride, tileBlendTexcoordStride }
-    };
-    // Control texture coordinate for one tile.
-    const float tileControlTexcoordStrideU = 1.0f / mDimension.x;
-    const float tileControlTexcoordStrideV = 1.0f / mDimension.y;
-    D3DXVECTOR2 tileControlTexcoord[4] =
+    // Faces and vertices of a chunk are stored contiguously and they never move, so setup the attribute
+    // table directly instead of sorting the faces by their attributes.
+    mChunkRanges.resize(slotsCount);
+    for (int iSlot = 0; iSlot < slotsCount; ++iSlot) {
+        mChunkRanges[iSlot].AttribId = iSlot;
+        mChunkRanges[iSlot].FaceStart = iSlot * TILES_COUNT_PER_CHUNK * 2;
+        mChunkRanges[iSlot].FaceCount = TILES_COUNT_PER_CHUNK * 2;
+        mChunkRanges[iSlot].VertexStart = iSlot * TILES_COUNT_PER_CHUNK * 4;
+        mChunkRanges[iSlot].VertexCount = TILES_COUNT_PER_CHUNK * 4;
+    }
+    mTerrainMesh->getPointer()->SetAttributeTable(&mChunkRanges.front(), slotsCount);
+
+    return true;
+}
+//-------------------------------------------------------------------------------------------------
+bool Terrain::_createTileInstances()
+{
+    D3DVERTEXELEMENT9 vertElement[] =
     {
-        { 0.0f, 0.0f },
-        { tileControlTexcoordStrideU, 0.0f },
-        { 0.0f, tileControlTexcoordStrideV },
-        { tileControlTexcoordStrideU, tileControlTexcoordStrideV }
+        { 0, 0, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0 },
+        { 0, 16, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 1 },
+        D3DDECL_END()
     };
 
-    TerrainVertex* vertices = nullptr;
-    unsigned* indices = nullptr; // 32-Bit indices
-    mTerrainMesh->getPointer()->LockVertexBuffer(0, (void**)&vertices);
-    mTerrainMesh->getPointer()->LockIndexBuffer(0, (void**)&indices);
+    mTileMesh = new Mesh(mRenderSystem->getD3DDevice());
+    if (!mTileMesh->create(2, 4, D3DXMESH_MANAGED, vertElement)) {
+        TINYSC_LOGLINE_ERR("Failed to create terrain tile mesh.");
+        return false;
+    }
 
-    const int rowChunksCount = mDimension.x / CHUNK_DIMENSION;
-    for (int iChunk = 0; iChunk < chunksCount; ++iChunk) {
-        for (int itile = 0; itile < TILES_COUNT_PER_CHUNK; ++itile) {
-            const int globalTileIndex = iChunk * TILES_COUNT_PER_CHUNK + itile;
-
-            // Get tile location.
-            Point2d tileLocation;
-            tileLocation.x = iChunk % rowChunksCount * CHUNK_DIMENSION + itile % CHUNK_DIMENSION;
-            tileLocation.y = iChunk / rowChunksCount * CHUNK_DIMENSION + itile / CHUNK_DIMENSION;
-
-            // Modify vertices
-            for (int iVert = 0; iVert < 4; ++iVert) {
-                const int vertIndex = globalTileIndex * 4 + iVert;
-
-                // Write the blend texture coordinate.
-                vertices[vertIndex].blendTexcoord = tileBlendTexcoord[iVert];
-                vertices[vertIndex].blendTexcoord.x += tileLocation.x * tileBlendTexcoordStride;
-                vertices[vertIndex].blendTexcoord.y += tileLocation.y * tileBlendTexcoordStride;
-
-                // Write the control texture coordinate.
-                vertices[vertIndex].controlTexcoord = tileControlTexcoord[iVert];
-                vertices[vertIndex].controlTexcoord.x += tileLocation.x * tileControlTexcoordStrideU;
-                vertices[vertIndex].controlTexcoord.y += tileLocation.y * tileControlTexcoordStrideV;
-            }
+    TileQuadVertex* vertices = nullptr;
+    mTileMesh->getPointer()->LockVertexBuffer(0, (void**)&vertices);
+    for (int iVert = 0; iVert < 4; ++iVert) {
+        for (int diagonal = 0; diagonal < 2; ++diagonal) {
+            D3DXVECTOR4& mask = vertices[iVert].cornerMasks[diagonal];
+            const int corner = TerrainTileInstances::QUAD_CORNERS[diagonal][iVert];
+            mask = D3DXVECTOR4(corner == 0 ? 1.0f : 0.0f, corner == 1 ? 1.0f : 0.0f, corner == 2 ? 1.0f : 0.0f, 
+                corner == 3 ? 1.0f : 0.0f);
         }
     }
+    mTileMesh->getPointer()->UnlockVertexBuffer();
 
-    mTerrainMesh->getPointer()->UnlockVertexBuffer();
-    mTerrainMesh->getPointer()->UnlockIndexBuffer();
+    unsigned short* indices = nullptr;
+    mTileMesh->getPointer()->LockIndexBuffer(0, (void**)&indices);
+    indices[0] = 0;
+    indices[1] = 1;
+    indices[2] = 2;
+    indices[3] = 0;
+    indices[4] = 2;
+    indices[5] = 3;
+    mTileMesh->getPointer()->UnlockIndexBuffer();
+
+    // A record for every tile, the slots of all chunks are filled.
+    const UINT instancesCount = mDimension.x * mDimension.y;
+    HRESULT hr = mRenderSystem->getD3DDevice()->CreateVertexBuffer(instancesCount * sizeof(TerrainTileInstances::Instance),
+        D3DUSAGE_WRITEONLY, 0, D3DPOOL_MANAGED, &mTileInstanceBuffer, NULL);
+    if (FAILED(hr)) {
+        TINYSC_LOGLINE_ERR("Failed to create terrain tile instance buffer. TerrainDimension(%d*%d).", mDimension.x, mDimension.y);
+        return false;
+    }
+
+    TINYSC_LOGLINE_INFO("Terrain tile instances: %u instances(%u KB).", instancesCount, 
+        instancesCount * (UINT)sizeof(TerrainTileInstances::Instance) / 1024);
+
+    // The quad is in stream 0 and the instances are in stream 1.
+    D3DVERTEXELEMENT9 instancedVertElement[] =
+    {
+        { 0, 0, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0 },
+        { 0, 16, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 1 },
+        { 1, 0, D3DDECLTYPE_SHORT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0 },
+        { 1, 8, D3DDECLTYPE_D3DCOLOR, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_NORMAL, 0 },
+        { 1, 12, D3DDECLTYPE_D3DCOLOR, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_NORMAL, 1 },
+        { 1, 16, D3DDECLTYPE_D3DCOLOR, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_NORMAL, 2 },
+        { 1, 20, D3DDECLTYPE_D3DCOLOR, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_NORMAL, 3 },
+        D3DDECL_END()
+    };
+
+    hr = mRenderSystem->getD3DDevice()->CreateVertexDeclaration(instancedVertElement, &mTileVertexDeclaration);
+    if (FAILED(hr)) {
+        TINYSC_LOGLINE_ERR("Failed to create terrain tile vertex declaration.");
+        return false;
+    }
 
     return true;
 }
@@ -536,55 +853,130 @@ bool Terrain::_createWaterTileMesh()
     {
         { 0, 0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0 },
         { 0, 12, D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0 },
-        { 0, 20, D3DDECLTYPE_FLOAT1, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 1},
         D3DDECL_END()
     };
 
-    mWaterTileInstancesMesh = new Mesh(mRenderSystem->getD3DDevice());
-    if (!mWaterTileInstancesMesh->create(2 * WATER_TILES_BATCH_SIZE, 4 * WATER_TILES_BATCH_SIZE, D3DXMESH_MANAGED, vertElement)) {
+    mWaterTileMesh = new Mesh(mRenderSystem->getD3DDevice());
+    if (!mWaterTileMesh->create(2, 4, D3DXMESH_MANAGED, vertElement)) {
         TINYSC_LOGLINE_ERR("Failed to create water tile mesh.");
         return false;
     }
 
     WaterVertex* vertices = nullptr;
-    mWaterTileInstancesMesh->getPointer()->LockVertexBuffer(0, (void**)&vertices);
-    for (int i = 0; i < WATER_TILES_BATCH_SIZE; ++i) {
-        vertices[i * 4].pos = D3DXVECTOR3(-Tile::SIZE * 0.5f, 0.0f, -Tile::SIZE * 0.5f);
-        vertices[i * 4].texcoord = D3DXVECTOR2(0.0f, 0.0f);
-        vertices[i * 4].index = (float)i;
+    mWaterTileMesh->getPointer()->LockVertexBuffer(0, (void**)&vertices);
+    vertices[0].pos = D3DXVECTOR3(-Tile::SIZE * 0.5f, 0.0f, -Tile::SIZE * 0.5f);
+    vertices[0].texcoord = D3DXVECTOR2(0.0f, 0.0f);
+    vertices[1].pos = D3DXVECTOR3(-Tile::SIZE * 0.5f, 0.0f, Tile::SIZE * 0.5f);
+    vertices[1].texcoord = D3DXVECTOR2(1.0f, 0.0f);
+    vertices[2].pos = D3DXVECTOR3(Tile::SIZE * 0.5f, 0.0f, Tile::SIZE * 0.5f);
+    vertices[2].texcoord = D3DXVECTOR2(1.0f, 1.0f);
+    vertices[3].pos = D3DXVECTOR3(Tile::SIZE * 0.5f, 0.0f, -Tile::SIZE * 0.5f);
+    vertices[3].texcoord = D3DXVECTOR2(0.0f, 1.0f);
+    mWaterTileMesh->getPointer()->UnlockVertexBuffer();
 
-        vertices[i * 4 + 1].pos = D3DXVECTOR3(-Tile::SIZE * 0.5f, 0.0f, Tile::SIZE * 0.5f);
-        vertices[i * 4 + 1].texcoord = D3DXVECTOR2(1.0f, 0.0f);
-        vertices[i * 4 + 1].index = (float)i;
+    unsigned short* indices = nullptr;
+    mWaterTileMesh->getPointer()->LockIndexBuffer(0, (void**)&indices);
+    indices[0] = 0;
+    indices[1] = 1;
+    indices[2] = 2;
+    indices[3] = 0;
+    indices[4] = 2;
+    indices[5] = 3;
+    mWaterTileMesh->getPointer()->UnlockIndexBuffer();
+
+    // The tile geometry is in stream 0 and the instances are in stream 1.
+    D3DVERTEXELEMENT9 instancedVertElement[] =
+    {
+        { 0, 0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0 },
+        { 0, 12, D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0 },
+        { 1, 0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 1 },
+        { 1, 12, D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 2 },
+        D3DDECL_END()
+    };
 
-        vertices[i * 4 + 2].pos = D3DXVECTOR3(Tile::SIZE * 0.5f, 0.0f, Tile::SIZE * 0.5f);
-        vertices[i * 4 + 2].texcoord = D3DXVECTOR2(1.0f, 1.0f);
-        vertices[i * 4 + 2].index = (float)i;
+    HRESULT hr = mRenderSystem->getD3DDevice()->CreateVertexDeclaration(instancedVertElement, &mWaterVertexDeclaration);
+    if (FAILED(hr)) {
+        TINYSC_LOGLINE_ERR("Failed to create water vertex declaration.");
+        return false;
+    }
 
-        vertices[i * 4 + 3].pos = D3DXVECTOR3(Tile::SIZE * 0.5f, 0.0f, -Tile::SIZE * 0.5f);
-        vertices[i * 4 + 3].texcoord = D3DXVECTOR2(0.0f, 1.0f);
-        vertices[i * 4 + 3].index = (float)i;
+    return true;
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::_updateWaterTileInstances(const std::vector<std::pair<int, int>>& chunkRuns)
+{
+    const int tilesCount = mWaterChunks.getTilesCount();
+    std::vector<std::pair<int, int>> allChunks;
+    const std::vector<std::pair<int, int>>* runs = &chunkRuns;
+
+    if (tilesCount > mWaterTileInstanceBufferCapacity) {
+        // Grow the buffer with some room, so adding water tile by tile doesn't recreate it each time.
+        const int capacity = Math::max<int>(tilesCount, mWaterTileInstanceBufferCapacity * 2);
+        IDirect3DVertexBuffer9* buffer = nullptr;
+        HRESULT hr = mRenderSystem->getD3DDevice()->CreateVertexBuffer(capacity * sizeof(WaterTileInstance), 
+            D3DUSAGE_WRITEONLY, 0, D3DPOOL_MANAGED, &buffer, NULL);
+        if (FAILED(hr)) {
+            TINYSC_LOGLINE_ERR("Failed to create water tile instance buffer 0x%08x %s. WaterTilesCount(%d).", hr,
+                ::DXGetErrorString(hr), tilesCount);
+        }
+        else {
+            if (mWaterTileInstanceBuffer)
+                mWaterTileInstanceBuffer->Release();
+            mWaterTileInstanceBuffer = buffer;
+            mWaterTileInstanceBufferCapacity = capacity;
+
+            allChunks.push_back(std::make_pair(0, (int)mWaterChunks.getChunksCount()));
+            runs = &allChunks;
+        }
     }
-    mWaterTileInstancesMesh->getPointer()->UnlockVertexBuffer();
 
-    unsigned short* indices = nullptr;
-    mWaterTileInstancesMesh->getPointer()->LockIndexBuffer(0, (void**)&indices);
-    for (int i = 0; i < WATER_TILES_BATCH_SIZE; ++i) {
-        indices[i * 6] = i * 4;
-        indices[i * 6 + 1] = i * 4 + 1;
-        indices[i * 6 + 2] = i * 4 + 2;
+    const int rowChunksCount = mDimension.x / CHUNK_DIMENSION;
+    for (const std::pair<int, int>& run : *runs) {
+        if (run.first >= run.second)
+            continue;
+
+        const TerrainWaterChunks::Chunk& lastChunk = mWaterChunks.getChunk(run.second - 1);
+        const int firstTile = mWaterChunks.getChunk(run.first).firstTile;
+        const int lastTile = Math::min<int>(lastChunk.firstTile + lastChunk.tilesCount, mWaterTileInstanceBufferCapacity);
+        if (firstTile >= lastTile)
+            continue;
+
+        WaterTileInstance* instances = nullptr;
+        HRESULT hr = mWaterTileInstanceBuffer->Lock(firstTile * sizeof(WaterTileInstance), 
+            (lastTile - firstTile) * sizeof(WaterTileInstance), (void**)&instances, 0);
+        if (FAILED(hr)) {
+            TINYSC_LOGLINE_ERR("Failed to lock water tile instance buffer 0x%08x %s.", hr, ::DXGetErrorString(hr));
+            return;
+        }
 
-        indices[i * 6 + 3] = i * 4;
-        indices[i * 6 + 4] = i * 4 + 2;
-        indices[i * 6 + 5] = i * 4 + 3;
-    }
-    mWaterTileInstancesMesh->getPointer()->UnlockIndexBuffer();
+        for (int i = run.first; i < run.second; ++i) {
+            const TerrainWaterChunks::Chunk& chunk = mWaterChunks.getChunk(i);
+            const Point2d firstTileLocation = Point2d(chunk.index % rowChunksCount, chunk.index / rowChunksCount) * CHUNK_DIMENSION;
 
-    return true;
+            int tile = chunk.firstTile;
+            for (int bit = 0; bit < TILES_COUNT_PER_CHUNK && tile < lastTile; ++bit) {
+                if ((chunk.tileMask & ((uint64_t)1 << bit)) == 0)
+                    continue;
+
+                const Point2d tileLocation(firstTileLocation.x + bit % CHUNK_DIMENSION, firstTileLocation.y + bit / CHUNK_DIMENSION);
+
+                WaterTileInstance* instance = instances + (tile - firstTile);
+                instance->position = _calcTilePositionFromLocation(tileLocation);
+                instance->position.y = mWaterTileAltitudes[tile];
+                instance->texcoord.x = tileLocation.x * WATER_TILE_TEXCOORD_SIZE;
+                instance->texcoord.y = tileLocation.y * WATER_TILE_TEXCOORD_SIZE;
+                ++tile;
+            }
+        }
+
+        mWaterTileInstanceBuffer->Unlock();
+    }
 }
 //-------------------------------------------------------------------------------------------------
-bool Terrain::_initializeImpl(const Size2d& dimension, const std::vector<Tile>& tilesData)
+bool Terrain::_initializeImpl(const TileStore& tilesData, const TerrainMapFile* mapFile)
 {
+    const Size2d& dimension = tilesData.getDimension();
+
     // Validate terrain dimension
     if (dimension.x % CHUNK_DIMENSION > 0 || dimension.y % CHUNK_DIMENSION > 0) {
         TINYSC_LOGLINE_ERR("Invalid terrain dimension(%d*%d).", dimension.x, dimension.y);
@@ -592,18 +984,27 @@ bool Terrain::_initializeImpl(const Size2d& dimension, const std::vector<Tile>&
     }
 
     mDimension = dimension;
-    _updateQuadTreeDimension();
+    mTilesData = tilesData;
+
+    _buildChunkSlots();
 
-    // Create the terrain mesh.
-    if (!_createTerrainMesh())
+    // Create the terrain mesh or the tile instances, and generate the geometry.
+    if (!_createTerrainGeometry())
         return false;
 
     // Create the water mesh.
     if (!_createWaterTileMesh())
         return false;
 
-    // Update tiles data.
-    setTilesData(tilesData);
+    // Build the quad tree, or load it from the map file if it has it. Leaves of the quad tree are 
+    // chunks, since chunks are the units to draw. Tiles in a chunk are walked by raycasting.
+    mTerrainQuadTree.create(Size2d(mDimension.x / CHUNK_DIMENSION, mDimension.y / CHUNK_DIMENSION));
+    if (mapFile && mapFile->hasQuadTree() && mapFile->getQuadTreeNodesCount() == mTerrainQuadTree.getNodesCount())
+        mTerrainQuadTree.loadAABBs(mapFile->getQuadTreeAABBs());
+    else
+        _buildTerrainQuadTree();
+
+    _buildWaterChunks();
 
     // Retrieve terrain effect
     mTerrainEffect = mRenderSystem->getEffectManager()->getEffect(EFFECT_RESOURCE_NAME_TERRAIN);
@@ -631,363 +1032,808 @@ bool Terrain::_initializeImpl(const Size2d& dimension, const std::vector<Tile>&
     return true;
 }
 //-------------------------------------------------------------------------------------------------
-void Terrain::_updateTerrainMeshGeometry()
+void Terrain::_updateTerrainMeshGeometry(const Rectd& dirtyRect)
 {
-    TerrainVertex* vertices = nullptr;
-    unsigned* indices = nullptr;
-    mTerrainMesh->getPointer()->LockVertexBuffer(0, (void**)&vertices);
-    mTerrainMesh->getPointer()->LockIndexBuffer(0, (void**)&indices);
+    std::vector<std::pair<int, int>> dirtySlots;
+    _gatherDirtySlots(dirtyRect, &dirtySlots);
+
+    IDirect3DVertexBuffer9* verticesBuffer = nullptr;
+    IDirect3DIndexBuffer9* indicesBuffer = nullptr;
+    mTerrainMesh->getPointer()->GetVertexBuffer(&verticesBuffer);
+    mTerrainMesh->getPointer()->GetIndexBuffer(&indicesBuffer);
 
-    const int chunksCount = (mDimension.x * mDimension.y) / TILES_COUNT_PER_CHUNK;
     const int rowChunksCount = mDimension.x / CHUNK_DIMENSION;
-    for (int iChunk = 0; iChunk < chunksCount; ++iChunk) {
-        for (int itile = 0; itile < TILES_COUNT_PER_CHUNK; ++itile) {
-            const int globaltileIndex = iChunk * TILES_COUNT_PER_CHUNK + itile;
-
-            // Get the tile's geometry.
-            Point2d tileLocation;
-            tileLocation.x = iChunk % rowChunksCount * CHUNK_DIMENSION + itile % CHUNK_DIMENSION;
-            tileLocation.y = iChunk / rowChunksCount * CHUNK_DIMENSION + itile / CHUNK_DIMENSION;
-
-            const int tileIndex = tileLocation.y * mDimension.x + tileLocation.x;
-            const Tile& tile = mTilesData[tileIndex];
-            const TileGeometry& tileGeometry = TILE_GEOMETRIES()[tile.type];
-
-            // Generate indices
-            for (int iIndices = 0; iIndices < 6; ++iIndices) {
-                indices[globaltileIndex * 6 + iIndices] = globaltileIndex * 4 + tileGeometry.indices[iIndices];
+    const int chunkVerticesCount = TILES_COUNT_PER_CHUNK * 4;
+    const int chunkIndicesCount = TILES_COUNT_PER_CHUNK * 6;
+
+    size_t iDirty = 0;
+    while (iDirty < dirtySlots.size()) {
+        // Lock only each run of adjacent dirty slots, so the rest of the buffers doesn't need to be
+        // uploaded again.
+        const size_t firstDirty = iDirty;
+        const int firstSlot = dirtySlots[iDirty].first;
+        int lastSlot = firstSlot;
+        while (++iDirty < dirtySlots.size() && dirtySlots[iDirty].first == lastSlot + 1)
+            ++lastSlot;
+        const int slotsCount = lastSlot - firstSlot + 1;
+
+        TerrainVertex* vertices = nullptr;
+        unsigned* indices = nullptr; // 32-Bit indices
+        verticesBuffer->Lock(firstSlot * chunkVerticesCount * sizeof(TerrainVertex), 
+            slotsCount * chunkVerticesCount * sizeof(TerrainVertex), (void**)&vertices, 0);
+        indicesBuffer->Lock(firstSlot * chunkIndicesCount * sizeof(unsigned),
+            slotsCount * chunkIndicesCount * sizeof(unsigned), (void**)&indices, 0);
+
+        for (size_t i = firstDirty; i < iDirty; ++i) {
+            const int slot = dirtySlots[i].first;
+            const int iChunk = dirtySlots[i].second;
+            const Point2d chunkOrigin(iChunk % rowChunksCount * CHUNK_DIMENSION, iChunk / rowChunksCount * CHUNK_DIMENSION);
+
+            // Position of the chunk's slot relative to the locked range.
+            const int localSlot = slot - firstSlot;
+            const int quadsCount = _generateChunkGeometry(mTilesData, Point2d::ZERO(), chunkOrigin, mMeshingMode,
+                slot * chunkVerticesCount, vertices + localSlot * chunkVerticesCount, indices + localSlot * chunkIndicesCount);
+
+            mChunkRanges[slot].FaceCount = quadsCount * 2;
+            mChunkRanges[slot].VertexCount = quadsCount * 4;
+        }
+
+        verticesBuffer->Unlock();
+        indicesBuffer->Unlock();
+    }
+
+    mTerrainMesh->getPointer()->SetAttributeTable(&mChunkRanges.front(), (DWORD)mChunkRanges.size());
+
+    verticesBuffer->Release();
+    indicesBuffer->Release();
+}
+//-------------------------------------------------------------------------------------------------
+int Terrain::_generateChunkGeometry(const TileStore& tiles, const Point2d& tilesOrigin, const Point2d& chunkOrigin,
+    ETerrainMeshingMode meshingMode, unsigned firstVertex, TerrainVertex* vertices, unsigned* indices)
+{
+    // Vertex normals of the tiles in the chunk.
+    TerrainNormals::Normal normals[TILES_COUNT_PER_CHUNK][4];
+    for (int itile = 0; itile < TILES_COUNT_PER_CHUNK; ++itile) {
+        const Point2d tileLocation = chunkOrigin + Point2d(itile % CHUNK_DIMENSION, itile / CHUNK_DIMENSION);
+        for (int iVert = 0; iVert < 4; ++iVert)
+            normals[itile][iVert] = TerrainNormals::calcTileVertexNormal(tiles, tileLocation, iVert);
+    }
+
+    // A flat tile can be merged with its neighbors if all of its normals face straight up, 
+    // i.e. all faces around it are flat and at the same level, so the lighting is the same.
+    auto isMergeable = [&](int itile, int level) {
+        const int tileIndex = (chunkOrigin.y + itile / CHUNK_DIMENSION) * tiles.getDimension().x + chunkOrigin.x + itile % CHUNK_DIMENSION;
+        if (tiles.getType(tileIndex) != ETileType::Flat || tiles.getLevel(tileIndex) != level)
+            return false;
+
+        for (int iVert = 0; iVert < 4; ++iVert) {
+            if (normals[itile][iVert].x != 0.0f || normals[itile][iVert].z != 0.0f)
+                return false;
+        }
+        return true;
+    };
+
+    bool isMerged[TILES_COUNT_PER_CHUNK] = {};
+    int quadsCount = 0;
+    for (int itile = 0; itile < TILES_COUNT_PER_CHUNK; ++itile) {
+        if (isMerged[itile])
+            continue;
+
+        const int tileX = itile % CHUNK_DIMENSION, tileY = itile / CHUNK_DIMENSION;
+        const int tileIndex = (chunkOrigin.y + tileY) * tiles.getDimension().x + chunkOrigin.x + tileX;
+        const int level = tiles.getLevel(tileIndex);
+
+        // Size of the quad in tiles. In greedy mode, grow a quad of mergeable tiles along x 
+        // first, then along y while whole rows can be merged.
+        int width = 1, height = 1;
+        if (meshingMode == ETerrainMeshingMode::eGreedy && isMergeable(itile, level)) {
+            while (tileX + width < CHUNK_DIMENSION && !isMerged[itile + width] && isMergeable(itile + width, level))
+                ++width;
+
+            for (bool canGrow = true; canGrow && tileY + height < CHUNK_DIMENSION; ) {
+                const int rowFirstTile = itile + height * CHUNK_DIMENSION;
+                for (int x = 0; x < width && canGrow; ++x)
+                    canGrow = !isMerged[rowFirstTile + x] && isMergeable(rowFirstTile + x, level);
+                if (canGrow)
+                    ++height;
             }
 
-            // Modify vertex positions
-            for (int iVert = 0; iVert < 4; ++iVert) {
-                const int vertIndex = globaltileIndex * 4 + iVert;
-                // Get the vertex local position from this tile type's geometry vertices position.
-                vertices[vertIndex].pos = tileGeometry.vertices[iVert], 1.0f;
-                // Move the vertex to world space position.
-                vertices[vertIndex].pos += _calcTilePositionFromLocation(tileLocation);
-                vertices[vertIndex].pos.y += tile.getAltitude();
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x)
+                    isMerged[itile + y * CHUNK_DIMENSION + x] = true;
             }
         }
+
+        const TileGeometry& tileGeometry = TILE_GEOMETRIES()[tiles.getType(tileIndex)];
+        const TileShape& tileShape = TileShape::SHAPES()[tiles.getType(tileIndex)];
+
+        // Generate indices
+        for (int iIndices = 0; iIndices < 6; ++iIndices) {
+            indices[quadsCount * 6 + iIndices] = firstVertex + quadsCount * 4 + tileGeometry.indices[iIndices];
+        }
+
+        // Each vertex of the quad is the same vertex of the tile at that corner of the quad,
+        // so vertices on the border of merged quads match the ones of their neighbors.
+        for (int iVert = 0; iVert < 4; ++iVert) {
+            const int cornerTile = itile + ((iVert & 1) ? width - 1 : 0) + ((iVert >> 1) ? (height - 1) * CHUNK_DIMENSION : 0);
+            const Point2d tileLocation = chunkOrigin + Point2d(cornerTile % CHUNK_DIMENSION, cornerTile / CHUNK_DIMENSION);
+            TerrainVertex& vertex = vertices[quadsCount * 4 + iVert];
+
+            // The vertex's corner on the tiles grid and its altitude level.
+            vertex.corner[0] = (short)(tilesOrigin.y + tileLocation.y + (iVert >> 1));
+            vertex.corner[1] = (short)(level + tileShape.vertexLevels[iVert]);
+            vertex.corner[2] = (short)(tilesOrigin.x + tileLocation.x + (iVert & 1));
+            vertex.corner[3] = 1;
+
+            vertex.normal = TerrainNormals::packNormal(normals[cornerTile][iVert]);
+        }
+
+        ++quadsCount;
     }
 
-    mTerrainMesh->getPointer()->UnlockVertexBuffer();
-    mTerrainMesh->getPointer()->UnlockIndexBuffer();
+    // Fill the rest of the slot with degenerate triangles, so a run of adjacent slots can be 
+    // drawn by one call. They are discarded before rasterization.
+    for (int iIndices = quadsCount * 6; iIndices < TILES_COUNT_PER_CHUNK * 6; ++iIndices)
+        indices[iIndices] = firstVertex;
 
-    // Generate adjacency buffer.
-    DWORD* adjacencyBuffer = new DWORD[mTerrainMesh->getPointer()->GetNumFaces() * 3];
-    mTerrainMesh->getPointer()->GenerateAdjacency(0.01f, adjacencyBuffer);
+    return quadsCount;
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::_updateTileInstances(const Rectd& dirtyRect)
+{
+    std::vector<std::pair<int, int>> dirtySlots;
+    _gatherDirtySlots(dirtyRect, &dirtySlots);
 
-    // Compute normals.
-    ::D3DXComputeNormals(mTerrainMesh->getPointer(), adjacencyBuffer);
+    const int rowChunksCount = mDimension.x / CHUNK_DIMENSION;
 
-    // Optimize the mesh by sorting face attributes.
-    mTerrainMesh->getPointer()->OptimizeInplace(D3DXMESHOPT_ATTRSORT, adjacencyBuffer, NULL, NULL, NULL);
+    size_t iDirty = 0;
+    while (iDirty < dirtySlots.size()) {
+        // Lock only each run of adjacent dirty slots, as the mesh does.
+        const size_t firstDirty = iDirty;
+        const int firstSlot = dirtySlots[iDirty].first;
+        int lastSlot = firstSlot;
+        while (++iDirty < dirtySlots.size() && dirtySlots[iDirty].first == lastSlot + 1)
+            ++lastSlot;
+        const int slotsCount = lastSlot - firstSlot + 1;
+
+        TerrainTileInstances::Instance* instances = nullptr;
+        mTileInstanceBuffer->Lock(firstSlot * TILES_COUNT_PER_CHUNK * sizeof(TerrainTileInstances::Instance),
+            slotsCount * TILES_COUNT_PER_CHUNK * sizeof(TerrainTileInstances::Instance), (void**)&instances, 0);
+
+        for (size_t i = firstDirty; i < iDirty; ++i) {
+            const int localSlot = dirtySlots[i].first - firstSlot;
+            const int iChunk = dirtySlots[i].second;
+            const Point2d chunkLocation(iChunk % rowChunksCount, iChunk / rowChunksCount);
+
+            TerrainTileInstances::buildInstances(mTilesData, _calcChunkTileRect(chunkLocation), 
+                instances + localSlot * TILES_COUNT_PER_CHUNK);
+        }
 
-    delete[] adjacencyBuffer;
+        mTileInstanceBuffer->Unlock();
+    }
 }
 //-------------------------------------------------------------------------------------------------
-void Terrain::_updateQuadTreeDimension()
+void Terrain::_gatherDirtySlots(const Rectd& dirtyRect, std::vector<std::pair<int, int>>* dirtySlots) const
 {
-    // Here uses a square quad tree for the terrain.
-    // Since the shape of terrain is not guarenteed to be square and the chunk number at one side is 
-    // not guaranteed to be 2^n. So we need to compute a minimum extended square for the terrain
-    // and build the quad tree for the virtually extended terrain.
+    // Extend the dirty area by one tile since normals on its border are affected as well, then
+    // find the chunks covering the area.
+    Rectd tileRect(dirtyRect.getMin() - Point2d(1, 1), dirtyRect.getMax() + Point2d(1, 1));
+    tileRect = Rectd::intersection(tileRect, Rectd::makeRect(Point2d::ZERO(), mDimension));
 
-    // Get the chunks number at the long side of the terrain.
-    const int longSideChunksCount = Math::max<int>(mDimension.x, mDimension.y) / CHUNK_DIMENSION;
-    // Calculate minimum 2^n integer greater than longSideChunksCount.
-    const int quadTreeSideDimensionChunksCount = (int)std::pow(2, (int)std::ceil(std::log(longSideChunksCount) / std::log(2)));
-    const int quadTreeSideDimension = quadTreeSideDimensionChunksCount * CHUNK_DIMENSION;
+    const Rectd chunkRect = _calcChunkRect(tileRect);
+    const Point2d& chunkMin = chunkRect.getMin();
+    const Point2d& chunkMax = chunkRect.getMax();
 
-    mQuadTreeDimension = Size2d(quadTreeSideDimension, quadTreeSideDimension);
+    const int rowChunksCount = mDimension.x / CHUNK_DIMENSION;
+    for (int chunkY = chunkMin.y; chunkY < chunkMax.y; ++chunkY) {
+        for (int chunkX = chunkMin.x; chunkX < chunkMax.x; ++chunkX) {
+            const int chunk = chunkY * rowChunksCount + chunkX;
+            dirtySlots->push_back(std::make_pair(mChunkSlots[chunk], chunk));
+        }
+    }
+    std::sort(dirtySlots->begin(), dirtySlots->end());
 }
 //-------------------------------------------------------------------------------------------------
-void Terrain::_buildTerrainQuadTree()
+void Terrain::_createChunkResidency()
 {
-    const int quadTreeDimensionTilesCount = mQuadTreeDimension.x * mQuadTreeDimension.y;
-    const int maxQuadTreeNodesCount = (1 - quadTreeDimensionTilesCount) / (-3) + quadTreeDimensionTilesCount;
-    // Reserve space for nodes to avoid reallocation when adding nodes to the array.
-    mTerrainQuadTreeNodes.reserve(maxQuadTreeNodesCount);
+    const int chunksCount = (mDimension.x * mDimension.y) / TILES_COUNT_PER_CHUNK;
+    const int rowChunksCount = mDimension.x / CHUNK_DIMENSION;
+    const ETerrainMeshingMode meshingMode = mMeshingMode;
+
+    // Chunks are generated with local indices, the first vertex of the slot is added when they are
+    // uploaded.
+    auto generate = [rowChunksCount, meshingMode](int chunk, const TileStore& tiles, const Point2d& tilesOrigin,
+        TerrainChunkResidency::ChunkGeometry* geometry) {
+        const Point2d chunkOrigin = Point2d(chunk % rowChunksCount, chunk / rowChunksCount) * CHUNK_DIMENSION - tilesOrigin;
+
+        geometry->vertices.resize(TILES_COUNT_PER_CHUNK * 4 * sizeof(TerrainVertex));
+        geometry->indices.resize(TILES_COUNT_PER_CHUNK * 6);
+        const int quadsCount = _generateChunkGeometry(tiles, tilesOrigin, chunkOrigin, meshingMode, 0, 
+            (TerrainVertex*)geometry->vertices.data(), geometry->indices.data());
+
+        geometry->vertices.resize(quadsCount * 4 * sizeof(TerrainVertex));
+        geometry->verticesCount = quadsCount * 4;
+        geometry->facesCount = quadsCount * 2;
+    };
 
-    // Begin to create the quad tree recursively.
-    Rectd rootNodeSquare(Point2d::ZERO(), mQuadTreeDimension);
-    _createTerrainQuadTreeNodeRecursively(rootNodeSquare, nullptr);
+    mChunkResidency.create(chunksCount, (int)mChunkRanges.size(), generate);
 }
 //-------------------------------------------------------------------------------------------------
-void Terrain::_buildWaterQuadTree()
+void Terrain::_requestChunk(int chunk)
 {
-    const int quadTreeDimensionTilesCount = mQuadTreeDimension.x * mQuadTreeDimension.y;
-    const int maxQuadTreeNodesCount = (1 - quadTreeDimensionTilesCount) / (-3) + quadTreeDimensionTilesCount;
-    // Reserve space for nodes to avoid reallocation when adding nodes to the array.
-    mWaterQuadTreeNodes.reserve(maxQuadTreeNodesCount);
+    // The chunk and its one tile border, since normals on the border depend on the neighbor tiles.
+    const int rowChunksCount = mDimension.x / CHUNK_DIMENSION;
+    const Rectd chunkRect = _calcChunkTileRect(Point2d(chunk % rowChunksCount, chunk / rowChunksCount));
+    Rectd tileRect(chunkRect.getMin() - Point2d(1, 1), chunkRect.getMax() + Point2d(1, 1));
+    tileRect = Rectd::intersection(tileRect, Rectd::makeRect(Point2d::ZERO(), mDimension));
 
-    // Begin to create the quad tree recursively.
-    Rectd rootNodeSquare(Point2d::ZERO(), mQuadTreeDimension);
-    _createWaterQuadTreeNodeRecursively(rootNodeSquare, nullptr);
+    mChunkResidency.requestChunk(chunk, mTilesData, tileRect);
 }
 //-------------------------------------------------------------------------------------------------
-void Terrain::_createTerrainQuadTreeNodeRecursively(const Rectd& subSquare, QuadTreeNode* parent)
+void Terrain::_updateResidentChunks()
 {
-    const Rectd actualTerrainRect = Rectd::makeRect(Point2d::ZERO(), mDimension);
-    const int intersectiontilesCount = Rectd::intersectionArea(actualTerrainRect, subSquare);
-    if (intersectiontilesCount == 0) {
-        // No intersection means the node is not in the actual terrain, add a null pointer to
-        // the parent's children array and return immediately.
-        parent->children[parent->childrenCount++] = nullptr;
-        return;
-    }
+    mChunkResidency.beginFrame();
 
-    mTerrainQuadTreeNodes.emplace_back();
-    QuadTreeNode& currentNode = mTerrainQuadTreeNodes.back();
+    // Mark the visible chunks as used first, so they aren't evicted by the uploaded chunks.
+    for (int chunk : mVisibleChunks)
+        mChunkResidency.useChunk(chunk);
 
-    if (subSquare.getWidth() * subSquare.getHeight() == 1) {
-        // If the sub-square only contains one tile, then this node should be a leaf node, update
-        // it's tile index.
-        currentNode.tile = subSquare.getPosition().y * mDimension.x + subSquare.getPosition().x;
+    IDirect3DVertexBuffer9* verticesBuffer = nullptr;
+    IDirect3DIndexBuffer9* indicesBuffer = nullptr;
+    mTerrainMesh->getPointer()->GetVertexBuffer(&verticesBuffer);
+    mTerrainMesh->getPointer()->GetIndexBuffer(&indicesBuffer);
+
+    const int chunkVerticesCount = TILES_COUNT_PER_CHUNK * 4;
+    const int chunkIndicesCount = TILES_COUNT_PER_CHUNK * 6;
+
+    bool isUploaded = false;
+    mChunkResidency.uploadGeneratedChunks([&](int, int slot, const TerrainChunkResidency::ChunkGeometry& geometry) {
+        const unsigned firstVertex = slot * chunkVerticesCount;
+
+        void* vertices = nullptr;
+        verticesBuffer->Lock(firstVertex * sizeof(TerrainVertex), (UINT)geometry.vertices.size(), &vertices, 0);
+        memcpy(vertices, geometry.vertices.data(), geometry.vertices.size());
+        verticesBuffer->Unlock();
+
+        unsigned* indices = nullptr;
+        indicesBuffer->Lock(slot * chunkIndicesCount * sizeof(unsigned), chunkIndicesCount * sizeof(unsigned), (void**)&indices, 0);
+        for (int i = 0; i < chunkIndicesCount; ++i)
+            indices[i] = firstVertex + geometry.indices[i];
+        indicesBuffer->Unlock();
+
+        mChunkRanges[slot].FaceCount = geometry.facesCount;
+        mChunkRanges[slot].VertexCount = geometry.verticesCount;
+        isUploaded = true;
+    });
+
+    if (isUploaded)
+        mTerrainMesh->getPointer()->SetAttributeTable(&mChunkRanges.front(), (DWORD)mChunkRanges.size());
+
+    verticesBuffer->Release();
+    indicesBuffer->Release();
+
+    mResidentChunkSlots.clear();
+    for (int chunk : mVisibleChunks) {
+        const int slot = mChunkResidency.getSlot(chunk);
+        if (slot >= 0)
+            mResidentChunkSlots.push_back(slot);
+        else if (!mChunkResidency.isRequested(chunk))
+            _requestChunk(chunk);
     }
-    else {
-        // If the rectangle is larger than a tile, then we need to continue sub-dividing.
-
-        if (subSquare.getWidth() == CHUNK_DIMENSION) {
-            // First check if the sub-square is equal to the size of a chunk. If so, update the node's
-            // chunk index to let the node has a chunk.
-            int chunkPosX = subSquare.getPosition().x / CHUNK_DIMENSION;
-            int chunkPosY = subSquare.getPosition().y / CHUNK_DIMENSION;
-            int rowChunkCounts = mDimension.x / CHUNK_DIMENSION;
-            currentNode.chunk = chunkPosY * rowChunkCounts + chunkPosX;
-        }
-
-        // Calculate sub-squares for four children.
-        const Size2d halfSize = subSquare.getSize() / 2;
-        Rectd subSquares[4];
-        subSquares[0] = Rectd::makeRect(subSquare.getPosition(), halfSize);
-        subSquares[1] = Rectd::makeRect(subSquare.getPosition() + Point2d(subSquare.getWidth() / 2, 0), halfSize);
-        subSquares[2] = Rectd::makeRect(subSquare.getPosition() + Point2d(0, subSquare.getHeight() / 2), halfSize);
-        subSquares[3] = Rectd::makeRect(subSquare.getPosition() + Point2d(subSquare.getWidth() / 2, subSquare.getHeight() / 2), halfSize);
-
-        for (int i = 0; i < 4; ++i) {
-            _createTerrainQuadTreeNodeRecursively(subSquares[i], &currentNode);
-        }
+    std::sort(mResidentChunkSlots.begin(), mResidentChunkSlots.end());
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::_invalidateResidentChunks(const Rectd& dirtyRect)
+{
+    std::vector<std::pair<int, int>> dirtySlots;
+    _gatherDirtySlots(dirtyRect, &dirtySlots);
+
+    // Chunks which are neither resident nor requested are generated from the current tiles when
+    // they are requested.
+    for (const std::pair<int, int>& dirtySlot : dirtySlots) {
+        const int chunk = dirtySlot.second;
+        if (mChunkResidency.getSlot(chunk) >= 0 || mChunkResidency.isRequested(chunk))
+            _requestChunk(chunk);
     }
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::_drawTerrainMeshChunks(const std::vector<int>& slots)
+{
+    IDirect3DVertexBuffer9* verticesBuffer = nullptr;
+    IDirect3DIndexBuffer9* indicesBuffer = nullptr;
+    mTerrainMesh->getPointer()->GetVertexBuffer(&verticesBuffer);
+    mTerrainMesh->getPointer()->GetIndexBuffer(&indicesBuffer);
 
-    // Update the current node's AABB.
-    AABB aabb;
-    if (currentNode.childrenCount > 0) {
-        // The node is not a leaf node, then its AABB should be the compound of its
-        // children's AABBs.
-        aabb = currentNode.children[0]->aabb; // It's safe since left-top children can't be nullptr.
-        for (int i = 1; i < 4; ++i) {
-            QuadTreeNode* node = currentNode.children[i];
-            if (node) 
-                aabb = AABB::compound(aabb, node->aabb);
-        }
+    IDirect3DDevice9* D3DDevice = mRenderSystem->getD3DDevice();
+    D3DDevice->SetStreamSource(0, verticesBuffer, 0, sizeof(TerrainVertex));
+    D3DDevice->SetIndices(indicesBuffer);
+    D3DDevice->SetVertexDeclaration(mTerrainVertexDeclaration);
+
+    // Each run of adjacent slots is contiguous in the buffers. Slots which aren't filled by their 
+    // chunks are padded with degenerate triangles, which are drawn unless the slot ends the run.
+    size_t i = 0;
+    while (i < slots.size()) {
+        const D3DXATTRIBUTERANGE& firstRange = mChunkRanges[slots[i]];
+        int lastSlot = slots[i];
+        while (++i < slots.size() && slots[i] == lastSlot + 1)
+            ++lastSlot;
+
+        const D3DXATTRIBUTERANGE& lastRange = mChunkRanges[lastSlot];
+        const UINT verticesCount = lastRange.VertexStart + lastRange.VertexCount - firstRange.VertexStart;
+        const UINT facesCount = lastRange.FaceStart + lastRange.FaceCount - firstRange.FaceStart;
+
+        D3DDevice->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, firstRange.VertexStart, verticesCount, 
+            firstRange.FaceStart * 3, facesCount);
+
+        ++mDrawStats.drawCallsCount;
+        mDrawStats.trianglesCount += facesCount;
     }
-    else {
-        // If the node is a leaf node then calculate its aabb based on the tile's type.
-        //
 
-        // Retrieve the tile
-        const int tileIndex = subSquare.getPosition().y * mDimension.x + subSquare.getPosition().x;
-        const Tile& tile = mTilesData[tileIndex];
+    verticesBuffer->Release();
+    indicesBuffer->Release();
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::_drawTileInstances()
+{
+    IDirect3DVertexBuffer9* verticesBuffer = nullptr;
+    IDirect3DIndexBuffer9* indicesBuffer = nullptr;
+    mTileMesh->getPointer()->GetVertexBuffer(&verticesBuffer);
+    mTileMesh->getPointer()->GetIndexBuffer(&indicesBuffer);
+
+    IDirect3DDevice9* D3DDevice = mRenderSystem->getD3DDevice();
+    D3DDevice->SetStreamSource(0, verticesBuffer, 0, sizeof(TileQuadVertex));
+    D3DDevice->SetIndices(indicesBuffer);
+    D3DDevice->SetVertexDeclaration(mTileVertexDeclaration);
+
+    // Every slot is filled by the records of its chunk's tiles, so each run of adjacent slots is a
+    // contiguous range of records.
+    size_t i = 0;
+    while (i < mVisibleChunkSlots.size()) {
+        const int firstSlot = mVisibleChunkSlots[i];
+        int lastSlot = firstSlot;
+        while (++i < mVisibleChunkSlots.size() && mVisibleChunkSlots[i] == lastSlot + 1)
+            ++lastSlot;
 
-        // Calculate tile's world space position
-        D3DXVECTOR3 worldPos = _calcTilePositionFromLocation(subSquare.getPosition());
-        worldPos.y = mTilesData[tileIndex].getAltitude();
+        const UINT tilesCount = (lastSlot - firstSlot + 1) * TILES_COUNT_PER_CHUNK;
 
-        const D3DXVECTOR3 halfSize = { Tile::SIZE * 0.5f, 0.0f, Tile::SIZE * 0.5f };
-        D3DXVECTOR3 min = worldPos - halfSize;
-        D3DXVECTOR3 max = worldPos + halfSize;
+        D3DDevice->SetStreamSourceFreq(0, D3DSTREAMSOURCE_INDEXEDDATA | tilesCount);
+        D3DDevice->SetStreamSource(1, mTileInstanceBuffer, firstSlot * TILES_COUNT_PER_CHUNK * sizeof(TerrainTileInstances::Instance),
+            sizeof(TerrainTileInstances::Instance));
+        D3DDevice->SetStreamSourceFreq(1, D3DSTREAMSOURCE_INSTANCEDATA | 1);
 
-        if (tile.type != ETileType::Flat) 
-            // The height of AABB is not zero if the tile is not a flat type.
-            max.y = worldPos.y + Tile::HEIGHT_PER_LEVEL;
+        D3DDevice->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, 0, 4, 0, 2);
 
-        aabb.setMin(min);
-        aabb.setMax(max);
+        ++mDrawStats.drawCallsCount;
+        mDrawStats.trianglesCount += tilesCount * 2;
     }
 
-    currentNode.aabb = aabb;
+    // Restore the streams to non-instanced drawing.
+    D3DDevice->SetStreamSourceFreq(0, 1);
+    D3DDevice->SetStreamSourceFreq(1, 1);
+    D3DDevice->SetStreamSource(1, nullptr, 0, 0);
 
-    // Add the current node to its parent's children array.
-    if (parent)
-        parent->children[parent->childrenCount++] = &currentNode;
+    verticesBuffer->Release();
+    indicesBuffer->Release();
 }
 //-------------------------------------------------------------------------------------------------
-void Terrain::_createWaterQuadTreeNodeRecursively(const Rectd& subSquare, QuadTreeNode* parent)
+void Terrain::_buildTerrainQuadTree()
 {
-    const Rectd actualTerrainRect = Rectd::makeRect(Point2d::ZERO(), mDimension);
-    const int intersectiontilesCount = Rectd::intersectionArea(actualTerrainRect, subSquare);
-    if (intersectiontilesCount == 0) {
-        // No intersection means the node is not in the actual terrain, add a null pointer to
-        // the parent's children array and return immediately.
-        parent->children[parent->childrenCount++] = nullptr;
-        return;
-    }
-
-    mWaterQuadTreeNodes.emplace_back();
-    QuadTreeNode& currentNode = mWaterQuadTreeNodes.back();
-
-    if (subSquare.getWidth() == 1) {
-        // Check if the sub-square is equal to 1. If so, update the node's
-        // tile index.
-        currentNode.tile = subSquare.getPosition().y * mDimension.x + subSquare.getPosition().x;
+    _updateTerrainQuadTree(Rectd::makeRect(Point2d::ZERO(), mDimension));
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::_buildWaterChunks()
+{
+    mWaterChunks.create(Size2d(mDimension.x / CHUNK_DIMENSION, mDimension.y / CHUNK_DIMENSION));
+    mWaterTileAltitudes.clear();
+    _updateWaterChunks(Rectd::makeRect(Point2d::ZERO(), mDimension));
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::_updateTerrainQuadTree(const Rectd& dirtyRect)
+{
+    const Rectd chunkRect = _calcChunkRect(dirtyRect);
+    for (int y = chunkRect.getTop(); y < chunkRect.getBottom(); ++y) {
+        for (int x = chunkRect.getLeft(); x < chunkRect.getRight(); ++x) {
+            const Point2d chunkLocation(x, y);
+            mTerrainQuadTree.setLeafAABB(chunkLocation, _calcChunkAABB(chunkLocation));
+        }
     }
-    else {
-        // If the rectangle is larger than a tile, then we need to continue sub-dividing.
-        //
 
-        // Calculate sub-squares for four children.
-        const Size2d halfSize = subSquare.getSize() / 2;
-        Rectd subSquares[4];
-        subSquares[0] = Rectd::makeRect(subSquare.getPosition(), halfSize);
-        subSquares[1] = Rectd::makeRect(subSquare.getPosition() + Point2d(subSquare.getWidth() / 2, 0), halfSize);
-        subSquares[2] = Rectd::makeRect(subSquare.getPosition() + Point2d(0, subSquare.getHeight() / 2), halfSize);
-        subSquares[3] = Rectd::makeRect(subSquare.getPosition() + Point2d(subSquare.getWidth() / 2, subSquare.getHeight() / 2), halfSize);
+    mTerrainQuadTree.refit(chunkRect);
+    mIsVisibleChunksCacheValid = false;
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::_updateWaterChunks(const Rectd& dirtyRect)
+{
+    const Rectd chunkRect = _calcChunkRect(dirtyRect);
+    const int rowChunksCount = mDimension.x / CHUNK_DIMENSION;
 
-        for (int i = 0; i < 4; ++i) {
-            _createWaterQuadTreeNodeRecursively(subSquares[i], &currentNode);
+    // Modified chunks as pairs of their row-major indices and the positions of their water tiles'
+    // altitudes in modifiedAltitudes.
+    std::vector<std::pair<int, int>> modifiedChunks;
+    std::vector<float> modifiedAltitudes;
+    float altitudes[TILES_COUNT_PER_CHUNK];
+
+    // Visit chunks region by region, which is the order they are stored in the list.
+    const int regionDimension = TerrainWaterChunks::REGION_DIMENSION;
+    const int firstRegionX = chunkRect.getLeft() / regionDimension * regionDimension;
+    const int firstRegionY = chunkRect.getTop() / regionDimension * regionDimension;
+    for (int regionY = firstRegionY; regionY < chunkRect.getBottom(); regionY += regionDimension) {
+        for (int regionX = firstRegionX; regionX < chunkRect.getRight(); regionX += regionDimension) {
+            const Rectd rect = Rectd::intersection(chunkRect, Rectd::makeRect(regionX, regionY, regionDimension, regionDimension));
+
+            for (int y = rect.getTop(); y < rect.getBottom(); ++y) {
+                for (int x = rect.getLeft(); x < rect.getRight(); ++x) {
+                    AABB aabb;
+                    const uint64_t tileMask = _calcWaterChunk(Point2d(x, y), &aabb, altitudes);
+
+                    // The AABB is determined by the water tiles and their altitudes, so the chunk
+                    // is unchanged if they are.
+                    const int i = mWaterChunks.findChunk(Point2d(x, y));
+                    if (i < 0 && tileMask == 0)
+                        continue;
+                    if (i >= 0) {
+                        const TerrainWaterChunks::Chunk& chunk = mWaterChunks.getChunk(i);
+                        if (chunk.tileMask == tileMask && 
+                            std::equal(altitudes, altitudes + chunk.tilesCount, mWaterTileAltitudes.begin() + chunk.firstTile))
+                            continue;
+                    }
+
+                    // Chunk without visible water is removed from the list.
+                    mWaterChunks.setChunk(Point2d(x, y), tileMask, aabb);
+
+                    int tilesCount = 0;
+                    for (uint64_t mask = tileMask; mask != 0; mask &= mask - 1)
+                        ++tilesCount;
+                    modifiedChunks.push_back(std::make_pair(y * rowChunksCount + x, (int)modifiedAltitudes.size()));
+                    modifiedAltitudes.insert(modifiedAltitudes.end(), altitudes, altitudes + tilesCount);
+                }
+            }
         }
     }
 
-    // Update the current node's AABB.
-    AABB aabb;
-    if (currentNode.childrenCount > 0) {
-        // The node is not a leaf node, then its AABB should be the compound of its
-        // children's AABBs.
-        aabb = currentNode.children[0]->aabb; // It's safe since left-top children can't be nullptr.
+    if (modifiedChunks.empty())
+        // Neither the water tiles nor their altitudes are modified.
+        return;
 
-        // Iterate its children and update the aabb
-        for (int i = 1; i < 4; ++i) {
-            QuadTreeNode* node = currentNode.children[i];
-            if (node) {  
-                if (node->tile != -1 && !mTilesData[node->tile].hasWater)
-                    // Tile without water doesn't affect parent's aabb
-                    continue;
+    // Tiles of the chunks from the first renumbered one are moved by refit, altitudes of the 
+    // unmodified ones are moved with them.
+    const size_t firstRenumberedChunk = mWaterChunks.getFirstRenumberedChunk();
+    const int firstMovedTile = firstRenumberedChunk > 0 ? 
+        mWaterChunks.getChunk(firstRenumberedChunk - 1).firstTile + mWaterChunks.getChunk(firstRenumberedChunk - 1).tilesCount : 0;
+    const std::vector<float> movedAltitudes(mWaterTileAltitudes.begin() + firstMovedTile, mWaterTileAltitudes.end());
+    std::vector<int> movedFirstTiles;
+    for (size_t i = firstRenumberedChunk; i < mWaterChunks.getChunksCount(); ++i)
+        movedFirstTiles.push_back(mWaterChunks.getChunk(i).firstTile);
+
+    mWaterChunks.refit();
+    mWaterTileAltitudes.resize(mWaterChunks.getTilesCount());
+
+    std::sort(modifiedChunks.begin(), modifiedChunks.end());
+    auto isModified = [&modifiedChunks](int index) {
+        auto it = std::lower_bound(modifiedChunks.begin(), modifiedChunks.end(), std::make_pair(index, 0));
+        return it != modifiedChunks.end() && it->first == index;
+    };
 
-                aabb = AABB::compound(aabb, node->aabb);
-            }
+    for (size_t i = firstRenumberedChunk; i < mWaterChunks.getChunksCount(); ++i) {
+        const TerrainWaterChunks::Chunk& chunk = mWaterChunks.getChunk(i);
+        if (!isModified(chunk.index)) {
+            const float* altitude = movedAltitudes.data() + (movedFirstTiles[i - firstRenumberedChunk] - firstMovedTile);
+            std::copy(altitude, altitude + chunk.tilesCount, mWaterTileAltitudes.begin() + chunk.firstTile);
         }
     }
-    else {
-        // If the node is a leaf node then calculate its aabb
-        D3DXVECTOR3 worldPos = _calcTilePositionFromLocation(subSquare.getPosition());
-        worldPos.y = mTilesData[currentNode.tile].waterAltitude;
-
-        D3DXVECTOR3 halfSize = { Tile::SIZE * 0.5f, 0.0f, Tile::SIZE * 0.5f };
-        D3DXVECTOR3 min = worldPos - halfSize;
-        D3DXVECTOR3 max = worldPos + halfSize;
 
-        aabb.setMin(min);
-        aabb.setMax(max);
+    // Write the altitudes of the modified chunks, and rewrite the instances of the modified chunks
+    // before the moved ones and all the moved ones.
+    std::vector<int> modifiedPositions;
+    for (const std::pair<int, int>& modifiedChunk : modifiedChunks) {
+        const int i = mWaterChunks.findChunk(Point2d(modifiedChunk.first % rowChunksCount, modifiedChunk.first / rowChunksCount));
+        if (i < 0)
+            // The chunk's water is removed.
+            continue;
+
+        const TerrainWaterChunks::Chunk& chunk = mWaterChunks.getChunk(i);
+        std::copy(modifiedAltitudes.begin() + modifiedChunk.second, modifiedAltitudes.begin() + modifiedChunk.second + chunk.tilesCount,
+            mWaterTileAltitudes.begin() + chunk.firstTile);
+        if (i < (int)firstRenumberedChunk)
+            modifiedPositions.push_back(i);
     }
 
-    currentNode.aabb = aabb;
+    std::sort(modifiedPositions.begin(), modifiedPositions.end());
+    std::vector<std::pair<int, int>> chunkRuns;
+    for (int i : modifiedPositions) {
+        if (!chunkRuns.empty() && chunkRuns.back().second == i)
+            ++chunkRuns.back().second;
+        else
+            chunkRuns.push_back(std::make_pair(i, i + 1));
+    }
+    if (firstRenumberedChunk < mWaterChunks.getChunksCount())
+        chunkRuns.push_back(std::make_pair((int)firstRenumberedChunk, (int)mWaterChunks.getChunksCount()));
 
-    // Add the current node to its parent's children array.
-    if (parent)
-        parent->children[parent->childrenCount++] = &currentNode;
+    _updateWaterTileInstances(chunkRuns);
+    mIsVisibleChunksCacheValid = false;
 }
 //-------------------------------------------------------------------------------------------------
-void Terrain::_gatherVisibleTerrainChunksRecursively(const QuadTreeNode& node, const ViewFrustum& viewFrustum,
-    bool isParentInsideFrustum, std::vector<int>* visibleChunks)
+void Terrain::_updateVisibleChunks(const ViewFrustum& viewFrustum)
 {
-    int aabbCullingResult = ViewFrustum::AABB_INSIDE;
+    // The camera only moves while the view is scrolled, and both the terrain and the water are 
+    // drawn with the same frustum in a frame.
+    if (mIsVisibleChunksCacheValid && viewFrustum == mCachedViewFrustum)
+        return;
 
-    if (!isParentInsideFrustum) {
-        // If parent is not completely inside the frustum, then perform Frustum-AABB intersection test.
-        aabbCullingResult = viewFrustum.hasIntersection(node.aabb);
+    mVisibleChunks.clear();
+    if (mCullingMode != ETerrainCullingMode::eIsometric || !_gatherVisibleChunksIsometric(viewFrustum, &mVisibleChunks))
+        mTerrainQuadTree.gatherVisibleNodes(viewFrustum, mTerrainQuadTree.getDepth(), &mVisibleChunks);
 
-        if (aabbCullingResult == ViewFrustum::AABB_OUTSIDE)
-            // If this node is completely outside of the frustum, then there is no need to check its children.
-            return;
+    mVisibleChunkSlots.clear();
+    for (int chunk : mVisibleChunks)
+        mVisibleChunkSlots.push_back(mChunkSlots[chunk]);
+    std::sort(mVisibleChunkSlots.begin(), mVisibleChunkSlots.end());
+
+    mVisibleWaterChunks.clear();
+    mWaterChunks.gatherVisibleChunks(viewFrustum, &mVisibleWaterChunks);
+
+    mCachedViewFrustum = viewFrustum;
+    mIsVisibleChunksCacheValid = true;
+}
+//-------------------------------------------------------------------------------------------------
+bool Terrain::_gatherVisibleChunksIsometric(const ViewFrustum& viewFrustum, std::vector<int>* chunks) const
+{
+    // Every chunk is treated as an AABB as high as the whole terrain. A chunk is outside a plane
+    // if the AABB's corner farthest along the plane normal is behind it, so in the chunks grid,
+    // chunk (v, u) is visible if A[i] * u + C[i] * v + K[i] >= 0 for all 4 planes, which is a
+    // convex polygon. Grid x goes along world z axis and grid y goes along world x axis.
+    const AABB terrainAABB = mTerrainQuadTree.getAABB(0, Point2d::ZERO());
+    const float chunkSize = Tile::SIZE * CHUNK_DIMENSION;
+    const float chunkHalfSize = chunkSize * 0.5f;
+    // World position of the center of chunk (0, 0), tile positions are at their centers.
+    const float chunkOffset = chunkHalfSize - Tile::SIZE * 0.5f;
+
+    float A[4], C[4], K[4];
+    for (int i = 0; i < 4; ++i) {
+        const D3DXPLANE& plane = viewFrustum.getPlane(i);
+        A[i] = plane.a * chunkSize;
+        C[i] = plane.c * chunkSize;
+        K[i] = (plane.a + plane.c) * chunkOffset + (fabsf(plane.a) + fabsf(plane.c)) * chunkHalfSize +
+            std::max(plane.b * terrainAABB.getMin().y, plane.b * terrainAABB.getMax().y) + plane.d;
     }
 
-    if (node.chunk != -1) {
-        // The node has a chunk, add it to the array.
-        visibleChunks->push_back(node.chunk);
+    // The polygon is unbounded if it extends along one of its edges' directions forever.
+    bool isDegenerate = true;
+    for (int i = 0; i < 4; ++i) {
+        for (float sign = -1.0f; sign <= 1.0f; sign += 2.0f) {
+            const float du = -C[i] * sign, dv = A[i] * sign;
+            if (du == 0.0f && dv == 0.0f)
+                continue;
+
+            isDegenerate = false;
+            bool isRecessive = true;
+            for (int j = 0; j < 4 && isRecessive; ++j)
+                isRecessive = A[j] * du + C[j] * dv >= 0.0f;
+            if (isRecessive)
+                return false;
+        }
     }
-    else {
-        // Check its children rescursively.
-        isParentInsideFrustum = (aabbCullingResult == ViewFrustum::AABB_INSIDE);
-        for (int i = 0; i < 4; ++i) {
-            QuadTreeNode* child = node.children[i];
-            if (child) {
-                _gatherVisibleTerrainChunksRecursively(*child, viewFrustum, isParentInsideFrustum, visibleChunks);
+
+    if (isDegenerate)
+        // No plane is facing horizontally.
+        return false;
+
+    // The rows range of the polygon is found from its vertices, which are the intersections of
+    // the plane pairs satisfying the other planes.
+    const float epsilon = 1e-3f;
+    float minU = FLT_MAX, maxU = -FLT_MAX;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = i + 1; j < 4; ++j) {
+            const float det = A[i] * C[j] - A[j] * C[i];
+            if (det == 0.0f)
+                continue;
+
+            const float u = (C[i] * K[j] - C[j] * K[i]) / det;
+            const float v = (A[j] * K[i] - A[i] * K[j]) / det;
+
+            bool isInside = true;
+            for (int k = 0; k < 4 && isInside; ++k)
+                isInside = A[k] * u + C[k] * v + K[k] >= -epsilon * (fabsf(A[k]) + fabsf(C[k]));
+            if (isInside) {
+                minU = std::min(minU, u);
+                maxU = std::max(maxU, u);
             }
         }
     }
+
+    if (minU > maxU)
+        // The polygon is empty.
+        return true;
+
+    // Scan the rows, each row of the polygon is a range of columns. Ranges are widened a little, so 
+    // the chunks on the boundary are never dropped by rounding errors.
+    const int rowChunksCount = mDimension.x / CHUNK_DIMENSION;
+    const int firstRow = (int)ceilf(std::max(0.0f, minU - epsilon));
+    const int lastRow = (int)floorf(std::min(mDimension.y / CHUNK_DIMENSION - 1.0f, maxU + epsilon));
+    for (int row = firstRow; row <= lastRow; ++row) {
+        float minV = -epsilon, maxV = rowChunksCount - 1 + epsilon;
+        for (int i = 0; i < 4; ++i) {
+            const float t = A[i] * row + K[i];
+            if (C[i] > 0.0f)
+                minV = std::max(minV, -t / C[i] - epsilon);
+            else if (C[i] < 0.0f)
+                maxV = std::min(maxV, -t / C[i] + epsilon);
+            else if (t < 0.0f)
+                maxV = -FLT_MAX;
+        }
+
+        if (minV > maxV)
+            continue;
+
+        const int firstColumn = (int)ceilf(minV), lastColumn = (int)floorf(maxV);
+        for (int column = firstColumn; column <= lastColumn; ++column)
+            chunks->push_back(row * rowChunksCount + column);
+    }
+
+    return true;
 }
 //-------------------------------------------------------------------------------------------------
-void Terrain::_gatherVisibleWaterTilesRecursively(const QuadTreeNode& node, const ViewFrustum& viewFrustum, 
-    bool isParentInsideFrustum, std::vector<int>* visibleWaterTiles)
+void Terrain::_buildChunkSlots()
 {
-    int aabbCullingResult = ViewFrustum::AABB_INSIDE;
+    const Size2d chunksDimension(mDimension.x / CHUNK_DIMENSION, mDimension.y / CHUNK_DIMENSION);
+    const int chunksCount = chunksDimension.x * chunksDimension.y;
+
+    // Sort the chunks by their Morton codes, then number them in that order. Slots are compact even 
+    // if the chunks grid isn't a square of a power of 2.
+    std::vector<std::pair<uint32_t, int>> codes(chunksCount);
+    for (int chunk = 0; chunk < chunksCount; ++chunk)
+        codes[chunk] = std::make_pair(Math::mortonCode(chunk % chunksDimension.x, chunk / chunksDimension.x), chunk);
+    std::sort(codes.begin(), codes.end());
+
+    mChunkSlots.resize(chunksCount);
+    for (int slot = 0; slot < chunksCount; ++slot)
+        mChunkSlots[codes[slot].second] = slot;
+}
+//-------------------------------------------------------------------------------------------------
+Rectd Terrain::_calcChunkRect(const Rectd& tileRect) const
+{
+    return Rectd(tileRect.getMin() / CHUNK_DIMENSION,
+        (tileRect.getMax() + Point2d(CHUNK_DIMENSION - 1, CHUNK_DIMENSION - 1)) / CHUNK_DIMENSION);
+}
+//-------------------------------------------------------------------------------------------------
+AABB Terrain::_calcTileAABB(const Point2d& location) const
+{
+    // Retrieve the tile
+    const int tileIndex = location.y * mDimension.x + location.x;
 
-    if (!isParentInsideFrustum) {
-        // If parent is not completely inside the frustum, then perform Frustum-AABB intersection test.
-        aabbCullingResult = viewFrustum.hasIntersection(node.aabb);
+    // Calculate tile's world space position
+    D3DXVECTOR3 worldPos = _calcTilePositionFromLocation(location);
+    worldPos.y = mTilesData.getAltitude(tileIndex);
 
-        if (aabbCullingResult == ViewFrustum::AABB_OUTSIDE)
-            // If this node is completely outside of the frustum, then there is no need to check its children.
-            return;
-    }
+    const D3DXVECTOR3 halfSize = { Tile::SIZE * 0.5f, 0.0f, Tile::SIZE * 0.5f };
+    D3DXVECTOR3 min = worldPos - halfSize;
+    D3DXVECTOR3 max = worldPos + halfSize;
 
-    if (node.tile != -1) {
-        // Node has a tile, check whether water is visible.
-        // If it is visible, add to the visible water tile array.
-        if (mTilesData[node.tile].isWaterVisible())
-            visibleWaterTiles->push_back(node.tile);
+    if (mTilesData.getType(tileIndex) != ETileType::Flat) 
+        // The height of AABB is not zero if the tile is not a flat type.
+        max.y = worldPos.y + Tile::HEIGHT_PER_LEVEL;
+
+    return AABB(min, max);
+}
+//-------------------------------------------------------------------------------------------------
+AABB Terrain::_calcWaterTileAABB(const Point2d& location) const
+{
+    D3DXVECTOR3 worldPos = _calcTilePositionFromLocation(location);
+    worldPos.y = mTilesData.getWaterAltitude(location.y * mDimension.x + location.x);
+
+    const D3DXVECTOR3 halfSize = { Tile::SIZE * 0.5f, 0.0f, Tile::SIZE * 0.5f };
+    return AABB(worldPos - halfSize, worldPos + halfSize);
+}
+//-------------------------------------------------------------------------------------------------
+AABB Terrain::_calcChunkAABB(const Point2d& chunkLocation) const
+{
+    const Rectd tileRect = _calcChunkTileRect(chunkLocation);
+    AABB aabb = _calcTileAABB(tileRect.getMin());
+    for (int y = tileRect.getTop(); y < tileRect.getBottom(); ++y) {
+        for (int x = tileRect.getLeft(); x < tileRect.getRight(); ++x)
+            aabb = AABB::compound(aabb, _calcTileAABB(Point2d(x, y)));
     }
-    else {
-        // Check its children rescursively.
-        isParentInsideFrustum = (aabbCullingResult == ViewFrustum::AABB_INSIDE);
-        for (int i = 0; i < 4; ++i) {
-            QuadTreeNode* child = node.children[i];
-            if (child) {
-                _gatherVisibleWaterTilesRecursively(*child, viewFrustum, isParentInsideFrustum, visibleWaterTiles);
-            }
+
+    return aabb;
+}
+//-------------------------------------------------------------------------------------------------
+uint64_t Terrain::_calcWaterChunk(const Point2d& chunkLocation, AABB* aabb, float* altitudes) const
+{
+    uint64_t tileMask = 0;
+    const Rectd tileRect = _calcChunkTileRect(chunkLocation);
+    for (int y = tileRect.getTop(); y < tileRect.getBottom(); ++y) {
+        for (int x = tileRect.getLeft(); x < tileRect.getRight(); ++x) {
+            if (!mTilesData.isWaterVisible(y * mDimension.x + x))
+                continue;
+
+            const AABB tileAABB = _calcWaterTileAABB(Point2d(x, y));
+            *aabb = tileMask != 0 ? AABB::compound(*aabb, tileAABB) : tileAABB;
+            *altitudes++ = tileAABB.getMin().y;
+
+            const int bit = (y - tileRect.getTop()) * CHUNK_DIMENSION + (x - tileRect.getLeft());
+            tileMask |= (uint64_t)1 << bit;
         }
     }
+
+    return tileMask;
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::_raycastOnTile(int tileIndex, const Ray& ray, std::vector<TerrainRaycastHit>* hits) const
+{
+    // Get this tile's geometry.
+    const TileGeometry& tileGeometry = TILE_GEOMETRIES()[mTilesData.getType(tileIndex)];
+
+    // Get tile's world space position
+    Point2d tileLocation(tileIndex % mDimension.x, tileIndex / mDimension.x);
+    D3DXVECTOR3 tilePosition = _calcTilePositionFromLocation(tileLocation);
+    tilePosition.y = mTilesData.getAltitude(tileIndex);
+
+    // Cast ray on tile's geometry.
+    float distances[2];
+    int hitCount = tileGeometry.raycast(tilePosition, ray, distances);
+
+    // Gather ray cast hit position
+    D3DXVECTOR3 hitPosition;
+    for (int i = 0; i < hitCount; ++i) {
+        hitPosition = ray.getPointOnRay(distances[i]);
+        hits->push_back(TerrainRaycastHit(distances[i], hitPosition, tileLocation));
+    }
 }
 //-------------------------------------------------------------------------------------------------
-void Terrain::_raycastOnQuadTreeRecursively(const QuadTreeNode& node, const Ray& ray, std::vector<TerrainRaycastHit>* hits) const
+bool Terrain::_raycastOnTileNearest(const Point2d& location, const Ray& ray, TerrainRaycastHit* hit) const
 {
-    if (ray.intersectAABB(node.aabb) == false)
-        // The ray has no intersection with the AABB of this node.
+    // Get this tile's geometry.
+    const int tileIndex = location.y * mDimension.x + location.x;
+    const TileGeometry& tileGeometry = TILE_GEOMETRIES()[mTilesData.getType(tileIndex)];
+
+    // Get tile's world space position
+    D3DXVECTOR3 tilePosition = _calcTilePositionFromLocation(location);
+    tilePosition.y = mTilesData.getAltitude(tileIndex);
+
+    // Cast ray on tile's geometry.
+    float distances[2];
+    int hitCount = tileGeometry.raycast(tilePosition, ray, distances);
+    if (hitCount == 0)
+        return false;
+
+    float distance = distances[0];
+    if (hitCount == 2)
+        distance = Math::min<float>(distance, distances[1]);
+
+    *hit = TerrainRaycastHit(distance, ray.getPointOnRay(distance), location);
+    return true;
+}
+//-------------------------------------------------------------------------------------------------
+void Terrain::_raycastOnChunk(const Point2d& chunkLocation, const Ray& ray, std::vector<TerrainRaycastHit>* hits) const
+{
+    TileGridWalker walker;
+    if (!walker.begin(ray, mTerrainQuadTree.getAABB(mTerrainQuadTree.getDepth(), chunkLocation), 
+        _calcChunkTileRect(chunkLocation), FLT_MAX))
         return;
 
-    if (node.childrenCount != 0) {
-        // Continue to test its children.
-        for (int i = 0; i < 4; ++i) {
-            QuadTreeNode* child = node.children[i];
-            if (child) {
-                _raycastOnQuadTreeRecursively(*child, ray, hits);
-            }
-        }
-    }
-    else {
-        // This node has no children so it must be a tile. Perform Triangle-Ray intersection test.
-        
-        // Get this tile's geometry.
-        const Tile& tile = mTilesData[node.tile];
-        const TileGeometry& tileGeometry = TILE_GEOMETRIES()[tile.type];
-
-        // Get tile's world space position
-        Point2d tileLocation(node.tile % mDimension.x, node.tile / mDimension.x);
-        D3DXVECTOR3 tilePosition = _calcTilePositionFromLocation(tileLocation);
-        tilePosition.y = mTilesData[node.tile].getAltitude();
-
-        // Cast ray on tile's geometry.
-        float distances[2];
-        int hitCount = tileGeometry.raycast(tilePosition, ray, distances);
-
-        // Gather ray cast hit position
-        D3DXVECTOR3 hitPosition;
-        for (int i = 0; i < hitCount; ++i) {
-            hitPosition = ray.getPointOnRay(distances[i]);
-            hits->push_back(TerrainRaycastHit(distances[i], hitPosition, tileLocation));
-        }
-    }
+    Point2d location;
+    while (walker.next(&location))
+        _raycastOnTile(location.y * mDimension.x + location.x, ray, hits);
+}
+//-------------------------------------------------------------------------------------------------
+int Terrain::_findTileFace(float x, float z, float* localX, float* localZ, int* face) const
+{
+    // Grid x goes along world z axis and grid y goes along world x axis, and tile centers are on
+    // half integers. Clamp the position to the terrain.
+    const float invTileSize = 1.0f / Tile::SIZE;
+    const float gridX = Math::clamp<float>(z * invTileSize + 0.5f, 0.0f, (float)mDimension.x);
+    const float gridY = Math::clamp<float>(x * invTileSize + 0.5f, 0.0f, (float)mDimension.y);
+    const int cellX = Math::min<int>((int)gridX, mDimension.x - 1);
+    const int cellY = Math::min<int>((int)gridY, mDimension.y - 1);
+
+    *localX = (gridY - cellY - 0.5f) * Tile::SIZE;
+    *localZ = (gridX - cellX - 0.5f) * Tile::SIZE;
+
+    const int tileIndex = cellY * mDimension.x + cellX;
+    const D3DXVECTOR3& splitLine = TILE_SURFACES()[mTilesData.getType(tileIndex)].splitLine;
+    *face = (*localX * splitLine.x + *localZ * splitLine.y + splitLine.z >= 0.0f) ? 0 : 1;
+
+    return tileIndex;
 }
 //-------------------------------------------------------------------------------------------------
 int Terrain::TileGeometry::raycast(const D3DXVECTOR3& tilePos, const Ray& ray, float distances[2]) const
@@ -1017,5 +1863,19 @@ int Terrain::TileGeometry::raycast(const D3DXVECTOR3& tilePos, const Ray& ray, f
 
     return hitCount;
 }
+//-------------------------------------------------------------------------------------------------
+D3DXVECTOR3 Terrain::TileGeometry::calcFaceNormal(int face) const
+{
+    const D3DXVECTOR3& v0 = vertices[indices[face * 3]];
+    const D3DXVECTOR3& v1 = vertices[indices[face * 3 + 1]];
+    const D3DXVECTOR3& v2 = vertices[indices[face * 3 + 2]];
+
+    D3DXVECTOR3 edge0 = v1 - v0;
+    D3DXVECTOR3 edge1 = v2 - v0;
+    D3DXVECTOR3 normal;
+    ::D3DXVec3Cross(&normal, &edge0, &edge1);
+    ::D3DXVec3Normalize(&normal, &normal);
+    return normal;
+}
 
 }
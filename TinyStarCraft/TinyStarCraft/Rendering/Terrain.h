@@ -1,5 +1,10 @@
 #pragma once
 
+#include "Camera.h"
+#include "TerrainChunkResidency.h"
+#include "TerrainQuadTree.h"
+#include "TerrainWaterChunks.h"
+#include "Tile.h"
 #include "Utilities/AABB.h"
 #include "Utilities/Rect2.h"
 #include "Utilities/Size2.h"
@@ -7,14 +12,14 @@
 namespace TinyStarCraft
 {
 
-class Camera;
 class Effect;
 class Mesh;
 class Material;
 class Ray;
 class RenderSystem;
+struct TerrainVertex;
+class TerrainMapFile;
 class Texture;
-class ViewFrustum;
 
 
 /**
@@ -40,61 +45,39 @@ struct TerrainRaycastHit
 };
 
 
-/** 15 Tile types */
-enum ETileType
+/**
+  	Statistics of the last drawn terrain.
+ */
+struct TerrainDrawStats
 {
-    Flat,
-    SouthA,
-    WestA,
-    NorthA,
-    EastA,
-    SouthWest,
-    NorthWest,
-    NorthEast,
-    SouthEast,
-    SouthB,
-    WestB,
-    NorthB,
-    EastB,
-    VShapeWestToEast,
-    VShapeSouthToNorth
+    int visibleChunksCount;     // Number of visible chunks, which is the number of draw calls if chunks are drawn one by one.
+    int drawCallsCount;         // Number of draw calls issued.
+    int trianglesCount;         // Number of triangles drawn, including degenerate ones padding the chunks.
 };
 
 
-/**
-  	Properties of a tile.
- */
-struct Tile
+/** Methods to draw the terrain. */
+enum class ETerrainRenderingMode
 {
-    /** Side length in world unit. */
-    static constexpr float SIZE = 45.255f;
-    /** Height per-level in world unit */
-    static constexpr float HEIGHT_PER_LEVEL = 18.475f;
-
-    ETileType type;
-    int level;
-    float waterAltitude;
-    bool hasWater;
+    eMesh = 0,          // Draw a mesh holding the vertices and indices of all tiles.
+    eInstanced = 1,     // Draw a shared quad for each tile from its instance record.
+    eStreamedMesh = 2   // Draw meshes of the chunks in view, generated on a worker thread under a memory budget.
+};
 
-    /** Constructor */
-    Tile() 
-        : type(ETileType::Flat), level(0), hasWater(false), waterAltitude(0.0f)
-    {}
 
-    /** Constrcutor */
-    Tile(ETileType type, int level, bool hasWater, float waterAltitude)
-        : type(type), level(level), hasWater(hasWater), waterAltitude(waterAltitude)
-    {}
+/** Methods to find the visible terrain chunks. */
+enum class ETerrainCullingMode
+{
+    eQuadTree = 0,      // Test the AABBs in the terrain quad tree with the view frustum.
+    eIsometric = 1      // Rasterize the footprint of the view frustum over the chunks grid.
+};
 
-    /** Get altitude in world unit */
-    float getAltitude() const { return level * HEIGHT_PER_LEVEL; }
 
-    /**
-    	Determine if water is visible on this tile.
-    @remarks
-        Water is visible only if tile has water and water is higher than tile.
-     */
-    bool isWaterVisible() const { return hasWater && waterAltitude > getAltitude(); }
+/** Methods to generate the terrain mesh. */
+enum class ETerrainMeshingMode
+{
+    ePerTile = 0,       // Every tile is a quad of its own.
+    eGreedy = 1         // Flat tiles at the same level in a chunk are merged into larger quads.
 };
 
 
@@ -107,6 +90,10 @@ public:
     static const int TILES_COUNT_PER_CHUNK = CHUNK_DIMENSION * CHUNK_DIMENSION;
     /* Blend texture side length measured in tiles number. */
     static const int BLEND_TEXTURE_DIMENSION = 4;
+    /* Bytes of a chunk's vertices, indices and attributes in the terrain mesh. */
+    static const size_t CHUNK_SLOT_BYTES = TILES_COUNT_PER_CHUNK * (4 * 12 + 6 * 4 + 2 * 4);
+    /* Default memory budget of the chunks' meshes in the streamed mesh mode. */
+    static const size_t DEFAULT_STREAMING_BUDGET = 16 * 1024 * 1024;
 
     static constexpr char EFFECT_RESOURCE_NAME_TERRAIN[12] = "__terrain__";
     static constexpr char EFFECT_RESOURCE_NAME_WATER[10] = "__water__";
@@ -124,25 +111,27 @@ private:
             Returns the number of hits ranges from 0~2.
          */
         int raycast(const D3DXVECTOR3& tilePos, const Ray& ray, float distances[2]) const;
+
+        /** Calculate the normal of one of the two triangles. */
+        D3DXVECTOR3 calcFaceNormal(int face) const;
     };
 
     /** Geometries of 15 type of tiles. */
     static const std::array<TileGeometry, 15>& TILE_GEOMETRIES();
 
-    /** Definition of a quad tree node */
-    struct QuadTreeNode
+    /** Surface planes of a tile's two faces in tile's local space. */
+    struct TileSurface
     {
-        QuadTreeNode* children[4];
-        size_t childrenCount;
-        AABB aabb;
-        int chunk;  // Will be chunk's index if the node has a chunk, otherwise it will be -1.
-        int tile;   // Will be tile's index if the node has a tile, otherwise it will be -1.
-
-        QuadTreeNode()
-            : children { 0 }, childrenCount(0), chunk(-1), tile(-1)
-        {}
+        // Height of a face as a function of local position: y = x * slopeX + z * slopeZ + offset.
+        float slopeX[2], slopeZ[2], offset[2];
+        D3DXVECTOR3 normals[2];
+        // Local positions with (x * splitLine.x + z * splitLine.y + splitLine.z >= 0) are on face 0.
+        D3DXVECTOR3 splitLine;
     };
 
+    /** Surfaces of 15 type of tiles, derived from their geometries. */
+    static const std::array<TileSurface, 15>& TILE_SURFACES();
+
 public:
     /** Constructor */
     explicit Terrain(RenderSystem* renderSystem);
@@ -162,8 +151,18 @@ public:
      */
     bool initialize(const Size2d& dimension, Tile initialTile = Tile(ETileType::Flat, 0, false, 0.0f));
 
+    /**
+      	Initialize the terrain from an opened map file.
+    @remarks
+        If the file has the quad tree section, quad trees are loaded from it instead of being built.
+     */
+    bool initialize(const TerrainMapFile& mapFile);
+
     /** Get tiles data */
-    const std::vector<Tile>& getTilesData() const { return mTilesData; }
+    const TileStore& getTilesData() const { return mTilesData; }
+
+    /** Get a tile by its location. */
+    Tile getTile(const Point2d& location) const { return mTilesData.getTile(location.y * mDimension.x + location.x); }
 
     /**
       	Modify terrain's tiles data.
@@ -172,14 +171,109 @@ public:
      */
     void setTilesData(const std::vector<Tile>& tilesData);
 
+    /**
+      	Modify a rectangle area of terrain's tiles data.
+    @param dirtyRect
+        Area of the modified tiles. Tiles outside this area are considered unchanged, only the chunks
+        affected by the area are regenerated.
+    @remarks
+        Dimension of the terrain remains unchanged. Only the tiles in the area are taken, pages of
+        tiles wholly in the area are shared instead of copied.
+     */
+    void setTilesData(const TileStore& tilesData, const Rectd& dirtyRect);
+
     /** Get dimension */
     const Size2d& getDimension() const { return mDimension; }
 
+    /** Get the quad tree of the terrain, whose leaves are chunks. */
+    const TerrainQuadTree& getTerrainQuadTree() const { return mTerrainQuadTree; }
+
+    /** Get the chunks with visible water. */
+    const TerrainWaterChunks& getWaterChunks() const { return mWaterChunks; }
+
+    /**
+      	Set the method to generate the terrain mesh, the whole mesh is regenerated.
+    @remarks
+        In the greedy mode, a flat tile whose vertex normals all face straight up is merged with 
+        such neighbors at the same level into rectangles, and each rectangle is drawn as one quad.
+        Quads never cross chunks, so chunks are still culled one by one. The shading is 
+        the same as the per-tile mode, since merged tiles have the same normal and the texture 
+        coordinates are linear to the positions.
+     */
+    void setMeshingMode(ETerrainMeshingMode mode);
+
+    /** Get the method to generate the terrain mesh. */
+    ETerrainMeshingMode getMeshingMode() const { return mMeshingMode; }
+
+    /**
+      	Set the method to draw the terrain.
+    @remarks
+        Only the geometry of the current mode is kept and updated when tiles are modified, the 
+        geometry of the previous mode is released and the new one is generated from the tiles data.
+        In the instanced mode, a tile's instance record takes 24 bytes, while the mesh takes 72 bytes
+        per tile in the per-tile meshing mode. Tiles are never merged, so the meshing mode only
+        applies to the mesh modes.
+        In the streamed mesh mode, the mesh only has slots for as many chunks as the streaming
+        budget holds, see setStreamingBudget. Visible chunks which aren't resident are generated 
+        from a copy of their tiles on a worker thread, and they are drawn from the frame after they
+        are generated. When a slot is needed, the least recently drawn chunk is evicted, so the 
+        memory of the mesh doesn't depend on the size of the map.
+    @return
+        Returns false if the geometry of the mode failed to be created, the previous mode is kept.
+     */
+    bool setRenderingMode(ETerrainRenderingMode mode);
+
+    /** Get the method to draw the terrain. */
+    ETerrainRenderingMode getRenderingMode() const { return mRenderingMode; }
+
+    /**
+      	Set the memory budget of the chunks' meshes in the streamed mesh mode. If the mode is in use,
+        all chunks are evicted and the mesh is recreated.
+    @remarks
+        The budget should hold the chunks in view, otherwise some of them are never drawn, which
+        is counted by the dropped chunks in the residency statistics.
+     */
+    void setStreamingBudget(size_t bytes);
+
+    /** Get the memory budget of the chunks' meshes in the streamed mesh mode. */
+    size_t getStreamingBudget() const { return mStreamingBudget; }
+
+    /** Get the statistics of the resident chunks in the streamed mesh mode. */
+    const TerrainResidencyStats& getResidencyStats() const { return mChunkResidency.getStats(); }
+
+    /**
+      	Set the method to find the visible terrain chunks.
+    @remarks
+        In the isometric mode, the view frustum is intersected with the slab between the lowest and
+        the highest altitude of the terrain, and the footprint of this volume on the ground is 
+        rasterized over the chunks grid row by row. No AABB is tested, so the cost is in proportion 
+        to the number of the visible chunks. Chunks lower than the highest one may be drawn near the
+        top and bottom of the view, since every chunk is treated as high as the whole terrain. 
+        If the footprint isn't bounded, the quad tree is used instead.
+     */
+    void setCullingMode(ETerrainCullingMode mode);
+
+    /** Get the method to find the visible terrain chunks. */
+    ETerrainCullingMode getCullingMode() const { return mCullingMode; }
+
     /**
       	Draw the terrain.
+    @remarks
+        Chunks are stored in the terrain mesh or the tile instance buffer in Morton order of their 
+        locations, so visible chunks close to each other tend to be adjacent in the buffers. Each run
+        of adjacent visible chunks is drawn by one call.
      */
     void drawTerrain(Camera* camera);
 
+    /** Get the statistics of the last drawn terrain. */
+    const TerrainDrawStats& getDrawStats() const { return mDrawStats; }
+
+    /**
+      	Get the terrain chunks in the view frustum of the last drawn terrain or water, as row-major 
+        indices in the chunks grid.
+     */
+    const std::vector<int>& getVisibleChunks() const { return mVisibleChunks; }
+
     /**
       	Draw the water.
      */
@@ -187,6 +281,9 @@ public:
 
     /**
       	Cast a ray on the terrain and return the nearest hit point.
+    @remarks
+        Tiles are visited front-to-back along the ray's projection on the ground, so the traversal
+        stops at the first tile which is hit.
     @Return
         Returns true if there is a hit. Returns false otherwise.
      */
@@ -197,6 +294,35 @@ public:
      */
     bool raycastAll(const Ray& ray, std::vector<TerrainRaycastHit>* hits) const;
 
+    /**
+      	Cast a batch of rays on the terrain and return the nearest hit point of each ray.
+    @remarks
+        Each ray walks the tile grid like raycast, no memory is allocated.
+    @param hits
+        Receives the nearest hit point of each ray which has a hit.
+    @param isHit
+        Receives whether each ray has a hit.
+     */
+    void raycastBatch(const D3DXVECTOR3* origins, const D3DXVECTOR3* directions, size_t count,
+        TerrainRaycastHit* hits, bool* isHit) const;
+
+    /**
+      	Get the height of the terrain surface at a world space position on the ground.
+    @remarks
+        The tile under the position is looked up directly and its face plane is evaluated. Positions
+        outside of the terrain are clamped to its border.
+     */
+    float getHeightAt(float x, float z) const;
+
+    /** Get the face normal of the terrain surface at a world space position on the ground. */
+    D3DXVECTOR3 getNormalAt(float x, float z) const;
+
+    /**
+      	Get the heights of the terrain surface at an array of world space positions on the ground.
+        Positions are processed 4 at a time with SSE.
+     */
+    void getHeightsAt(const float* x, const float* z, size_t count, float* heights) const;
+
     /**
         Set a blend texture.
     @param index
@@ -224,62 +350,196 @@ public:
     void setWaveTexture(size_t index, Texture* texture);
 
 private:
-    bool _initializeImpl(const Size2d& dimension, const std::vector<Tile>& tilesData);
+    bool _initializeImpl(const TileStore& tilesData, const TerrainMapFile* mapFile = nullptr);
+
+    /**
+      	Create the geometry of the current rendering mode and generate it from the tiles data.
+        Resources created before a failure are released.
+     */
+    bool _createTerrainGeometry();
+
+    /** Release the geometry of both rendering modes. */
+    void _releaseTerrainGeometry();
+
+    /** Update the geometry of the current rendering mode in a dirty area of tiles. */
+    void _updateTerrainGeometry(const Rectd& dirtyRect);
 
     /**	
-        Create the terrain mesh
+        Create the terrain mesh with slots for a number of chunks.
         Texture coordinate for the control texture & blend textures are also generated.
      */
-    bool _createTerrainMesh();
+    bool _createTerrainMesh(int slotsCount);
+
+    /**
+      	Create the shared quad of the tiles, the instance buffer with a record of every tile in the
+        slots order of the chunks, and the vertex declaration to draw them.
+     */
+    bool _createTileInstances();
 
+    /**
+      	Create the geometry of a water tile and the vertex declaration to draw it with the instance
+        buffer.
+     */
     bool _createWaterTileMesh();
 
-    /** Modify the terrain mesh's vertices positions and indices according to tiles data. */
-    void _updateTerrainMeshGeometry();
+    /**
+      	Rewrite the instances of the water tiles in runs of the water chunks list from their
+        altitudes. If the instance buffer is too small for all water tiles, it's recreated and all
+        instances are written.
+    @param chunkRuns
+        Runs of adjacent positions in the water chunks list, as [first, last) pairs.
+    @remarks
+        If the buffer can't be recreated, the previous one is kept, and the tiles beyond its
+        capacity aren't drawn until it grows.
+     */
+    void _updateWaterTileInstances(const std::vector<std::pair<int, int>>& chunkRuns);
 
     /** 
-        Calculate and update quad tree dimension. 
-        Since the dimension of the terrain is fixed after init, so the function just need to be
-        called once at initialization.
+        Modify the terrain mesh's vertices and indices according to tiles data.
+    @param dirtyRect
+        Area of the modified tiles. Chunks covering the area and its one tile border are regenerated,
+        since normals on the border depend on the modified tiles.
+     */
+    void _updateTerrainMeshGeometry(const Rectd& dirtyRect);
+
+    /**
+        Rewrite the instance records of the tiles in the chunks covering a dirty area and its one
+        tile border, since normals on the border depend on the modified tiles.
+     */
+    void _updateTileInstances(const Rectd& dirtyRect);
+
+    /**
+      	Get the chunks covering a dirty area of tiles and its one tile border.
+    @param dirtySlots
+        Receives the chunks as pairs of their slots and row-major indices, sorted by their slots.
+     */
+    void _gatherDirtySlots(const Rectd& dirtyRect, std::vector<std::pair<int, int>>* dirtySlots) const;
+
+    /**
+      	Generate the vertices and indices of a chunk. The rest of the chunk's slot is padded with
+        degenerate triangles.
+    @param tiles
+        Tiles of the chunk and its border, whose first tile is at tilesOrigin in the terrain.
+    @param chunkOrigin
+        Location of the chunk's first tile in tiles.
+    @param firstVertex
+        Index of the chunk's first vertex in the vertex buffer, which is added to the indices.
+    @return
+        Returns the number of generated quads.
+     */
+    static int _generateChunkGeometry(const TileStore& tiles, const Point2d& tilesOrigin, const Point2d& chunkOrigin,
+        ETerrainMeshingMode meshingMode, unsigned firstVertex, TerrainVertex* vertices, unsigned* indices);
+
+    /** Start the worker thread generating the chunks in the streamed mesh mode. */
+    void _createChunkResidency();
+
+    /** Request the worker thread to generate a chunk from its current tiles. */
+    void _requestChunk(int chunk);
+
+    /**
+      	Upload the generated chunks into the terrain mesh and gather the slots of the visible resident
+        chunks. Visible chunks which are neither resident nor requested are requested.
      */
-    void _updateQuadTreeDimension();
+    void _updateResidentChunks();
 
-    /**	Build quad tree for the terrain. */
+    /** Request the resident and requested chunks covering a dirty area and its one tile border again. */
+    void _invalidateResidentChunks(const Rectd& dirtyRect);
+
+    /** Draw the runs of adjacent slots in the terrain mesh. */
+    void _drawTerrainMeshChunks(const std::vector<int>& slots);
+
+    /** Draw the tiles of the runs of adjacent visible chunks from the instance buffer. */
+    void _drawTileInstances();
+
+    /**	Build quad tree for the terrain. The tree must have been created with the chunks dimension. */
     void _buildTerrainQuadTree();
 
-    /** Build quad tree for water. */
-    void _buildWaterQuadTree();
+    /** Build the list of chunks with visible water. */
+    void _buildWaterChunks();
+
+    /**
+        Update the chunk leaves of the terrain quad tree covering the dirty area and refit their 
+        ancestors. Since the dimension of the terrain is fixed after init, the topology of the tree 
+        remains unchanged.
+     */
+    void _updateTerrainQuadTree(const Rectd& dirtyRect);
+
+    /**
+        Update the water of the chunks covering the dirty area. Chunks without visible water are
+        removed from the list, so they are never gathered.
+    @remarks
+        Chunks whose water tiles and water altitudes are unchanged are skipped, and only the 
+        instances of the modified chunks are rewritten, together with the instances moved by a 
+        modified tiles count.
+     */
+    void _updateWaterChunks(const Rectd& dirtyRect);
+
+    /**
+      	Update the visible terrain chunks and water chunks for a view frustum.
+    @remarks
+        The lists are cached with the frustum which they are gathered with, and they are reused
+        until the frustum or the chunks are modified.
+     */
+    void _updateVisibleChunks(const ViewFrustum& viewFrustum);
+
+    /**
+      	Gather the visible chunks by rasterizing the footprint of the view frustum over the chunks
+        grid, see setCullingMode.
+    @param chunks
+        Visible chunks' row-major indices are added to this array in order.
+    @return
+        Returns false if the footprint isn't bounded, nothing is gathered. Returns true otherwise.
+     */
+    bool _gatherVisibleChunksIsometric(const ViewFrustum& viewFrustum, std::vector<int>* chunks) const;
+
+    /** Assign each chunk its slot in the terrain mesh, in Morton order of the chunks' locations. */
+    void _buildChunkSlots();
+
+    /** Get the rectangle of chunks covering a rectangle of tiles. */
+    Rectd _calcChunkRect(const Rectd& tileRect) const;
+
+    /** Get the rectangle of tiles in a chunk. */
+    Rectd _calcChunkTileRect(const Point2d& chunkLocation) const
+    {
+        return Rectd::makeRect(chunkLocation * CHUNK_DIMENSION, Size2d(CHUNK_DIMENSION, CHUNK_DIMENSION));
+    }
+
+    /** Calculate the AABB of a tile's geometry. */
+    AABB _calcTileAABB(const Point2d& location) const;
 
-    /**	Subdivide the terrain and create quad tree nodes recursively. */
-    void _createTerrainQuadTreeNodeRecursively(const Rectd& subSquare, QuadTreeNode* parent);
+    /** Calculate the AABB of a tile's water surface. */
+    AABB _calcWaterTileAABB(const Point2d& location) const;
 
-    /**	Subdivide the water and create quad tree nodes recursively. */
-    void _createWaterQuadTreeNodeRecursively(const Rectd& subSquare, QuadTreeNode* parent);
+    /** Calculate the compound AABB of the tiles' geometry in a chunk. */
+    AABB _calcChunkAABB(const Point2d& chunkLocation) const;
 
     /**
-      	Gather visible chunks of the terrain mesh.
-        This will traverse the entire quad tree and do frustum-AABB intersection test
-        to determine each chunk's visibility. Visible chunk's id will be gathered to 
-        the visible chunks array.
-    @param isParentInsideFrustum
-        To indicate whether this node's parent is completely inside the camera view frustum.
-        If set to true, the Frustum-AABB intersection test will be skipped and the node and all its
-        children will be considered as visible nodes since they must be inside the frustum as well.
-        Otherwise, a Frustum-AABB intersection test is performed to check whether the node is visible.
+      	Calculate the compound AABB of the visible water surfaces in a chunk.
+    @param altitudes
+        Receives the water altitudes of the tiles in the mask in order.
+    @return
+        Returns the mask of the tiles with visible water in the chunk, 0 if there isn't any.
+     */
+    uint64_t _calcWaterChunk(const Point2d& chunkLocation, AABB* aabb, float* altitudes) const;
+
+    /** 
+      	Perform Triangle-Ray intersection test on the tiles of a chunk, and add the hit points to 
+        the array. Only the tiles under the ray's path are tested.
      */
-    void _gatherVisibleTerrainChunksRecursively(const QuadTreeNode& node, const ViewFrustum& viewFrustum,
-        bool isParentInsideFrustum, std::vector<int>* visibleChunks);
+    void _raycastOnChunk(const Point2d& chunkLocation, const Ray& ray, std::vector<TerrainRaycastHit>* hits) const;
 
-    /** Gather visible water tiles */
-    void _gatherVisibleWaterTilesRecursively(const QuadTreeNode& node, const ViewFrustum& viewFrustum, 
-        bool isParentInsideFrustum, std::vector<int>* visibleWaterTiles);
+    /** Perform Triangle-Ray intersection test on a tile and add the hit points to the array. */
+    void _raycastOnTile(int tileIndex, const Ray& ray, std::vector<TerrainRaycastHit>* hits) const;
+
+    /** Perform Triangle-Ray intersection test on a tile and get the nearest hit point. */
+    bool _raycastOnTileNearest(const Point2d& location, const Ray& ray, TerrainRaycastHit* hit) const;
 
     /**
-        Traverse the quad tree to find ray hit points.
-      	Perform AABB-Ray intersection on node's AABB to cull unintersected nodes. Perform Triangle-Ray intersection
-        test on tile nodes to compute the hit points and add to the array..
+      	Find the tile and its face under a world space position on the ground.
+    @return
+        Returns the tile's index. Local position in the tile is written to localX and localZ.
      */
-    void _raycastOnQuadTreeRecursively(const QuadTreeNode& node, const Ray& ray, std::vector<TerrainRaycastHit>* hits) const;
+    int _findTileFace(float x, float z, float* localX, float* localZ, int* face) const;
 
     /** Calculate world space position by giving tile's location */
     D3DXVECTOR3 _calcTilePositionFromLocation(const Point2d& location) const
@@ -291,19 +551,55 @@ private:
     RenderSystem* mRenderSystem;
 
     Mesh* mTerrainMesh;
-    Mesh* mWaterTileInstancesMesh;
+    Mesh* mWaterTileMesh;
     Effect* mTerrainEffect;
     Effect* mWaterEffect;
 
     Size2d mDimension;
-    std::vector<Tile> mTilesData;
-
-    Size2d mQuadTreeDimension;
-    std::vector<QuadTreeNode> mTerrainQuadTreeNodes;
-    std::vector<QuadTreeNode> mWaterQuadTreeNodes;
-
-    std::vector<D3DXVECTOR4> mWaterTileInstancePositions;
-    std::vector<D3DXVECTOR4> mWaterTileInstanceTexcoords;
+    TileStore mTilesData;
+
+    TerrainQuadTree mTerrainQuadTree;
+    TerrainWaterChunks mWaterChunks;
+
+    // Slot of each chunk in the terrain mesh by its row-major index. Slot i holds the vertices, faces
+    // and attribute range i, and the ranges are mirrored here by slot. In the streamed mesh mode, 
+    // slots are assigned by the chunk residency instead.
+    std::vector<int> mChunkSlots;
+    std::vector<D3DXATTRIBUTERANGE> mChunkRanges;
+    IDirect3DVertexDeclaration9* mTerrainVertexDeclaration;
+
+    // Instanced rendering mode. The instance record of the i-th tile of the chunk in slot s is the 
+    // (s * TILES_COUNT_PER_CHUNK + i)-th record in the buffer.
+    Mesh* mTileMesh;
+    IDirect3DVertexBuffer9* mTileInstanceBuffer;
+    IDirect3DVertexDeclaration9* mTileVertexDeclaration;
+
+    // Streamed mesh mode. Slots of the terrain mesh are assigned to the resident chunks.
+    TerrainChunkResidency mChunkResidency;
+    std::vector<int> mResidentChunkSlots;   // Slots of the visible resident chunks in ascending order.
+
+    ETerrainRenderingMode mRenderingMode;
+    size_t mStreamingBudget;
+    ETerrainMeshingMode mMeshingMode;
+    ETerrainCullingMode mCullingMode;
+
+    // Visible chunks in the cached view frustum. Terrain chunks are row-major indices in the chunks
+    // grid and water chunks are positions in the water chunks list. The cache is invalidated when 
+    // AABBs of chunks are modified.
+    ViewFrustum mCachedViewFrustum;
+    bool mIsVisibleChunksCacheValid;
+    std::vector<int> mVisibleChunks;
+    std::vector<int> mVisibleChunkSlots;    // Slots of the visible chunks in ascending order.
+    std::vector<int> mVisibleWaterChunks;
+    TerrainDrawStats mDrawStats;
+
+    // Instance data of all visible water tiles, drawn from the second vertex stream. Water altitudes
+    // of the instances are kept in water tiles order, so the modified ones are found without 
+    // reading the buffer back.
+    IDirect3DVertexBuffer9* mWaterTileInstanceBuffer;
+    int mWaterTileInstanceBufferCapacity;
+    std::vector<float> mWaterTileAltitudes;
+    IDirect3DVertexDeclaration9* mWaterVertexDeclaration;
 
     Texture* mBlendTextures[4];
     Texture* mControlTexture;
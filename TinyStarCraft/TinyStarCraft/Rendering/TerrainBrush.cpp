@@ -0,0 +1,143 @@
+#include "Precompiled.h"
+#include "TerrainBrush.h"
+#include "Utilities/Assert.h"
+
+namespace TinyStarCraft
+{
+
+//-------------------------------------------------------------------------------------------------
+static bool _isInSegmentRadius(const Point2d& location, const Point2d& a, const Point2d& b, int radius)
+{
+    // Squared distance from the location to the closest point of segment ab.
+    const int64_t abX = b.x - a.x, abY = b.y - a.y;
+    const int64_t apX = location.x - a.x, apY = location.y - a.y;
+    const int64_t lengthSquared = abX * abX + abY * abY;
+    const int64_t radiusSquared = (int64_t)radius * radius;
+
+    const int64_t projection = apX * abX + apY * abY;
+    if (lengthSquared == 0 || projection <= 0)
+        return apX * apX + apY * apY <= radiusSquared;
+
+    if (projection >= lengthSquared) {
+        const int64_t bpX = location.x - b.x, bpY = location.y - b.y;
+        return bpX * bpX + bpY * bpY <= radiusSquared;
+    }
+
+    // Squared distance to the line is cross(ab, ap)^2 / |ab|^2.
+    const int64_t cross = abX * apY - abY * apX;
+    return (double)cross * cross <= (double)radiusSquared * lengthSquared;
+}
+//-------------------------------------------------------------------------------------------------
+TerrainBrush TerrainBrush::makeCircle(const Point2d& center, int radius)
+{
+    TerrainBrush brush;
+    brush.mShapes.push_back({ ETerrainBrushShape::eCircle, std::vector<Point2d>(1, center), Math::max(radius, 0), Rectd() });
+    return brush;
+}
+//-------------------------------------------------------------------------------------------------
+TerrainBrush TerrainBrush::makeRectangle(const Rectd& rect)
+{
+    TerrainBrush brush;
+    brush.mShapes.push_back({ ETerrainBrushShape::eRectangle, std::vector<Point2d>(), 0, rect });
+    return brush;
+}
+//-------------------------------------------------------------------------------------------------
+TerrainBrush TerrainBrush::makePolyline(const std::vector<Point2d>& points, int radius)
+{
+    TINYSC_ASSERT(!points.empty(), "A polyline brush needs one point at least.");
+
+    TerrainBrush brush;
+    brush.mShapes.push_back({ ETerrainBrushShape::ePolyline, points, Math::max(radius, 0), Rectd() });
+    return brush;
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainBrush::add(const TerrainBrush& brush)
+{
+    mShapes.insert(mShapes.end(), brush.mShapes.begin(), brush.mShapes.end());
+}
+//-------------------------------------------------------------------------------------------------
+Rectd TerrainBrush::getBounds() const
+{
+    TINYSC_ASSERT(!mShapes.empty(), "The brush is empty.");
+
+    Rectd bounds = _getShapeBounds(mShapes[0]);
+    for (const Shape& shape : mShapes)
+        bounds = Rectd::compound(bounds, _getShapeBounds(shape));
+
+    return bounds;
+}
+//-------------------------------------------------------------------------------------------------
+bool TerrainBrush::isTileBrushed(const Point2d& location) const
+{
+    for (const Shape& shape : mShapes) {
+        if (_isTileInShape(shape, location))
+            return true;
+    }
+
+    return false;
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainBrush::getTiles(const Size2d& dimension, std::vector<Point2d>* tiles) const
+{
+    tiles->clear();
+
+    // Only the bounds of each shape are scanned, since shapes may be far apart.
+    const Rectd terrainRect = Rectd::makeRect(Point2d::ZERO(), dimension);
+    std::vector<int> tileIndices;
+    for (const Shape& shape : mShapes) {
+        const Rectd rect = Rectd::intersection(_getShapeBounds(shape), terrainRect);
+        for (int y = rect.getTop(); y < rect.getBottom(); ++y) {
+            for (int x = rect.getLeft(); x < rect.getRight(); ++x) {
+                if (_isTileInShape(shape, Point2d(x, y)))
+                    tileIndices.push_back(y * dimension.x + x);
+            }
+        }
+    }
+
+    if (mShapes.size() > 1) {
+        std::sort(tileIndices.begin(), tileIndices.end());
+        tileIndices.erase(std::unique(tileIndices.begin(), tileIndices.end()), tileIndices.end());
+    }
+
+    tiles->reserve(tileIndices.size());
+    for (int tileIndex : tileIndices)
+        tiles->push_back(Point2d(tileIndex % dimension.x, tileIndex / dimension.x));
+}
+//-------------------------------------------------------------------------------------------------
+Rectd TerrainBrush::_getShapeBounds(const Shape& shape)
+{
+    if (shape.type == ETerrainBrushShape::eRectangle)
+        return shape.rect;
+
+    Rectd bounds = Rectd::makeRect(shape.points[0], Size2d(1, 1));
+    for (const Point2d& point : shape.points)
+        bounds = Rectd::compound(bounds, Rectd::makeRect(point, Size2d(1, 1)));
+
+    return Rectd(bounds.getMin() - Point2d(shape.radius, shape.radius), bounds.getMax() + Point2d(shape.radius, shape.radius));
+}
+//-------------------------------------------------------------------------------------------------
+bool TerrainBrush::_isTileInShape(const Shape& shape, const Point2d& location)
+{
+    switch (shape.type)
+    {
+    case ETerrainBrushShape::eCircle:
+        return _isInSegmentRadius(location, shape.points[0], shape.points[0], shape.radius);
+
+    case ETerrainBrushShape::eRectangle:
+        return shape.rect.isPointInside(location);
+
+    case ETerrainBrushShape::ePolyline:
+        if (shape.points.size() == 1)
+            return _isInSegmentRadius(location, shape.points[0], shape.points[0], shape.radius);
+
+        for (size_t i = 1; i < shape.points.size(); ++i) {
+            if (_isInSegmentRadius(location, shape.points[i - 1], shape.points[i], shape.radius))
+                return true;
+        }
+        return false;
+    }
+
+    return false;
+}
+
+}
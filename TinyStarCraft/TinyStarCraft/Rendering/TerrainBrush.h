@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Utilities/Point2.h"
+#include "Utilities/Rect2.h"
+#include "Utilities/Size2.h"
+
+namespace TinyStarCraft
+{
+
+/**
+  	Shapes of terrain brushes.
+ */
+enum class ETerrainBrushShape
+{
+    eCircle = 0,        // Tiles within a radius of a center tile.
+    eRectangle = 1,     // Tiles in a rectangle.
+    ePolyline = 2       // Tiles within a radius of a polyline through tile locations.
+};
+
+
+/**
+  	An area of tiles modified at once by TerrainModifier.
+@remarks
+    A brush is made of one or more shapes, and a tile is brushed if its location is inside any of
+    them. Distances are measured between tile locations.
+ */
+class TerrainBrush
+{
+public:
+    /** Constructor, make a brush without any shape. */
+    TerrainBrush() = default;
+
+    /** Make a brush of the tiles within a radius of a tile. A radius of 0 brushes the tile only. */
+    static TerrainBrush makeCircle(const Point2d& center, int radius);
+
+    /** Make a brush of the tiles in a rectangle. */
+    static TerrainBrush makeRectangle(const Rectd& rect);
+
+    /** Make a brush of the tiles within a radius of a polyline, which has one point at least. */
+    static TerrainBrush makePolyline(const std::vector<Point2d>& points, int radius);
+
+    /** Add the shapes of another brush. */
+    void add(const TerrainBrush& brush);
+
+    /** Determine if the brush has no shape. */
+    bool isEmpty() const { return mShapes.empty(); }
+
+    /** Get the bounding rectangle of the brushed tiles. The brush must not be empty. */
+    Rectd getBounds() const;
+
+    /** Determine if a tile is brushed. */
+    bool isTileBrushed(const Point2d& location) const;
+
+    /**
+      	Get the brushed tiles of a terrain.
+    @param tiles
+        Receives the locations of the brushed tiles inside the terrain in row-major order.
+     */
+    void getTiles(const Size2d& dimension, std::vector<Point2d>* tiles) const;
+
+private:
+    /** A shape of the brush. */
+    struct Shape
+    {
+        ETerrainBrushShape type;
+        std::vector<Point2d> points;    // Center of a circle, or points of a polyline.
+        int radius;
+        Rectd rect;                     // Rectangle of a rectangle shape.
+    };
+
+    /** Get the bounding rectangle of a shape's tiles. */
+    static Rectd _getShapeBounds(const Shape& shape);
+
+    /** Determine if a tile is inside a shape. */
+    static bool _isTileInShape(const Shape& shape, const Point2d& location);
+
+private:
+    std::vector<Shape> mShapes;
+};
+
+}
@@ -0,0 +1,224 @@
+#include "Precompiled.h"
+#include "TerrainChunkResidency.h"
+#include "Utilities/Assert.h"
+
+namespace TinyStarCraft
+{
+
+//-------------------------------------------------------------------------------------------------
+TerrainChunkResidency::TerrainChunkResidency()
+    : mNextRequestId(1),
+      mFrame(0),
+      mStats(),
+      mGeneratedChunksCount(0),
+      mBusyRequestsCount(0),
+      mIsStopping(false)
+{
+}
+//-------------------------------------------------------------------------------------------------
+TerrainChunkResidency::~TerrainChunkResidency()
+{
+    destroy();
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainChunkResidency::create(int chunksCount, int slotsCount, const GenerateFunction& generate)
+{
+    TINYSC_ASSERT(!mWorker.joinable(), "Residency is already created.");
+    TINYSC_ASSERT(slotsCount > 0, "Residency must have at least one slot.");
+
+    mGenerate = generate;
+
+    mChunkSlots.assign(chunksCount, -1);
+    mChunkRequests.assign(chunksCount, 0);
+
+    mSlotChunks.assign(slotsCount, -1);
+    mSlotFrames.assign(slotsCount, 0);
+    mLruSlots.clear();
+    mSlotLruPositions.assign(slotsCount, mLruSlots.end());
+    // Free slots are taken from the back, so lower slots are used first.
+    mFreeSlots.clear();
+    for (int slot = slotsCount - 1; slot >= 0; --slot)
+        mFreeSlots.push_back(slot);
+
+    mFrame = 0;
+    mStats = TerrainResidencyStats();
+    mStats.slotsCount = slotsCount;
+
+    mIsStopping = false;
+    mWorker = std::thread(&TerrainChunkResidency::_run, this);
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainChunkResidency::destroy()
+{
+    if (mWorker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mIsStopping = true;
+            mRequests.clear();
+        }
+        mRequestsCondition.notify_all();
+        mWorker.join();
+    }
+
+    mResults.clear();
+    mGeneratedChunksCount = 0;
+    mBusyRequestsCount = 0;
+
+    mChunkSlots.clear();
+    mChunkRequests.clear();
+    mSlotChunks.clear();
+    mSlotFrames.clear();
+    mLruSlots.clear();
+    mSlotLruPositions.clear();
+    mFreeSlots.clear();
+    mStats = TerrainResidencyStats();
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainChunkResidency::beginFrame()
+{
+    ++mFrame;
+}
+//-------------------------------------------------------------------------------------------------
+int TerrainChunkResidency::useChunk(int chunk)
+{
+    const int slot = mChunkSlots[chunk];
+    if (slot >= 0)
+        _touchSlot(slot);
+
+    return slot;
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainChunkResidency::requestChunk(int chunk, const TileStore& tiles, const Rectd& tileRect)
+{
+    Request request;
+    request.chunk = chunk;
+    request.id = mNextRequestId++;
+    request.tilesOrigin = tileRect.getMin();
+
+    // Copy the tiles, the worker never reads the terrain's tiles.
+    const Size2d size(tileRect.getWidth(), tileRect.getHeight());
+    request.tiles.resize(size);
+    for (int y = 0; y < size.y; ++y) {
+        for (int x = 0; x < size.x; ++x) {
+            const int tileIndex = (tileRect.getTop() + y) * tiles.getDimension().x + tileRect.getLeft() + x;
+            request.tiles.setPackedTile(y * size.x + x, tiles.getPackedTile(tileIndex));
+        }
+    }
+
+    if (mChunkRequests[chunk] == 0)
+        ++mStats.requestedChunksCount;
+    mChunkRequests[chunk] = request.id;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRequests.push_back(std::move(request));
+    }
+    mRequestsCondition.notify_one();
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainChunkResidency::uploadGeneratedChunks(const UploadFunction& upload)
+{
+    std::vector<Result> results;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        results.swap(mResults);
+        mStats.generatedChunksCount = mGeneratedChunksCount;
+    }
+
+    for (const Result& result : results) {
+        // Only the latest request of a chunk is uploaded.
+        if (mChunkRequests[result.chunk] != result.id)
+            continue;
+
+        mChunkRequests[result.chunk] = 0;
+        --mStats.requestedChunksCount;
+
+        int slot = mChunkSlots[result.chunk];
+        if (slot < 0) {
+            slot = _allocateSlot();
+            if (slot < 0) {
+                // The chunk is requested again if it's still needed.
+                ++mStats.droppedChunksCount;
+                continue;
+            }
+
+            mChunkSlots[result.chunk] = slot;
+            mSlotChunks[slot] = result.chunk;
+            ++mStats.residentChunksCount;
+        }
+
+        // The chunk was just requested, so it's as recent as the chunks used in this frame.
+        _touchSlot(slot);
+        upload(result.chunk, slot, result.geometry);
+    }
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainChunkResidency::waitForRequests()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mIdleCondition.wait(lock, [this]() { return mRequests.empty() && mBusyRequestsCount == 0; });
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainChunkResidency::_run()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (;;) {
+        mRequestsCondition.wait(lock, [this]() { return mIsStopping || !mRequests.empty(); });
+        if (mIsStopping)
+            return;
+
+        // The latest request is the most likely to be in view.
+        Request request = std::move(mRequests.back());
+        mRequests.pop_back();
+        ++mBusyRequestsCount;
+        lock.unlock();
+
+        Result result;
+        result.chunk = request.chunk;
+        result.id = request.id;
+        mGenerate(request.chunk, request.tiles, request.tilesOrigin, &result.geometry);
+
+        lock.lock();
+        mResults.push_back(std::move(result));
+        ++mGeneratedChunksCount;
+        --mBusyRequestsCount;
+        if (mRequests.empty() && mBusyRequestsCount == 0)
+            mIdleCondition.notify_all();
+    }
+}
+//-------------------------------------------------------------------------------------------------
+int TerrainChunkResidency::_allocateSlot()
+{
+    if (!mFreeSlots.empty()) {
+        const int slot = mFreeSlots.back();
+        mFreeSlots.pop_back();
+        return slot;
+    }
+
+    // Evict the least recently used chunk, unless it's used in this frame.
+    const int slot = mLruSlots.back();
+    if (mSlotFrames[slot] == mFrame)
+        return -1;
+
+    mChunkSlots[mSlotChunks[slot]] = -1;
+    mSlotChunks[slot] = -1;
+    mLruSlots.erase(mSlotLruPositions[slot]);
+    mSlotLruPositions[slot] = mLruSlots.end();
+    --mStats.residentChunksCount;
+    ++mStats.evictedChunksCount;
+    return slot;
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainChunkResidency::_touchSlot(int slot)
+{
+    if (mSlotLruPositions[slot] != mLruSlots.end()) {
+        mLruSlots.splice(mLruSlots.begin(), mLruSlots, mSlotLruPositions[slot]);
+    }
+    else {
+        mLruSlots.push_front(slot);
+        mSlotLruPositions[slot] = mLruSlots.begin();
+    }
+    mSlotFrames[slot] = mFrame;
+}
+
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+
+#include "Tile.h"
+#include "Utilities/Point2.h"
+#include "Utilities/Rect2.h"
+
+namespace TinyStarCraft
+{
+
+/**
+  	Statistics of the resident terrain chunks.
+ */
+struct TerrainResidencyStats
+{
+    int slotsCount;             // Number of chunks which can be resident at once.
+    int residentChunksCount;    // Number of chunks whose geometry is in a slot.
+    int requestedChunksCount;   // Number of chunks waiting for their geometry from the worker thread.
+    int generatedChunksCount;   // Total number of chunk geometries generated by the worker thread.
+    int evictedChunksCount;     // Total number of resident chunks evicted to make room for others.
+    int droppedChunksCount;     // Total number of generated chunks dropped since every slot was in use.
+};
+
+
+/**
+  	Keep the geometry of a limited number of terrain chunks in slots, and generate the geometry of
+    requested chunks on a worker thread.
+@remarks
+    A request copies the tiles needed by the chunk, so the worker never reads the terrain's tiles
+    while they are modified. Generated chunks are given a free slot or the slot of the least
+    recently used chunk, and chunks used in the current frame are never evicted. Requests are
+    generated from the latest one, so chunks which just came into view are generated before the
+    ones which the camera has already left.
+    Only standard C++ is used, and the geometry is opaque to this class, so residency can be
+    tested without D3DX.
+ */
+class TerrainChunkResidency
+{
+public:
+    /** Geometry of a chunk generated by the worker thread. */
+    struct ChunkGeometry
+    {
+        std::vector<char> vertices;
+        std::vector<unsigned> indices;
+        int verticesCount;
+        int facesCount;
+    };
+
+    /**
+      	Function called on the worker thread to generate a chunk's geometry.
+    @param tiles
+        Copy of the tiles requested with the chunk, whose first tile is at tilesOrigin.
+     */
+    typedef std::function<void(int chunk, const TileStore& tiles, const Point2d& tilesOrigin, ChunkGeometry* geometry)> GenerateFunction;
+
+    /** Function called on the calling thread to copy a generated chunk's geometry into its slot. */
+    typedef std::function<void(int chunk, int slot, const ChunkGeometry& geometry)> UploadFunction;
+
+public:
+    /** Constructor */
+    TerrainChunkResidency();
+
+    /** Destructor */
+    ~TerrainChunkResidency();
+
+    /** Start the worker thread. All chunks are not resident. */
+    void create(int chunksCount, int slotsCount, const GenerateFunction& generate);
+
+    /** Stop the worker thread and remove all chunks. Requests which are not generated are discarded. */
+    void destroy();
+
+    /** Start a new frame. Chunks used in the frame are kept resident until the next frame. */
+    void beginFrame();
+
+    /**
+      	Mark a chunk as used in the current frame.
+    @return
+        Returns the chunk's slot, or -1 if the chunk isn't resident.
+     */
+    int useChunk(int chunk);
+
+    /** Get a chunk's slot, or -1 if the chunk isn't resident. */
+    int getSlot(int chunk) const { return mChunkSlots[chunk]; }
+
+    /** Determine if a chunk is waiting for its geometry. */
+    bool isRequested(int chunk) const { return mChunkRequests[chunk] != 0; }
+
+    /**
+      	Request to generate a chunk's geometry from a rectangle of tiles. If the chunk is already
+        requested, the previous request is discarded. A resident chunk keeps its current geometry
+        until the new one is uploaded.
+     */
+    void requestChunk(int chunk, const TileStore& tiles, const Rectd& tileRect);
+
+    /** Upload the chunks generated since the last call into their slots. */
+    void uploadGeneratedChunks(const UploadFunction& upload);
+
+    /** Block until the worker thread has generated all requests. */
+    void waitForRequests();
+
+    /** Get the statistics. */
+    const TerrainResidencyStats& getStats() const { return mStats; }
+
+private:
+    /** A request to generate a chunk. */
+    struct Request
+    {
+        int chunk;
+        unsigned id;
+        TileStore tiles;
+        Point2d tilesOrigin;
+    };
+
+    /** A chunk generated by the worker thread. */
+    struct Result
+    {
+        int chunk;
+        unsigned id;
+        ChunkGeometry geometry;
+    };
+
+    /** Worker thread's loop. */
+    void _run();
+
+    /** Find a slot for a chunk which isn't resident, and return -1 if every slot is in use. */
+    int _allocateSlot();
+
+    /** Move a slot to the front of the least recently used list. */
+    void _touchSlot(int slot);
+
+private:
+    GenerateFunction mGenerate;
+
+    std::vector<int> mChunkSlots;           // Slot of each chunk, -1 if the chunk isn't resident.
+    std::vector<unsigned> mChunkRequests;   // Id of each chunk's latest request, 0 if the chunk isn't requested.
+    unsigned mNextRequestId;
+
+    std::vector<int> mSlotChunks;           // Chunk in each slot, -1 if the slot is free.
+    std::vector<unsigned> mSlotFrames;      // Frame in which each slot was last used.
+    std::list<int> mLruSlots;               // Occupied slots from the most recently used one.
+    std::vector<std::list<int>::iterator> mSlotLruPositions;
+    std::vector<int> mFreeSlots;
+    unsigned mFrame;
+
+    TerrainResidencyStats mStats;
+
+    // Shared with the worker thread.
+    std::thread mWorker;
+    std::mutex mMutex;
+    std::condition_variable mRequestsCondition;
+    std::condition_variable mIdleCondition;
+    std::deque<Request> mRequests;
+    std::vector<Result> mResults;
+    int mGeneratedChunksCount;
+    int mBusyRequestsCount;
+    bool mIsStopping;
+};
+
+}
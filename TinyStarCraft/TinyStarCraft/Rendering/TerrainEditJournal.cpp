@@ -0,0 +1,142 @@
+#include "Precompiled.h"
+#include "TerrainEditJournal.h"
+#include "Utilities/Assert.h"
+
+namespace TinyStarCraft
+{
+
+//-------------------------------------------------------------------------------------------------
+static bool _isSamePackedTile(const TileStore::PackedTile& a, const TileStore::PackedTile& b)
+{
+    return a.typeAndFlags == b.typeAndFlags && a.level == b.level && a.waterAltitude == b.waterAltitude;
+}
+//-------------------------------------------------------------------------------------------------
+TerrainEditJournal::TerrainEditJournal()
+    : mMemorySize(0), mBudget(DEFAULT_BUDGET)
+{
+}
+//-------------------------------------------------------------------------------------------------
+bool TerrainEditJournal::commit(const TileStore& tiles)
+{
+    // Each tile is recorded once with its value before the edit, sort the records by tile.
+    std::sort(mRecordedTiles.begin(), mRecordedTiles.end(),
+        [](const RecordedTile& a, const RecordedTile& b) { return a.tileIndex < b.tileIndex; });
+
+    const int dimensionX = tiles.getDimension().x;
+
+    Edit edit;
+    for (const RecordedTile& record : mRecordedTiles) {
+        mRecordedBits[record.tileIndex >> 6] = 0;
+
+        const TileStore::PackedTile newTile = tiles.getPackedTile(record.tileIndex);
+        if (_isSamePackedTile(record.oldTile, newTile))
+            // Written back to its old value.
+            continue;
+
+        const Rectd tileRect = Rectd::makeRect(record.tileIndex % dimensionX, record.tileIndex / dimensionX, 1, 1);
+        if (edit.runs.empty()) {
+            edit.rect = tileRect;
+        }
+        else {
+            edit.rect = Rectd::compound(edit.rect, tileRect);
+        }
+
+        if (!edit.runs.empty() && edit.runs.back().firstTile + edit.runs.back().tilesCount == record.tileIndex) {
+            ++edit.runs.back().tilesCount;
+        }
+        else {
+            edit.runs.push_back({ record.tileIndex, 1, (int)edit.oldTiles.size() });
+        }
+
+        edit.oldTiles.push_back(record.oldTile);
+        edit.newTiles.push_back(newTile);
+    }
+
+    mRecordedTiles.clear();
+    if (edit.runs.empty())
+        return false;
+
+    edit.runs.shrink_to_fit();
+    edit.oldTiles.shrink_to_fit();
+    edit.newTiles.shrink_to_fit();
+
+    for (const Edit& redoEdit : mRedoEdits)
+        mMemorySize -= _getEditSize(redoEdit);
+    mRedoEdits.clear();
+
+    mMemorySize += _getEditSize(edit);
+    mUndoEdits.push_back(std::move(edit));
+    _trimToBudget();
+    return true;
+}
+//-------------------------------------------------------------------------------------------------
+bool TerrainEditJournal::undo(TileStore* tiles, Rectd* dirtyRect)
+{
+    TINYSC_ASSERT(mRecordedTiles.empty(), "An edit isn't committed.");
+    if (mUndoEdits.empty())
+        return false;
+
+    _applyEdit(mUndoEdits.back(), true, tiles);
+    *dirtyRect = mUndoEdits.back().rect;
+
+    mRedoEdits.push_back(std::move(mUndoEdits.back()));
+    mUndoEdits.pop_back();
+    return true;
+}
+//-------------------------------------------------------------------------------------------------
+bool TerrainEditJournal::redo(TileStore* tiles, Rectd* dirtyRect)
+{
+    TINYSC_ASSERT(mRecordedTiles.empty(), "An edit isn't committed.");
+    if (mRedoEdits.empty())
+        return false;
+
+    _applyEdit(mRedoEdits.back(), false, tiles);
+    *dirtyRect = mRedoEdits.back().rect;
+
+    mUndoEdits.push_back(std::move(mRedoEdits.back()));
+    mRedoEdits.pop_back();
+    return true;
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainEditJournal::clear()
+{
+    for (const RecordedTile& record : mRecordedTiles)
+        mRecordedBits[record.tileIndex >> 6] = 0;
+    mRecordedTiles.clear();
+    mUndoEdits.clear();
+    mRedoEdits.clear();
+    mMemorySize = 0;
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainEditJournal::setBudget(size_t budget)
+{
+    mBudget = budget;
+    _trimToBudget();
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainEditJournal::_applyEdit(const Edit& edit, bool isUndo, TileStore* tiles)
+{
+    const std::vector<TileStore::PackedTile>& values = isUndo ? edit.oldTiles : edit.newTiles;
+
+    for (const TileRun& run : edit.runs) {
+        for (int i = 0; i < run.tilesCount; ++i)
+            tiles->setPackedTile(run.firstTile + i, values[run.firstDelta + i]);
+    }
+}
+//-------------------------------------------------------------------------------------------------
+size_t TerrainEditJournal::_getEditSize(const Edit& edit)
+{
+    return sizeof(Edit) + edit.runs.capacity() * sizeof(TileRun) +
+        (edit.oldTiles.capacity() + edit.newTiles.capacity()) * sizeof(TileStore::PackedTile);
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainEditJournal::_trimToBudget()
+{
+    // The latest edit is kept, so an operation larger than the budget can still be undone.
+    while (mMemorySize > mBudget && mUndoEdits.size() > 1) {
+        mMemorySize -= _getEditSize(mUndoEdits.front());
+        mUndoEdits.pop_front();
+    }
+}
+
+}
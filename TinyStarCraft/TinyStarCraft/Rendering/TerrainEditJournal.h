@@ -0,0 +1,138 @@
+#pragma once
+
+#include <deque>
+
+#include "Tile.h"
+#include "Utilities/Rect2.h"
+
+namespace TinyStarCraft
+{
+
+/**
+  	Undo and redo stacks of terrain edits, which only record the tiles each edit changed.
+@remarks
+    Tiles are recorded with their value before the first write of the edit. When the edit is
+    committed, the recorded tiles are compared with their current value, and the changed ones are
+    kept as runs of consecutive tile indices with their old and new values, so the memory of an
+    edit is proportional to the tiles it changed, not to the size of the terrain.
+    A bit per tile index marks the tiles recorded in the current edit, so a tile written many times
+    is recorded once.
+    The oldest edits are dropped once the journal is larger than its budget, except the latest
+    edit, which is kept even if it's larger than the budget on its own.
+ */
+class TerrainEditJournal
+{
+public:
+    /** Default memory budget of the journal. */
+    static const size_t DEFAULT_BUDGET = 16 * 1024 * 1024;
+
+public:
+    /** Constructor */
+    TerrainEditJournal();
+
+    /** Record a tile's value before it's written. Only the first record of a tile in an edit is kept. */
+    void recordTile(int tileIndex, const TileStore::PackedTile& oldTile)
+    {
+        const size_t word = (size_t)tileIndex >> 6;
+        const uint64_t bit = (uint64_t)1 << (tileIndex & 63);
+        if (word >= mRecordedBits.size())
+            mRecordedBits.resize(word + 1, 0);
+        else if (mRecordedBits[word] & bit)
+            return;
+
+        mRecordedBits[word] |= bit;
+        mRecordedTiles.push_back({ tileIndex, oldTile });
+    }
+
+    /** Get the number of tiles recorded in the current edit. */
+    size_t getRecordedTilesCount() const { return mRecordedTiles.size(); }
+
+    /**
+      	Finish the current edit and push it on the undo stack. The redo stack is cleared.
+    @param tiles
+        Tiles after the edit.
+    @return
+        Returns false if the edit changed no tiles, which isn't pushed.
+     */
+    bool commit(const TileStore& tiles);
+
+    /**
+      	Restore the tiles of the latest edit and move it to the redo stack.
+    @param tiles
+        Tiles to restore, which must not have been modified since the latest commit, undo or redo.
+    @param dirtyRect
+        Receives the rectangle of the restored tiles.
+    @return
+        Returns false if there is nothing to undo.
+     */
+    bool undo(TileStore* tiles, Rectd* dirtyRect);
+
+    /**
+      	Apply the latest undone edit again and move it to the undo stack.
+    @see
+        TerrainEditJournal::undo
+     */
+    bool redo(TileStore* tiles, Rectd* dirtyRect);
+
+    /** Remove all edits. */
+    void clear();
+
+    bool canUndo() const { return !mUndoEdits.empty(); }
+
+    bool canRedo() const { return !mRedoEdits.empty(); }
+
+    /**
+      	Change the memory budget in bytes. The oldest edits are dropped if the journal is larger,
+        except the latest one.
+     */
+    void setBudget(size_t budget);
+
+    size_t getBudget() const { return mBudget; }
+
+    /** Get the memory used by the recorded edits in bytes. */
+    size_t getMemorySize() const { return mMemorySize; }
+
+private:
+    /** Consecutive tiles changed by an edit. */
+    struct TileRun
+    {
+        int firstTile;      // Index of the first tile.
+        int tilesCount;
+        int firstDelta;     // Index of the first tile's values in the edit's old and new tiles.
+    };
+
+    /** Tiles changed by an edit. */
+    struct Edit
+    {
+        std::vector<TileRun> runs;
+        std::vector<TileStore::PackedTile> oldTiles;
+        std::vector<TileStore::PackedTile> newTiles;
+        Rectd rect;         // Bounding rectangle of the changed tiles.
+    };
+
+    /** A tile recorded in the current edit. */
+    struct RecordedTile
+    {
+        int tileIndex;
+        TileStore::PackedTile oldTile;
+    };
+
+    /** Write an edit's old or new tiles. */
+    static void _applyEdit(const Edit& edit, bool isUndo, TileStore* tiles);
+
+    /** Get the memory used by an edit. */
+    static size_t _getEditSize(const Edit& edit);
+
+    /** Drop the oldest edits until the journal fits in the budget, or only the latest one is left. */
+    void _trimToBudget();
+
+private:
+    std::vector<RecordedTile> mRecordedTiles;
+    std::vector<uint64_t> mRecordedBits;    // Set for the tile indices in mRecordedTiles.
+    std::deque<Edit> mUndoEdits;    // Edits from the oldest one.
+    std::vector<Edit> mRedoEdits;   // Undone edits from the oldest undone one.
+    size_t mMemorySize;
+    size_t mBudget;
+};
+
+}
@@ -0,0 +1,241 @@
+#include "Precompiled.h"
+#include "TerrainMapFile.h"
+#include "Utilities/Assert.h"
+#include "Utilities/Logging.h"
+#include "Utilities/Math.h"
+
+namespace TinyStarCraft
+{
+
+static const char   MAP_FILE_MAGIC[4] = { 'T', 'S', 'C', 'M' };
+static const size_t MAP_FILE_SECTION_ALIGNMENT = 16;
+
+/** Align an offset to the section alignment. */
+static size_t _alignSectionOffset(size_t offset)
+{
+    return (offset + MAP_FILE_SECTION_ALIGNMENT - 1) / MAP_FILE_SECTION_ALIGNMENT * MAP_FILE_SECTION_ALIGNMENT;
+}
+
+//-------------------------------------------------------------------------------------------------
+TerrainMapFile::TerrainMapFile()
+    : mFile(INVALID_HANDLE_VALUE),
+      mFileMapping(NULL),
+      mView(nullptr),
+      mFileSize(0),
+      mHeader(nullptr)
+{
+}
+//-------------------------------------------------------------------------------------------------
+TerrainMapFile::~TerrainMapFile()
+{
+    close();
+}
+//-------------------------------------------------------------------------------------------------
+bool TerrainMapFile::open(const std::string& fileName)
+{
+    TINYSC_ASSERT(!isOpen(), "A map file is already opened.");
+
+    mFile = ::CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (mFile == INVALID_HANDLE_VALUE) {
+        TINYSC_LOGLINE_ERR("Failed to open map file %s.", fileName.c_str());
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!::GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(Header)) {
+        TINYSC_LOGLINE_ERR("Map file %s is too small.", fileName.c_str());
+        close();
+        return false;
+    }
+
+    if ((uint64_t)fileSize.QuadPart > SIZE_MAX) {
+        // The whole file is mapped, it must fit in the address space.
+        TINYSC_LOGLINE_ERR("Map file %s is too large.", fileName.c_str());
+        close();
+        return false;
+    }
+    mFileSize = (size_t)fileSize.QuadPart;
+
+    mFileMapping = ::CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mFileMapping == NULL) {
+        TINYSC_LOGLINE_ERR("Failed to create file mapping for map file %s.", fileName.c_str());
+        close();
+        return false;
+    }
+
+    mView = (const BYTE*)::MapViewOfFile(mFileMapping, FILE_MAP_READ, 0, 0, 0);
+    if (mView == nullptr) {
+        TINYSC_LOGLINE_ERR("Failed to map view of map file %s.", fileName.c_str());
+        close();
+        return false;
+    }
+
+    // Validate the header and make sure sections are inside the file, nothing else is touched.
+    const Header* header = (const Header*)mView;
+    if (memcmp(header->magic, MAP_FILE_MAGIC, sizeof(MAP_FILE_MAGIC)) != 0 || header->version != VERSION) {
+        TINYSC_LOGLINE_ERR("Map file %s has an unknown format or version.", fileName.c_str());
+        close();
+        return false;
+    }
+
+    if (header->width <= 0 || header->height <= 0 ||
+        header->width % Terrain::CHUNK_DIMENSION > 0 || header->height % Terrain::CHUNK_DIMENSION > 0)
+    {
+        TINYSC_LOGLINE_ERR("Map file %s has an invalid dimension(%d*%d).", fileName.c_str(), header->width, header->height);
+        close();
+        return false;
+    }
+
+    // Sizes are computed in 64 bits, so they can't wrap around on 32-bit targets. A section is
+    // inside the file if it starts inside the file and fits in the rest of it.
+    const uint64_t tilesSize = (uint64_t)header->width * (uint64_t)header->height * sizeof(TileRecord);
+    const uint64_t quadTreeSize = (uint64_t)header->quadTreeNodesCount * 6 * sizeof(float);
+    if (header->tilesOffset < sizeof(Header) || header->tilesOffset > mFileSize ||
+        tilesSize > mFileSize - header->tilesOffset ||
+        (header->quadTreeOffset != 0 && (header->quadTreeOffset > mFileSize ||
+        quadTreeSize > mFileSize - header->quadTreeOffset)))
+    {
+        TINYSC_LOGLINE_ERR("Map file %s is truncated.", fileName.c_str());
+        close();
+        return false;
+    }
+
+    if (header->tilesOffset % MAP_FILE_SECTION_ALIGNMENT != 0 || header->quadTreeOffset % MAP_FILE_SECTION_ALIGNMENT != 0) {
+        TINYSC_LOGLINE_ERR("Map file %s has misaligned sections.", fileName.c_str());
+        close();
+        return false;
+    }
+
+    mHeader = header;
+    return true;
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainMapFile::close()
+{
+    if (mView) {
+        ::UnmapViewOfFile(mView);
+        mView = nullptr;
+    }
+
+    if (mFileMapping) {
+        ::CloseHandle(mFileMapping);
+        mFileMapping = NULL;
+    }
+
+    if (mFile != INVALID_HANDLE_VALUE) {
+        ::CloseHandle(mFile);
+        mFile = INVALID_HANDLE_VALUE;
+    }
+
+    mFileSize = 0;
+    mHeader = nullptr;
+}
+//-------------------------------------------------------------------------------------------------
+const TerrainMapFile::TileRecord* TerrainMapFile::getChunkTiles(int chunk) const
+{
+    TINYSC_ASSERT(isOpen(), "Map file is not opened.");
+    const TileRecord* tiles = (const TileRecord*)(mView + mHeader->tilesOffset);
+    return tiles + chunk * Terrain::TILES_COUNT_PER_CHUNK;
+}
+//-------------------------------------------------------------------------------------------------
+bool TerrainMapFile::decodeTiles(TileStore* tiles) const
+{
+    const Size2d dimension = getDimension();
+    const int rowChunksCount = dimension.x / Terrain::CHUNK_DIMENSION;
+    const int chunksCount = rowChunksCount * (dimension.y / Terrain::CHUNK_DIMENSION);
+
+    tiles->resize(dimension);
+    for (int iChunk = 0; iChunk < chunksCount; ++iChunk) {
+        const TileRecord* chunkTiles = getChunkTiles(iChunk);
+        const int chunkX = iChunk % rowChunksCount * Terrain::CHUNK_DIMENSION;
+        const int chunkY = iChunk / rowChunksCount * Terrain::CHUNK_DIMENSION;
+
+        // A row of a chunk is a run of consecutive tiles in the store.
+        for (int row = 0; row < Terrain::CHUNK_DIMENSION; ++row) {
+            const TileRecord* rowTiles = chunkTiles + row * Terrain::CHUNK_DIMENSION;
+            for (int i = 0; i < Terrain::CHUNK_DIMENSION; ++i) {
+                if (!TileStore::isValidPackedTile(rowTiles[i])) {
+                    TINYSC_LOGLINE_ERR("Map file has an invalid tile at (%d, %d).", chunkX + i, chunkY + row);
+                    return false;
+                }
+            }
+
+            tiles->setPackedTiles((chunkY + row) * dimension.x + chunkX, rowTiles, Terrain::CHUNK_DIMENSION);
+        }
+    }
+
+    return true;
+}
+//-------------------------------------------------------------------------------------------------
+const float* TerrainMapFile::getQuadTreeAABBs() const
+{
+    TINYSC_ASSERT(hasQuadTree(), "Map file doesn't have the quad tree section.");
+    return (const float*)(mView + mHeader->quadTreeOffset);
+}
+//-------------------------------------------------------------------------------------------------
+bool TerrainMapFile::write(const std::string& fileName, const Terrain& terrain, bool includeQuadTree)
+{
+    const Size2d& dimension = terrain.getDimension();
+    const TileStore& tilesData = terrain.getTilesData();
+
+    // Encode tiles in chunk order.
+    const int rowChunksCount = dimension.x / Terrain::CHUNK_DIMENSION;
+    const int chunksCount = rowChunksCount * (dimension.y / Terrain::CHUNK_DIMENSION);
+    std::vector<TileRecord> tiles(dimension.x * dimension.y);
+    for (int iChunk = 0; iChunk < chunksCount; ++iChunk) {
+        const int chunkX = iChunk % rowChunksCount * Terrain::CHUNK_DIMENSION;
+        const int chunkY = iChunk / rowChunksCount * Terrain::CHUNK_DIMENSION;
+
+        for (int itile = 0; itile < Terrain::TILES_COUNT_PER_CHUNK; ++itile) {
+            const int x = chunkX + itile % Terrain::CHUNK_DIMENSION;
+            const int y = chunkY + itile / Terrain::CHUNK_DIMENSION;
+            tiles[iChunk * Terrain::TILES_COUNT_PER_CHUNK + itile] = tilesData.getPackedTile(y * dimension.x + x);
+        }
+    }
+
+    Header header;
+    memcpy(header.magic, MAP_FILE_MAGIC, sizeof(MAP_FILE_MAGIC));
+    header.version = VERSION;
+    header.width = dimension.x;
+    header.height = dimension.y;
+    header.tilesOffset = (uint32_t)_alignSectionOffset(sizeof(Header));
+    header.quadTreeOffset = 0;
+    header.quadTreeNodesCount = 0;
+    header.reserved = 0;
+
+    std::vector<float> quadTreeAABBs;
+    if (includeQuadTree) {
+        const size_t nodesCount = terrain.getTerrainQuadTree().getNodesCount();
+        quadTreeAABBs.resize(nodesCount * 6);
+        terrain.getTerrainQuadTree().saveAABBs(&quadTreeAABBs[0]);
+
+        header.quadTreeOffset = (uint32_t)_alignSectionOffset(header.tilesOffset + tiles.size() * sizeof(TileRecord));
+        header.quadTreeNodesCount = (uint32_t)nodesCount;
+    }
+
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        TINYSC_LOGLINE_ERR("Failed to create map file %s.", fileName.c_str());
+        return false;
+    }
+
+    static const char padding[MAP_FILE_SECTION_ALIGNMENT] = { 0 };
+    file.write((const char*)&header, sizeof(Header));
+    file.write(padding, header.tilesOffset - sizeof(Header));
+    file.write((const char*)tiles.data(), tiles.size() * sizeof(TileRecord));
+
+    if (includeQuadTree) {
+        file.write(padding, header.quadTreeOffset - header.tilesOffset - tiles.size() * sizeof(TileRecord));
+        file.write((const char*)quadTreeAABBs.data(), quadTreeAABBs.size() * sizeof(float));
+    }
+
+    if (!file) {
+        TINYSC_LOGLINE_ERR("Failed to write map file %s.", fileName.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Terrain.h"
+
+namespace TinyStarCraft
+{
+
+/**
+  	A binary terrain map file, which is read through a memory mapped view.
+@remarks
+    Layout of the file:
+    - Header.
+    - Tiles payload of packed tiles. Tiles are grouped by 8*8 chunks, chunks are in row-major
+      order and tiles in a chunk are in row-major order as well.
+    - Optional quad tree section. AABBs of the terrain quad tree's nodes, written as min x, y, z
+      and max x, y, z arrays.
+    Sections are 16 bytes aligned. Nothing is parsed when a file is opened except the header, tiles
+    are copied only when they are accessed.
+ */
+class TerrainMapFile
+{
+public:
+    /** Current version of the format. Files with other versions are rejected. */
+    static const uint32_t VERSION = 2;
+
+    /** Header of the file. */
+    struct Header
+    {
+        char magic[4];              // Always "TSCM".
+        uint32_t version;
+        int32_t width;              // Dimension of the terrain in tiles.
+        int32_t height;
+        uint32_t tilesOffset;       // Offset of the tiles payload in bytes.
+        uint32_t quadTreeOffset;    // Offset of the quad tree section in bytes, 0 if there isn't one.
+        uint32_t quadTreeNodesCount;
+        uint32_t reserved;
+    };
+
+    /** Tiles are stored in the same packed form as in memory. */
+    typedef TileStore::PackedTile TileRecord;
+
+public:
+    /** Constructor */
+    TerrainMapFile();
+
+    /** Destructor */
+    ~TerrainMapFile();
+
+    /**
+      	Open a map file and map it to memory.
+    @return
+        Returns true if the file is opened and its header is valid. Returns false otherwise.
+     */
+    bool open(const std::string& fileName);
+
+    /** Unmap and close the file. */
+    void close();
+
+    /** Check if a file is opened. */
+    bool isOpen() const { return mHeader != nullptr; }
+
+    /** Get the dimension of the terrain in tiles. */
+    Size2d getDimension() const { return Size2d(mHeader->width, mHeader->height); }
+
+    /** Get the 8*8 packed tiles of a chunk. */
+    const TileRecord* getChunkTiles(int chunk) const;
+
+    /**
+      	Copy all tiles into a tile store, a row of a chunk at a time.
+    @return
+        Returns false if a tile is invalid, e.g. its type is unknown. Returns true otherwise.
+     */
+    bool decodeTiles(TileStore* tiles) const;
+
+    /** Check if the file has the quad tree section. */
+    bool hasQuadTree() const { return mHeader->quadTreeOffset != 0; }
+
+    /** Get the number of nodes of the quad tree in the quad tree section. */
+    size_t getQuadTreeNodesCount() const { return mHeader->quadTreeNodesCount; }
+
+    /** Get the AABBs of the terrain quad tree. */
+    const float* getQuadTreeAABBs() const;
+
+    /**
+      	Write a terrain into a map file.
+    @param includeQuadTree
+        Write the quad tree section or not. With the section, the terrain doesn't need to build its
+        quad tree when it is loaded.
+    @return
+        Returns true if the file is written. Returns false otherwise.
+     */
+    static bool write(const std::string& fileName, const Terrain& terrain, bool includeQuadTree);
+
+private:
+    HANDLE mFile;
+    HANDLE mFileMapping;
+    const BYTE* mView;
+    size_t mFileSize;
+    const Header* mHeader;
+};
+
+}
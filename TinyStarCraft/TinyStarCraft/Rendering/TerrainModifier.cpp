@@ -1,166 +1,327 @@
 #include "Precompiled.h"
 #include "TerrainModifier.h"
+#include "Utilities/Assert.h"
 
 namespace TinyStarCraft
 {
 
+//-------------------------------------------------------------------------------------------------
+// Tile produce tables are generated at compile time. Rules are written once for each pair of tile
+// types in the order of the types, and the tables are diagonally symmetrical. Only single return
+// constexpr functions are used, since Visual Studio 2015 doesn't support loops in them.
+
+// Two tile types which produce another type when they meet.
+struct TileProduceRule
+{
+    ETileType tileA;
+    ETileType tileB;            // A type after tileA.
+    ETileType produceTile;
+};
+
+// Rules of hightening method.
+static constexpr TileProduceRule HIGHTENING_PRODUCE_RULES[] =
+{
+    { ETileType::SouthA, ETileType::WestA, ETileType::SouthWest },
+    { ETileType::SouthA, ETileType::NorthA, ETileType::VShapeSouthToNorth },
+    { ETileType::SouthA, ETileType::EastA, ETileType::SouthEast },
+    { ETileType::SouthA, ETileType::SouthWest, ETileType::SouthWest },
+    { ETileType::SouthA, ETileType::SouthEast, ETileType::SouthEast },
+    { ETileType::SouthA, ETileType::VShapeWestToEast, ETileType::SouthB },
+    { ETileType::WestA, ETileType::NorthA, ETileType::NorthWest },
+    { ETileType::WestA, ETileType::EastA, ETileType::VShapeWestToEast },
+    { ETileType::WestA, ETileType::SouthWest, ETileType::SouthWest },
+    { ETileType::WestA, ETileType::NorthWest, ETileType::NorthWest },
+    { ETileType::WestA, ETileType::VShapeSouthToNorth, ETileType::WestB },
+    { ETileType::NorthA, ETileType::EastA, ETileType::NorthEast },
+    { ETileType::NorthA, ETileType::NorthWest, ETileType::NorthWest },
+    { ETileType::NorthA, ETileType::NorthEast, ETileType::NorthEast },
+    { ETileType::NorthA, ETileType::VShapeWestToEast, ETileType::NorthB },
+    { ETileType::EastA, ETileType::NorthEast, ETileType::NorthEast },
+    { ETileType::EastA, ETileType::SouthEast, ETileType::SouthEast },
+    { ETileType::EastA, ETileType::VShapeSouthToNorth, ETileType::EastB },
+    { ETileType::SouthWest, ETileType::NorthWest, ETileType::WestB },
+    { ETileType::SouthWest, ETileType::SouthEast, ETileType::SouthB },
+    { ETileType::SouthWest, ETileType::SouthB, ETileType::SouthB },
+    { ETileType::SouthWest, ETileType::WestB, ETileType::WestB },
+    { ETileType::NorthWest, ETileType::NorthEast, ETileType::NorthB },
+    { ETileType::NorthWest, ETileType::WestB, ETileType::WestB },
+    { ETileType::NorthWest, ETileType::NorthB, ETileType::NorthB },
+    { ETileType::NorthEast, ETileType::SouthEast, ETileType::EastB },
+    { ETileType::NorthEast, ETileType::NorthB, ETileType::NorthB },
+    { ETileType::NorthEast, ETileType::EastB, ETileType::EastB },
+    { ETileType::SouthEast, ETileType::SouthB, ETileType::SouthB },
+    { ETileType::SouthEast, ETileType::EastB, ETileType::EastB }
+};
+
+// Rules of lowering method.
+static constexpr TileProduceRule LOWERING_PRODUCE_RULES[] =
+{
+    { ETileType::SouthA, ETileType::SouthWest, ETileType::SouthA },
+    { ETileType::SouthA, ETileType::SouthEast, ETileType::SouthA },
+    { ETileType::WestA, ETileType::SouthWest, ETileType::WestA },
+    { ETileType::WestA, ETileType::NorthWest, ETileType::WestA },
+    { ETileType::NorthA, ETileType::NorthWest, ETileType::NorthA },
+    { ETileType::NorthA, ETileType::NorthEast, ETileType::NorthA },
+    { ETileType::EastA, ETileType::NorthEast, ETileType::EastA },
+    { ETileType::EastA, ETileType::SouthEast, ETileType::EastA },
+    { ETileType::SouthWest, ETileType::NorthWest, ETileType::WestA },
+    { ETileType::SouthWest, ETileType::SouthEast, ETileType::SouthA },
+    { ETileType::SouthWest, ETileType::SouthB, ETileType::SouthWest },
+    { ETileType::SouthWest, ETileType::WestB, ETileType::SouthWest },
+    { ETileType::NorthWest, ETileType::NorthEast, ETileType::NorthA },
+    { ETileType::NorthWest, ETileType::WestB, ETileType::NorthWest },
+    { ETileType::NorthWest, ETileType::NorthB, ETileType::NorthWest },
+    { ETileType::NorthEast, ETileType::SouthEast, ETileType::EastA },
+    { ETileType::NorthEast, ETileType::NorthB, ETileType::NorthEast },
+    { ETileType::NorthEast, ETileType::EastB, ETileType::NorthEast },
+    { ETileType::SouthEast, ETileType::SouthB, ETileType::SouthEast },
+    { ETileType::SouthEast, ETileType::EastB, ETileType::SouthEast },
+    { ETileType::SouthB, ETileType::WestB, ETileType::SouthWest },
+    { ETileType::SouthB, ETileType::EastB, ETileType::SouthEast },
+    { ETileType::SouthB, ETileType::VShapeWestToEast, ETileType::SouthA },
+    { ETileType::WestB, ETileType::NorthB, ETileType::NorthWest },
+    { ETileType::WestB, ETileType::VShapeSouthToNorth, ETileType::WestA },
+    { ETileType::NorthB, ETileType::EastB, ETileType::NorthEast },
+    { ETileType::NorthB, ETileType::VShapeWestToEast, ETileType::NorthA },
+    { ETileType::EastB, ETileType::VShapeSouthToNorth, ETileType::EastA }
+};
+
+// Produce tiles of a desired tile, indexed by the original tile. An undefined produce is -1.
+struct TileProduceRow
+{
+    int8_t produceTiles[16];
+};
+
+// Produce tiles of a method, indexed by the desired tile.
+struct TileProduceTable
+{
+    TileProduceRow rows[16];
+};
+
+static constexpr int _getProduceRuleKey(int tileA, int tileB)
+{
+    return tileA * 16 + tileB;
+}
+
+static constexpr bool _areProduceRulesSorted(const TileProduceRule* rules, int rulesCount)
+{
+    // Rules are sorted by their types, and a pair of types has one rule only.
+    return rulesCount < 2 ? true :
+        _getProduceRuleKey(rules[rulesCount - 2].tileA, rules[rulesCount - 2].tileB) <
+            _getProduceRuleKey(rules[rulesCount - 1].tileA, rules[rulesCount - 1].tileB) &&
+        _areProduceRulesSorted(rules, rulesCount - 1);
+}
+
+static constexpr int _findProduceRule(const TileProduceRule* rules, int first, int last, int key)
+{
+    // Binary search keeps the generation within the compiler's constexpr evaluation limits.
+    return first >= last ? -1 :
+        _getProduceRuleKey(rules[(first + last) / 2].tileA, rules[(first + last) / 2].tileB) == key ?
+            rules[(first + last) / 2].produceTile :
+        _getProduceRuleKey(rules[(first + last) / 2].tileA, rules[(first + last) / 2].tileB) < key ?
+            _findProduceRule(rules, (first + last) / 2 + 1, last, key) :
+            _findProduceRule(rules, first, (first + last) / 2, key);
+}
+
+static constexpr int _getDefaultProduceTile(int ruleProduceTile, int tileA, int tileB)
+{
+    return ruleProduceTile != -1 ? ruleProduceTile :
+        // When a type meets itself produces itself, and flat types can be overriden by any other types.
+        (tileA == tileB || tileA == ETileType::Flat) ? tileB : -1;
+}
+
+static constexpr int _getOrderedProduceTile(int method, int tileA, int tileB)
+{
+    return
+        // All *_A types can get overriden by any one of by *_B types when hightening, and *_B types
+        // can get overriden by *_A types when lowering.
+        (tileA >= ETileType::SouthA && tileA <= ETileType::EastA && tileB >= ETileType::SouthB && tileB <= ETileType::EastB) ?
+            (method == 0 ? tileB : tileA) :
+        _getDefaultProduceTile(method == 0 ?
+            _findProduceRule(HIGHTENING_PRODUCE_RULES, 0, (int)std::extent<decltype(HIGHTENING_PRODUCE_RULES)>::value, _getProduceRuleKey(tileA, tileB)) :
+            _findProduceRule(LOWERING_PRODUCE_RULES, 0, (int)std::extent<decltype(LOWERING_PRODUCE_RULES)>::value, _getProduceRuleKey(tileA, tileB)),
+            tileA, tileB);
+}
+
+static constexpr int8_t _getProduceTile(int method, int desiredTile, int originalTile)
+{
+    return (int8_t)(desiredTile <= originalTile ? _getOrderedProduceTile(method, desiredTile, originalTile) :
+        _getOrderedProduceTile(method, originalTile, desiredTile));
+}
+
+template <size_t... Indices>
+static constexpr TileProduceRow _makeProduceRow(int method, int desiredTile, std::index_sequence<Indices...>)
+{
+    return { { _getProduceTile(method, desiredTile, (int)Indices)... } };
+}
+
+// Each row is a constant of its own, so every evaluation stays within the compiler's constexpr
+// evaluation limits.
+template <int Method, int DesiredTile>
+struct TileProduceRowOf
+{
+    static constexpr TileProduceRow value = _makeProduceRow(Method, DesiredTile, std::make_index_sequence<16>());
+};
+
+template <int Method, int DesiredTile>
+constexpr TileProduceRow TileProduceRowOf<Method, DesiredTile>::value;
+
+template <int Method, size_t... DesiredTiles>
+static constexpr TileProduceTable _makeProduceTable(std::index_sequence<DesiredTiles...>)
+{
+    return { { TileProduceRowOf<Method, (int)DesiredTiles>::value... } };
+}
+
+// Produce tables of hightening and lowering methods.
+static constexpr TileProduceTable TILE_PRODUCE_TABLES[2] =
+{
+    _makeProduceTable<0>(std::make_index_sequence<16>()),
+    _makeProduceTable<1>(std::make_index_sequence<16>())
+};
+
+static constexpr bool _isProduceTableSymmetrical(const TileProduceTable& table, int index)
+{
+    return index == 16 * 16 ? true :
+        table.rows[index / 16].produceTiles[index % 16] == table.rows[index % 16].produceTiles[index / 16] &&
+        _isProduceTableSymmetrical(table, index + 1);
+}
+
+static constexpr int _getTableProduceTile(int method, ETileType desiredTile, ETileType originalTile)
+{
+    return TILE_PRODUCE_TABLES[method].rows[desiredTile].produceTiles[originalTile];
+}
+
+static_assert(_areProduceRulesSorted(HIGHTENING_PRODUCE_RULES, (int)std::extent<decltype(HIGHTENING_PRODUCE_RULES)>::value),
+    "Hightening rules must be sorted by their types.");
+static_assert(_areProduceRulesSorted(LOWERING_PRODUCE_RULES, (int)std::extent<decltype(LOWERING_PRODUCE_RULES)>::value),
+    "Lowering rules must be sorted by their types.");
+static_assert(_isProduceTableSymmetrical(TILE_PRODUCE_TABLES[0], 0), "Hightening produce table isn't symmetrical.");
+static_assert(_isProduceTableSymmetrical(TILE_PRODUCE_TABLES[1], 0), "Lowering produce table isn't symmetrical.");
+static_assert(_getTableProduceTile(0, ETileType::Flat, ETileType::NorthB) == ETileType::NorthB, "Flat must be overriden when hightening.");
+static_assert(_getTableProduceTile(1, ETileType::EastA, ETileType::Flat) == ETileType::EastA, "Flat must be overriden when lowering.");
+static_assert(_getTableProduceTile(0, ETileType::WestB, ETileType::WestB) == ETileType::WestB, "A type must produce itself.");
+static_assert(_getTableProduceTile(0, ETileType::NorthWest, ETileType::SouthWest) == ETileType::WestB, "Hightening rules must be symmetrical.");
+static_assert(_getTableProduceTile(1, ETileType::EastB, ETileType::NorthB) == ETileType::NorthEast, "Lowering rules must be symmetrical.");
+static_assert(_getTableProduceTile(0, ETileType::SouthA, ETileType::EastB) == ETileType::EastB, "*_B types must override *_A types when hightening.");
+static_assert(_getTableProduceTile(1, ETileType::SouthA, ETileType::EastB) == ETileType::SouthA, "*_A types must override *_B types when lowering.");
+static_assert(_getTableProduceTile(0, ETileType::SouthWest, ETileType::NorthEast) == -1, "Opposite corners must be undefined.");
+static_assert(_getTableProduceTile(1, ETileType::SouthWest, ETileType::NorthEast) == -1, "Opposite corners must be undefined.");
+//-------------------------------------------------------------------------------------------------
+
 TerrainModifier::TerrainModifier(Terrain* terrain)
-    : mTerrain(terrain)
+    : mTerrain(terrain), mIsDirty(false), mIsEditing(false)
 {
-    _initTileProduceTables();
-    // Get data from the terrain.
+    // Get data from the terrain, which shares its pages with the modifier until they're modified.
     mTilesData = mTerrain->getTilesData();
 }
 
-void TerrainModifier::hightenGround(const Point2d& location)
+Rectd TerrainModifier::hightenGround(const Point2d& location)
 {
-    _modifyTilesRecursively(location, 1 | 2 | 4 | 8, ETileType::Flat, mTilesData[_toTileIndex(location)].level + 1, 0);
+    const int level = mTilesData.getLevel(_toTileIndex(location)) + 1;
+    if (!_isStorableLevel(level))
+        return Rectd::makeRect(location, Size2d(0, 0));
+
+    return _modifyGround({ { location, 1 | 2 | 4 | 8, ETileType::Flat, level } }, 0);
 }
 
-void TerrainModifier::lowerGround(const Point2d& location)
+Rectd TerrainModifier::lowerGround(const Point2d& location)
 {
-    // Increase the altitude level of non-flat tiles by 1.
-    for (size_t i = 0; i < mTilesData.size(); ++i) {
-        if (mTilesData[i].type != ETileType::Flat)
-            mTilesData[i].level++;
-    }
+    const int level = _getElevationLevel(mTilesData, _toTileIndex(location), 1) - 1;
+    if (!_isStorableLevel(level))
+        return Rectd::makeRect(location, Size2d(0, 0));
 
-    _modifyTilesRecursively(location, 1 | 2 | 4 | 8, ETileType::Flat, mTilesData[_toTileIndex(location)].level - 1, 1);
+    return _modifyGround({ { location, 1 | 2 | 4 | 8, ETileType::Flat, level } }, 1);
+}
 
-    // Decrease the altitude level of non-flat tiles by 1.
-    for (size_t i = 0; i < mTilesData.size(); ++i) {
-        if (mTilesData[i].type != ETileType::Flat)
-            mTilesData[i].level--;
-    }
+Rectd TerrainModifier::hightenArea(const TerrainBrush& brush)
+{
+    return _modifyArea(brush, 0);
+}
+
+Rectd TerrainModifier::lowerArea(const TerrainBrush& brush)
+{
+    return _modifyArea(brush, 1);
 }
 
 void TerrainModifier::hightenTile(const Point2d& location)
 {
-    mTilesData[_toTileIndex(location)].level++;
+    const int tileIndex = _toTileIndex(location);
+    if (!_isStorableLevel(mTilesData.getLevel(tileIndex) + 1))
+        return;
+
+    _recordTile(tileIndex);
+    mTilesData.setLevel(tileIndex, mTilesData.getLevel(tileIndex) + 1);
+    _markTileDirty(location);
+    _finishOperation();
 }
 
 void TerrainModifier::lowerTile(const Point2d& location)
 {
-    mTilesData[_toTileIndex(location)].level--;
+    const int tileIndex = _toTileIndex(location);
+    if (!_isStorableLevel(mTilesData.getLevel(tileIndex) - 1))
+        return;
+
+    _recordTile(tileIndex);
+    mTilesData.setLevel(tileIndex, mTilesData.getLevel(tileIndex) - 1);
+    _markTileDirty(location);
+    _finishOperation();
 }
 
 void TerrainModifier::updateTerrain()
 {
-    mTerrain->setTilesData(mTilesData);
+    if (!mIsDirty)
+        return;
+
+    mTerrain->setTilesData(mTilesData, mDirtyRect);
+    mIsDirty = false;
 }
 
-void TerrainModifier::_initTileProduceTables()
+void TerrainModifier::beginEdit()
 {
-    // Initialize all produce tiles to undefined.
-    mHighteningTileProduceTable.resize(16, std::vector<int>(16, -1));
+    TINYSC_ASSERT(!mIsEditing, "An edit is already started.");
+    mIsEditing = true;
+}
 
-    // Flat types can be overriden by any other types.
-    for (size_t i = 0; i < 16; ++i) {
-        mHighteningTileProduceTable[ETileType::Flat][i] = i;
-    }
+void TerrainModifier::commitEdit()
+{
+    TINYSC_ASSERT(mIsEditing, "No edit is started.");
+    mIsEditing = false;
 
-    // When a type meets itself produces itself.
-    for (size_t i = 0; i < 16; ++i) {
-        mHighteningTileProduceTable[i][i] = i;
-    }
+    mJournal.commit(mTilesData);
+    updateTerrain();
+}
 
-    mHighteningTileProduceTable[ETileType::SouthWest][ETileType::NorthWest] = ETileType::WestB;
-    mHighteningTileProduceTable[ETileType::SouthWest][ETileType::SouthEast] = ETileType::SouthB;
-    mHighteningTileProduceTable[ETileType::SouthA][ETileType::SouthWest] = ETileType::SouthWest;
-    mHighteningTileProduceTable[ETileType::WestA][ETileType::SouthWest] = ETileType::SouthWest;
-    mHighteningTileProduceTable[ETileType::NorthWest][ETileType::NorthEast] = ETileType::NorthB;
-    mHighteningTileProduceTable[ETileType::WestA][ETileType::NorthWest] = ETileType::NorthWest;
-    mHighteningTileProduceTable[ETileType::NorthA][ETileType::NorthWest] = ETileType::NorthWest;
-    mHighteningTileProduceTable[ETileType::NorthEast][ETileType::SouthEast] = ETileType::EastB;
-    mHighteningTileProduceTable[ETileType::NorthA][ETileType::NorthEast] = ETileType::NorthEast;
-    mHighteningTileProduceTable[ETileType::EastA][ETileType::NorthEast] = ETileType::NorthEast;
-    mHighteningTileProduceTable[ETileType::SouthA][ETileType::SouthEast] = ETileType::SouthEast;
-    mHighteningTileProduceTable[ETileType::EastA][ETileType::SouthEast] = ETileType::SouthEast;
-    mHighteningTileProduceTable[ETileType::SouthA][ETileType::WestA] = ETileType::SouthWest;
-    mHighteningTileProduceTable[ETileType::SouthA][ETileType::NorthA] = ETileType::VShapeSouthToNorth;
-    mHighteningTileProduceTable[ETileType::SouthA][ETileType::EastA] = ETileType::SouthEast;
-    mHighteningTileProduceTable[ETileType::WestA][ETileType::NorthA] = ETileType::NorthWest;
-    mHighteningTileProduceTable[ETileType::WestA][ETileType::EastA] = ETileType::VShapeWestToEast;
-    mHighteningTileProduceTable[ETileType::NorthA][ETileType::EastA] = ETileType::NorthEast;
-    mHighteningTileProduceTable[ETileType::SouthA][ETileType::VShapeWestToEast] = ETileType::SouthB;
-    mHighteningTileProduceTable[ETileType::WestA][ETileType::VShapeSouthToNorth] = ETileType::WestB;
-    mHighteningTileProduceTable[ETileType::NorthA][ETileType::VShapeWestToEast] = ETileType::NorthB;
-    mHighteningTileProduceTable[ETileType::EastA][ETileType::VShapeSouthToNorth] = ETileType::EastB;
-    mHighteningTileProduceTable[ETileType::SouthWest][ETileType::SouthB] = ETileType::SouthB;
-    mHighteningTileProduceTable[ETileType::SouthWest][ETileType::WestB] = ETileType::WestB;
-    mHighteningTileProduceTable[ETileType::NorthWest][ETileType::NorthB] = ETileType::NorthB;
-    mHighteningTileProduceTable[ETileType::NorthWest][ETileType::WestB] = ETileType::WestB;
-    mHighteningTileProduceTable[ETileType::NorthEast][ETileType::NorthB] = ETileType::NorthB;
-    mHighteningTileProduceTable[ETileType::NorthEast][ETileType::EastB] = ETileType::EastB;
-    mHighteningTileProduceTable[ETileType::SouthEast][ETileType::SouthB] = ETileType::SouthB;
-    mHighteningTileProduceTable[ETileType::SouthEast][ETileType::EastB] = ETileType::EastB;
-
-    // All *_A types can get overriden by any one of by *_B types.
-    for (size_t i = ETileType::SouthA; i <= ETileType::EastA; ++i) {
-        for (size_t j = ETileType::SouthB; j <= ETileType::EastB; ++j)
-            mHighteningTileProduceTable[i][j] = j;
-    }
+bool TerrainModifier::undo()
+{
+    TINYSC_ASSERT(!mIsEditing, "Can't undo during an edit.");
 
-    // Make the table diagnally symmetrical
-    for (size_t i = 0; i < 16; ++i) {
-        for (size_t j = 0; j < i; ++j) {
-            mHighteningTileProduceTable[i][j] = mHighteningTileProduceTable[j][i];
-        }
-    }
+    Rectd rect;
+    if (!mJournal.undo(&mTilesData, &rect))
+        return false;
 
-    mLoweringTileProduceTable.resize(16, std::vector<int>(16, -1));
+    _markRectDirty(rect);
+    updateTerrain();
+    return true;
+}
 
-    // Flat types can be overriden by any other types.
-    for (size_t i = 0; i < 16; ++i) {
-        mLoweringTileProduceTable[ETileType::Flat][i] = i;
-    }
+bool TerrainModifier::redo()
+{
+    TINYSC_ASSERT(!mIsEditing, "Can't redo during an edit.");
 
-    // When a type meets itself produces itself.
-    for (size_t i = 0; i < 16; ++i) {
-        mLoweringTileProduceTable[i][i] = i;
-    }
+    Rectd rect;
+    if (!mJournal.redo(&mTilesData, &rect))
+        return false;
 
-    mLoweringTileProduceTable[ETileType::SouthWest][ETileType::NorthWest] = ETileType::WestA;
-    mLoweringTileProduceTable[ETileType::SouthWest][ETileType::SouthEast] = ETileType::SouthA;
-    mLoweringTileProduceTable[ETileType::SouthWest][ETileType::SouthB] = ETileType::SouthWest;
-    mLoweringTileProduceTable[ETileType::SouthWest][ETileType::WestB] = ETileType::SouthWest;
-    mLoweringTileProduceTable[ETileType::NorthWest][ETileType::NorthEast] = ETileType::NorthA;
-    mLoweringTileProduceTable[ETileType::NorthWest][ETileType::WestB] = ETileType::NorthWest;
-    mLoweringTileProduceTable[ETileType::NorthWest][ETileType::NorthB] = ETileType::NorthWest;
-    mLoweringTileProduceTable[ETileType::NorthEast][ETileType::SouthEast] = ETileType::EastA;
-    mLoweringTileProduceTable[ETileType::NorthEast][ETileType::NorthB] = ETileType::NorthEast;
-    mLoweringTileProduceTable[ETileType::NorthEast][ETileType::EastB] = ETileType::NorthEast;
-    mLoweringTileProduceTable[ETileType::SouthEast][ETileType::SouthB] = ETileType::SouthEast;
-    mLoweringTileProduceTable[ETileType::SouthEast][ETileType::EastB] = ETileType::SouthEast;
-    mLoweringTileProduceTable[ETileType::SouthB][ETileType::WestB] = ETileType::SouthWest;
-    mLoweringTileProduceTable[ETileType::SouthB][ETileType::EastB] = ETileType::SouthEast;
-    mLoweringTileProduceTable[ETileType::WestB][ETileType::NorthB] = ETileType::NorthWest;
-    mLoweringTileProduceTable[ETileType::NorthB][ETileType::EastB] = ETileType::NorthEast;
-    mLoweringTileProduceTable[ETileType::SouthB][ETileType::VShapeWestToEast] = ETileType::SouthA;
-    mLoweringTileProduceTable[ETileType::WestB][ETileType::VShapeSouthToNorth] = ETileType::WestA;
-    mLoweringTileProduceTable[ETileType::NorthB][ETileType::VShapeWestToEast] = ETileType::NorthA;
-    mLoweringTileProduceTable[ETileType::EastB][ETileType::VShapeSouthToNorth] = ETileType::EastA;
-    mLoweringTileProduceTable[ETileType::SouthA][ETileType::SouthWest] = ETileType::SouthA;
-    mLoweringTileProduceTable[ETileType::WestA][ETileType::SouthWest] = ETileType::WestA;
-    mLoweringTileProduceTable[ETileType::NorthA][ETileType::NorthWest] = ETileType::NorthA;
-    mLoweringTileProduceTable[ETileType::WestA][ETileType::NorthWest] = ETileType::WestA;
-    mLoweringTileProduceTable[ETileType::NorthA][ETileType::NorthEast] = ETileType::NorthA;
-    mLoweringTileProduceTable[ETileType::EastA][ETileType::NorthEast] = ETileType::EastA;
-    mLoweringTileProduceTable[ETileType::SouthA][ETileType::SouthEast] = ETileType::SouthA;
-    mLoweringTileProduceTable[ETileType::EastA][ETileType::SouthEast] = ETileType::EastA;
-
-    // All *_B types can get overriden by any one of by *_A types.
-    for (size_t i = ETileType::SouthA; i <= ETileType::EastA; ++i) {
-        for (size_t j = ETileType::SouthB; j <= ETileType::EastB; ++j)
-            mLoweringTileProduceTable[i][j] = i;
-    }
+    _markRectDirty(rect);
+    updateTerrain();
+    return true;
+}
 
-    // Make the table diagnally symmetrical
-    for (size_t i = 0; i < 16; ++i) {
-        for (size_t j = 0; j < i; ++j) {
-            mLoweringTileProduceTable[i][j] = mLoweringTileProduceTable[j][i];
-        }
-    }
+int TerrainModifier::getProduceTile(int method, int desiredTile, int originalTile)
+{
+    TINYSC_ASSERT(method >= 0 && method < 2 && desiredTile >= 0 && desiredTile < 16 && originalTile >= 0 && originalTile < 16,
+        "Produce tile is out of the tables.");
+    return TILE_PRODUCE_TABLES[method].rows[desiredTile].produceTiles[originalTile];
 }
 
 int TerrainModifier::_toTileIndex(const Point2d& location) const
@@ -168,71 +329,274 @@ int TerrainModifier::_toTileIndex(const Point2d& location) const
     return location.y * mTerrain->getDimension().x + location.x;
 }
 
+void TerrainModifier::_markTileDirty(const Point2d& location)
+{
+    _markRectDirty(Rectd::makeRect(location, Size2d(1, 1)));
+}
+
+void TerrainModifier::_markRectDirty(const Rectd& rect)
+{
+    if (mIsDirty) {
+        mDirtyRect = Rectd::compound(mDirtyRect, rect);
+    }
+    else {
+        mDirtyRect = rect;
+        mIsDirty = true;
+    }
+}
+
+void TerrainModifier::_finishOperation()
+{
+    if (!mIsEditing)
+        mJournal.commit(mTilesData);
+}
+
 int TerrainModifier::_getProducetile(ETileType desiredtile, int desiredLevel, ETileType originalTile, int originalLevel,
-    int method)
+    int method) const
 {
     if (method == 0) {
         if (desiredLevel > originalLevel)
             // Higher tile override lower tile.
             return desiredtile;
         else
-            return mHighteningTileProduceTable[desiredtile][originalTile];
+            return _getTableProduceTile(0, desiredtile, originalTile);
     }
     else if (method == 1) {
         if (desiredLevel < originalLevel) 
             // Lower tile overrides higher tile.
             return desiredtile;
         else 
-            return mLoweringTileProduceTable[desiredtile][originalTile];
+            return _getTableProduceTile(1, desiredtile, originalTile);
     }
     
     // Should never get here.
     return 0;
 }
 
-void TerrainModifier::_modifyTilesRecursively(const Point2d& location, unsigned char extendDirections, ETileType desiredTile, 
-    int altitudeLevel, int method)
+int TerrainModifier::_getElevationLevel(const TileStore& tiles, int tileIndex, int method)
 {
-    const int tileIndex = _toTileIndex(location);
+    // Lowering walks the upper edges of slopes.
+    const int level = tiles.getLevel(tileIndex);
+    return (method == 1 && tiles.getType(tileIndex) != ETileType::Flat) ? level + 1 : level;
+}
 
-    if (method == 0) {
-        // If we are hightening the ground, stop if altitude is lower than the original altitude in
-        // this tile.
-        if (altitudeLevel < mTilesData[tileIndex].level)
-            return;
+void TerrainModifier::_setElevationTile(ElevationWindow* window, int tileIndex, ETileType type, int altitudeLevel, int method)
+{
+    if (window->journal)
+        window->journal->recordTile(tileIndex, window->tiles->getPackedTile(tileIndex));
+
+    window->tiles->setType(tileIndex, type);
+    window->tiles->setLevel(tileIndex, (method == 1 && type != ETileType::Flat) ? altitudeLevel - 1 : altitudeLevel);
+}
+
+Rectd TerrainModifier::_modifyGround(const std::vector<PendingTile>& seeds, int method)
+{
+    ElevationWindow window = { &mTilesData, Rectd::makeRect(Point2d::ZERO(), mTerrain->getDimension()), &mJournal, false };
+
+    const Rectd modifiedRect = _modifyTiles(seeds, method, &window);
+    _markRectDirty(modifiedRect);
+    _finishOperation();
+    return modifiedRect;
+}
+
+Rectd TerrainModifier::_modifyArea(const TerrainBrush& brush, int method)
+{
+    if (brush.isEmpty())
+        return Rectd::makeRect(Point2d::ZERO(), Size2d(0, 0));
+
+    std::vector<Point2d> locations;
+    brush.getTiles(mTerrain->getDimension(), &locations);
+
+    // Every brushed tile is a seed one level above or below its level before the operation.
+    std::vector<PendingTile> seeds;
+    seeds.reserve(locations.size());
+    for (const Point2d& location : locations) {
+        const int tileIndex = _toTileIndex(location);
+        const int level = (method == 0) ? mTilesData.getLevel(tileIndex) + 1 : _getElevationLevel(mTilesData, tileIndex, 1) - 1;
+        if (_isStorableLevel(level))
+            seeds.push_back({ location, 1 | 2 | 4 | 8, ETileType::Flat, level });
     }
-    else if (method == 1) {
-        // If we are lowering the ground, stop if altitude is higher than the original altitude
-        // in this tile.
-        if (altitudeLevel > mTilesData[tileIndex].level)
-            return;
+
+    if (seeds.empty())
+        return Rectd::makeRect(brush.getBounds().getMin(), Size2d(0, 0));
+
+    Rectd modifiedRect;
+    if (!_modifyClustersInParallel(seeds, method, &modifiedRect))
+        return _modifyGround(seeds, method);
+
+    _markRectDirty(modifiedRect);
+    _finishOperation();
+    return modifiedRect;
+}
+
+bool TerrainModifier::_modifyClustersInParallel(const std::vector<PendingTile>& seeds, int method, Rectd* modifiedRect)
+{
+    const Size2d& dimension = mTerrain->getDimension();
+    const Rectd terrainRect = Rectd::makeRect(Point2d::ZERO(), dimension);
+
+    // Join the cells of the seeds with their 8 neighbor cells.
+    const Size2d cellsDimension((dimension.x + CLUSTER_CELL_SIZE - 1) / CLUSTER_CELL_SIZE,
+        (dimension.y + CLUSTER_CELL_SIZE - 1) / CLUSTER_CELL_SIZE);
+    std::vector<int> cellParents(cellsDimension.x * cellsDimension.y, -1);
+
+    auto findRoot = [&cellParents](int cell) {
+        while (cellParents[cell] != cell) {
+            cellParents[cell] = cellParents[cellParents[cell]];
+            cell = cellParents[cell];
+        }
+        return cell;
+    };
+
+    for (const PendingTile& seed : seeds) {
+        const int cell = (seed.location.y / CLUSTER_CELL_SIZE) * cellsDimension.x + seed.location.x / CLUSTER_CELL_SIZE;
+        cellParents[cell] = cell;
     }
 
-    int produceTile = _getProducetile(desiredTile, altitudeLevel, mTilesData[tileIndex].type, mTilesData[tileIndex].level, method);
-    if (produceTile == -1) {
-        // If the produce of this two tile types is undefined, then highten/lower this tile as well.
-        produceTile = 0;
-        extendDirections = 1 | 2 | 4 | 8;
-        altitudeLevel = (method == 0) ? altitudeLevel + 1 : altitudeLevel - 1;
+    for (int y = 0; y < cellsDimension.y; ++y) {
+        for (int x = 0; x < cellsDimension.x; ++x) {
+            const int cell = y * cellsDimension.x + x;
+            if (cellParents[cell] < 0)
+                continue;
+
+            // Neighbors at the west, north west, north and north east.
+            static const Point2d neighborDeltas[] = { {-1, 0}, {-1, -1}, {0, -1}, {1, -1} };
+            for (const Point2d& delta : neighborDeltas) {
+                const Point2d neighbor(x + delta.x, y + delta.y);
+                if (neighbor.x < 0 || neighbor.x >= cellsDimension.x || neighbor.y < 0)
+                    continue;
+
+                const int neighborCell = neighbor.y * cellsDimension.x + neighbor.x;
+                if (cellParents[neighborCell] >= 0)
+                    cellParents[findRoot(cell)] = findRoot(neighborCell);
+            }
+        }
+    }
+
+    // Bounding rectangle of the seeds in each group of cells.
+    std::vector<int> cellClusters(cellParents.size(), -1);
+    std::vector<Rectd> clusterRects;
+    for (const PendingTile& seed : seeds) {
+        int& cluster = cellClusters[findRoot((seed.location.y / CLUSTER_CELL_SIZE) * cellsDimension.x + seed.location.x / CLUSTER_CELL_SIZE)];
+        const Rectd seedRect = Rectd::makeRect(seed.location, Size2d(1, 1));
+        if (cluster < 0) {
+            cluster = (int)clusterRects.size();
+            clusterRects.push_back(seedRect);
+        }
+        else {
+            clusterRects[cluster] = Rectd::compound(clusterRects[cluster], seedRect);
+        }
     }
 
-    // Update the tiles data and altitude level data.
-    mTilesData[tileIndex].type = (ETileType)produceTile;
-    mTilesData[tileIndex].level = altitudeLevel;
+    // Groups whose windows overlap may modify the same tiles, so they are merged.
+    auto getWindowRect = [&terrainRect](const Rectd& rect) {
+        const Point2d margin(CLUSTER_WINDOW_MARGIN, CLUSTER_WINDOW_MARGIN);
+        return Rectd::intersection(Rectd(rect.getMin() - margin, rect.getMax() + margin), terrainRect);
+    };
 
-    if (method == 0)
-        // Neighbor altitude decrease in highten method.
-        altitudeLevel--;
-    else if (method == 1) 
-        // Neighbor altitude increase in lower method.
-        altitudeLevel++;
+    std::vector<int> mergedClusters(clusterRects.size());
+    for (size_t i = 0; i < mergedClusters.size(); ++i)
+        mergedClusters[i] = (int)i;
 
+    for (bool isMerged = true; isMerged;) {
+        isMerged = false;
+        for (size_t i = 0; i < clusterRects.size(); ++i) {
+            for (size_t j = i + 1; j < clusterRects.size(); ++j) {
+                if (mergedClusters[i] != (int)i || mergedClusters[j] != (int)j ||
+                    !Rectd::isOverlapped(getWindowRect(clusterRects[i]), getWindowRect(clusterRects[j])))
+                    continue;
+
+                clusterRects[i] = Rectd::compound(clusterRects[i], clusterRects[j]);
+                for (int& merged : mergedClusters) {
+                    if (merged == (int)j)
+                        merged = (int)i;
+                }
+                isMerged = true;
+            }
+        }
+    }
+
+    std::vector<ElevationCluster> clusters;
+    std::vector<int> clusterIndices(clusterRects.size(), -1);
+    for (size_t i = 0; i < clusterRects.size(); ++i) {
+        if (mergedClusters[i] == (int)i) {
+            clusterIndices[i] = (int)clusters.size();
+            clusters.push_back(ElevationCluster());
+            clusters.back().rect = clusterRects[i];
+        }
+    }
+
+    if (clusters.size() < 2)
+        return false;
+
+    // Seeds are gathered in their order.
+    for (const PendingTile& seed : seeds) {
+        const int cluster = cellClusters[findRoot((seed.location.y / CLUSTER_CELL_SIZE) * cellsDimension.x + seed.location.x / CLUSTER_CELL_SIZE)];
+        clusters[clusterIndices[mergedClusters[cluster]]].seeds.push_back(seed);
+    }
+
+    // Copy the tiles of each cluster's window.
+    for (ElevationCluster& cluster : clusters) {
+        const Rectd windowRect = getWindowRect(cluster.rect);
+        cluster.tiles.resize(windowRect.getSize());
+        for (int y = windowRect.getTop(); y < windowRect.getBottom(); ++y) {
+            for (int x = windowRect.getLeft(); x < windowRect.getRight(); ++x) {
+                cluster.tiles.setPackedTile((y - windowRect.getTop()) * windowRect.getWidth() + x - windowRect.getLeft(),
+                    mTilesData.getPackedTile(y * dimension.x + x));
+            }
+        }
+        cluster.window = { &cluster.tiles, windowRect, nullptr, false };
+    }
+
+    // Modify the windows on worker threads. Windows don't overlap, and a window which would be
+    // left by the elevation logic is marked as overflowed.
+    std::atomic<size_t> nextCluster(0);
+    auto modifyClusters = [this, &clusters, &nextCluster, method]() {
+        for (size_t i = nextCluster++; i < clusters.size(); i = nextCluster++)
+            clusters[i].modifiedRect = _modifyTiles(clusters[i].seeds, method, &clusters[i].window);
+    };
+
+    const size_t threadsCount = Math::min<size_t>(Math::max<size_t>(std::thread::hardware_concurrency(), 1), clusters.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadsCount; ++i)
+        threads.push_back(std::thread(modifyClusters));
+    modifyClusters();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    for (const ElevationCluster& cluster : clusters) {
+        if (cluster.window.isOverflowed)
+            return false;
+    }
+
+    // Copy the modified tiles back.
+    for (size_t i = 0; i < clusters.size(); ++i) {
+        const ElevationCluster& cluster = clusters[i];
+        const Rectd& windowRect = cluster.window.rect;
+        for (int y = cluster.modifiedRect.getTop(); y < cluster.modifiedRect.getBottom(); ++y) {
+            for (int x = cluster.modifiedRect.getLeft(); x < cluster.modifiedRect.getRight(); ++x) {
+                const int tileIndex = y * dimension.x + x;
+                const TileStore::PackedTile tile = cluster.tiles.getPackedTile(
+                    (y - windowRect.getTop()) * windowRect.getWidth() + x - windowRect.getLeft());
+
+                mJournal.recordTile(tileIndex, mTilesData.getPackedTile(tileIndex));
+                mTilesData.setPackedTile(tileIndex, tile);
+            }
+        }
+
+        *modifiedRect = (i == 0) ? cluster.modifiedRect : Rectd::compound(*modifiedRect, cluster.modifiedRect);
+    }
+
+    return true;
+}
+
+Rectd TerrainModifier::_modifyTiles(const std::vector<PendingTile>& seeds, int method, ElevationWindow* window) const
+{
     // Mask values for 8 directions.
     static const int directions[] = { 1, 2, 4, 8, 8 | 1, 1 | 2, 2 | 4, 4 | 8 };
     // Location deltas for 8 directions.
     static const Point2d locationDeltas[] = { {0, 1}, {-1, 0}, {0, -1}, {1, 0}, {1, 1}, {-1, 1}, {-1, -1}, {1, -1} };
     // Neighbor tiles for hightening and lowering method.
-    static ETileType neighborTiles[2][8] =
+    static const ETileType neighborTiles[2][8] =
     {
         // Hightening method
         {
@@ -257,25 +621,78 @@ void TerrainModifier::_modifyTilesRecursively(const Point2d& location, unsigned
             ETileType::WestB
         }
     };
-    
-    // Recursively modify neibghbor tiles at direction 1, 2, 4, 8
-    unsigned char flags = 0;
-    Rectd terrainRect = Rectd::makeRect(Point2d::ZERO(), mTerrain->getDimension());
-    for (int i = 0; i < 4; ++i) {
-        Point2d nextLocation = location + locationDeltas[i];
-        if ((extendDirections & directions[i]) && terrainRect.isPointInside(nextLocation)) {
-            _modifyTilesRecursively(nextLocation, directions[i], neighborTiles[method][i], altitudeLevel, method);
-            flags |= directions[i];
+
+    const Rectd terrainRect = Rectd::makeRect(Point2d::ZERO(), mTerrain->getDimension());
+    const Rectd& windowRect = window->rect;
+    TileStore& tiles = *window->tiles;
+    Rectd modifiedRect = Rectd::makeRect(seeds[0].location, Size2d(1, 1));
+
+    // Seeds are modified in order, so they are pushed in reverse order.
+    std::vector<PendingTile> pendingTiles(seeds.rbegin(), seeds.rend());
+
+    while (!pendingTiles.empty()) {
+        PendingTile tile = pendingTiles.back();
+        pendingTiles.pop_back();
+
+        const int tileIndex = (tile.location.y - windowRect.getTop()) * windowRect.getWidth() + tile.location.x - windowRect.getLeft();
+        const int originalLevel = _getElevationLevel(tiles, tileIndex, method);
+
+        if (method == 0) {
+            // If we are hightening the ground, stop if altitude is lower than the original altitude in
+            // this tile.
+            if (tile.altitudeLevel < originalLevel)
+                continue;
         }
-    }
+        else if (method == 1) {
+            // If we are lowering the ground, stop if altitude is higher than the original altitude
+            // in this tile.
+            if (tile.altitudeLevel > originalLevel)
+                continue;
+        }
+
+        int produceTile = _getProducetile(tile.desiredTile, tile.altitudeLevel, tiles.getType(tileIndex), originalLevel, method);
+        if (produceTile == -1) {
+            // If the produce of this two tile types is undefined, then highten/lower this tile as well.
+            produceTile = 0;
+            tile.extendDirections = 1 | 2 | 4 | 8;
+            tile.altitudeLevel = (method == 0) ? tile.altitudeLevel + 1 : tile.altitudeLevel - 1;
+        }
+
+        // Update the tiles data and altitude level data.
+        _setElevationTile(window, tileIndex, (ETileType)produceTile, tile.altitudeLevel, method);
+        modifiedRect = Rectd::compound(modifiedRect, Rectd::makeRect(tile.location, Size2d(1, 1)));
+
+        // Neighbor altitude decrease in highten method, and increase in lower method.
+        const int neighborLevel = (method == 0) ? tile.altitudeLevel - 1 : tile.altitudeLevel + 1;
 
-    // Recursively modify neibghbor tiles at corner directions.
-    for (int i = 4; i < 8; ++i) {
-        if ((directions[i] & flags) == directions[i]) {
-            Point2d nextLocation = location + locationDeltas[i];
-            _modifyTilesRecursively(nextLocation, directions[i], neighborTiles[method][i], altitudeLevel, method);
+        // Neighbor tiles at direction 1, 2, 4, 8 are modified first, then the ones at corner
+        // directions. Each neighbor is finished with the tiles it reaches before the next one, so
+        // they are pushed in reverse order.
+        unsigned char flags = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (!(tile.extendDirections & directions[i]))
+                continue;
+
+            const Point2d nextLocation = tile.location + locationDeltas[i];
+            if (windowRect.isPointInside(nextLocation)) {
+                flags |= directions[i];
+            }
+            else if (terrainRect.isPointInside(nextLocation)) {
+                // The tiles reached from here are unknown to the window.
+                window->isOverflowed = true;
+                return modifiedRect;
+            }
+        }
+
+        for (int i = 7; i >= 0; --i) {
+            if ((directions[i] & flags) == directions[i]) {
+                pendingTiles.push_back({ tile.location + locationDeltas[i], (unsigned char)directions[i],
+                    neighborTiles[method][i], neighborLevel });
+            }
         }
     }
-}
 
+    return modifiedRect;
 }
+
+}
\ No newline at end of file
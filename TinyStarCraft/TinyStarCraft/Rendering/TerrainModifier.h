@@ -1,8 +1,16 @@
 #pragma once
 
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
 #include "Utilities/Point2.h"
+#include "Utilities/Rect2.h"
 #include "Utilities/Size2.h"
 #include "Terrain.h"
+#include "TerrainBrush.h"
+#include "TerrainEditJournal.h"
 
 namespace TinyStarCraft
 {
@@ -11,6 +19,10 @@ class Terrain;
 
 /**
   	A helper class to modify terrain geometry.
+@remarks
+    Every operation is recorded as an edit which can be undone and redone. Operations between
+    beginEdit and commitEdit are recorded as one edit. Only the tiles changed by an edit are
+    recorded, see TerrainEditJournal.
  */
 class TerrainModifier
 {
@@ -26,17 +38,56 @@ public:
         Increase a tile's altitude level by 1. 
     @remarks
         This operation will perform a elevation logic algorithm which will change neighbor tiles to
-        generate continuous elevations.
+        generate continuous elevations. Nothing is changed if the level would be out of the range
+        which tiles can store.
+    @return
+        Returns the rectangle of tiles modified by this operation, which is empty if nothing is
+        changed.
      */
-    void hightenGround(const Point2d& location);
+    Rectd hightenGround(const Point2d& location);
 
     /**
       	Decrease a tile's altitude level by 1.
     @remarks
         This operation will perform a elevation logic algorithm which will change neighbor tiles to
-        generate continuous elevations.
+        generate continuous elevations. Nothing is changed if the level would be out of the range
+        which tiles can store.
+        The elevation logic lowers the upper edges of slopes, so a non-flat tile is treated as one
+        level higher than its stored level: lowering it makes it flat at its stored level.
+    @return
+        Returns the rectangle of tiles modified by this operation, which is empty if nothing is
+        changed.
      */
-    void lowerGround(const Point2d& location);
+    Rectd lowerGround(const Point2d& location);
+
+    /**
+      	Increase the altitude level of every tile of a brush by 1.
+    @remarks
+        Every brushed tile is a seed of the elevation logic, flat one level above its level before
+        the operation. Seeds are modified in row-major order, each one with the slopes it makes
+        around it before the next one. A seed which the slopes of an earlier one already raised
+        above its level is left as they made it, and the slopes of a later seed may raise an
+        earlier one further, so brushed tiles end one level higher at least, and higher where the
+        brush covers steep ground. Tiles already at the highest level which tiles can store aren't
+        seeds, and are left unchanged.
+        Parts of the brush far enough apart to be modified independently are modified on multiple
+        threads, and the result is the same as modifying all the seeds in a single walk.
+    @return
+        Returns the rectangle of tiles modified by this operation, which is empty if nothing is
+        changed.
+     */
+    Rectd hightenArea(const TerrainBrush& brush);
+
+    /**
+      	Decrease the altitude level of every tile of a brush by 1.
+    @remarks
+        Brushed tiles are lowered like hightenArea raises them, from the levels the elevation logic
+        of lowerGround sees, which are the upper edges of slopes. Flat tiles already at the lowest
+        level which tiles can store are left unchanged.
+    @see
+        TerrainModifier::hightenArea
+     */
+    Rectd lowerArea(const TerrainBrush& brush);
 
     /**
       	Increase one tile's altitude level by 1.
@@ -50,50 +101,180 @@ public:
 
     /**
         Update the terrain to apply modification.
+    @remarks
+        Only the area modified since the last update is applied to the terrain.
      */
     void updateTerrain();
 
+    /** Start an edit. Operations until commitEdit are undone and redone together. */
+    void beginEdit();
+
+    /** Finish the edit, and apply the area modified since the last update to the terrain. */
+    void commitEdit();
+
+    /** Determine if operations are being recorded in an edit started by beginEdit. */
+    bool isEditing() const { return mIsEditing; }
+
+    /**
+      	Restore the tiles changed by the latest edit, and apply them to the terrain.
+    @return
+        Returns false if there is nothing to undo.
+     */
+    bool undo();
+
+    /**
+      	Apply the latest undone edit again to the tiles and the terrain.
+    @return
+        Returns false if there is nothing to redo.
+     */
+    bool redo();
+
+    bool canUndo() const { return mJournal.canUndo(); }
+
+    bool canRedo() const { return mJournal.canRedo(); }
+
+    /** Get the journal of the recorded edits. */
+    TerrainEditJournal& getJournal() { return mJournal; }
+
+    /**
+      	Get the tile produced when the elevation logic brings a tile type onto a tile of another
+        type at the same level.
+    @param method
+        Set to 0 means this is a hightening operation; Set to 1 means this is a lowering operation.
+    @param desiredTile, originalTile
+        Tile types, or 15 which is no type.
+    @return
+        Returns -1 if the produce is undefined, in which case the tile is raised or lowered as well.
+     */
+    static int getProduceTile(int method, int desiredTile, int originalTile);
+
 private:
+    /** Brushed tiles are grouped by cells of this size to find the parts modified independently. */
+    static const int CLUSTER_CELL_SIZE = 16;
+
+    /**
+      	A part of a brush is modified in a window of tiles around it, which is this many tiles
+        larger than the part. Parts whose windows overlap are modified together.
+     */
+    static const int CLUSTER_WINDOW_MARGIN = 16;
+
+    /** A tile waiting to be modified by the elevation logic. */
+    struct PendingTile
+    {
+        Point2d location;
+        unsigned char extendDirections;     // Directions to expand, see _modifyTiles.
+        ETileType desiredTile;
+        int altitudeLevel;
+    };
+
+    /** Tiles which the elevation logic reads and writes. */
+    struct ElevationWindow
+    {
+        TileStore* tiles;                   // Tiles in the window, in row-major order of the window.
+        Rectd rect;                         // Location of the window in the terrain.
+        TerrainEditJournal* journal;        // Records tiles before they are written, can be null.
+        bool isOverflowed;                  // Set if the elevation logic reached a tile out of the window.
+    };
+
+    /** A part of a brush modified independently in its own window. */
+    struct ElevationCluster
+    {
+        std::vector<PendingTile> seeds;     // Brushed tiles of the part, in row-major order.
+        Rectd rect;                         // Bounding rectangle of the seeds.
+        TileStore tiles;                    // Copy of the tiles in the window.
+        ElevationWindow window;
+        Rectd modifiedRect;
+    };
+
     /** Transform a location to tile index in one dimensional array. */
     int _toTileIndex(const Point2d& location) const;
 
-    /** Initialize the produce tables. */
-    void _initTileProduceTables();
+    /** Extend the dirty area to contain a modified tile. */
+    void _markTileDirty(const Point2d& location);
+
+    /** Extend the dirty area to contain a rectangle of modified tiles. */
+    void _markRectDirty(const Rectd& rect);
+
+    /** Record a tile in the current edit before it's modified. */
+    void _recordTile(int tileIndex) { mJournal.recordTile(tileIndex, mTilesData.getPackedTile(tileIndex)); }
+
+    /** Commit the operation's changes as an edit, unless it's part of an edit started by beginEdit. */
+    void _finishOperation();
 
     /**
         Get a produce tile by giving two tile types and their altitude level.
     @param method
         Set to 0 means this is a hightening operation; Set to 1 means this is a lowering operation.
      */
-    int _getProducetile(ETileType desiredtile, int desiredLevel, ETileType originalTile, int originalLevel, int method);
+    int _getProducetile(ETileType desiredtile, int desiredLevel, ETileType originalTile, int originalLevel, int method) const;
+
+    /** Run the elevation logic on the modifier's tiles and commit the operation. */
+    Rectd _modifyGround(const std::vector<PendingTile>& seeds, int method);
+
+    /** Raise or lower the tiles of a brush and commit the operation. */
+    Rectd _modifyArea(const TerrainBrush& brush, int method);
+
+    /**
+      	Split the seeds into parts whose windows don't overlap, and run the elevation logic of each
+        part on a worker thread.
+    @return
+        Returns false and leaves the tiles unchanged if there are less than 2 parts, or if the
+        elevation logic of a part left its window, in which case the seeds must be modified at once.
+     */
+    bool _modifyClustersInParallel(const std::vector<PendingTile>& seeds, int method, Rectd* modifiedRect);
 
     /**
       	Called in hightenGround/lowerGround functions.
         Perform elevation logic which need expansively modification on neighbor tiles.
-    @param directionMask 
-        Masks to tell the function the expanding directions. Masks are:
-        1 - Positive Y, 2 - Negative X, 4 - Negative Y, 8 - Positive X
-        Near directions combined togeter makes diagnal direction.
+    @remarks
+        Tiles are modified from a worklist in the same depth-first order as a recursive walk, but
+        the pending tiles are kept on the heap instead of the call stack, and only the tiles which
+        are reached are read or written. Seeds are modified in order, each one with the tiles it
+        reaches before the next one.
+        When lowering, a non-flat tile is treated as one level higher than its stored level, which
+        is the upper edge of its slope.
+        Only the window's tiles are touched, so windows which don't overlap can be modified on
+        different threads. The logic stops if it needs a tile of the terrain out of the window.
+    @param seeds
+        Tiles to modify first. Directions to expand are masks of
+        1 - Positive Y, 2 - Negative X, 4 - Negative Y, 8 - Positive X, and near directions
+        combined together make diagonal directions.
     @param method
         Set to 0 means this is a hightening operation; Set to 1 means this is a lowering operation.
+    @return
+        Returns the rectangle of modified tiles.
+     */
+    Rectd _modifyTiles(const std::vector<PendingTile>& seeds, int method, ElevationWindow* window) const;
+
+    /**
+      	Determine if the elevation logic can raise or lower a tile to a level.
+    @remarks
+        The modified tile is flat at the level, and the elevation logic never stores the tiles it
+        reaches beyond it, so only the level itself has to be in the range which tiles can store.
      */
-    void _modifyTilesRecursively(const Point2d& location, unsigned char directionMask, ETileType desiredTile, int altitudeLevel,
-        int method);
+    static bool _isStorableLevel(int level) { return level >= TileStore::MIN_LEVEL && level <= TileStore::MAX_LEVEL; }
+
+    /** Get a tile's altitude level as seen by the elevation logic of a method. */
+    static int _getElevationLevel(const TileStore& tiles, int tileIndex, int method);
+
+    /** Store a tile's type and its altitude level as seen by the elevation logic of a method. */
+    static void _setElevationTile(ElevationWindow* window, int tileIndex, ETileType type, int altitudeLevel, int method);
 
 private:
     Terrain* mTerrain;
     
     // Modifier's data.
     // Modifications are stored in these data arrays. These data will be applied
-    // to terrain when TerrainModifier::updateTerrain is called.
-    std::vector<Tile> mTilesData;
-
-    typedef std::vector<std::vector<int>> ProduceTable;
-    // This two tables defines what type of tile to produce when certain two
-    // types of tile meet. For hightening and lowering method there are two different
-    // rules.
-    ProduceTable mHighteningTileProduceTable;
-    ProduceTable mLoweringTileProduceTable;
+    // to terrain when TerrainModifier::updateTerrain is called, which shares the
+    // modified pages with the terrain.
+    TileStore mTilesData;
+
+    // Area of tiles modified since the last terrain update.
+    Rectd mDirtyRect;
+    bool mIsDirty;
+
+    TerrainEditJournal mJournal;
+    bool mIsEditing;
 };
 
 }
@@ -0,0 +1,103 @@
+#include "Precompiled.h"
+#include "TerrainNormals.h"
+#include "Utilities/Math.h"
+
+namespace TinyStarCraft
+{
+
+//-------------------------------------------------------------------------------------------------
+const std::array<TerrainNormals::ShapeNormals, 15>& TerrainNormals::SHAPE_NORMALS()
+{
+    static const std::array<ShapeNormals, 15> shapeNormals = []() {
+        std::array<ShapeNormals, 15> shapeNormals;
+
+        for (size_t type = 0; type < shapeNormals.size(); ++type) {
+            const TileShape& shape = TileShape::SHAPES()[type];
+            ShapeNormals& normals = shapeNormals[type];
+
+            // Local positions of the vertices, see TileShape.
+            float positions[4][3];
+            for (int i = 0; i < 4; ++i) {
+                positions[i][0] = (i & 2) ? Tile::SIZE * 0.5f : -Tile::SIZE * 0.5f;
+                positions[i][1] = shape.vertexLevels[i] * Tile::HEIGHT_PER_LEVEL;
+                positions[i][2] = (i & 1) ? Tile::SIZE * 0.5f : -Tile::SIZE * 0.5f;
+            }
+
+            for (int i = 0; i < 4; ++i)
+                normals.vertexNormalSums[i] = { 0.0f, 0.0f, 0.0f };
+
+            for (int face = 0; face < 2; ++face) {
+                const int* indices = &shape.indices[face * 3];
+                const float* v0 = positions[indices[0]];
+                const float* v1 = positions[indices[1]];
+                const float* v2 = positions[indices[2]];
+
+                // Normalized cross product of the two edges from v0.
+                const float edge0[3] = { v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2] };
+                const float edge1[3] = { v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2] };
+                Normal normal = {
+                    edge0[1] * edge1[2] - edge0[2] * edge1[1],
+                    edge0[2] * edge1[0] - edge0[0] * edge1[2],
+                    edge0[0] * edge1[1] - edge0[1] * edge1[0]
+                };
+                const float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+                normal = { normal.x / length, normal.y / length, normal.z / length };
+
+                for (int i = 0; i < 3; ++i) {
+                    Normal& sum = normals.vertexNormalSums[indices[i]];
+                    sum = { sum.x + normal.x, sum.y + normal.y, sum.z + normal.z };
+                }
+            }
+        }
+
+        return shapeNormals;
+    }();
+
+    return shapeNormals;
+}
+//-------------------------------------------------------------------------------------------------
+TerrainNormals::Normal TerrainNormals::calcTileVertexNormal(const TileStore& tiles, const Point2d& location, int vertex)
+{
+    const Size2d& dimension = tiles.getDimension();
+
+    // Vertex 0 ~ 3 of a tile lies on its corners (x, y), (x + 1, y), (x, y + 1) and (x + 1, y + 1) 
+    // on the tiles grid.
+    const Point2d corner(location.x + (vertex & 1), location.y + (vertex >> 1));
+
+    // Heights are compared in altitude levels, so connected vertices are found exactly.
+    const int tileIndex = location.y * dimension.x + location.x;
+    const int level = tiles.getLevel(tileIndex) + TileShape::SHAPES()[tiles.getType(tileIndex)].vertexLevels[vertex];
+
+    // Iterate the four tiles sharing the corner.
+    Normal normal = { 0.0f, 0.0f, 0.0f };
+    for (int y = corner.y - 1; y <= corner.y; ++y) {
+        for (int x = corner.x - 1; x <= corner.x; ++x) {
+            if (x < 0 || y < 0 || x >= dimension.x || y >= dimension.y)
+                continue;
+
+            const int neighbor = y * dimension.x + x;
+            const ETileType neighborType = tiles.getType(neighbor);
+            // The neighbor tile's vertex at this corner.
+            const int neighborVertex = (corner.x - x) | ((corner.y - y) << 1);
+
+            if (tiles.getLevel(neighbor) + TileShape::SHAPES()[neighborType].vertexLevels[neighborVertex] != level)
+                continue;
+
+            const Normal& sum = SHAPE_NORMALS()[neighborType].vertexNormalSums[neighborVertex];
+            normal = { normal.x + sum.x, normal.y + sum.y, normal.z + sum.z };
+        }
+    }
+
+    // The vertex's own faces are always accumulated, so the normal is never zero.
+    const float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+    return { normal.x / length, normal.y / length, normal.z / length };
+}
+//-------------------------------------------------------------------------------------------------
+uint32_t TerrainNormals::packNormal(const Normal& normal)
+{
+    // Map each component in [-1, 1] to the nearest byte in [0, 255].
+    auto packComponent = [](float value) { return (uint32_t)Math::clamp(std::floor(value * 127.5f + 127.5f + 0.5f), 0.0f, 255.0f); };
+    return 0xff000000 | (packComponent(normal.x) << 16) | (packComponent(normal.y) << 8) | packComponent(normal.z);
+}
+
+}
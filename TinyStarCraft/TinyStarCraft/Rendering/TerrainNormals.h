@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Tile.h"
+#include "Utilities/Point2.h"
+
+namespace TinyStarCraft
+{
+
+/**
+  	Smooth vertex normals of terrain tiles, derived from the tile shape tables.
+@remarks
+    Face normals of the 15 tile shapes are constants, so a vertex normal only depends on the 4 tiles
+    sharing its corner, and any area of tiles can be recomputed alone. Only standard C++ is used,
+    so normals can be generated and tested without D3DX.
+ */
+class TerrainNormals
+{
+public:
+    /** A normal vector. */
+    struct Normal
+    {
+        float x, y, z;
+    };
+
+public:
+    /**
+      	Calculate the smooth normal of one of a tile's vertices.
+    @remarks
+        Normals of the faces sharing the vertex position are averaged. Faces of the neighbor tiles
+        whose vertex at the corner is at a different height, e.g. at the edge of a cliff, are not
+        connected to the vertex.
+     */
+    static Normal calcTileVertexNormal(const TileStore& tiles, const Point2d& location, int vertex);
+
+    /**
+      	Pack a normal into 0xffRRGGBB as normal * 0.5 + 0.5, which is the layout of D3DCOLOR.
+    @remarks
+        Each component is rounded to the nearest of the 256 steps the shader decodes as
+        byte / 255 * 2 - 1, so it's off by 1 / 255 at most. 0 has no exact step, and is packed to
+        128 which is decoded as 1 / 255.
+     */
+    static uint32_t packNormal(const Normal& normal);
+
+private:
+    /** Normals of a tile shape. */
+    struct ShapeNormals
+    {
+        Normal vertexNormalSums[4];     // Sum of the normals of the faces using each vertex.
+    };
+
+    /** Normals of the 15 tile shapes. */
+    static const std::array<ShapeNormals, 15>& SHAPE_NORMALS();
+};
+
+}
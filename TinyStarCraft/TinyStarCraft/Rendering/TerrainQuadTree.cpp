@@ -0,0 +1,313 @@
+#include "Precompiled.h"
+#include "TerrainQuadTree.h"
+#include "Camera.h"
+#include "Utilities/Assert.h"
+
+namespace TinyStarCraft
+{
+
+//-------------------------------------------------------------------------------------------------
+void TerrainQuadTree::RayPacket::setRay(int i, const Ray& ray, float t)
+{
+    originX[i] = ray.getOrigin().x;
+    originY[i] = ray.getOrigin().y;
+    originZ[i] = ray.getOrigin().z;
+
+    // Use a huge value instead of infinity for axis-parallel rays, so the slab test doesn't 
+    // produce NaN.
+    const D3DXVECTOR3& direction = ray.getDirection();
+    invDirectionX[i] = direction.x != 0.0f ? 1.0f / direction.x : FLT_MAX;
+    invDirectionY[i] = direction.y != 0.0f ? 1.0f / direction.y : FLT_MAX;
+    invDirectionZ[i] = direction.z != 0.0f ? 1.0f / direction.z : FLT_MAX;
+
+    tMax[i] = t;
+}
+//-------------------------------------------------------------------------------------------------
+TerrainQuadTree::TerrainQuadTree()
+{
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainQuadTree::create(const Size2d& leafDimension)
+{
+    // Calculate grid dimensions from the leaves up to the root, each level halves its child level.
+    std::vector<Size2d> dimensions;
+    dimensions.push_back(leafDimension);
+    while (dimensions.back().x > 1 || dimensions.back().y > 1) {
+        const Size2d& childDimension = dimensions.back();
+        dimensions.push_back(Size2d((childDimension.x + 1) / 2, (childDimension.y + 1) / 2));
+    }
+
+    TINYSC_ASSERT(dimensions.size() <= MAX_DEPTH + 1, "Quad tree is too deep.");
+
+    // Lay out levels from the root. Each node of a level owns a group of four children in the next 
+    // level, including padding children which are outside of the grid.
+    mLevels.resize(dimensions.size());
+    int nodesCount = 0;
+    for (size_t level = 0; level < mLevels.size(); ++level) {
+        mLevels[level].offset = nodesCount;
+        mLevels[level].dimension = dimensions[dimensions.size() - 1 - level];
+
+        if (level == 0) {
+            nodesCount += 1;
+        }
+        else {
+            const Size2d& parentDimension = mLevels[level - 1].dimension;
+            nodesCount += parentDimension.x * parentDimension.y * 4;
+        }
+    }
+
+    mMinX.resize(nodesCount);
+    mMinY.resize(nodesCount);
+    mMinZ.resize(nodesCount);
+    mMaxX.resize(nodesCount);
+    mMaxY.resize(nodesCount);
+    mMaxZ.resize(nodesCount);
+
+    for (int i = 0; i < nodesCount; ++i)
+        _clearAABB(i);
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainQuadTree::setLeafAABB(const Point2d& location, const AABB& aabb)
+{
+    const int node = _getNodeIndex(getDepth(), location);
+    mMinX[node] = aabb.getMin().x;
+    mMinY[node] = aabb.getMin().y;
+    mMinZ[node] = aabb.getMin().z;
+    mMaxX[node] = aabb.getMax().x;
+    mMaxY[node] = aabb.getMax().y;
+    mMaxZ[node] = aabb.getMax().z;
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainQuadTree::clearLeafAABB(const Point2d& location)
+{
+    _clearAABB(_getNodeIndex(getDepth(), location));
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainQuadTree::saveAABBs(float* data) const
+{
+    const std::vector<float>* arrays[6] = { &mMinX, &mMinY, &mMinZ, &mMaxX, &mMaxY, &mMaxZ };
+    for (int i = 0; i < 6; ++i)
+        std::copy(arrays[i]->begin(), arrays[i]->end(), data + i * getNodesCount());
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainQuadTree::loadAABBs(const float* data)
+{
+    std::vector<float>* arrays[6] = { &mMinX, &mMinY, &mMinZ, &mMaxX, &mMaxY, &mMaxZ };
+    const size_t nodesCount = getNodesCount();
+    for (int i = 0; i < 6; ++i)
+        arrays[i]->assign(data + i * nodesCount, data + (i + 1) * nodesCount);
+}
+//-------------------------------------------------------------------------------------------------
+AABB TerrainQuadTree::getAABB(int level, const Point2d& location) const
+{
+    const int node = _getNodeIndex(level, location);
+    return AABB(D3DXVECTOR3(mMinX[node], mMinY[node], mMinZ[node]), D3DXVECTOR3(mMaxX[node], mMaxY[node], mMaxZ[node]));
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainQuadTree::refit(const Rectd& leafRect)
+{
+    Rectd rect = leafRect;
+    for (int level = getDepth() - 1; level >= 0; --level) {
+        // Parents of the nodes in the rectangle.
+        rect = Rectd(rect.getMin() / 2, (rect.getMax() + Point2d(1, 1)) / 2);
+
+        for (int y = rect.getTop(); y < rect.getBottom(); ++y) {
+            for (int x = rect.getLeft(); x < rect.getRight(); ++x) {
+                const Point2d location(x, y);
+                const int node = _getNodeIndex(level, location);
+                const int firstChild = _getFirstChildIndex(level, location);
+
+                // Compound AABB of the four children. Empty AABBs of padding children don't 
+                // contribute to it.
+                float minX = mMinX[firstChild], minY = mMinY[firstChild], minZ = mMinZ[firstChild];
+                float maxX = mMaxX[firstChild], maxY = mMaxY[firstChild], maxZ = mMaxZ[firstChild];
+                for (int child = firstChild + 1; child < firstChild + 4; ++child) {
+                    minX = Math::min<float>(minX, mMinX[child]);
+                    minY = Math::min<float>(minY, mMinY[child]);
+                    minZ = Math::min<float>(minZ, mMinZ[child]);
+                    maxX = Math::max<float>(maxX, mMaxX[child]);
+                    maxY = Math::max<float>(maxY, mMaxY[child]);
+                    maxZ = Math::max<float>(maxZ, mMaxZ[child]);
+                }
+
+                mMinX[node] = minX;
+                mMinY[node] = minY;
+                mMinZ[node] = minZ;
+                mMaxX[node] = maxX;
+                mMaxY[node] = maxY;
+                mMaxZ[node] = maxZ;
+            }
+        }
+    }
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainQuadTree::gatherVisibleNodes(const ViewFrustum& viewFrustum, int level, std::vector<int>* nodes) const
+{
+    if (mLevels.empty())
+        return;
+
+    // Only visible nodes are pushed to the stack. The root is tested alone, other nodes are tested
+    // together with their siblings when their parent is popped.
+    const int rootCullingResult = viewFrustum.hasIntersection(getAABB(0, Point2d::ZERO()));
+    if (rootCullingResult == ViewFrustum::AABB_OUTSIDE)
+        return;
+
+    StackEntry stack[MAX_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, Point2d::ZERO(), rootCullingResult == ViewFrustum::AABB_INSIDE };
+
+    while (stackSize > 0) {
+        const StackEntry entry = stack[--stackSize];
+
+        if (entry.level == level) {
+            nodes->push_back(entry.location.y * mLevels[level].dimension.x + entry.location.x);
+            continue;
+        }
+
+        const int firstChild = _getFirstChildIndex(entry.level, entry.location);
+        int cullingResults[4];
+
+        if (entry.isInsideFrustum) {
+            // If parent is completely inside the frustum, so are its children. Only empty children,
+            // including padding children outside of the grid, need to be culled.
+            for (int i = 0; i < 4; ++i)
+                cullingResults[i] = _isEmpty(firstChild + i) ? ViewFrustum::AABB_OUTSIDE : ViewFrustum::AABB_INSIDE;
+        }
+        else {
+            // Perform Frustum-AABB intersection test on the four children at once.
+            viewFrustum.hasIntersection4(&mMinX[firstChild], &mMinY[firstChild], &mMinZ[firstChild],
+                &mMaxX[firstChild], &mMaxY[firstChild], &mMaxZ[firstChild], cullingResults);
+        }
+
+        // Push visible children in reversed order so they are popped in order. If a child is 
+        // completely outside of the frustum, then there is no need to check its children.
+        for (int i = 3; i >= 0; --i) {
+            if (cullingResults[i] == ViewFrustum::AABB_OUTSIDE)
+                continue;
+
+            const Point2d childLocation(entry.location.x * 2 + (i & 1), entry.location.y * 2 + (i >> 1));
+            stack[stackSize++] = { entry.level + 1, childLocation, cullingResults[i] == ViewFrustum::AABB_INSIDE };
+        }
+    }
+}
+//-------------------------------------------------------------------------------------------------
+int TerrainQuadTree::_intersectRayPacket(const RayPacket& packet, int node) const
+{
+    if (_isEmpty(node))
+        // Slab test below doesn't reject inverted boxes.
+        return 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+    // Slab test on 4 rays at once. Each ray is clipped to [0, tMax].
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(mMinX[node]), _mm_loadu_ps(packet.originX)), _mm_loadu_ps(packet.invDirectionX));
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(mMaxX[node]), _mm_loadu_ps(packet.originX)), _mm_loadu_ps(packet.invDirectionX));
+    __m128 tNear = _mm_max_ps(_mm_setzero_ps(), _mm_min_ps(t0, t1));
+    __m128 tFar = _mm_min_ps(_mm_loadu_ps(packet.tMax), _mm_max_ps(t0, t1));
+
+    t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(mMinY[node]), _mm_loadu_ps(packet.originY)), _mm_loadu_ps(packet.invDirectionY));
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(mMaxY[node]), _mm_loadu_ps(packet.originY)), _mm_loadu_ps(packet.invDirectionY));
+    tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+    tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+
+    t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(mMinZ[node]), _mm_loadu_ps(packet.originZ)), _mm_loadu_ps(packet.invDirectionZ));
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(mMaxZ[node]), _mm_loadu_ps(packet.originZ)), _mm_loadu_ps(packet.invDirectionZ));
+    tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+    tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+
+    return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+#else
+    const float* mins[3] = { &mMinX[node], &mMinY[node], &mMinZ[node] };
+    const float* maxs[3] = { &mMaxX[node], &mMaxY[node], &mMaxZ[node] };
+    const float* origins[3] = { packet.originX, packet.originY, packet.originZ };
+    const float* invDirections[3] = { packet.invDirectionX, packet.invDirectionY, packet.invDirectionZ };
+
+    int mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        float tNear = 0.0f, tFar = packet.tMax[i];
+        for (int axis = 0; axis < 3; ++axis) {
+            const float t0 = (*mins[axis] - origins[axis][i]) * invDirections[axis][i];
+            const float t1 = (*maxs[axis] - origins[axis][i]) * invDirections[axis][i];
+            tNear = Math::max<float>(tNear, Math::min<float>(t0, t1));
+            tFar = Math::min<float>(tFar, Math::max<float>(t0, t1));
+        }
+
+        if (tNear <= tFar)
+            mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+//-------------------------------------------------------------------------------------------------
+int TerrainQuadTree::_intersectSiblings(const float origin[3], const float invDirection[3], int firstSibling) const
+{
+    // Like Ray::intersectAABB, the whole line of the ray is tested.
+#if defined(_M_IX86) || defined(_M_X64)
+    const __m128 minX = _mm_loadu_ps(&mMinX[firstSibling]), maxX = _mm_loadu_ps(&mMaxX[firstSibling]);
+    const __m128 minY = _mm_loadu_ps(&mMinY[firstSibling]), maxY = _mm_loadu_ps(&mMaxY[firstSibling]);
+    const __m128 minZ = _mm_loadu_ps(&mMinZ[firstSibling]), maxZ = _mm_loadu_ps(&mMaxZ[firstSibling]);
+
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(minX, _mm_set1_ps(origin[0])), _mm_set1_ps(invDirection[0]));
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(maxX, _mm_set1_ps(origin[0])), _mm_set1_ps(invDirection[0]));
+    __m128 tNear = _mm_min_ps(t0, t1);
+    __m128 tFar = _mm_max_ps(t0, t1);
+
+    t0 = _mm_mul_ps(_mm_sub_ps(minY, _mm_set1_ps(origin[1])), _mm_set1_ps(invDirection[1]));
+    t1 = _mm_mul_ps(_mm_sub_ps(maxY, _mm_set1_ps(origin[1])), _mm_set1_ps(invDirection[1]));
+    tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+    tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+
+    t0 = _mm_mul_ps(_mm_sub_ps(minZ, _mm_set1_ps(origin[2])), _mm_set1_ps(invDirection[2]));
+    t1 = _mm_mul_ps(_mm_sub_ps(maxZ, _mm_set1_ps(origin[2])), _mm_set1_ps(invDirection[2]));
+    tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+    tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+
+    // Slab test doesn't reject inverted boxes, mask out the empty ones.
+    const __m128 isEmpty = _mm_cmpgt_ps(minX, maxX);
+    return _mm_movemask_ps(_mm_andnot_ps(isEmpty, _mm_cmple_ps(tNear, tFar)));
+#else
+    const float* mins[3] = { &mMinX[firstSibling], &mMinY[firstSibling], &mMinZ[firstSibling] };
+    const float* maxs[3] = { &mMaxX[firstSibling], &mMaxY[firstSibling], &mMaxZ[firstSibling] };
+
+    int mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (_isEmpty(firstSibling + i))
+            continue;
+
+        float tNear = -FLT_MAX, tFar = FLT_MAX;
+        for (int axis = 0; axis < 3; ++axis) {
+            const float t0 = (mins[axis][i] - origin[axis]) * invDirection[axis];
+            const float t1 = (maxs[axis][i] - origin[axis]) * invDirection[axis];
+            tNear = Math::max<float>(tNear, Math::min<float>(t0, t1));
+            tFar = Math::min<float>(tFar, Math::max<float>(t0, t1));
+        }
+
+        if (tNear <= tFar)
+            mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+//-------------------------------------------------------------------------------------------------
+int TerrainQuadTree::_getNodeIndex(int level, const Point2d& location) const
+{
+    if (level == 0)
+        return 0;
+
+    // Find the sibling group by the parent's location, then the node's position in the group.
+    const Size2d& parentDimension = mLevels[level - 1].dimension;
+    const int group = (location.y >> 1) * parentDimension.x + (location.x >> 1);
+    return mLevels[level].offset + group * 4 + ((location.y & 1) << 1 | (location.x & 1));
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainQuadTree::_clearAABB(int node)
+{
+    // Use an inverted box, so it is outside of any frustum and it doesn't change any compound AABB.
+    mMinX[node] = FLT_MAX;
+    mMinY[node] = FLT_MAX;
+    mMinZ[node] = FLT_MAX;
+    mMaxX[node] = -FLT_MAX;
+    mMaxY[node] = -FLT_MAX;
+    mMaxZ[node] = -FLT_MAX;
+}
+
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "Utilities/AABB.h"
+#include "Utilities/Rect2.h"
+#include "Utilities/Ray.h"
+#include "Utilities/Size2.h"
+
+namespace TinyStarCraft
+{
+
+class ViewFrustum;
+
+/**
+  	A pointer-free quad tree over a grid of leaves.
+@remarks
+    Nodes are stored level by level from the root to the leaves. In each level, the four children
+    of a node are stored contiguously, and these sibling groups are ordered as their parents are
+    in the parent level's grid. So children are addressed by index arithmetic only and no pointer
+    is stored in the tree.
+    AABBs are stored in separate min/max arrays for each axis. A node without anything inside,
+    e.g. a padding node outside the grid, has an empty AABB which is always culled.
+ */
+class TerrainQuadTree
+{
+public:
+    /** Maximum number of levels below the root. */
+    static const int MAX_DEPTH = 16;
+
+    /** A packet of 4 rays in SoA layout. */
+    struct RayPacket
+    {
+        float originX[4], originY[4], originZ[4];
+        float invDirectionX[4], invDirectionY[4], invDirectionZ[4];
+        float tMax[4];  // Each ray is clipped to [0, tMax], shrink it to cull farther nodes.
+
+        /** Set one of the rays in the packet. */
+        void setRay(int i, const Ray& ray, float t);
+    };
+
+public:
+    /** Constructor */
+    TerrainQuadTree();
+
+    /**
+      	Create the tree topology for a grid of leaves.
+        All AABBs are initialized to empty.
+     */
+    void create(const Size2d& leafDimension);
+
+    /** Get the level of the leaves. The root is at level 0. */
+    int getDepth() const { return (int)mLevels.size() - 1; }
+
+    /** Get the grid dimension of nodes in one level. */
+    const Size2d& getLevelDimension(int level) const { return mLevels[level].dimension; }
+
+    /** Get the number of nodes including padding nodes. */
+    size_t getNodesCount() const { return mMinX.size(); }
+
+    /** Modify a leaf's AABB. Call refit to apply the change to its ancestors. */
+    void setLeafAABB(const Point2d& location, const AABB& aabb);
+
+    /** Make a leaf's AABB empty, so it will never be visible or hit by rays. */
+    void clearLeafAABB(const Point2d& location);
+
+    /**
+      	Copy all nodes' AABBs to a buffer of getNodesCount() * 6 floats.
+        They are written as min x, y, z and max x, y, z arrays.
+     */
+    void saveAABBs(float* data) const;
+
+    /** Load all nodes' AABBs from a buffer written by saveAABBs on a tree of the same topology. */
+    void loadAABBs(const float* data);
+
+    /** Get a node's AABB. */
+    AABB getAABB(int level, const Point2d& location) const;
+
+    /**
+      	Recompute compound AABBs of all ancestors of the leaves inside a rectangle.
+     */
+    void refit(const Rectd& leafRect);
+
+    /**
+      	Gather the nodes in a level which are visible in the view frustum.
+    @param nodes
+        Visible nodes' row-major indices in the level's grid are added to this array.
+     */
+    void gatherVisibleNodes(const ViewFrustum& viewFrustum, int level, std::vector<int>* nodes) const;
+
+    /**
+      	Traverse the leaves whose AABB has intersection with the ray.
+    @param callback
+        Called with the leaf's row-major index in the leaves grid for each intersected leaf.
+     */
+    template <typename Callback>
+    void raycast(const Ray& ray, Callback callback) const;
+
+    /**
+      	Traverse the leaves whose AABB has intersection with any ray in the packet.
+    @remarks
+        Children are visited near-first by the direction of the first ray in the packet. The callback
+        may shrink the rays' tMax in the packet, nodes beyond a ray's tMax are culled for it.
+    @param rayMask
+        Bit i is set if ray i in the packet is active.
+    @param callback
+        Called with the leaf's row-major index in the leaves grid and the mask of rays which hit
+        the leaf's AABB.
+     */
+    template <typename Callback>
+    void raycastPacket(RayPacket& packet, int rayMask, Callback callback) const;
+
+private:
+    /** A level of nodes. */
+    struct Level
+    {
+        int offset;         // Index of the first node in this level.
+        Size2d dimension;   // Grid dimension of the actual nodes in this level.
+    };
+
+    /** An entry in the traversal stack. */
+    struct StackEntry
+    {
+        int level;
+        Point2d location;
+        bool isInsideFrustum;
+    };
+
+    /** An entry in the ray traversal stack. */
+    struct RayStackEntry
+    {
+        int level;
+        Point2d location;
+    };
+
+    /** An entry in the ray packet traversal stack. */
+    struct PacketStackEntry
+    {
+        int level;
+        Point2d location;
+        int rayMask;
+    };
+
+    /** Maximum number of entries in a traversal stack. */
+    static const int MAX_STACK_SIZE = MAX_DEPTH * 3 + 1;
+
+    /** Get the index of a node. */
+    int _getNodeIndex(int level, const Point2d& location) const;
+
+    /** Get the index of a node's first child, its four children are stored contiguously. */
+    int _getFirstChildIndex(int level, const Point2d& location) const
+    {
+        return mLevels[level + 1].offset + (location.y * mLevels[level].dimension.x + location.x) * 4;
+    }
+
+    /** Test a node's AABB with the rays in a packet and get the mask of rays which hit it. */
+    int _intersectRayPacket(const RayPacket& packet, int node) const;
+
+    /**
+      	Test the AABBs of four sibling nodes with the line of a ray and get the mask of nodes which
+        are hit. The ray is given by its origin and inverted direction, like in a RayPacket.
+     */
+    int _intersectSiblings(const float origin[3], const float invDirection[3], int firstSibling) const;
+
+    /** Make a node's AABB empty. */
+    void _clearAABB(int node);
+
+    /** Check if a node's AABB is empty. */
+    bool _isEmpty(int node) const { return mMinX[node] > mMaxX[node]; }
+
+private:
+    std::vector<Level> mLevels;
+
+    std::vector<float> mMinX;
+    std::vector<float> mMinY;
+    std::vector<float> mMinZ;
+    std::vector<float> mMaxX;
+    std::vector<float> mMaxY;
+    std::vector<float> mMaxZ;
+};
+
+
+template <typename Callback>
+void TerrainQuadTree::raycast(const Ray& ray, Callback callback) const
+{
+    if (mLevels.empty() || ray.intersectAABB(getAABB(0, Point2d::ZERO())) == false)
+        return;
+
+    RayPacket packet;
+    packet.setRay(0, ray, FLT_MAX);
+    const float origin[3] = { packet.originX[0], packet.originY[0], packet.originZ[0] };
+    const float invDirection[3] = { packet.invDirectionX[0], packet.invDirectionY[0], packet.invDirectionZ[0] };
+
+    // Only nodes hit by the ray are pushed to the stack. The root is tested alone, other nodes are
+    // tested together with their siblings when their parent is popped.
+    RayStackEntry stack[MAX_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, Point2d::ZERO() };
+
+    const int depth = getDepth();
+    while (stackSize > 0) {
+        const RayStackEntry entry = stack[--stackSize];
+
+        if (entry.level == depth) {
+            callback(entry.location.y * mLevels[depth].dimension.x + entry.location.x);
+            continue;
+        }
+
+        // Padding children outside of the grid are empty, so they are never hit. Children are written
+        // unconditionally and only the hit ones are kept, which avoids unpredictable branches.
+        const int hitMask = _intersectSiblings(origin, invDirection, _getFirstChildIndex(entry.level, entry.location));
+        for (int i = 3; i >= 0; --i) {
+            const Point2d childLocation(entry.location.x * 2 + (i & 1), entry.location.y * 2 + (i >> 1));
+            stack[stackSize] = { entry.level + 1, childLocation };
+            stackSize += (hitMask >> i) & 1;
+        }
+    }
+}
+
+template <typename Callback>
+void TerrainQuadTree::raycastPacket(RayPacket& packet, int rayMask, Callback callback) const
+{
+    if (mLevels.empty() || rayMask == 0)
+        return;
+
+    // Grid x goes along world z axis and grid y goes along world x axis. Flip the children order
+    // on an axis if the ray goes to the negative direction on it.
+    int leadingRay = 0;
+    while ((rayMask & (1 << leadingRay)) == 0)
+        ++leadingRay;
+    const int nearChild = (packet.invDirectionZ[leadingRay] < 0.0f ? 1 : 0) | (packet.invDirectionX[leadingRay] < 0.0f ? 2 : 0);
+
+    PacketStackEntry stack[MAX_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, Point2d::ZERO(), rayMask };
+
+    const int depth = getDepth();
+    while (stackSize > 0) {
+        const PacketStackEntry entry = stack[--stackSize];
+
+        // Test when the node is popped, so the rays' tMax shrunk by nearer leaves cull it.
+        const int hitMask = entry.rayMask & _intersectRayPacket(packet, _getNodeIndex(entry.level, entry.location));
+        if (hitMask == 0)
+            continue;
+
+        if (entry.level == depth) {
+            callback(entry.location.y * mLevels[depth].dimension.x + entry.location.x, hitMask);
+            continue;
+        }
+
+        // Push children which are inside the grid, the nearest one is pushed last.
+        const Size2d& childDimension = mLevels[entry.level + 1].dimension;
+        for (int i = 3; i >= 0; --i) {
+            const int child = i ^ nearChild;
+            const Point2d childLocation(entry.location.x * 2 + (child & 1), entry.location.y * 2 + (child >> 1));
+            if (childLocation.x < childDimension.x && childLocation.y < childDimension.y)
+                stack[stackSize++] = { entry.level + 1, childLocation, hitMask };
+        }
+    }
+}
+
+}
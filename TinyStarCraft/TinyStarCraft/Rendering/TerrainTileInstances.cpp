@@ -0,0 +1,54 @@
+#include "Precompiled.h"
+#include "TerrainTileInstances.h"
+#include "TerrainNormals.h"
+
+namespace TinyStarCraft
+{
+
+const int TerrainTileInstances::QUAD_CORNERS[2][4] =
+{
+    { 0, 1, 3, 2 },     // Faces split along the diagonal from corner 0 to 3.
+    { 1, 3, 2, 0 }      // Faces split along the diagonal from corner 1 to 2.
+};
+//-------------------------------------------------------------------------------------------------
+const std::array<int, 15>& TerrainTileInstances::DIAGONALS()
+{
+    static const std::array<int, 15> diagonals = []() {
+        std::array<int, 15> diagonals;
+
+        // The two faces of a shape share the corners on the diagonal.
+        for (size_t type = 0; type < diagonals.size(); ++type) {
+            const int* indices = TileShape::SHAPES()[type].indices;
+            const bool isCorner0Shared = (indices[0] == 0 || indices[1] == 0 || indices[2] == 0) &&
+                (indices[3] == 0 || indices[4] == 0 || indices[5] == 0);
+            diagonals[type] = isCorner0Shared ? 0 : 1;
+        }
+
+        return diagonals;
+    }();
+
+    return diagonals;
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainTileInstances::buildInstances(const TileStore& tiles, const Rectd& rect, Instance* instances)
+{
+    const Size2d& dimension = tiles.getDimension();
+
+    for (int y = rect.getMin().y; y < rect.getMax().y; ++y) {
+        for (int x = rect.getMin().x; x < rect.getMax().x; ++x) {
+            const int tileIndex = y * dimension.x + x;
+
+            instances->tile[0] = (int16_t)y;
+            instances->tile[1] = (int16_t)tiles.getLevel(tileIndex);
+            instances->tile[2] = (int16_t)x;
+            instances->tile[3] = (int16_t)tiles.getType(tileIndex);
+
+            for (int iVert = 0; iVert < 4; ++iVert)
+                instances->normals[iVert] = TerrainNormals::packNormal(TerrainNormals::calcTileVertexNormal(tiles, Point2d(x, y), iVert));
+
+            ++instances;
+        }
+    }
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Tile.h"
+#include "Utilities/Rect2.h"
+
+namespace TinyStarCraft
+{
+
+/**
+  	Instance records to draw terrain tiles with one shared quad.
+@remarks
+    A record only holds the tile's location, altitude level and type, and the shape of the type is
+    looked up by the vertex shader, so a modified tile rewrites a few bytes instead of its vertices
+    and indices. Vertex normals are stored as well, since they depend on the neighbor tiles.
+    Only standard C++ is used, so records can be built and tested without D3DX.
+ */
+class TerrainTileInstances
+{
+public:
+    /** Instance record of a tile. */
+    struct Instance
+    {
+        int16_t tile[4];        // Row, altitude level, column and type of the tile, as (row, level, column, type).
+        uint32_t normals[4];    // Normals of the tile's vertices 0 ~ 3, packed by TerrainNormals::packNormal.
+    };
+
+    /**
+        Corners of a tile in the order of the shared quad's vertices, for each diagonal of the
+        tile's faces. See TileShape for the corners.
+    @remarks
+        The quad is drawn as faces (0, 1, 2) and (0, 2, 3) of its vertices. Walking the corners
+        around the tile from a different one splits the tile along the other diagonal, and the
+        winding of the faces is kept.
+     */
+    static const int QUAD_CORNERS[2][4];
+
+public:
+    /**
+      	Build the records of the tiles in a rectangle.
+    @param instances
+        Receives the records in row-major order of the rectangle.
+     */
+    static void buildInstances(const TileStore& tiles, const Rectd& rect, Instance* instances);
+
+    /** Get which diagonal the faces of a tile type are split along, as the index to QUAD_CORNERS. */
+    static int getDiagonal(ETileType type) { return DIAGONALS()[type]; }
+
+private:
+    /** Diagonals of the 15 tile shapes. */
+    static const std::array<int, 15>& DIAGONALS();
+};
+
+}
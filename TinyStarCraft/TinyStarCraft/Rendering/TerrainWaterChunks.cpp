@@ -0,0 +1,219 @@
+#include "Precompiled.h"
+#include "TerrainWaterChunks.h"
+#include "Camera.h"
+
+namespace TinyStarCraft
+{
+
+//-------------------------------------------------------------------------------------------------
+void TerrainWaterChunks::AABBArrays::clear()
+{
+    minX.clear();
+    minY.clear();
+    minZ.clear();
+    maxX.clear();
+    maxY.clear();
+    maxZ.clear();
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainWaterChunks::AABBArrays::insert(size_t i, const AABB& aabb)
+{
+    minX.insert(minX.begin() + i, aabb.getMin().x);
+    minY.insert(minY.begin() + i, aabb.getMin().y);
+    minZ.insert(minZ.begin() + i, aabb.getMin().z);
+    maxX.insert(maxX.begin() + i, aabb.getMax().x);
+    maxY.insert(maxY.begin() + i, aabb.getMax().y);
+    maxZ.insert(maxZ.begin() + i, aabb.getMax().z);
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainWaterChunks::AABBArrays::erase(size_t i)
+{
+    minX.erase(minX.begin() + i);
+    minY.erase(minY.begin() + i);
+    minZ.erase(minZ.begin() + i);
+    maxX.erase(maxX.begin() + i);
+    maxY.erase(maxY.begin() + i);
+    maxZ.erase(maxZ.begin() + i);
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainWaterChunks::AABBArrays::set(size_t i, const AABB& aabb)
+{
+    minX[i] = aabb.getMin().x;
+    minY[i] = aabb.getMin().y;
+    minZ[i] = aabb.getMin().z;
+    maxX[i] = aabb.getMax().x;
+    maxY[i] = aabb.getMax().y;
+    maxZ[i] = aabb.getMax().z;
+}
+//-------------------------------------------------------------------------------------------------
+AABB TerrainWaterChunks::AABBArrays::get(size_t i) const
+{
+    return AABB(D3DXVECTOR3(minX[i], minY[i], minZ[i]), D3DXVECTOR3(maxX[i], maxY[i], maxZ[i]));
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainWaterChunks::AABBArrays::gatherVisible(const ViewFrustum& viewFrustum, int first, int last,
+    std::vector<int>* visibles) const
+{
+    int cullingResults[4];
+
+    int i = first;
+    for (; i + 4 <= last; i += 4) {
+        viewFrustum.hasIntersection4(&minX[i], &minY[i], &minZ[i], &maxX[i], &maxY[i], &maxZ[i], cullingResults);
+
+        for (int j = 0; j < 4; ++j) {
+            if (cullingResults[j] != ViewFrustum::AABB_OUTSIDE)
+                visibles->push_back(i + j);
+        }
+    }
+
+    // Test the remaining AABBs one by one.
+    for (; i < last; ++i) {
+        if (viewFrustum.hasIntersection(get(i)) != ViewFrustum::AABB_OUTSIDE)
+            visibles->push_back(i);
+    }
+}
+//-------------------------------------------------------------------------------------------------
+TerrainWaterChunks::TerrainWaterChunks()
+    : mTilesCount(0),
+      mFirstRenumberedChunk(SIZE_MAX)
+{
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainWaterChunks::create(const Size2d& chunksDimension)
+{
+    mChunksDimension = chunksDimension;
+    mTilesCount = 0;
+
+    mChunks.clear();
+    mChunkKeys.clear();
+    mChunkAABBs.clear();
+    mRegions.clear();
+    mRegionKeys.clear();
+    mRegionAABBs.clear();
+    mDirtyRegionKeys.clear();
+    mFirstRenumberedChunk = SIZE_MAX;
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainWaterChunks::setChunk(const Point2d& chunkLocation, uint64_t tileMask, const AABB& aabb)
+{
+    const int key = _getSortKey(chunkLocation);
+    const int regionKey = key / (REGION_DIMENSION * REGION_DIMENSION);
+    auto it = std::lower_bound(mChunkKeys.begin(), mChunkKeys.end(), key);
+    const size_t i = it - mChunkKeys.begin();
+    const bool exists = it != mChunkKeys.end() && *it == key;
+
+    if (tileMask == 0) {
+        if (exists) {
+            mChunks.erase(mChunks.begin() + i);
+            mChunkKeys.erase(it);
+            mChunkAABBs.erase(i);
+            _updateRegion(regionKey, i, -1);
+            mFirstRenumberedChunk = std::min(mFirstRenumberedChunk, i);
+        }
+        return;
+    }
+
+    if (!exists) {
+        // Keep the list sorted. When the whole terrain is built in key order, chunks are always
+        // appended.
+        mChunks.insert(mChunks.begin() + i, Chunk());
+        mChunkKeys.insert(it, key);
+        mChunkAABBs.insert(i, aabb);
+    }
+    _updateRegion(regionKey, i, exists ? 0 : 1);
+
+    int tilesCount = 0;
+    for (uint64_t mask = tileMask; mask != 0; mask &= mask - 1)
+        ++tilesCount;
+
+    // Tiles of the following chunks are moved if the chunk's tiles count is modified.
+    if (!exists || mChunks[i].tilesCount != tilesCount)
+        mFirstRenumberedChunk = std::min(mFirstRenumberedChunk, i);
+
+    mChunks[i].index = chunkLocation.y * mChunksDimension.x + chunkLocation.x;
+    mChunks[i].tileMask = tileMask;
+    mChunks[i].tilesCount = tilesCount;
+    mChunkAABBs.set(i, aabb);
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainWaterChunks::refit()
+{
+    std::sort(mDirtyRegionKeys.begin(), mDirtyRegionKeys.end());
+    mDirtyRegionKeys.erase(std::unique(mDirtyRegionKeys.begin(), mDirtyRegionKeys.end()), mDirtyRegionKeys.end());
+
+    for (int regionKey : mDirtyRegionKeys) {
+        auto it = std::lower_bound(mRegionKeys.begin(), mRegionKeys.end(), regionKey);
+        if (it == mRegionKeys.end() || *it != regionKey)
+            // The region's last chunk is removed.
+            continue;
+
+        const size_t region = it - mRegionKeys.begin();
+        AABB aabb = mChunkAABBs.get(mRegions[region].firstChunk);
+        for (int i = mRegions[region].firstChunk + 1; i < mRegions[region].lastChunk; ++i)
+            aabb = AABB::compound(aabb, mChunkAABBs.get(i));
+        mRegionAABBs.set(region, aabb);
+    }
+    mDirtyRegionKeys.clear();
+
+    const size_t firstChunk = getFirstRenumberedChunk();
+    int tilesCount = firstChunk > 0 ? mChunks[firstChunk - 1].firstTile + mChunks[firstChunk - 1].tilesCount : 0;
+    for (size_t i = firstChunk; i < mChunks.size(); ++i) {
+        mChunks[i].firstTile = tilesCount;
+        tilesCount += mChunks[i].tilesCount;
+    }
+    mTilesCount = tilesCount;
+    mFirstRenumberedChunk = SIZE_MAX;
+}
+//-------------------------------------------------------------------------------------------------
+int TerrainWaterChunks::findChunk(const Point2d& chunkLocation) const
+{
+    const int key = _getSortKey(chunkLocation);
+    auto it = std::lower_bound(mChunkKeys.begin(), mChunkKeys.end(), key);
+    return it != mChunkKeys.end() && *it == key ? (int)(it - mChunkKeys.begin()) : -1;
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainWaterChunks::gatherVisibleChunks(const ViewFrustum& viewFrustum, std::vector<int>* chunks) const
+{
+    std::vector<int> visibleRegions;
+    mRegionAABBs.gatherVisible(viewFrustum, 0, (int)mRegions.size(), &visibleRegions);
+
+    for (int region : visibleRegions)
+        mChunkAABBs.gatherVisible(viewFrustum, mRegions[region].firstChunk, mRegions[region].lastChunk, chunks);
+}
+//-------------------------------------------------------------------------------------------------
+int TerrainWaterChunks::_getSortKey(const Point2d& chunkLocation) const
+{
+    const int rowRegionsCount = (mChunksDimension.x + REGION_DIMENSION - 1) / REGION_DIMENSION;
+    const int region = chunkLocation.y / REGION_DIMENSION * rowRegionsCount + chunkLocation.x / REGION_DIMENSION;
+    const int chunkInRegion = chunkLocation.y % REGION_DIMENSION * REGION_DIMENSION + chunkLocation.x % REGION_DIMENSION;
+    return region * REGION_DIMENSION * REGION_DIMENSION + chunkInRegion;
+}
+//-------------------------------------------------------------------------------------------------
+void TerrainWaterChunks::_updateRegion(int regionKey, size_t chunk, int delta)
+{
+    auto it = std::lower_bound(mRegionKeys.begin(), mRegionKeys.end(), regionKey);
+    const size_t region = it - mRegionKeys.begin();
+    if (it == mRegionKeys.end() || *it != regionKey) {
+        // The chunk is the first one of its region, the region's AABB is set by refit.
+        mRegions.insert(mRegions.begin() + region, { (int)chunk, (int)chunk });
+        mRegionKeys.insert(it, regionKey);
+        mRegionAABBs.insert(region, AABB());
+    }
+
+    mRegions[region].lastChunk += delta;
+    for (size_t i = region + 1; i < mRegions.size(); ++i) {
+        mRegions[i].firstChunk += delta;
+        mRegions[i].lastChunk += delta;
+    }
+
+    if (mRegions[region].firstChunk == mRegions[region].lastChunk) {
+        mRegions.erase(mRegions.begin() + region);
+        mRegionKeys.erase(mRegionKeys.begin() + region);
+        mRegionAABBs.erase(region);
+    }
+    else {
+        mDirtyRegionKeys.push_back(regionKey);
+    }
+}
+
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "Utilities/AABB.h"
+#include "Utilities/Point2.h"
+#include "Utilities/Size2.h"
+
+namespace TinyStarCraft
+{
+
+class ViewFrustum;
+
+/**
+  	A sparse list of the terrain chunks which have visible water.
+@remarks
+    Only chunks with at least one visible water tile are stored, each with a mask of its water tiles
+    and the compound AABB of their water surfaces. Chunks are grouped by regions of
+    REGION_DIMENSION * REGION_DIMENSION chunks, and only regions with water are stored as well.
+    Regions are culled before their chunks, so culling water costs in proportion to the amount of
+    water in view, and a terrain without water pays nothing. Modifying chunks only refits their
+    regions.
+    Water tiles are numbered in the order of the chunks, so the tiles of adjacent chunks in the list
+    are contiguous in any per-tile array in that order.
+ */
+class TerrainWaterChunks
+{
+public:
+    /** Number of chunks on each side of a region. */
+    static const int REGION_DIMENSION = 8;
+
+    /** A chunk with visible water. */
+    struct Chunk
+    {
+        int index;          // Row-major index of the chunk in the terrain's chunks grid.
+        uint64_t tileMask;  // Bit i is set if the i-th tile in the chunk in row-major order has visible water.
+        int firstTile;      // Index of the chunk's first water tile in water tiles order, valid after refit.
+        int tilesCount;     // Number of water tiles in the chunk.
+    };
+
+public:
+    /** Constructor */
+    TerrainWaterChunks();
+
+    /** Remove all chunks and set the dimension of the terrain's chunks grid. */
+    void create(const Size2d& chunksDimension);
+
+    /**
+      	Modify a chunk's water tiles. Call refit to apply the change to the regions and number the
+        water tiles.
+    @param tileMask
+        Mask of the chunk's tiles with visible water. The chunk is removed if it's 0.
+    @param aabb
+        Compound AABB of the water surfaces of the tiles in the mask.
+     */
+    void setChunk(const Point2d& chunkLocation, uint64_t tileMask, const AABB& aabb);
+
+    /**
+      	Refit the regions of the modified chunks, and number the water tiles again from the first
+        chunk whose tiles count is modified. Tiles of the chunks before it keep their numbers.
+     */
+    void refit();
+
+    /** Find the position of a chunk in the list, returns -1 if it doesn't have visible water. */
+    int findChunk(const Point2d& chunkLocation) const;
+
+    /**
+      	Get the position of the first chunk whose tiles are numbered again by the next refit. Returns
+        the chunks count if no chunk is added, removed or modified with a different tiles count.
+     */
+    size_t getFirstRenumberedChunk() const { return std::min(mFirstRenumberedChunk, mChunks.size()); }
+
+    /** Get the number of chunks with visible water. */
+    size_t getChunksCount() const { return mChunks.size(); }
+
+    /** Get the number of tiles with visible water. */
+    int getTilesCount() const { return mTilesCount; }
+
+    /** Get a chunk by its position in the list. */
+    const Chunk& getChunk(size_t i) const { return mChunks[i]; }
+
+    /**
+      	Gather the chunks which are visible in the view frustum.
+    @param chunks
+        Positions of the visible chunks in the list are added to this array.
+     */
+    void gatherVisibleChunks(const ViewFrustum& viewFrustum, std::vector<int>* chunks) const;
+
+private:
+    /** AABBs stored in separate min/max arrays for each axis, so they are tested 4 at a time. */
+    struct AABBArrays
+    {
+        std::vector<float> minX, minY, minZ;
+        std::vector<float> maxX, maxY, maxZ;
+
+        void clear();
+        void insert(size_t i, const AABB& aabb);
+        void erase(size_t i);
+        void set(size_t i, const AABB& aabb);
+        AABB get(size_t i) const;
+
+        /** Add the positions of the AABBs in [first, last) which are visible in the view frustum. */
+        void gatherVisible(const ViewFrustum& viewFrustum, int first, int last, std::vector<int>* visibles) const;
+    };
+
+    /** A region with visible water, its chunks are stored contiguously. */
+    struct Region
+    {
+        int firstChunk;
+        int lastChunk;
+    };
+
+    /** Get the key which chunks are sorted by. Chunks in a region have adjacent keys. */
+    int _getSortKey(const Point2d& chunkLocation) const;
+
+    /**
+      	Mark the region of a chunk for refit, after the chunk is added to the list (delta is 1),
+        removed from it (delta is -1) or modified (delta is 0). The region is added or removed as
+        needed, and the chunk ranges of the regions after it are shifted.
+     */
+    void _updateRegion(int regionKey, size_t chunk, int delta);
+
+private:
+    Size2d mChunksDimension;
+    int mTilesCount;
+
+    // Chunks sorted by their keys.
+    std::vector<Chunk> mChunks;
+    std::vector<int> mChunkKeys;
+    AABBArrays mChunkAABBs;
+
+    // Regions sorted by their keys, which are the keys of their chunks divided by the number of
+    // chunks in a region.
+    std::vector<Region> mRegions;
+    std::vector<int> mRegionKeys;
+    AABBArrays mRegionAABBs;
+
+    // Modifications since the last refit.
+    std::vector<int> mDirtyRegionKeys;
+    size_t mFirstRenumberedChunk;
+};
+
+}
@@ -0,0 +1,214 @@
+#include "Precompiled.h"
+#include "Tile.h"
+#include "Utilities/Assert.h"
+#include "Utilities/Math.h"
+
+namespace TinyStarCraft
+{
+
+//-------------------------------------------------------------------------------------------------
+const std::array<TileShape, 15>& TileShape::SHAPES()
+{
+    static const std::array<TileShape, 15> shapes =
+    {
+        {
+            { { 0, 0, 0, 0 }, { 0, 1, 2, 2, 1, 3 } },   // Flat
+            { { 1, 0, 0, 0 }, { 0, 1, 2, 2, 1, 3 } },   // SouthA
+            { { 0, 1, 0, 0 }, { 0, 1, 3, 0, 3, 2 } },   // WestA
+            { { 0, 0, 0, 1 }, { 0, 1, 2, 2, 1, 3 } },   // NorthA
+            { { 0, 0, 1, 0 }, { 0, 1, 3, 0, 3, 2 } },   // EastA
+            { { 1, 1, 0, 0 }, { 0, 1, 2, 2, 1, 3 } },   // SouthWest
+            { { 0, 1, 0, 1 }, { 0, 1, 2, 2, 1, 3 } },   // NorthWest
+            { { 0, 0, 1, 1 }, { 0, 1, 2, 2, 1, 3 } },   // NorthEast
+            { { 1, 0, 1, 0 }, { 0, 1, 2, 2, 1, 3 } },   // SouthEast
+            { { 1, 1, 1, 0 }, { 0, 1, 2, 2, 1, 3 } },   // SouthB
+            { { 1, 1, 0, 1 }, { 0, 1, 3, 0, 3, 2 } },   // WestB
+            { { 0, 1, 1, 1 }, { 0, 1, 2, 2, 1, 3 } },   // NorthB
+            { { 1, 0, 1, 1 }, { 0, 1, 3, 0, 3, 2 } },   // EastB
+            { { 0, 1, 1, 0 }, { 0, 1, 3, 0, 3, 2 } },   // VShapeWestToEast
+            { { 1, 0, 0, 1 }, { 0, 1, 2, 2, 1, 3 } }    // VShapeSouthToNorth
+        }
+    };
+
+    return shapes;
+}
+//-------------------------------------------------------------------------------------------------
+TileStore::TileStore(const Size2d& dimension, const std::vector<Tile>& tiles)
+{
+    TINYSC_ASSERT(tiles.size() == dimension.x * dimension.y, "Tiles data's length is invalid.");
+
+    resize(dimension);
+    for (size_t i = 0; i < tiles.size(); ++i)
+        setTile((int)i, tiles[i]);
+}
+//-------------------------------------------------------------------------------------------------
+void TileStore::resize(const Size2d& dimension)
+{
+    mDimension = dimension;
+    mTilesCount = dimension.x * dimension.y;
+
+    // All pages share a page of flat tiles until they're modified.
+    std::shared_ptr<Page> flatPage = std::make_shared<Page>();
+    std::fill_n(flatPage->typeAndFlags, TILES_COUNT_PER_PAGE, (uint8_t)ETileType::Flat);
+    std::fill_n(flatPage->levels, TILES_COUNT_PER_PAGE, 0);
+    std::fill_n(flatPage->waterAltitudes, TILES_COUNT_PER_PAGE, 0);
+
+    mPages.assign((mTilesCount + TILES_COUNT_PER_PAGE - 1) / TILES_COUNT_PER_PAGE, flatPage);
+}
+//-------------------------------------------------------------------------------------------------
+void TileStore::setLevel(int index, int level)
+{
+    TINYSC_ASSERT(level >= MIN_LEVEL && level <= MAX_LEVEL, "Altitude level is out of range.");
+    _getWritablePage(index)->levels[index & PAGE_MASK] = (int8_t)level;
+}
+//-------------------------------------------------------------------------------------------------
+void TileStore::setWater(int index, bool hasWater, float waterAltitude)
+{
+    Page* page = _getWritablePage(index);
+    const int offset = index & PAGE_MASK;
+
+    if (hasWater)
+        page->typeAndFlags[offset] |= WATER_FLAG;
+    else
+        page->typeAndFlags[offset] &= ~WATER_FLAG;
+
+    const float fixedWaterAltitude = floorf(waterAltitude * WATER_ALTITUDE_SCALE + 0.5f);
+    page->waterAltitudes[offset] = (int16_t)Math::clamp<float>(fixedWaterAltitude, INT16_MIN, INT16_MAX);
+}
+//-------------------------------------------------------------------------------------------------
+Tile TileStore::getTile(int index) const
+{
+    return Tile(getType(index), getLevel(index), hasWater(index), getWaterAltitude(index));
+}
+//-------------------------------------------------------------------------------------------------
+void TileStore::setTile(int index, const Tile& tile)
+{
+    setType(index, tile.type);
+    setLevel(index, tile.level);
+    setWater(index, tile.hasWater, tile.waterAltitude);
+}
+//-------------------------------------------------------------------------------------------------
+TileStore::PackedTile TileStore::getPackedTile(int index) const
+{
+    const Page& page = _getPage(index);
+    const int offset = index & PAGE_MASK;
+
+    PackedTile tile;
+    tile.typeAndFlags = page.typeAndFlags[offset];
+    tile.level = page.levels[offset];
+    tile.waterAltitude = page.waterAltitudes[offset];
+    return tile;
+}
+//-------------------------------------------------------------------------------------------------
+void TileStore::setPackedTile(int index, const PackedTile& tile)
+{
+    Page* page = _getWritablePage(index);
+    const int offset = index & PAGE_MASK;
+
+    page->typeAndFlags[offset] = tile.typeAndFlags;
+    page->levels[offset] = tile.level;
+    page->waterAltitudes[offset] = tile.waterAltitude;
+}
+//-------------------------------------------------------------------------------------------------
+void TileStore::setPackedTiles(int index, const PackedTile* tiles, int count)
+{
+    TINYSC_ASSERT(index >= 0 && index + count <= (int)mTilesCount, "Tiles are out of the store.");
+
+    while (count > 0) {
+        // Tiles up to the end of the page.
+        Page* page = _getWritablePage(index);
+        const int offset = index & PAGE_MASK;
+        const int pageCount = Math::min<int>(count, TILES_COUNT_PER_PAGE - offset);
+
+        for (int i = 0; i < pageCount; ++i) {
+            page->typeAndFlags[offset + i] = tiles[i].typeAndFlags;
+            page->levels[offset + i] = tiles[i].level;
+            page->waterAltitudes[offset + i] = tiles[i].waterAltitude;
+        }
+
+        index += pageCount;
+        tiles += pageCount;
+        count -= pageCount;
+    }
+}
+//-------------------------------------------------------------------------------------------------
+void TileStore::copyRect(const TileStore& other, const Rectd& rect)
+{
+    TINYSC_ASSERT(other.mDimension.x == mDimension.x && other.mDimension.y == mDimension.y,
+        "Dimensions of tile stores are different.");
+
+    for (int y = rect.getTop(); y < rect.getBottom(); ++y) {
+        const int last = y * mDimension.x + rect.getRight();
+        for (int first = y * mDimension.x + rect.getLeft(); first < last; ) {
+            // Copy the tiles of the row in one page, unless the page is shared.
+            const int offset = first & PAGE_MASK;
+            const int count = Math::min(last - first, TILES_COUNT_PER_PAGE - offset);
+            const Page& otherPage = other._getPage(first);
+            if (&otherPage != &_getPage(first)) {
+                Page* page = _getWritablePage(first);
+                std::copy_n(otherPage.typeAndFlags + offset, count, page->typeAndFlags + offset);
+                std::copy_n(otherPage.levels + offset, count, page->levels + offset);
+                std::copy_n(otherPage.waterAltitudes + offset, count, page->waterAltitudes + offset);
+            }
+
+            first += count;
+        }
+    }
+}
+//-------------------------------------------------------------------------------------------------
+void TileStore::shareRect(const TileStore& other, const Rectd& rect)
+{
+    TINYSC_ASSERT(other.mDimension.x == mDimension.x && other.mDimension.y == mDimension.y,
+        "Dimensions of tile stores are different.");
+
+    if (rect.getWidth() <= 0 || rect.getHeight() <= 0)
+        return;
+
+    // Pages whose tiles are all in the rectangle are shared. The other store's tiles out of the
+    // rectangle may be stale, so the rows of the other pages are copied.
+    const int firstPage = (rect.getTop() * mDimension.x + rect.getLeft()) >> PAGE_SHIFT;
+    const int lastPage = ((rect.getBottom() - 1) * mDimension.x + rect.getRight() - 1) >> PAGE_SHIFT;
+    for (int i = firstPage; i <= lastPage; ++i) {
+        if (_isPageInRect(i, rect))
+            mPages[i] = other.mPages[i];
+    }
+
+    copyRect(other, rect);
+}
+//-------------------------------------------------------------------------------------------------
+bool TileStore::_isPageInRect(int pageIndex, const Rectd& rect) const
+{
+    const int first = pageIndex << PAGE_SHIFT;
+    const int last = Math::min<int>(first + TILES_COUNT_PER_PAGE, (int)mTilesCount) - 1;
+    const Point2d firstLocation(first % mDimension.x, first / mDimension.x);
+    const Point2d lastLocation(last % mDimension.x, last / mDimension.x);
+    if (firstLocation.y < rect.getTop() || lastLocation.y >= rect.getBottom())
+        return false;
+
+    // A page spanning rows holds the end of one row and the start of the next, so the rectangle
+    // must cover whole rows.
+    if (firstLocation.y != lastLocation.y)
+        return rect.getLeft() == 0 && rect.getRight() == mDimension.x;
+
+    return firstLocation.x >= rect.getLeft() && lastLocation.x < rect.getRight();
+}
+//-------------------------------------------------------------------------------------------------
+void TileStore::_copyPage(int pageIndex)
+{
+    mPages[pageIndex] = std::make_shared<Page>(*mPages[pageIndex]);
+}
+//-------------------------------------------------------------------------------------------------
+bool TileStore::isStorable(const Tile& tile)
+{
+    const float waterAltitude = tile.waterAltitude * WATER_ALTITUDE_SCALE;
+    return tile.level >= MIN_LEVEL && tile.level <= MAX_LEVEL &&
+        waterAltitude >= INT16_MIN && waterAltitude <= INT16_MAX;
+}
+//-------------------------------------------------------------------------------------------------
+bool TileStore::isValidPackedTile(const PackedTile& tile)
+{
+    return (tile.typeAndFlags & TYPE_MASK) <= VShapeSouthToNorth && (tile.typeAndFlags & ~(TYPE_MASK | WATER_FLAG)) == 0 &&
+        tile.level >= MIN_LEVEL && tile.level <= MAX_LEVEL;
+}
+
+}
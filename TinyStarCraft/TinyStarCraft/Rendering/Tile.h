@@ -0,0 +1,242 @@
+#pragma once
+
+#include <memory>
+
+#include "Utilities/Rect2.h"
+#include "Utilities/Size2.h"
+
+namespace TinyStarCraft
+{
+
+/** 15 Tile types */
+enum ETileType
+{
+    Flat,
+    SouthA,
+    WestA,
+    NorthA,
+    EastA,
+    SouthWest,
+    NorthWest,
+    NorthEast,
+    SouthEast,
+    SouthB,
+    WestB,
+    NorthB,
+    EastB,
+    VShapeWestToEast,
+    VShapeSouthToNorth
+};
+
+
+/**
+  	Properties of a tile.
+ */
+struct Tile
+{
+    /** Side length in world unit. */
+    static constexpr float SIZE = 45.255f;
+    /** Height per-level in world unit */
+    static constexpr float HEIGHT_PER_LEVEL = 18.475f;
+
+    ETileType type;
+    int level;
+    float waterAltitude;
+    bool hasWater;
+
+    /** Constructor */
+    Tile()
+        : type(ETileType::Flat), level(0), hasWater(false), waterAltitude(0.0f)
+    {}
+
+    /** Constrcutor */
+    Tile(ETileType type, int level, bool hasWater, float waterAltitude)
+        : type(type), level(level), hasWater(hasWater), waterAltitude(waterAltitude)
+    {}
+
+    /** Get altitude in world unit */
+    float getAltitude() const { return level * HEIGHT_PER_LEVEL; }
+
+    /**
+    	Determine if water is visible on this tile.
+    @remarks
+        Water is visible only if tile has water and water is higher than tile.
+     */
+    bool isWaterVisible() const { return hasWater && waterAltitude > getAltitude(); }
+};
+
+
+/**
+  	Shape of a tile type, which doesn't depend on the rendering API.
+@remarks
+    Vertex 0 ~ 3 lie on the tile's corners (-x, -z), (-x, +z), (+x, -z) and (+x, +z) in local
+    space, whose heights are 0 or 1 altitude level above the tile.
+ */
+struct TileShape
+{
+    int vertexLevels[4];    // Height of each vertex in altitude levels.
+    int indices[6];         // Vertices of the two triangle faces.
+
+    /** Shapes of the 15 tile types, indexed by ETileType. */
+    static const std::array<TileShape, 15>& SHAPES();
+};
+
+
+/**
+  	Packed storage of a grid of tiles.
+@remarks
+    A tile takes 4 bytes: tile type and water flag share 1 byte, altitude level takes 1 byte and
+    water altitude is stored as 16 bits fixed point. The fields are kept in separated arrays, so
+    an algorithm only touches the fields it needs, e.g. raycasting never loads water data.
+    Tiles are indexed in row-major order.
+    Tiles are stored in pages of consecutive tiles, which are shared by copies of a store and are
+    copied when one of the stores first modifies them, so copying a store doesn't copy its tiles.
+    Stores sharing pages must be used on the same thread.
+ */
+class TileStore
+{
+public:
+    /** Range of altitude levels. */
+    static const int MIN_LEVEL = INT8_MIN;
+    static const int MAX_LEVEL = INT8_MAX;
+
+    /** Water altitude is stored in 1 / WATER_ALTITUDE_SCALE world unit. */
+    static const int WATER_ALTITUDE_SCALE = 8;
+
+    /** Number of tiles in a page. */
+    static const int TILES_COUNT_PER_PAGE = 1024;
+
+    /** A tile packed into 4 bytes. */
+    struct PackedTile
+    {
+        uint8_t typeAndFlags;       // Tile type in low 4 bits, bit 4 is set if the tile has water.
+        int8_t level;
+        int16_t waterAltitude;
+    };
+
+public:
+    /** Constructor */
+    TileStore() : mDimension(0, 0), mTilesCount(0) {}
+
+    /** Constructor, store an array of tiles in row-major order. */
+    TileStore(const Size2d& dimension, const std::vector<Tile>& tiles);
+
+    /** Resize the store, all tiles are reset to default flat tile. */
+    void resize(const Size2d& dimension);
+
+    /** Get dimension of the grid. */
+    const Size2d& getDimension() const { return mDimension; }
+
+    /** Get the number of tiles. */
+    size_t size() const { return mTilesCount; }
+
+    ETileType getType(int index) const { return (ETileType)(_getPage(index).typeAndFlags[index & PAGE_MASK] & TYPE_MASK); }
+
+    void setType(int index, ETileType type)
+    {
+        uint8_t& typeAndFlags = _getWritablePage(index)->typeAndFlags[index & PAGE_MASK];
+        typeAndFlags = (uint8_t)((typeAndFlags & ~TYPE_MASK) | type);
+    }
+
+    int getLevel(int index) const { return _getPage(index).levels[index & PAGE_MASK]; }
+
+    /** Modify a tile's altitude level, which must be in [MIN_LEVEL, MAX_LEVEL]. */
+    void setLevel(int index, int level);
+
+    /** Get altitude in world unit */
+    float getAltitude(int index) const { return getLevel(index) * Tile::HEIGHT_PER_LEVEL; }
+
+    bool hasWater(int index) const { return (_getPage(index).typeAndFlags[index & PAGE_MASK] & WATER_FLAG) != 0; }
+
+    float getWaterAltitude(int index) const
+    {
+        return (float)_getPage(index).waterAltitudes[index & PAGE_MASK] / WATER_ALTITUDE_SCALE;
+    }
+
+    /** Modify a tile's water. Water altitude is rounded to the stored precision. */
+    void setWater(int index, bool hasWater, float waterAltitude);
+
+    /** Determine if water is visible on a tile. */
+    bool isWaterVisible(int index) const { return hasWater(index) && getWaterAltitude(index) > getAltitude(index); }
+
+    /** Unpack a tile. */
+    Tile getTile(int index) const;
+
+    /** Pack and store a tile. */
+    void setTile(int index, const Tile& tile);
+
+    /** Get a tile in packed form. */
+    PackedTile getPackedTile(int index) const;
+
+    /** Store a tile in packed form. */
+    void setPackedTile(int index, const PackedTile& tile);
+
+    /** Store a run of consecutive tiles in packed form, each page they cover is looked up once. */
+    void setPackedTiles(int index, const PackedTile* tiles, int count);
+
+    /** Copy tiles in a rectangle from another store of the same dimension. */
+    void copyRect(const TileStore& other, const Rectd& rect);
+
+    /**
+      	Take the tiles in a rectangle from another store of the same dimension, like copyRect.
+    @remarks
+        Pages whose tiles are all in the rectangle are shared with the other store instead of
+        copied. The tiles of the other pages are copied, so tiles outside the rectangle are never
+        changed.
+     */
+    void shareRect(const TileStore& other, const Rectd& rect);
+
+    /** Determine if a tile is held by a page shared with another store. */
+    bool isSharingTile(const TileStore& other, int index) const { return &_getPage(index) == &other._getPage(index); }
+
+    /** Check if a tile can be stored without clamping its level or water altitude. */
+    static bool isStorable(const Tile& tile);
+
+    /**
+      	Check if a packed tile read from outside, e.g. from a map file, is valid: its type is known,
+        no other flag than the water flag is set and its level is in [MIN_LEVEL, MAX_LEVEL].
+     */
+    static bool isValidPackedTile(const PackedTile& tile);
+
+private:
+    static const uint8_t TYPE_MASK = 0x0f;
+    static const uint8_t WATER_FLAG = 0x10;
+
+    static const int PAGE_SHIFT = 10;
+    static const int PAGE_MASK = TILES_COUNT_PER_PAGE - 1;
+    static_assert(TILES_COUNT_PER_PAGE == 1 << PAGE_SHIFT, "Number of tiles in a page must be a power of 2.");
+
+    /** Tiles of a page. The last page of a store may be partially used. */
+    struct Page
+    {
+        uint8_t typeAndFlags[TILES_COUNT_PER_PAGE];
+        int8_t levels[TILES_COUNT_PER_PAGE];
+        int16_t waterAltitudes[TILES_COUNT_PER_PAGE];
+    };
+
+    /** Get the page of a tile. */
+    const Page& _getPage(int index) const { return *mPages[index >> PAGE_SHIFT]; }
+
+    /** Get the page of a tile to modify it, the page is copied first if it's shared. */
+    Page* _getWritablePage(int index)
+    {
+        std::shared_ptr<Page>& page = mPages[index >> PAGE_SHIFT];
+        if (page.use_count() != 1)
+            _copyPage(index >> PAGE_SHIFT);
+
+        return page.get();
+    }
+
+    /** Replace a shared page by a copy of its own. */
+    void _copyPage(int pageIndex);
+
+    /** Determine if all the tiles of a page are in a rectangle. */
+    bool _isPageInRect(int pageIndex, const Rectd& rect) const;
+
+private:
+    Size2d mDimension;
+    size_t mTilesCount;
+    std::vector<std::shared_ptr<Page>> mPages;
+};
+
+}
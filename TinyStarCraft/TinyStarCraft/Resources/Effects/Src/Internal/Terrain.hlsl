@@ -1,5 +1,16 @@
 #include "Common.hlsli"
 
+// Must be the same as the constants in Tile and Terrain.
+static const float TILE_SIZE = 45.255f;
+static const float HEIGHT_PER_LEVEL = 18.475f;
+static const float BLEND_TEXTURE_DIMENSION = 4.0f;
+
+float2 _InvTerrainDimension;
+
+// Shapes of the 15 tile types for the instanced technique, see TileShape and TerrainTileInstances.
+float4 _TileVertexLevels[15];
+float _TileDiagonals[15];
+
 texture _BlendTexture0;
 texture _BlendTexture1;
 texture _BlendTexture2;
@@ -57,10 +68,10 @@ sampler ControlTextureSamp = sampler_state
 
 struct AppData
 {
-    float4 pos : POSITION;
-    float3 normal : NORMAL;
-    float2 blendTexcoord : TEXCOORD0;
-    float2 controlTexcoord : TEXCOORD1;
+    // Row and column of the tiles grid's corner and altitude level, as (row, level, column, 1).
+    float4 corner : POSITION;
+    // Normal packed into RGB.
+    float4 normal : NORMAL;
 };
 
 struct VertOut
@@ -72,17 +83,58 @@ struct VertOut
     float fWorldHeight : TEXCOORD3;
 };
 
-VertOut VSMain(AppData i)
+struct InstancedAppData
+{
+    // Masks of the quad vertex's corner of the tile for each diagonal of the tile's faces.
+    float4 cornerMask0 : TEXCOORD0;
+    float4 cornerMask1 : TEXCOORD1;
+    // Row and column of the tile, its altitude level and type, as (row, level, column, type).
+    float4 tile : POSITION;
+    // Normals of the tile's vertices packed into RGB.
+    float4 normal0 : NORMAL0;
+    float4 normal1 : NORMAL1;
+    float4 normal2 : NORMAL2;
+    float4 normal3 : NORMAL3;
+};
+
+VertOut MakeVertOut(float4 vCorner, float3 vPackedNormal)
 {
     VertOut o;
-    o.pos = WORLD_TO_CLIP(i.pos);
-    o.normal = i.normal;
-    o.blendTexcoord = i.blendTexcoord;
-    o.controlTexcoord = i.controlTexcoord;
-	o.fWorldHeight = i.pos.y;
+
+    // Tiles are centered on their locations, so corners are half a tile off.
+    float4 vPos = float4((vCorner.x - 0.5f) * TILE_SIZE, vCorner.y * HEIGHT_PER_LEVEL, (vCorner.z - 0.5f) * TILE_SIZE, 1.0f);
+    float2 vCornerUV = vCorner.zx;
+
+    o.pos = WORLD_TO_CLIP(vPos);
+    o.normal = normalize(vPackedNormal * 2.0f - 1.0f);
+    o.blendTexcoord = vCornerUV / BLEND_TEXTURE_DIMENSION;
+    o.controlTexcoord = vCornerUV * _InvTerrainDimension;
+	o.fWorldHeight = vPos.y;
     return o;
 }
 
+VertOut VSMain(AppData i)
+{
+    return MakeVertOut(i.corner, i.normal.rgb);
+}
+
+VertOut VSInstancedMain(InstancedAppData i)
+{
+    float fType = i.tile.w;
+    float4 vMask = lerp(i.cornerMask0, i.cornerMask1, _TileDiagonals[fType]);
+
+    // Vertex 0 ~ 3 lie on the corners (row, column), (row, column + 1), (row + 1, column) and
+    // (row + 1, column + 1) of the tiles grid.
+    float4 vCorner;
+    vCorner.x = i.tile.x + vMask.z + vMask.w;
+    vCorner.y = i.tile.y + dot(vMask, _TileVertexLevels[fType]);
+    vCorner.z = i.tile.z + vMask.y + vMask.w;
+    vCorner.w = 1.0f;
+
+    float3 vPackedNormal = i.normal0.rgb * vMask.x + i.normal1.rgb * vMask.y + i.normal2.rgb * vMask.z + i.normal3.rgb * vMask.w;
+    return MakeVertOut(vCorner, vPackedNormal);
+}
+
 GbufferOutput PSMain(VertOut i)
 {
 	GbufferOutput o;
@@ -110,4 +162,16 @@ technique Default
         vertexshader = compile vs_2_0 VSMain();
         pixelshader = compile ps_2_0 PSMain();
     }
+};
+
+// Draws the shared tile quad for each tile from the instance records, see Terrain::setRenderingMode.
+// Instancing requires shader model 3.
+technique Instanced
+{
+    pass p0
+    {
+        ZFunc = GreaterEqual;
+        vertexshader = compile vs_3_0 VSInstancedMain();
+        pixelshader = compile ps_3_0 PSMain();
+    }
 };
\ No newline at end of file
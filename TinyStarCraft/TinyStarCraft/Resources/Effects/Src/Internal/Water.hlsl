@@ -1,10 +1,7 @@
 #include "Common.hlsli"
 
-static const int WATER_TILES_BATCH_SIZE = 64;
 static const float WATER_TILE_TEXCOORD_SIZE = 0.2f;
 
-float3 _InstancePositions[WATER_TILES_BATCH_SIZE];
-float2 _InstanceTexcoords[WATER_TILES_BATCH_SIZE];
 float4 _DeepWaterColor = { 0.12f, 0.1f, 0.11f, 1.0f };
 float4 _ShallowWaterColor = { 0.3f, 0.3f, 0.2f, 1.0f };
 texture _NormalMap0;
@@ -44,7 +41,9 @@ struct AppData
 {
     float4 pos : POSITION;
     float2 texcoord : TEXCOORD0;
-    float index : TEXCOORD1;
+    // Per-instance data from the second vertex stream.
+    float3 instancePosition : TEXCOORD1;
+    float2 instanceTexcoord : TEXCOORD2;
 };
 
 struct VertOut
@@ -60,12 +59,12 @@ VertOut VSMain(AppData i)
 {
     VertOut o;
 
-    float3 vInstancePosition = _InstancePositions[i.index];
+    float3 vInstancePosition = i.instancePosition;
     i.pos += float4(vInstancePosition, 0.0f);
 
     o.pos = float4(mul(i.pos, _gViewProjMatrix), 1.0f);
 	o.vView = _gViewPoint.xyz - i.pos.xyz;
-    o.geometryTexcoord = _InstanceTexcoords[i.index].xy + i.texcoord * WATER_TILE_TEXCOORD_SIZE;
+    o.geometryTexcoord = i.instanceTexcoord + i.texcoord * WATER_TILE_TEXCOORD_SIZE;
     o.viewportTexcoord = CLIP_TO_VIEWPORT_TEXCOORD(o.pos);
     o.altitude = vInstancePosition.y;
 
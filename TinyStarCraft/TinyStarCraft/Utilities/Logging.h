@@ -19,13 +19,13 @@ void _LogLine(ELogMessageType msgType, const char* function, const char* format,
 
 
 /** Logout an information. */
-#define TINYSC_LOGLINE_INFO(format, ...) _LogLine(ELogMessageType::eInfo, __FUNCTION__, format, __VA_ARGS__);
+#define TINYSC_LOGLINE_INFO(format, ...) _LogLine(ELogMessageType::eInfo, __FUNCTION__, format, ##__VA_ARGS__);
 
 /** Logout an warning message. */
-#define TINYSC_LOGLINE_WARN(format, ...) _LogLine(ELogMessageType::eWarning, __FUNCTION__, format, __VA_ARGS__);
+#define TINYSC_LOGLINE_WARN(format, ...) _LogLine(ELogMessageType::eWarning, __FUNCTION__, format, ##__VA_ARGS__);
 
 /** Logout an error message. */
-#define TINYSC_LOGLINE_ERR(format, ...) _LogLine(ELogMessageType::eError, __FUNCTION__, format, __VA_ARGS__);
+#define TINYSC_LOGLINE_ERR(format, ...) _LogLine(ELogMessageType::eError, __FUNCTION__, format, ##__VA_ARGS__);
 
 /** Logout a D3D API call infomation */
 #define TINYSC_LOGLINE_D3D_INFO(func, hr) _LogLine(ELogMessageType::eInfo, __FUNCTION__, func ## " 0x%08x %s.", hr, ::DXGetErrorDescription(hr))
@@ -62,6 +62,16 @@ public:
         return val * 180.0f / PI();
     }
 
+    /**
+      	Interleave the bits of two 16-bit coordinates, bits of x go to the even bits and bits of y 
+        go to the odd bits. Points sorted by their codes are in Z-order, so points close in the 
+        order are close in space as well.
+     */
+    static uint32_t mortonCode(uint32_t x, uint32_t y)
+    {
+        return _spreadBits(x) | (_spreadBits(y) << 1);
+    }
+
     /**
       	Linear interpolation
      */
@@ -69,6 +79,18 @@ public:
     {
         return from + (to - from) * t;
     }
+
+private:
+    /** Insert a zero bit before each of the lower 16 bits. */
+    static uint32_t _spreadBits(uint32_t v)
+    {
+        v &= 0x0000ffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
 };
 
 };
\ No newline at end of file
@@ -55,7 +55,7 @@ public:
      */
     void setPosition(const Point2<T>& val)
     {
-        WGVector2<T> offset = val - mMin;
+        Vector2<T> offset = val - mMin;
         mMin = val;
         mMax = mMax + offset;
     }
@@ -155,6 +155,30 @@ public:
             Math::max<T>(T(0), Math::min<T>(r1.mMax.y, r2.mMax.y) - Math::max<T>(r1.mMin.y, r2.mMin.y));
     }
 
+    /**
+     *	Compute the intersection of two rectangles.
+     *  @remarks
+     *  If the rectangles are not overlapped, the result has zero or negative size.
+     */
+    static Rect<T> intersection(const Rect<T>& r1, const Rect<T>& r2)
+    {
+        return Rect<T>(
+            Point2<T>(Math::max<T>(r1.mMin.x, r2.mMin.x), Math::max<T>(r1.mMin.y, r2.mMin.y)),
+            Point2<T>(Math::min<T>(r1.mMax.x, r2.mMax.x), Math::min<T>(r1.mMax.y, r2.mMax.y))
+            );
+    }
+
+    /**
+     *	Combine two rectangles together to make a compound rectangle which contains both of them.
+     */
+    static Rect<T> compound(const Rect<T>& r1, const Rect<T>& r2)
+    {
+        return Rect<T>(
+            Point2<T>(Math::min<T>(r1.mMin.x, r2.mMin.x), Math::min<T>(r1.mMin.y, r2.mMin.y)),
+            Point2<T>(Math::max<T>(r1.mMax.x, r2.mMax.x), Math::max<T>(r1.mMax.y, r2.mMax.y))
+            );
+    }
+
 private:
     Point2<T> mMin;
     Point2<T> mMax;
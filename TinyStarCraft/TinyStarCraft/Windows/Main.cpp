@@ -212,21 +212,39 @@ public:
 
             TerrainRaycastHit hit;
             if (mScene->getTerrain()->raycast(ray, &hit)) {
+                mTerrainModifier->beginEdit();
+
                 if (uMsg == WM_LBUTTONUP) {
                     if (wParam & MK_CONTROL)
                         mTerrainModifier->hightenTile(hit.tileLocation);
+                    else if (wParam & MK_SHIFT)
+                        mTerrainModifier->hightenArea(TerrainBrush::makeCircle(hit.tileLocation, BRUSH_RADIUS));
                     else
                         mTerrainModifier->hightenGround(hit.tileLocation);
                 }
                 else {
                     if (wParam & MK_CONTROL)
                         mTerrainModifier->lowerTile(hit.tileLocation);
+                    else if (wParam & MK_SHIFT)
+                        mTerrainModifier->lowerArea(TerrainBrush::makeCircle(hit.tileLocation, BRUSH_RADIUS));
                     else
                         mTerrainModifier->lowerGround(hit.tileLocation);
                 }
 
-                mTerrainModifier->updateTerrain();
+                mTerrainModifier->commitEdit();
             }
+            break;
+        }
+        case WM_KEYDOWN:
+        {
+            // Ctrl + Z undoes the latest terrain edit, and Ctrl + Y redoes it.
+            if (::GetKeyState(VK_CONTROL) < 0) {
+                if (wParam == 'Z')
+                    mTerrainModifier->undo();
+                else if (wParam == 'Y')
+                    mTerrainModifier->redo();
+            }
+            break;
         }
         default:
             break;
@@ -260,6 +278,9 @@ private:
     }
 
 private:
+    // Radius of the circle brush used with the shift key.
+    static const int BRUSH_RADIUS = 3;
+
     GameWindow mGameWindow;
     RenderSystem *mRenderSystem;
     EffectManager* mEffectManager;